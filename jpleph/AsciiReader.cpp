@@ -0,0 +1,562 @@
+//
+// parallel reader of the ASCII ephemeris data files (see AsciiReader.h)
+//
+#include <algorithm>
+#include <cfloat>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "AsciiReader.h"
+#include "../libjpleph/MappedFile.h"
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+    static size_t const MAX_TOKEN = 64; // longest number accepted
+
+    bool isSpace(char const c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    // an integer of the block header line. 'p' is moved behind it
+    bool parseInt(char const * & p, char const * const end, int & value)
+    {
+        while (p < end && isSpace(*p))
+        {
+            ++p;
+        }
+        from_chars_result const result = from_chars(p, end, value);
+        if (result.ec != errc() || (result.ptr < end && !isSpace(*result.ptr)))
+        {
+            return false;
+        }
+        p = result.ptr;
+        return true;
+    }
+
+    // a number in Fortran notation (D exponent, optional plus sign). The token is copied to the stack for the
+    // exponent letter
+    bool parseValue(char const * begin, char const * const end, long double & value)
+    {
+        if (begin < end && *begin == '+')
+        {
+            ++begin;
+        }
+        size_t const length = size_t(end - begin);
+        if (length == 0 || length >= MAX_TOKEN)
+        {
+            return false;
+        }
+        char token[MAX_TOKEN];
+        for (size_t i = 0; i < length; ++i)
+        {
+            token[i] = begin[i] == 'D' || begin[i] == 'd' ? 'e' : begin[i];
+        }
+        from_chars_result const result = from_chars(token, token + length, value);
+        return result.ec == errc() && result.ptr == token + length;
+    }
+
+    static unsigned char const GZIP_MAGIC[] = { 0x1f, 0x8b };
+    static unsigned char const XZ_MAGIC[]   = { 0xfd, '7', 'z', 'X', 'Z', 0x00 };
+
+    // the command writing the decompressed file to its standard output, nullptr for a file that is not compressed.
+    // Told by the first bytes of the file, not by its name. The programs are looked up on the PATH by the shell
+    char const * decompressor(string const & fileName)
+    {
+        unsigned char magic[sizeof(XZ_MAGIC)] = {};
+        ifstream file(fileName, ifstream::binary);
+        file.read(reinterpret_cast<char *>(magic), sizeof(magic));
+        if (memcmp(magic, GZIP_MAGIC, sizeof(GZIP_MAGIC)) == 0)
+        {
+            return "gzip -dc";
+        }
+        if (memcmp(magic, XZ_MAGIC, sizeof(XZ_MAGIC)) == 0)
+        {
+            return "xz -dc";
+        }
+        return nullptr;
+    }
+
+    // the output of a decompressor. It runs as a process of its own, in parallel to the splitter
+    class Pipe
+    {
+    public:
+        Pipe(char const * const command, string const & fileName)
+            : command(command), fileName(fileName)
+        {
+#ifdef _WIN32
+            stream = _popen((string(command) + " \"" + fileName + "\"").c_str(), "rb");
+#else
+            string quoted;
+            for (char const c : fileName)
+            {
+                quoted += c == '\'' ? string("'\\''") : string(1, c);
+            }
+            stream = popen((string(command) + " '" + quoted + "'").c_str(), "r");
+#endif
+            if (stream == nullptr)
+            {
+                throw runtime_error("AsciiReader: could not start '" + string(command) + "' for " + fileName);
+            }
+        }
+
+        ~Pipe()
+        {
+            if (stream != nullptr)
+            {
+                wait(); // the decompressor ends on the closed pipe
+            }
+        }
+
+        Pipe(Pipe const &) = delete;
+        Pipe & operator=(Pipe const &) = delete;
+
+        // waits for the end of the decompressor. Throws if it failed. 'delivered' is the number of bytes read from the pipe.
+        // The shell is started even if the decompressor is not installed, it fails without output then
+        void close(size_t const delivered)
+        {
+            int const status = wait();
+            if (status != 0 && delivered == 0 && notFound(status))
+            {
+                string const program = command.substr(0, command.find(' '));
+                throw runtime_error("AsciiReader: could not decompress " + fileName + ", " + program + " not found. It has to be on the PATH");
+            }
+            if (status != 0)
+            {
+                throw runtime_error("AsciiReader: could not decompress " + fileName);
+            }
+        }
+
+        FILE * stream;
+
+    private:
+        int wait()
+        {
+            FILE * const closing = stream;
+            stream = nullptr;
+#ifdef _WIN32
+            return _pclose(closing);
+#else
+            return pclose(closing);
+#endif
+        }
+
+        // the exit status of the shell for a command it could not find
+        static bool notFound(int const status)
+        {
+#ifdef _WIN32
+            return status == 1; // cmd.exe: "... is not recognized as an internal or external command"
+#else
+            return WIFEXITED(status) && WEXITSTATUS(status) == 127;
+#endif
+        }
+
+        string const command;
+        string const fileName;
+    };
+}
+
+
+char const AsciiReader::STANDARD_INPUT[] = "-";
+
+
+AsciiReader::AsciiReader(vector<string> const & fileNames, unsigned const threads)
+    : AsciiReader(fileNames, threads, Selection())
+{
+}
+
+
+AsciiReader::AsciiReader(vector<string> const & fileNames, unsigned const threads, Selection const & selection)
+    : fileNames(fileNames), selection(selection), window(WINDOW_PER_THREAD * max(threads != 0 ? threads : thread::hardware_concurrency(), 1u)), slots(window),
+      numSplit(0), numTaken(0), numDone(0), splitDone(false), stop(false), bytes(0), skipped(0), start(chrono::steady_clock::now())
+{
+    unsigned const numWorkers = max(threads != 0 ? threads : thread::hardware_concurrency(), 1u);
+    splitter = thread(&AsciiReader::split, this);
+    for (unsigned i = 0; i < numWorkers; ++i)
+    {
+        workers.push_back(thread(&AsciiReader::work, this));
+    }
+}
+
+
+AsciiReader::~AsciiReader()
+{
+    {
+        lock_guard<std::mutex> lock(queueMutex);
+        stop = true;
+    }
+    splitCondition.notify_all();
+    workCondition.notify_all();
+    splitter.join();
+    for (thread & worker : workers)
+    {
+        worker.join();
+    }
+}
+
+
+bool AsciiReader::next(Block & block)
+{
+    unique_lock<std::mutex> lock(queueMutex);
+    Slot & slot = slots[numDone % window];
+    readyCondition.wait(lock, [this, &slot] { return error != nullptr || (numDone < numSplit && slot.parsed) || (splitDone && numDone == numSplit); });
+    if (error != nullptr)
+    {
+        rethrow_exception(error);
+    }
+    if (numDone == numSplit)
+    {
+        return false;
+    }
+
+    block.fileName = slot.span.fileName;
+    block.number   = slot.span.number;
+    block.values.swap(slot.values); // the buffer of the caller is reused for a later block
+    slot.parsed = false;
+    ++numDone;
+    lock.unlock();
+    splitCondition.notify_one();
+    return true;
+}
+
+
+AsciiReader::Statistics AsciiReader::statistics() const
+{
+    lock_guard<std::mutex> lock(queueMutex);
+    Statistics result;
+    result.bytes   = bytes;
+    result.blocks  = numDone;
+    result.skipped = skipped;
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+
+// the block header lines are the only lines without a decimal point. The lines of a block are not looked at
+// beyond that, the padding of the last line is skipped by parse()
+void AsciiReader::split()
+{
+    try
+    {
+        for (string const & fileName : fileNames)
+        {
+            bool more;
+            if (fileName == STANDARD_INPUT)
+            {
+                more = splitStream(fileName, stdin);
+            }
+            else if (char const * const command = decompressor(fileName))
+            {
+                Pipe pipe(command, fileName);
+                size_t const before = bytes; // only the splitter changes it
+                more = splitStream(fileName, pipe.stream);
+                if (more)
+                {
+                    pipe.close(bytes - before); // throws if the decompressor failed, the blocks read may be incomplete
+                }
+            }
+            else
+            {
+                more = splitMapped(fileName);
+            }
+            if (!more)
+            {
+                return;
+            }
+        }
+    }
+    catch (...)
+    {
+        fail(current_exception());
+        return;
+    }
+
+    {
+        lock_guard<std::mutex> lock(queueMutex);
+        splitDone = true;
+    }
+    readyCondition.notify_all();
+    workCondition.notify_all();
+}
+
+
+// a plain file, the blocks are parsed in the mapping
+bool AsciiReader::splitMapped(string const & fileName)
+{
+    unique_ptr<MappedFile> file = make_unique<MappedFile>(fileName);
+    char const * const data = file->data();
+    char const * const end  = data + file->size();
+    {
+        lock_guard<std::mutex> lock(queueMutex);
+        files.push_back(std::move(file));
+        bytes += size_t(end - data);
+    }
+
+    Span current = { &fileName, nullptr, nullptr, 0, 0, nullptr };
+    for (char const * p = data; p < end; )
+    {
+        char const * eol = static_cast<char const *>(memchr(p, '\n', size_t(end - p)));
+        eol = eol != nullptr ? eol : end;
+        Span next = { &fileName, min(eol + 1, end), end, 0, 0, nullptr };
+        if (header(p, eol, next))
+        {
+            if (current.begin != nullptr)
+            {
+                current.end = p;
+                if (!push(current))
+                {
+                    return false;
+                }
+            }
+            current = next;
+        }
+        else if (current.begin == nullptr && !all_of(p, eol, isSpace))
+        {
+            throw runtime_error("AsciiReader: coefficients before the first block header in " + fileName);
+        }
+        p = eol + 1;
+    }
+    return current.begin == nullptr || push(current);
+}
+
+
+// standard input or the output of a decompressor. The stream is read in chunks while the workers parse the blocks
+// before, the lines of a block are copied to a buffer owned by its span
+bool AsciiReader::splitStream(string const & fileName, FILE * const stream)
+{
+    vector<char> chunk(CHUNK_SIZE);
+    size_t filled = 0; // bytes in the chunk, the first is the start of a line
+    Span current = { &fileName, nullptr, nullptr, 0, 0, nullptr };
+    shared_ptr<vector<char>> text;
+
+    auto const finish = [&current, &text, this]()
+    {
+        current.begin = text->data();
+        current.end   = text->data() + text->size();
+        current.text  = text;
+        return push(current);
+    };
+
+    for (bool last = false; !last; )
+    {
+        size_t const read = fread(chunk.data() + filled, 1, chunk.size() - filled, stream);
+        last    = read == 0;
+        filled += read;
+        {
+            lock_guard<std::mutex> lock(queueMutex);
+            bytes += read;
+        }
+
+        char const * p = chunk.data();
+        char const * const end = p + filled;
+        while (p < end)
+        {
+            char const * eol = static_cast<char const *>(memchr(p, '\n', size_t(end - p)));
+            if (eol == nullptr && !last)
+            {
+                break; // the rest of the line comes with the next chunk
+            }
+            eol = eol != nullptr ? eol : end;
+
+            Span next = { &fileName, nullptr, nullptr, 0, 0, nullptr };
+            if (header(p, eol, next))
+            {
+                if (text != nullptr && !finish())
+                {
+                    return false;
+                }
+                current = next;
+                text = make_shared<vector<char>>();
+            }
+            else if (text != nullptr)
+            {
+                text->insert(text->end(), p, eol);
+                text->push_back('\n');
+            }
+            else if (!all_of(p, eol, isSpace))
+            {
+                throw runtime_error("AsciiReader: coefficients before the first block header in " + fileName);
+            }
+            p = min(eol + 1, end);
+        }
+
+        // keep the incomplete line, a line longer than the chunk makes it grow
+        filled = size_t(end - p);
+        memmove(chunk.data(), p, filled);
+        chunk.resize(max(chunk.size(), 2 * filled));
+    }
+    if (ferror(stream))
+    {
+        throw runtime_error("AsciiReader: could not read " + fileName);
+    }
+    return text == nullptr || finish();
+}
+
+
+// true for a block header line, 'span' gets its numbers. Throws for a malformed one
+bool AsciiReader::header(char const * p, char const * const eol, Span & span)
+{
+    if (all_of(p, eol, isSpace) || memchr(p, '.', size_t(eol - p)) != nullptr)
+    {
+        return false;
+    }
+    if (!parseInt(p, eol, span.number) || !parseInt(p, eol, span.numberCoeff) || span.numberCoeff < 2 || !all_of(p, eol, isSpace))
+    {
+        throw runtime_error("AsciiReader: malformed block header in " + *span.fileName);
+    }
+    return true;
+}
+
+
+// waits for a free slot. False if the reader is stopped or failed. Blocks outside the window are dropped
+bool AsciiReader::push(Span const & span)
+{
+    if (!selected(span))
+    {
+        lock_guard<std::mutex> lock(queueMutex);
+        ++skipped;
+        return !stop && error == nullptr;
+    }
+
+    {
+        unique_lock<std::mutex> lock(queueMutex);
+        splitCondition.wait(lock, [this] { return stop || error != nullptr || numSplit - numDone < window; });
+        if (stop || error != nullptr)
+        {
+            return false;
+        }
+        slots[numSplit % window].span = span;
+        ++numSplit;
+    }
+    workCondition.notify_one();
+    return true;
+}
+
+
+// the dates of the block, the first two values, against the window
+bool AsciiReader::selected(Span const & span) const
+{
+    if (selection.dateStart == -LDBL_MAX && selection.dateEnd == LDBL_MAX)
+    {
+        return true;
+    }
+
+    long double dates[2];
+    char const * p = span.begin;
+    for (long double & date : dates)
+    {
+        while (p < span.end && isSpace(*p))
+        {
+            ++p;
+        }
+        char const * const token = p;
+        while (p < span.end && !isSpace(*p))
+        {
+            ++p;
+        }
+        if (!parseValue(token, p, date))
+        {
+            throw runtime_error("AsciiReader: invalid dates of block " + to_string(span.number) + " of " + *span.fileName);
+        }
+    }
+    return dates[1] > selection.dateStart && dates[0] < selection.dateEnd;
+}
+
+
+void AsciiReader::work()
+{
+    vector<long double> values;
+    for (;;)
+    {
+        Span span;
+        size_t number;
+        {
+            unique_lock<std::mutex> lock(queueMutex);
+            workCondition.wait(lock, [this] { return stop || error != nullptr || numTaken < numSplit || splitDone; });
+            if (stop || error != nullptr || numTaken == numSplit)
+            {
+                return;
+            }
+            number = numTaken++;
+            span   = slots[number % window].span;
+            values.swap(slots[number % window].values); // reuse the buffer of the slot
+        }
+
+        try
+        {
+            parse(span, values);
+        }
+        catch (...)
+        {
+            fail(current_exception());
+            return;
+        }
+
+        {
+            lock_guard<std::mutex> lock(queueMutex);
+            Slot & slot = slots[number % window];
+            slot.values.swap(values);
+            slot.parsed = true;
+        }
+        readyCondition.notify_all();
+    }
+}
+
+
+// the selected coefficients of a block. Tokens behind them are the padding of the last line
+void AsciiReader::parse(Span const & span, vector<long double> & values) const
+{
+    values.clear();
+    char const * p = span.begin;
+    for (size_t k = 0; k < size_t(span.numberCoeff); ++k)
+    {
+        while (p < span.end && isSpace(*p))
+        {
+            ++p;
+        }
+        char const * const token = p;
+        while (p < span.end && !isSpace(*p))
+        {
+            ++p;
+        }
+        if (token == p)
+        {
+            throw runtime_error("AsciiReader: too few coefficients in block " + to_string(span.number) + " of " + *span.fileName);
+        }
+        if (!selection.values.empty() && k >= 2 && (k >= selection.values.size() || !selection.values[k]))
+        {
+            continue;
+        }
+        long double value;
+        if (!parseValue(token, p, value))
+        {
+            throw runtime_error("AsciiReader: invalid coefficient '" + string(token, p) + "' in block " + to_string(span.number)
+                                + " of " + *span.fileName);
+        }
+        values.push_back(value);
+    }
+}
+
+
+void AsciiReader::fail(exception_ptr const & failure)
+{
+    {
+        lock_guard<std::mutex> lock(queueMutex);
+        if (error == nullptr)
+        {
+            error = failure;
+        }
+    }
+    readyCondition.notify_all();
+    workCondition.notify_all();
+    splitCondition.notify_all();
+}
@@ -0,0 +1,146 @@
+//
+// parallel reader of the ASCII ephemeris data files (ascSYYYY.XXX, the GROUP 1070 data)
+//
+// A data file is a sequence of blocks. A block starts with a line of two integers, the block number and the number
+// of coefficients, followed by the coefficients, three per line in Fortran D notation. The last line of a block is
+// padded with zeros if the number of coefficients is not a multiple of three.
+//
+// The files are mapped into memory. A splitter thread cuts them into blocks at the block header lines (the only lines
+// without a decimal point), a pool of workers parses the blocks and next() hands them out in file order. At most
+// WINDOW_PER_THREAD blocks per worker are in flight, so the memory used does not grow with the size of the files.
+// The coefficients are parsed in place, without temporary strings.
+//
+// "-" reads standard input. Files compressed by gzip or xz (told by their first bytes) are read from a decompressor
+// process, started through the shell (popen, cmd.exe on Windows): gzip and xz have to be installed and on the PATH.
+// Such streams are read in chunks, the splitter copies the lines of a block into a buffer of its own.
+// Decompressing, splitting, parsing and the caller of next() run at the same time.
+//
+// A Selection restricts the reading to a time window and to some of the values of a block. Blocks outside the window
+// are dropped by the splitter after reading their dates, their coefficients are never parsed. The values not selected
+// are skipped by the workers, Block::values holds the selected ones in the order of the block.
+//
+//   AsciiReader reader({ "ascp01950.440", "ascp02050.440" });
+//   AsciiReader::Block block;
+//   while (reader.next(block))
+//   {
+//       ... block.values[0], block.values[1] are the start and end date of the block
+//   }
+//
+#pragma once
+#ifndef ASCIIREADER_H
+#define ASCIIREADER_H
+
+#include <cfloat>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class MappedFile;
+
+
+class AsciiReader
+{
+public:
+    static std::size_t const WINDOW_PER_THREAD = 4;           // blocks in flight per worker
+    static std::size_t const CHUNK_SIZE        = 1 << 20;     // bytes read at once from a stream
+    static char const        STANDARD_INPUT[];                // "-", the file name of standard input
+
+    struct Block
+    {
+        std::string const *      fileName;
+        int                      number;   // the block number given in the file
+        std::vector<long double> values;   // start date, end date, coefficients
+    };
+
+    // the blocks overlapping [dateStart, dateEnd] (julian ephemeris days) and the values flagged in 'values' (index
+    // into a block). Empty 'values': all of them. The dates of a block are always taken
+    struct Selection
+    {
+        long double       dateStart = -LDBL_MAX;
+        long double       dateEnd   =  LDBL_MAX;
+        std::vector<bool> values;
+    };
+
+    struct Statistics
+    {
+        std::size_t bytes;   // of the files read so far
+        std::size_t blocks;  // handed out by next()
+        std::size_t skipped; // outside the window of the selection
+        double      seconds; // since the reader was constructed
+    };
+
+    // starts reading. 0 threads: one worker per hardware thread
+    explicit AsciiReader(std::vector<std::string> const & fileNames, unsigned const threads = 0);
+    AsciiReader(std::vector<std::string> const & fileNames, unsigned const threads, Selection const & selection);
+    ~AsciiReader();
+
+    AsciiReader(AsciiReader const &) = delete;
+    AsciiReader & operator=(AsciiReader const &) = delete;
+
+    // the next block in the order of the files. The buffer of 'block' is reused. False after the last block.
+    // Throws runtime_error for a file that can't be read or a malformed block
+    bool next(Block & block);
+
+    Statistics statistics() const;
+
+private:
+    // a block of a file not parsed yet
+    struct Span
+    {
+        std::string const * fileName;
+        char const *        begin;  // behind the block header line
+        char const *        end;    // start of the next block header line or the end of the file
+        int                 number;
+        int                 numberCoeff;
+        std::shared_ptr<std::vector<char> const> text; // owns the lines of a block read from a stream
+    };
+
+    struct Slot
+    {
+        Span                     span;
+        std::vector<long double> values;
+        bool                     parsed = false;
+    };
+
+    void split();              // splitter thread
+    bool splitMapped(std::string const & fileName);
+    bool splitStream(std::string const & fileName, std::FILE * const stream);
+    static bool header(char const * p, char const * const eol, Span & span);
+    bool push(Span const & span);
+    bool selected(Span const & span) const;
+    void work();               // worker threads
+    void parse(Span const & span, std::vector<long double> & values) const;
+    void fail(std::exception_ptr const & error);
+
+    std::vector<std::string> const           fileNames;
+    Selection const                          selection;
+    std::vector<std::unique_ptr<MappedFile>> files;   // mapped by the splitter, kept until the reader is destroyed
+    std::size_t const                        window;
+    std::vector<Slot>                        slots;   // block k in slot k % window
+
+    mutable std::mutex      queueMutex;
+    std::condition_variable splitCondition;   // a slot was freed
+    std::condition_variable workCondition;    // a block was split off
+    std::condition_variable readyCondition;   // a block was parsed
+    std::size_t             numSplit;         // blocks split off
+    std::size_t             numTaken;         // blocks taken by the workers
+    std::size_t             numDone;          // blocks handed out by next()
+    bool                    splitDone;
+    bool                    stop;
+    std::exception_ptr      error;
+    std::size_t             bytes;
+    std::size_t             skipped;
+    std::chrono::steady_clock::time_point const start;
+
+    std::thread              splitter;
+    std::vector<std::thread> workers;
+};
+
+#endif
@@ -132,11 +132,19 @@
 #include <fstream>
 #include <iomanip>
 #include <cfloat>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <cctype>
+#include <exception>
 
 //#include <cstdlib>
 
 #include "optionparser.h"
 #include "asc2eph.h"
+#include "AsciiReader.h"
+#include "../libjpleph/EphemerisFormat.h"
+#include "../libjpleph/RecordCodec.h"
 
 namespace {
 
@@ -179,15 +187,30 @@ struct Arg: public option::Arg
 };
 
 
-    enum OptionIndex { UNKNOWN, OUTPUT, HEADER, FILES };
+    enum OptionIndex { UNKNOWN, OUTPUT, HEADER, FILES, V2, COMPRESSED, THREADS, START, END, BODIES, APPEND };
     const option::Descriptor usage[] =
     {
         {UNKNOWN, 0, "", "" , Arg::None, "USAGE: asc2eph -o output -h header -f file1 file2 ...\n\n"},
         {OUTPUT,  0, "o", "output", Arg::Required, "-o, --output   \t output binary ephemeris file"},
         {HEADER,  0, "h", "header", Arg::Required, "-h, --header   \t Ephemeris header file"},
-        {FILES,   0, "f", "files",  Arg::Required, "-f, --files    \t ASCII ephemeris files"},
+        {FILES,   0, "f", "files",  Arg::Required, "-f, --files    \t ASCII ephemeris files, - for standard input. Files compressed by gzip or xz are decompressed while read (gzip and xz have to be on the PATH)"},
+        {V2,      0, "2", "v2",     Arg::None,     "-2, --v2       \t write the v2 format (aligned records with checksums, see EphemerisFormat.h)"},
+        {THREADS, 0, "j", "threads", Arg::Required, "-j, --threads  \t number of threads parsing the ASCII files, default: one per hardware thread"},
+        {START,   0, "s", "start",  Arg::Required, "-s, --start    \t start of the time span (julian ephemeris date), default: start of the ASCII files"},
+        {END,     0, "e", "end",    Arg::Required, "-e, --end      \t end of the time span (julian ephemeris date), default: end of the ASCII files"},
+        {BODIES,  0, "b", "bodies", Arg::Required, "-b, --bodies   \t comma separated entries to keep: mercury, venus, emb, mars, jupiter, saturn, uranus, neptune, pluto, moon, sun, "
+                                                   "nutations, librations, mantle, tt-tdb, earth (emb and moon), default: all"},
+        {APPEND,  0, "a", "append", Arg::None,     "-a, --append   \t append the blocks behind the end of the existing output file. The format of the file is kept, "
+                                                   "the header file (and the bodies) must give the same descriptors (GROUP 1050)"},
+        {COMPRESSED, 0, "z", "compressed", Arg::None, "-z, --compressed \t write the compressed v2 container (every record compressed on its own, see RecordCodec.h)"},
         {UNKNOWN, 0, "", "", Arg::None, "\nExamples:\n"
-                                        "asc2eph -o jpleph -h header.431_572 -f ascp00000.431 ascp01000.431 ascp02000.431\n"},
+                                        "asc2eph -o jpleph -h header.431_572 -f ascp00000.431 ascp01000.431 ascp02000.431\n"
+                                        "asc2eph -2 -o jpleph -h header.431_572 -f ascp00000.431\n"
+                                        "asc2eph -z -o jpleph -h header.431_572 -f ascp00000.431\n"
+                                        "asc2eph -j 4 -o jpleph -h header.431_572 -f ascp00000.431 ascp01000.431\n"
+                                        "xzcat ascp01000.431.xz | asc2eph -o jpleph -h header.431_572 -f ascp00000.431.gz -f -\n"
+                                        "asc2eph -a -o jpleph -h header.431_572 -f ascp03000.431\n"
+                                        "asc2eph -s 2415020.5 -e 2488069.5 -b sun,earth,jupiter,saturn,uranus,neptune -o jpleph -h header.431_572 -f ascp01900.431 ascp02000.431\n"},
         {0,0,0,0,0,0}
     };  
     
@@ -215,6 +238,10 @@ struct Arg: public option::Arg
     static std::vector<int> const dimensions = { 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 2, 3 ,3, 1 }; // these are fixed values depending on the type of values
                                                                                                // default is 3 except for Nutation (2) and TT-TDB (1) 
 
+    // the names of the entries for the bodies option, in the order of GROUP 1050
+    static char const * const ENTRY_NAMES[NUM_BODIES] = { "mercury", "venus", "emb", "mars", "jupiter", "saturn", "uranus", "neptune", "pluto",
+                                                          "moon", "sun", "nutations", "librations", "mantle", "tt-tdb" };
+
 
     bool gotoGroup(std::ifstream & headerStream, std::string const & groupName)
     {
@@ -259,26 +286,76 @@ struct Arg: public option::Arg
     }
 
 
-    // look for block header
-    bool readBlockHeader(std::ifstream & ephemeris, int & recordNumber,  int & numberCoeff)
+    // comma separated names of ENTRY_NAMES. "earth" takes the Earth-Moon barycenter and the Moon. False for an unknown name
+    bool parseBodies(std::string const & list, std::vector<bool> & selected)
     {
-            ephemeris >> recordNumber >> numberCoeff;
-            return ephemeris.good();
+        selected.assign(NUM_BODIES, false);
+        std::size_t begin = 0;
+        while (begin <= list.size())
+        {
+            std::size_t end = list.find(',', begin);
+            end = end == std::string::npos ? list.size() : end;
+            std::string name = list.substr(begin, end - begin);
+            std::transform(name.begin(), name.end(), name.begin(), [](char const c) { return char(std::tolower(c)); });
+            if (name == "earth")
+            {
+                selected[2] = selected[9] = true;
+            } else
+            {
+                char const * const * entry = std::find_if(std::begin(ENTRY_NAMES), std::end(ENTRY_NAMES), [&name](char const * n) { return name == n; });
+                if (entry == std::end(ENTRY_NAMES))
+                {
+                    std::cerr << "Unknown body " << name << std::endl;
+                    return false;
+                }
+                selected[std::size_t(entry - std::begin(ENTRY_NAMES))] = true;
+            }
+            begin = end + 1;
+        }
+        return true;
     }
 
-    bool readDataBlock(std::ifstream & ephemeris, std::vector<long double> & db, int const numberCoeff)
+    // only the selected entries are written. The values of a block to keep (see AsciiReader::Selection) and the
+    // descriptors of the shorter records: the selected entries keep their order in the record, the others get
+    // no coefficients
+    std::vector<bool> selectEntries(std::vector<bool> const & selected, std::vector<int> & index, std::vector<int> & order, std::vector<int> & entries)
     {
-        for(int i = 0; i < numberCoeff; ++i)
+        auto const present = [&](std::size_t const i) { return index[i] >= 3 && order[i] > 0 && entries[i] > 0; };
+        auto const size    = [&](std::size_t const i) { return std::size_t(order[i]) * std::size_t(entries[i]) * std::size_t(dimensions[i]); };
+
+        std::size_t numValues = 2;
+        for (std::size_t i = 0; i < index.size(); ++i)
         {
-            std::string valueString;
-            ephemeris >> valueString;
-            if(!ephemeris.good())
+            numValues = present(i) ? std::max(numValues, std::size_t(index[i] - 1) + size(i)) : numValues;
+        }
+        std::vector<bool> values(numValues, false);
+        values[INDEX_START_DATE] = values[INDEX_END_DATE] = true;
+        for (std::size_t i = 0; i < index.size(); ++i)
+        {
+            if (selected[i] && present(i))
             {
-                return false;
+                std::fill_n(values.begin() + (index[i] - 1), size(i), true);
             }
-            db.push_back(f2cLongDouble(valueString));
         }
-        return true;
+
+        int next = 3; // Fortran index behind the selected entries so far
+        for (std::size_t i = 0; i < index.size(); ++i)
+        {
+            if (selected[i] && present(i))
+            {
+                index[i] = 1 + int(std::count(values.begin(), values.begin() + (index[i] - 1), true));
+                next = std::max(next, index[i] + int(size(i)));
+            } else
+            {
+                order[i]   = 0;
+                entries[i] = 0;
+            }
+        }
+        for (std::size_t i = 0; i < index.size(); ++i)
+        {
+            index[i] = entries[i] > 0 ? index[i] : next;
+        }
+        return values;
     }
 
 
@@ -336,6 +413,235 @@ struct Arg: public option::Arg
             return true;
         }
     }
+
+
+    std::vector<EphemerisFormat::Descriptor> descriptorsV2(std::vector<int> const & index, std::vector<int> const & order, std::vector<int> const & entries)
+    {
+        std::vector<EphemerisFormat::Descriptor> descriptors;
+        for (std::size_t i = 0; i < index.size(); ++i)
+        {
+            descriptors.push_back({ index[i], order[i], entries[i], dimensions[i] });
+        }
+        return descriptors;
+    }
+
+    // v2 format (see EphemerisFormat.h). The header, the table of contents and the sections are built in memory
+    // and written at once. The records follow at the next page boundary. The dates are filled in by finalizeHeaderV2
+    bool writeHeaderV2(std::ofstream & jpleph, std::vector<std::string> const & ttl, std::vector<std::string> const & constantNames,
+                       std::vector<long double> const & constantValues,
+                       long double const au, long double const emrat, int const deNum,
+                       std::vector<int> const & index,
+                       std::vector<int> const & order,
+                       std::vector<int> const & entries,
+                       EphemerisFormat::Header & header, bool const compressed)
+    {
+        std::vector<double> const values(constantValues.begin(), constantValues.end());
+        std::vector<char> head = EphemerisFormat::head(ttl, constantNames, values, descriptorsV2(index, order, entries), header, compressed);
+        header.au    = double(au);
+        header.emrat = double(emrat);
+        header.denum = deNum;
+        std::memcpy(head.data(), &header, sizeof(header));
+        jpleph.write(head.data(), std::streamsize(head.size()));
+        return jpleph.good();
+    }
+
+    // a record of the v2 format: the values as double, zero padding and the checksum at the end of the stride.
+    // The first record fixes the number of values, all others must have the same
+    bool writeRecordV2(std::ofstream & jpleph, std::vector<long double> const & db, EphemerisFormat::Header & header, std::vector<double> & buffer)
+    {
+        if (!EphemerisFormat::record(db.data(), db.size(), header, buffer))
+        {
+            return false;
+        }
+        jpleph.write(reinterpret_cast<char const *>(buffer.data()), std::streamsize(header.recordStride));
+        return jpleph.good();
+    }
+
+    // a record of the compressed container, compressed on its own (see RecordCodec.h). The first record fixes the
+    // number of values and the order of the values in the blocks. 'blocks' collects the start of every block
+    struct Compression
+    {
+        std::vector<EphemerisFormat::Descriptor> descriptors;
+        std::vector<std::uint32_t>               order;
+        std::vector<unsigned char>               planes;
+        std::vector<unsigned char>               block;
+        std::vector<std::uint64_t>               blocks;
+        std::size_t                              bytes = 0; // uncompressed
+    };
+
+    bool writeRecordCompressed(std::ofstream & jpleph, std::vector<long double> const & db, EphemerisFormat::Header & header, Compression & compression)
+    {
+        if (header.numRecords == 0)
+        {
+            header.numValues    = std::uint32_t(db.size());
+            header.recordStride = 0;
+            compression.order   = RecordCodec::order(compression.descriptors, db.size());
+            compression.blocks.push_back(0);
+        }
+        if (db.size() != header.numValues)
+        {
+            return false;
+        }
+
+        RecordCodec::encode(db.data(), compression.order, compression.planes, compression.block);
+        jpleph.write(reinterpret_cast<char const *>(compression.block.data()), std::streamsize(compression.block.size()));
+        compression.blocks.push_back(compression.blocks.back() + compression.block.size());
+        compression.bytes += EphemerisFormat::recordStride(db.size());
+        ++header.numRecords;
+        return jpleph.good();
+    }
+
+    // the index of the blocks behind the records, entered into the table of contents
+    bool writeIndex(std::ofstream & jpleph, EphemerisFormat::Header const & header, Compression const & compression)
+    {
+        std::uint64_t const end    = header.recordOffset + compression.blocks.back();
+        std::uint64_t const offset = EphemerisFormat::align(std::size_t(end), sizeof(double));
+        std::vector<char> const padding(std::size_t(offset - end), 0);
+        jpleph.write(padding.data(), std::streamsize(padding.size()));
+        jpleph.write(reinterpret_cast<char const *>(compression.blocks.data()), std::streamsize(compression.blocks.size() * sizeof(std::uint64_t)));
+
+        EphemerisFormat::Section section;
+        jpleph.seekp(std::streamoff(EphemerisFormat::indexSection(header, offset, section)));
+        jpleph.write(reinterpret_cast<char const *>(&section), sizeof(section));
+        return jpleph.good();
+    }
+
+    // an ephemeris file written before, extended by asc2eph -a: its format, the SS values, the descriptors and where
+    // the next record goes
+    struct ExistingFile
+    {
+        bool                                     v2         = false;
+        bool                                     compressed = false;
+        long double                              dateStart;
+        long double                              dateEnd;
+        long double                              dateInterval;
+        int                                      deNum;
+        std::vector<EphemerisFormat::Descriptor> descriptors;
+        std::streampos                           ssPosition;    // v1
+        std::size_t                              numValues = 0; // v1: values of the first record, 0 without records
+        EphemerisFormat::Header                  header = EphemerisFormat::Header(); // v2
+        std::vector<std::uint64_t>               blocks;        // compressed: the record index
+        std::streamoff                           end;           // behind the last record
+    };
+
+    bool readExisting(std::string const & fileName, ExistingFile & existing)
+    {
+        std::ifstream jpleph(fileName, std::ifstream::binary);
+        char magic[sizeof(EphemerisFormat::MAGIC)] = {};
+        jpleph.read(magic, sizeof(magic));
+        if(!jpleph.good())
+        {
+            std::cerr << "Could not read the ephemeris file " << fileName << " to append to" << std::endl;
+            return false;
+        }
+        jpleph.seekg(0);
+
+        if(EphemerisFormat::isV2(magic, sizeof(magic)))
+        {
+            EphemerisFormat::Header & header = existing.header;
+            std::vector<EphemerisFormat::Section> sections;
+            if(!read(jpleph, header) || header.endianness != EphemerisFormat::ENDIANNESS
+               || (header.version != EphemerisFormat::VERSION && header.version != EphemerisFormat::VERSION_COMPRESSED))
+            {
+                std::cerr << "Not a v2 ephemeris file of this machine: " << fileName << std::endl;
+                return false;
+            }
+            existing.v2           = true;
+            existing.compressed   = header.version == EphemerisFormat::VERSION_COMPRESSED;
+            existing.dateStart    = header.dateStart;
+            existing.dateEnd      = header.dateEnd;
+            existing.dateInterval = header.dateInterval;
+            existing.deNum        = header.denum;
+            existing.end          = std::streamoff(header.recordOffset + header.numRecords * header.recordStride);
+
+            sections.resize(header.numSections);
+            jpleph.seekg(std::streamoff(header.tocOffset));
+            jpleph.read(reinterpret_cast<char *>(sections.data()), std::streamsize(sections.size() * sizeof(EphemerisFormat::Section)));
+            for(EphemerisFormat::Section const & section : sections)
+            {
+                jpleph.seekg(std::streamoff(section.offset));
+                if(section.type == std::uint32_t(EphemerisFormat::SectionType::DESCRIPTOR))
+                {
+                    existing.descriptors.resize(std::size_t(section.size / sizeof(EphemerisFormat::Descriptor)));
+                    jpleph.read(reinterpret_cast<char *>(existing.descriptors.data()), std::streamsize(section.size));
+                }
+                if(section.type == std::uint32_t(EphemerisFormat::SectionType::RECORD_INDEX))
+                {
+                    existing.blocks.resize(std::size_t(header.numRecords + 1));
+                    jpleph.read(reinterpret_cast<char *>(existing.blocks.data()), std::streamsize(existing.blocks.size() * sizeof(std::uint64_t)));
+                    existing.end = std::streamoff(header.recordOffset + existing.blocks.back());
+                }
+            }
+            if(existing.compressed && existing.blocks.empty())
+            {
+                std::cerr << "Compressed ephemeris file without record index: " << fileName << std::endl;
+                return false;
+            }
+        } else
+        {
+            // the v1 header as written by writeHeader
+            std::vector<std::string> ttl;
+            std::vector<std::string> constantNames;
+            std::vector<long double> constantValues;
+            long double au;
+            long double emrat;
+            std::vector<int> index;
+            std::vector<int> order;
+            std::vector<int> entries;
+            std::vector<int> dims;
+            if(!read(jpleph, ttl) || !read(jpleph, constantNames) || !read(jpleph, constantValues))
+            {
+                std::cerr << "Error reading the header of " << fileName << std::endl;
+                return false;
+            }
+            existing.ssPosition = jpleph.tellg();
+            if(!read(jpleph, existing.dateStart) || !read(jpleph, existing.dateEnd) || !read(jpleph, existing.dateInterval) ||
+               !read(jpleph, au) || !read(jpleph, emrat) || !read(jpleph, existing.deNum) ||
+               !read(jpleph, index) || !read(jpleph, order) || !read(jpleph, entries) || !read(jpleph, dims) ||
+               index.size() != order.size() || index.size() != entries.size() || index.size() != dims.size())
+            {
+                std::cerr << "Error reading the header of " << fileName << std::endl;
+                return false;
+            }
+            for(std::size_t i = 0; i < index.size(); ++i)
+            {
+                existing.descriptors.push_back({ index[i], order[i], entries[i], dims[i] });
+            }
+
+            // the size of the first record, records are size prefixed vectors
+            std::streampos const firstRecord = jpleph.tellg();
+            std::vector<long double>::size_type numValues;
+            existing.numValues = read(jpleph, numValues) ? numValues : 0;
+            jpleph.clear();
+            jpleph.seekg(0, std::ios_base::end);
+            existing.end = jpleph.tellg();
+            if(existing.end < firstRecord)
+            {
+                std::cerr << "Error reading the header of " << fileName << std::endl;
+                return false;
+            }
+        }
+        return jpleph.good();
+    }
+
+    bool sameDescriptors(std::vector<EphemerisFormat::Descriptor> const & lhs, std::vector<EphemerisFormat::Descriptor> const & rhs)
+    {
+        return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](EphemerisFormat::Descriptor const & l, EphemerisFormat::Descriptor const & r)
+        {
+            return l.index == r.index && l.order == r.order && l.entries == r.entries && l.dimension == r.dimension;
+        });
+    }
+
+    bool finalizeHeaderV2(std::ofstream & jpleph, EphemerisFormat::Header & header,
+                          long double const dateStart, long double const dateEnd,
+                          long double const dateInterval)
+    {
+        header.dateStart    = double(dateStart);
+        header.dateEnd      = double(dateEnd);
+        header.dateInterval = double(dateInterval);
+        jpleph.seekp(0);
+        return jpleph.good() && write(jpleph, header);
+    }
 }
 
 using namespace std;
@@ -344,7 +650,7 @@ using namespace std;
 
 int main(int argc, char * argv[])
 {
-    // the time span covered can be selected by the user(not implemented yet)
+    // the time span covered can be selected by the user.
     // by default the time span of the output file is the same as the 
     // time span of the provided input files
     long double tStart = - LDBL_MAX; // start date
@@ -393,6 +699,24 @@ int main(int argc, char * argv[])
         return 0;
     }
 
+    unsigned const threads  = options[THREADS].count() > 0 ? unsigned(stoul(options[THREADS].arg)) : 0;
+    tStart = options[START].count() > 0 ? stold(options[START].arg) : tStart;
+    tEnd   = options[END].count() > 0 ? stold(options[END].arg) : tEnd;
+    if(tStart >= tEnd)
+    {
+        cerr << "The start of the time span must be before its end" << endl << flush;
+        return 0;
+    }
+    vector<bool> selectedEntries;
+    if(options[BODIES].count() > 0 && !parseBodies(options[BODIES].arg, selectedEntries))
+    {
+        option::printUsage(cout, usage);
+        return 0;
+    }
+    bool const append     = options[APPEND].count() > 0;
+    bool compressed       = options[COMPRESSED].count() > 0;
+    bool v2               = options[V2].count() > 0 || compressed;
+
     option::Option outOption = options[OUTPUT];
     if(outOption.count() > 0)
     {
@@ -645,6 +969,24 @@ int main(int argc, char * argv[])
         cout << endl;
     }
 
+    // the descriptors of the output file for the selected entries
+    AsciiReader::Selection selection;
+    selection.dateStart = tStart;
+    selection.dateEnd   = tEnd;
+    if(!selectedEntries.empty())
+    {
+        selection.values = selectEntries(selectedEntries, index, order, entries);
+        cout << "\nSelected entries:" << endl;
+        for(vector<int> const * row : { &index, &order, &entries })
+        {
+            for(int i = 0; i < NUM_BODIES; ++i)
+            {
+                cout << setw(5) << (*row)[i];
+            }
+            cout << endl;
+        }
+    }
+
 
      //read group 1070. The actual entries
      //he header contains this for concatentation of the
@@ -661,18 +1003,64 @@ int main(int argc, char * argv[])
 
 
      // open output file as binary
-     ofstream jpleph(outputFileName, ofstream::binary);
+     ofstream jpleph;
      // we have to add the original record 1 and 2 writing here
      // and remeber where the variable stuff is for rewriting at the end
      // random access stream!
      // write header record and get position for ss values
      streampos ssPosition;
+     EphemerisFormat::Header header; // v2
+     vector<double> recordBuffer;    // v2
+     Compression compression;        // compressed v2
+     ExistingFile existing;          // append
 
-     writeHeader(jpleph, ttl, constantNames, constantValues,
-                 dateStart, dateEnd, dateInterval,   //SS values
-                 au, emrat, numde,
-                 index, order, entries,
-                 ssPosition);
+     if(append)
+     {
+         // the records go behind the last one of the file, the header is patched at the end. Blocks up to the end
+         // of the file are skipped by the reader
+         if(!readExisting(outputFileName, existing))
+         {
+             return 0;
+         }
+         vector<EphemerisFormat::Descriptor> const descriptors = descriptorsV2(index, order, entries);
+         if(!sameDescriptors(descriptors, existing.descriptors) || existing.deNum != numde)
+         {
+             cerr << "The header file does not match the ephemeris file " << outputFileName << " (DE number or GROUP 1050)" << endl;
+             return 0;
+         }
+         v2           = existing.v2;
+         compressed   = existing.compressed;
+         header       = existing.header;
+         ssPosition   = existing.ssPosition;
+         dateStart    = existing.dateStart;
+         dateEnd      = existing.dateEnd;
+         dateInterval = existing.dateInterval;
+         db2z         = existing.dateEnd;
+         compression.descriptors = descriptors;
+         compression.blocks      = existing.blocks;
+         compression.order       = compressed ? RecordCodec::order(descriptors, header.numValues) : vector<uint32_t>();
+         selection.dateStart     = max(selection.dateStart, existing.dateEnd);
+
+         jpleph.open(outputFileName, ofstream::binary | ofstream::in | ofstream::out);
+         jpleph.seekp(existing.end);
+         cout << "\nAppending to " << outputFileName << " behind JED " << fixed << setprecision(2) << existing.dateEnd << endl;
+     } else if(v2)
+     {
+         jpleph.open(outputFileName, ofstream::binary);
+         writeHeaderV2(jpleph, ttl, constantNames, constantValues,
+                       au, emrat, numde,
+                       index, order, entries,
+                       header, compressed);
+         compression.descriptors = descriptorsV2(index, order, entries);
+     } else
+     {
+         jpleph.open(outputFileName, ofstream::binary);
+         writeHeader(jpleph, ttl, constantNames, constantValues,
+                     dateStart, dateEnd, dateInterval,   //SS values
+                     au, emrat, numde,
+                     index, order, entries,
+                     ssPosition);
+     }
 
      int blockCounter = 0;
 
@@ -685,120 +1073,114 @@ int main(int argc, char * argv[])
      } 
 
 
-     bool firstBlock = true; // for controling tracking of block time spans
+     bool firstBlock = !append; // for controling tracking of block time spans. Appended blocks abut the end of the file
 
-     // start reading ASCII ephemeris files
-    for(size_t j = 0; j < inputFileNames.size(); ++j)    // go through all the input data files
-    {
-        ifstream ephemeris(inputFileNames[j]);
-        
-        if(!ephemeris.good())
-        {
-            cerr << "Could not open input file " << inputFileNames[j] << endl;
-            return 0;
-        } else 
-        {
-            cout << "\nOpened input file " << inputFileNames[j] << endl << endl; 
-        }
-        
-        int recordNumber = 0;
-        int numberCoeff;
-        while(recordNumber == 0)
-        {
-            if(!readBlockHeader(ephemeris, recordNumber,  numberCoeff))
-            {
-                cerr << "Error reading input file for block header" << inputFileNames[j] << endl;
-                ephemeris.close();
-                return 0;
-            }
-        }
-
-        vector<long double> db;
-        
-        while(!ephemeris.eof())   // scan though all the data blocks in a single file
+     // read the ASCII ephemeris files. The blocks are parsed concurrently and come in the order of the files
+     // (see AsciiReader.h), the checks of the time spans stay sequential. Blocks outside [tStart, tEnd] and the
+     // entries not selected are left out by the reader
+     AsciiReader reader(inputFileNames, threads, selection);
+     AsciiReader::Block block;
+     string const * currentFile = nullptr;
+     try
+     {
+        while(reader.next(block))
         {
-            db.clear();
-            db.reserve(numberCoeff);
-            // we have to repeat this until we hit eof file and then have to continue to the next
-            // file if it exists
-            // read all coefficients
-            if(!readDataBlock(ephemeris, db, numberCoeff))
+            if(block.fileName != currentFile)
             {
-                cerr << "Error reading coefficients from " << inputFileNames[j] << endl;
-                ephemeris.close(); 
-                return 0;   
+                currentFile = block.fileName;
+                cout << "\nReading input file " << *currentFile << endl << endl;
             }
+            vector<long double> const & db = block.values;
 
-            // TODO: this has to become more complex
-            // handling first records, date ranges and changing input files
             // the first two entries in a data block are the start and end date of the block
-            if(db[INDEX_END_DATE] < tEnd)
+            // Skip this data block if it begins before the previous block ended
+            // (the files overlap).
+            if (db[INDEX_START_DATE] >= db2z)
             {
-                // not at the end date // todo but we could be reaching file end!
-                // Skip this data block if the end of the interval is less       
-                // than the specified start time or if it does not begin     
-                // where the previous block ended.
-                if (db[INDEX_END_DATE] >= tStart && db[INDEX_START_DATE] >= db2z)
+                if(firstBlock)
+                {
+                    db2z = db[INDEX_START_DATE];
+                    firstBlock = false;
+                }
+
+                if(db[INDEX_START_DATE] != db2z)
                 {
-                    if(firstBlock)
-                    {
-                        db2z = db[INDEX_START_DATE];
-                        firstBlock = false;
-                    }
-
-                    if(db[INDEX_START_DATE] != db2z)
-                    {
-                        cerr << "Data blocks do not overlap or abut" << endl;
-                        return 0;
-                    }
-
-                    db2z = db[INDEX_END_DATE]; 
-
-                    // keep time span for the binary ephemeris file
-                    if(blockCounter == 0)
-                    {
-                        dateStart = db[INDEX_START_DATE];
-                        dateInterval = db2z - dateStart;
-                    }
-                    dateEnd = db2z;
-
-                    blockCounter++;
-            
-                    if(!write(jpleph, db)) // writing everything including start end end date of block
-                    {
-                        cerr << "Writing block" << blockCounter << " failed" << endl;
-                        return 0;                            
-                    }
-
-                    // inform user about progess
-                    if(blockCounter % 100 == 1)
-                    {
-                        if(db[INDEX_START_DATE] >= tStart)
-                        {
-                            cout << setw(5) << blockCounter << " Ephemeris records written. Last JED = " << setw(13) << fixed<< setprecision(2) << db[INDEX_END_DATE] << endl;
-                        } else
-                        {
-                            cout << "Searching for first requested record ..." << endl;
-                        }
-                    }
+                    cerr << "Data blocks do not overlap or abut" << endl;
+                    return 0;
                 }
 
-                //goto next block, we might hit EOF. then switch to next file
-                readBlockHeader(ephemeris, recordNumber,  numberCoeff); 
+                // the appended records must fit the ones of the file
+                if(append && (db[INDEX_END_DATE] - db[INDEX_START_DATE] != dateInterval || (!v2 && existing.numValues != 0 && db.size() != existing.numValues)))
+                {
+                    cerr << "Data block does not fit the records of " << outputFileName << endl;
+                    return 0;
+                }
+
+                db2z = db[INDEX_END_DATE];
+
+                // keep time span for the binary ephemeris file
+                if(blockCounter == 0 && !append)
+                {
+                    dateStart = db[INDEX_START_DATE];
+                    dateInterval = db2z - dateStart;
+                }
+                dateEnd = db2z;
+
+                blockCounter++;
+
+                bool const written = compressed ? writeRecordCompressed(jpleph, db, header, compression)
+                                   : v2         ? writeRecordV2(jpleph, db, header, recordBuffer)
+                                                : write(jpleph, db); // writing everything including start end end date of block
+                if(!written)
+                {
+                    cerr << "Writing block" << blockCounter << " failed" << endl;
+                    return 0;
+                }
+
+                // inform user about progess
+                if(blockCounter % 100 == 1)
+                {
+                    cout << setw(5) << blockCounter << " Ephemeris records written. Last JED = " << setw(13) << fixed<< setprecision(2) << db[INDEX_END_DATE] << endl;
+                }
             }
         }
-        ephemeris.close();
-    }
+     }
+     catch(exception const & e)
+     {
+        cerr << e.what() << endl;
+        return 0;
+     }
+     AsciiReader::Statistics const statistics = reader.statistics();
 
     // write info about last record
     cout << setw(5) << blockCounter << " Ephemeris records written. Last JED = " << setw(13) << fixed << setprecision(2) << db2z << endl;
     
     // finalize the header record with the ss values
-    finalizeHeader(jpleph, ssPosition, dateStart, dateEnd, dateInterval);
+    if(compressed)
+    {
+        writeIndex(jpleph, header, compression);
+        uint64_t const compressedBytes = compression.blocks.back() - (append ? existing.blocks.back() : 0);
+        cout << "Compressed " << compression.bytes << " bytes of records to " << compressedBytes << " bytes (ratio "
+             << setprecision(2) << double(compression.bytes) / double(max(compressedBytes, uint64_t(1))) << ")" << endl;
+    }
+    if(v2)
+    {
+        finalizeHeaderV2(jpleph, header, dateStart, dateEnd, dateInterval);
+    } else
+    {
+        finalizeHeader(jpleph, ssPosition, dateStart, dateEnd, dateInterval);
+    }
     // close output file
     jpleph << flush;
     jpleph.close();
 
-    cout << "\nOutput file " <<outputFileName << " written" << endl; 
+    cout << "\nOutput file " <<outputFileName << " written" << endl;
+    cout << "Read " << setprecision(1) << (statistics.bytes / 1.0e6) << " MB in " << setprecision(3) << statistics.seconds << " s: "
+         << setprecision(1) << (statistics.bytes / 1.0e6 / statistics.seconds) << " MB/s, "
+         << (statistics.blocks / statistics.seconds) << " blocks/s" << endl;
+    if(statistics.skipped > 0)
+    {
+        cout << statistics.skipped << " blocks outside of the time span skipped" << endl;
+    }
 }
 
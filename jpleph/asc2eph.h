@@ -39,6 +39,43 @@ bool write(std::ofstream & outStream, std::vector<T> const & values)
 }
 
 
+// templates for read methods, the counterparts of the write methods (asc2eph -a reads the header of a file written before)
+
+template <typename T>
+bool read(std::ifstream & inStream, T & value)
+{
+    inStream.read((char *)& value, sizeof(T));
+    return inStream.good();
+}
+
+// specialize for strings
+template<>
+bool read(std::ifstream & inStream, std::string & value)
+{
+    std::getline(inStream, value, '\0');
+    return inStream.good();
+}
+
+template <typename T>
+bool read(std::ifstream & inStream, std::vector<T> & values)
+{
+    typename std::vector<T>::size_type size;
+    if (!read(inStream, size)) // reading the size of the vector
+    {
+        return false;
+    }
+
+    values.resize(size);
+    for (typename std::vector<T>::size_type i = 0; i < values.size(); ++i)
+    {
+        if (!read<T>(inStream, values[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 //template <typename T>
 //bool write(std::ofstream & outstream, std::array<T> const & values)
 //{
@@ -1,8 +1,20 @@
+#include <stdexcept>
+
 #include "Chebysheff.h"
 
-Chebysheff::Chebysheff(EphemerisRecord::RecordType const & record, double const & secspan): twotc(0.0), record(record), secspan(secspan) { }
+Chebysheff::Chebysheff(EphemerisRecord::RecordType const & record, double const & secspan): record(record), secspan(secspan) { }
+
+void Chebysheff::operator()(double const & time, int const body, bool const vel, Components & position, Components & velocity)
+{
+    evaluate(time, body, position.data(), vel ? velocity.data() : nullptr, nullptr);
+}
+
+void Chebysheff::operator()(double const & time, int const body, Components & position, Components & velocity, Components & acceleration)
+{
+    evaluate(time, body, position.data(), velocity.data(), acceleration.data());
+}
 
-void Chebysheff::operator()(double const & time, int const body, bool const vel, std::vector<double> & position, std::vector<double> & velocity)
+void Chebysheff::evaluate(double const & time, int const body, double * position, double * velocity, double * acceleration) const
 {
     // read the descriptor for the body
     EphemerisRecord::RecordDescriptorEntry const & entryDescriptor = record.getDescriptor(body);
@@ -12,36 +24,28 @@ void Chebysheff::operator()(double const & time, int const body, bool const vel,
     int sub = 0;
     double const tc = normalizedTime(time, nsub, sub); // determine sub intervall and interpolation point within the intervall -1 <= tc <= 1.0
 
-    // create chebysheff polynomial values
-    createPolyValues(tc, entryDescriptor.numCoefficient, vel, p, v);
-
-    // interpolation
-    int const base = entryDescriptor.recordIndex + sub*(entryDescriptor.numCoefficient) * (entryDescriptor.dimension); 
-    for (int i = 0; i < entryDescriptor.dimension; ++i)  
+    // the coefficients of all components of the sub intervall
+    int const base  = entryDescriptor.recordIndex + sub*(entryDescriptor.numCoefficient) * (entryDescriptor.dimension); 
+    int const count = entryDescriptor.numCoefficient * entryDescriptor.dimension;
+    if (base < 0)
     {
-        double tempp = 0.0;
-
-        for (int j = entryDescriptor.numCoefficient - 1; j >= 0; --j)
-        {
-            tempp = tempp + p[j] * record.at(j + i *entryDescriptor.numCoefficient + base);
-        }
-
-        position[i] = tempp;
+        throw std::out_of_range("Chebysheff: coefficients outside of the record");
     }
 
+    // interpolation
+    Clenshaw::evaluate(record.coefficients(size_t(base), size_t(count)), entryDescriptor.numCoefficient, entryDescriptor.dimension, tc, position, velocity, acceleration);
 
-    if (vel)
+    // derivatives with respect to tc -> per second
+    double const vfac = (2.0 * nsub) / secspan;
+    for (int i = 0; i < entryDescriptor.dimension; ++i)
     {
-        double const vfac = (2.0 * nsub) / secspan;
-        for (int i = 0; i < entryDescriptor.dimension; ++i) 
+        if (velocity != nullptr)
         {
-            double tempv = 0.0;
-            for (int j = entryDescriptor.numCoefficient - 1; j >= 1; --j)
-            {
-                tempv = tempv + v[j] * record.at(j + i *entryDescriptor.numCoefficient + base);
-            }
-
-            velocity[i] = tempv * vfac;
+            velocity[i] = velocity[i] * vfac;
+        }
+        if (acceleration != nullptr)
+        {
+            acceleration[i] = acceleration[i] * (vfac * vfac);
         }
     }
 }
@@ -65,50 +69,3 @@ double Chebysheff::normalizedTime(double const & time, int const nsub, int & sub
 
     return (endOfIntervall? (2.0 * (tFraction + 1.0) - 1.0) : (2.0 * tFraction - 1.0));
 }
-
-
-// create the values of the different chebysheff polynomials for interpolation
-void Chebysheff::createPolyValues(double const & tc, int const order, bool const vel, std::vector<double> & pc, std::vector<double> & vc)
-{
-    double const  twotc = tc + tc;
-
-    // create chebysheff polynomial values
-    if (pc.size() >= 2 && pc[1] != tc || pc.size() < 2) // new value for tc i.e. we have to calculate new Chebysheff values
-    {
-        pc.clear();
-        pc.reserve(order);
-        pc = { 1.0 };     // p[0]
-        pc.push_back(tc); // p[1]
-
-        if (vel)
-        {
-            vc.clear();
-            vc.reserve(order);
-            vc = { 0.0, 1.0, twotc + twotc }; // vc[0], vc[1], vc[2]
-           // vc.push_back(twotc + twotc);
-        }
-    }
-
-    // double const twotc = tc + tc;
-    // fill up if not already calculated
-    if (int(pc.size()) - 1 < order)
-    {
-        for (int i = pc.size(); i < order; ++i)
-        {
-            pc.push_back((twotc * pc[i - 1]) - pc[i - 2]);
-        }
-    }
-
-
-    if (vel) // if speeds requested 
-    {
-        // caculate the derivative Chebysheff values
-        if (int(vc.size()) - 1 < order)
-        {
-            for (int i = vc.size(); i < order; ++i)
-            {
-                vc.push_back(twotc * vc[i - 1] + pc[i - 1] + pc[i - 1] - vc[i - 2]);
-            }
-        }
-    }
-}
\ No newline at end of file
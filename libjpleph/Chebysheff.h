@@ -1,32 +1,40 @@
 //
 // class representing the values of the different chebysheff polynomials
 // up to specific order
-// we have a dynamic handling in order to minimize recalcluations
+// the series are evaluated with the Clenshaw recurrence (see Clenshaw.h)
 //
 #ifndef CHEBYSHEFF_H
 #define CHEBYSHEFF_H
 
-#include <vector>
+#include <array>
 
 #include "EphemerisRecord.h"
+#include "Clenshaw.h"
 
 
 class Chebysheff 
 {
     public:
+    static int const MAX_DIMENSION = Clenshaw::MAX_DIMENSION; // number of components of an entry
+
+    typedef std::array<double, MAX_DIMENSION> Components;
+
     explicit Chebysheff(EphemerisRecord::RecordType const & record, double const & secspan);
-    void operator()(double const & time, int const body, bool const vel, std::vector<double> & position, std::vector<double> & velocity);
+
+    // position and (if 'vel') velocity of the entry 'body' at the time 'time' (0.0 <= time <= 1.0 within the record)
+    void operator()(double const & time, int const body, bool const vel, Components & position, Components & velocity);
+
+    // as above with the acceleration in addition. Velocity and acceleration are per second
+    void operator()(double const & time, int const body, Components & position, Components & velocity, Components & acceleration);
+
+    static double normalizedTime(double const & time, int const nsub, int & sub); // normalize to proper intervall and determine subintervall
 
     private:
-        double normalizedTime(double const & time, int const nsub, int & sub); // normalize to proper intervall and determine subintervall
-        void createPolyValues(double const & tc, int const order, bool const vel, std::vector<double> & pc, std::vector<double> & vc);
-	double twotc;
-	std::vector<double>  p; // chebysheff polynomial values for position
-	std::vector<double>  v; // chebysheff polynomial values for velocity (1 st derivative)
+        void evaluate(double const & time, int const body, double * position, double * velocity, double * acceleration) const;
 
-    EphemerisRecord::RecordType const & record;
+    EphemerisRecord::RecordType const record; // view of the record. Cheap to copy
 
     double const secspan; // record interval in seconds
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,400 @@
+//
+// SIMD evaluation of chebysheff series. Every lane evaluates the series at a different point
+//
+#include <stdexcept>
+
+#include "ChebysheffBatch.h"
+#include "Clenshaw.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CHEBYSHEFF_X64
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_AVX2   __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#endif
+
+// no fused multiply add: the results have to be identical to the ones of Clenshaw::evaluate
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+using namespace std;
+
+namespace
+{
+    // one point after the other with the scalar Clenshaw recurrence
+    void evaluateScalar(double const * coefficients, int const numCoefficient, int const dimension,
+                        double const * tc, size_t const begin, size_t const end, double const vfac,
+                        double * const * position, double * const * velocity)
+    {
+        double p[Clenshaw::MAX_DIMENSION];
+        double v[Clenshaw::MAX_DIMENSION];
+
+        for (size_t k = begin; k < end; ++k)
+        {
+            Clenshaw::evaluate(coefficients, numCoefficient, dimension, tc[k], p, velocity != nullptr ? v : nullptr, nullptr);
+            for (int i = 0; i < dimension; ++i)
+            {
+                position[i][k] = p[i];
+                if (velocity != nullptr)
+                {
+                    velocity[i][k] = v[i] * vfac;
+                }
+            }
+        }
+    }
+
+
+    // the single precision recurrence for one point after the other
+    void evaluateScalar(float const * coefficients, int const numCoefficient, int const dimension,
+                        double const * tc, size_t const begin, size_t const end, double const vfac,
+                        double * const * position, double * const * velocity)
+    {
+        for (size_t k = begin; k < end; ++k)
+        {
+            float const t     = float(tc[k]);
+            float const twotc = t + t;
+            for (int i = 0; i < dimension; ++i)
+            {
+                float const * c = coefficients + i * numCoefficient;
+                float b1 = 0.0f;
+                float b2 = 0.0f;
+                float d1 = 0.0f;
+                float d2 = 0.0f;
+                for (int j = numCoefficient - 1; j >= 1; --j)
+                {
+                    float const d0 = (b1 + b1) + twotc * d1 - d2;
+                    d2 = d1;
+                    d1 = d0;
+                    float const b0 = c[j] + twotc * b1 - b2;
+                    b2 = b1;
+                    b1 = b0;
+                }
+                position[i][k] = double(c[0] + t * b1 - b2);
+                if (velocity != nullptr)
+                {
+                    velocity[i][k] = double(b1 + t * d1 - d2) * vfac;
+                }
+            }
+        }
+    }
+
+
+#ifdef CHEBYSHEFF_X64
+
+    // the Clenshaw recurrence of Clenshaw.cpp, lane by lane
+    TARGET_AVX2
+    size_t evaluateAvx2(double const * coefficients, int const numCoefficient, int const dimension,
+                        double const * tc, size_t const count, double const vfac,
+                        double * const * position, double * const * velocity)
+    {
+        __m256d const vfacs = _mm256_set1_pd(vfac);
+
+        size_t k = 0;
+        for (; k + 4 <= count; k += 4)
+        {
+            __m256d const tcs   = _mm256_loadu_pd(tc + k);
+            __m256d const twotc = _mm256_add_pd(tcs, tcs);
+
+            for (int i = 0; i < dimension; ++i)
+            {
+                double const * c = coefficients + i * numCoefficient;
+                __m256d b1 = _mm256_setzero_pd();
+                __m256d b2 = _mm256_setzero_pd();
+                __m256d d1 = _mm256_setzero_pd();
+                __m256d d2 = _mm256_setzero_pd();
+                for (int j = numCoefficient - 1; j >= 1; --j)
+                {
+                    if (velocity != nullptr)
+                    {
+                        __m256d const d0 = _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(b1, b1), _mm256_mul_pd(twotc, d1)), d2);
+                        d2 = d1;
+                        d1 = d0;
+                    }
+                    __m256d const b0 = _mm256_sub_pd(_mm256_add_pd(_mm256_set1_pd(c[j]), _mm256_mul_pd(twotc, b1)), b2);
+                    b2 = b1;
+                    b1 = b0;
+                }
+                _mm256_storeu_pd(position[i] + k, _mm256_sub_pd(_mm256_add_pd(_mm256_set1_pd(c[0]), _mm256_mul_pd(tcs, b1)), b2));
+
+                if (velocity != nullptr)
+                {
+                    __m256d const derivative = _mm256_sub_pd(_mm256_add_pd(b1, _mm256_mul_pd(tcs, d1)), d2);
+                    _mm256_storeu_pd(velocity[i] + k, _mm256_mul_pd(derivative, vfacs));
+                }
+            }
+        }
+        return k;
+    }
+
+
+    TARGET_AVX512
+    size_t evaluateAvx512(double const * coefficients, int const numCoefficient, int const dimension,
+                          double const * tc, size_t const count, double const vfac,
+                          double * const * position, double * const * velocity)
+    {
+        __m512d const vfacs = _mm512_set1_pd(vfac);
+
+        size_t k = 0;
+        for (; k + 8 <= count; k += 8)
+        {
+            __m512d const tcs   = _mm512_loadu_pd(tc + k);
+            __m512d const twotc = _mm512_add_pd(tcs, tcs);
+
+            for (int i = 0; i < dimension; ++i)
+            {
+                double const * c = coefficients + i * numCoefficient;
+                __m512d b1 = _mm512_setzero_pd();
+                __m512d b2 = _mm512_setzero_pd();
+                __m512d d1 = _mm512_setzero_pd();
+                __m512d d2 = _mm512_setzero_pd();
+                for (int j = numCoefficient - 1; j >= 1; --j)
+                {
+                    if (velocity != nullptr)
+                    {
+                        __m512d const d0 = _mm512_sub_pd(_mm512_add_pd(_mm512_add_pd(b1, b1), _mm512_mul_pd(twotc, d1)), d2);
+                        d2 = d1;
+                        d1 = d0;
+                    }
+                    __m512d const b0 = _mm512_sub_pd(_mm512_add_pd(_mm512_set1_pd(c[j]), _mm512_mul_pd(twotc, b1)), b2);
+                    b2 = b1;
+                    b1 = b0;
+                }
+                _mm512_storeu_pd(position[i] + k, _mm512_sub_pd(_mm512_add_pd(_mm512_set1_pd(c[0]), _mm512_mul_pd(tcs, b1)), b2));
+
+                if (velocity != nullptr)
+                {
+                    __m512d const derivative = _mm512_sub_pd(_mm512_add_pd(b1, _mm512_mul_pd(tcs, d1)), d2);
+                    _mm512_storeu_pd(velocity[i] + k, _mm512_mul_pd(derivative, vfacs));
+                }
+            }
+        }
+        return k;
+    }
+
+
+    // single precision: 8 points per register. The times are rounded from two double registers,
+    // the results widened to double in two halves
+    TARGET_AVX2
+    size_t evaluateAvx2(float const * coefficients, int const numCoefficient, int const dimension,
+                        double const * tc, size_t const count, double const vfac,
+                        double * const * position, double * const * velocity)
+    {
+        __m256d const vfacs = _mm256_set1_pd(vfac);
+
+        size_t k = 0;
+        for (; k + 8 <= count; k += 8)
+        {
+            __m256 const tcs   = _mm256_set_m128(_mm256_cvtpd_ps(_mm256_loadu_pd(tc + k + 4)), _mm256_cvtpd_ps(_mm256_loadu_pd(tc + k)));
+            __m256 const twotc = _mm256_add_ps(tcs, tcs);
+
+            for (int i = 0; i < dimension; ++i)
+            {
+                float const * c = coefficients + i * numCoefficient;
+                __m256 b1 = _mm256_setzero_ps();
+                __m256 b2 = _mm256_setzero_ps();
+                __m256 d1 = _mm256_setzero_ps();
+                __m256 d2 = _mm256_setzero_ps();
+                for (int j = numCoefficient - 1; j >= 1; --j)
+                {
+                    if (velocity != nullptr)
+                    {
+                        __m256 const d0 = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(b1, b1), _mm256_mul_ps(twotc, d1)), d2);
+                        d2 = d1;
+                        d1 = d0;
+                    }
+                    __m256 const b0 = _mm256_sub_ps(_mm256_add_ps(_mm256_set1_ps(c[j]), _mm256_mul_ps(twotc, b1)), b2);
+                    b2 = b1;
+                    b1 = b0;
+                }
+                __m256 const p = _mm256_sub_ps(_mm256_add_ps(_mm256_set1_ps(c[0]), _mm256_mul_ps(tcs, b1)), b2);
+                _mm256_storeu_pd(position[i] + k, _mm256_cvtps_pd(_mm256_castps256_ps128(p)));
+                _mm256_storeu_pd(position[i] + k + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(p, 1)));
+
+                if (velocity != nullptr)
+                {
+                    __m256 const derivative = _mm256_sub_ps(_mm256_add_ps(b1, _mm256_mul_ps(tcs, d1)), d2);
+                    _mm256_storeu_pd(velocity[i] + k, _mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(derivative)), vfacs));
+                    _mm256_storeu_pd(velocity[i] + k + 4, _mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(derivative, 1)), vfacs));
+                }
+            }
+        }
+        return k;
+    }
+
+
+    // 16 floats from two halves and back. Only AVX-512F instructions: the halves are moved as 4 doubles
+    TARGET_AVX512
+    __m512 combineHalves(__m256 const low, __m256 const high)
+    {
+        return _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(low)), _mm256_castps_pd(high), 1));
+    }
+
+    TARGET_AVX512
+    __m256 upperHalf(__m512 const value)
+    {
+        return _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(value), 1));
+    }
+
+
+    // single precision: 16 points per register
+    TARGET_AVX512
+    size_t evaluateAvx512(float const * coefficients, int const numCoefficient, int const dimension,
+                          double const * tc, size_t const count, double const vfac,
+                          double * const * position, double * const * velocity)
+    {
+        __m512d const vfacs = _mm512_set1_pd(vfac);
+
+        size_t k = 0;
+        for (; k + 16 <= count; k += 16)
+        {
+            __m512 const tcs   = combineHalves(_mm512_cvtpd_ps(_mm512_loadu_pd(tc + k)), _mm512_cvtpd_ps(_mm512_loadu_pd(tc + k + 8)));
+            __m512 const twotc = _mm512_add_ps(tcs, tcs);
+
+            for (int i = 0; i < dimension; ++i)
+            {
+                float const * c = coefficients + i * numCoefficient;
+                __m512 b1 = _mm512_setzero_ps();
+                __m512 b2 = _mm512_setzero_ps();
+                __m512 d1 = _mm512_setzero_ps();
+                __m512 d2 = _mm512_setzero_ps();
+                for (int j = numCoefficient - 1; j >= 1; --j)
+                {
+                    if (velocity != nullptr)
+                    {
+                        __m512 const d0 = _mm512_sub_ps(_mm512_add_ps(_mm512_add_ps(b1, b1), _mm512_mul_ps(twotc, d1)), d2);
+                        d2 = d1;
+                        d1 = d0;
+                    }
+                    __m512 const b0 = _mm512_sub_ps(_mm512_add_ps(_mm512_set1_ps(c[j]), _mm512_mul_ps(twotc, b1)), b2);
+                    b2 = b1;
+                    b1 = b0;
+                }
+                __m512 const p = _mm512_sub_ps(_mm512_add_ps(_mm512_set1_ps(c[0]), _mm512_mul_ps(tcs, b1)), b2);
+                _mm512_storeu_pd(position[i] + k, _mm512_cvtps_pd(_mm512_castps512_ps256(p)));
+                _mm512_storeu_pd(position[i] + k + 8, _mm512_cvtps_pd(upperHalf(p)));
+
+                if (velocity != nullptr)
+                {
+                    __m512 const derivative = _mm512_sub_ps(_mm512_add_ps(b1, _mm512_mul_ps(tcs, d1)), d2);
+                    _mm512_storeu_pd(velocity[i] + k, _mm512_mul_pd(_mm512_cvtps_pd(_mm512_castps512_ps256(derivative)), vfacs));
+                    _mm512_storeu_pd(velocity[i] + k + 8, _mm512_mul_pd(_mm512_cvtps_pd(upperHalf(derivative)), vfacs));
+                }
+            }
+        }
+        return k;
+    }
+
+
+    ChebysheffBatch::InstructionSet detectInstructionSet()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuidex(info, 0, 0);
+        int const maxLeaf = info[0];
+        if (maxLeaf < 7)
+        {
+            return ChebysheffBatch::InstructionSet::SCALAR;
+        }
+        __cpuidex(info, 1, 0);
+        bool const osxsave = (info[2] & (1 << 27)) != 0;
+        if (!osxsave)
+        {
+            return ChebysheffBatch::InstructionSet::SCALAR;
+        }
+        unsigned long long const xcr0 = _xgetbv(0);
+        __cpuidex(info, 7, 0);
+        bool const avx2   = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x06) == 0x06;
+        bool const avx512 = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6;
+#else
+        __builtin_cpu_init();
+        bool const avx2   = __builtin_cpu_supports("avx2");
+        bool const avx512 = __builtin_cpu_supports("avx512f");
+#endif
+        if (avx512)
+        {
+            return ChebysheffBatch::InstructionSet::AVX512;
+        }
+        if (avx2)
+        {
+            return ChebysheffBatch::InstructionSet::AVX2;
+        }
+        return ChebysheffBatch::InstructionSet::SCALAR;
+    }
+
+#endif
+}
+
+
+ChebysheffBatch::InstructionSet ChebysheffBatch::instructionSet()
+{
+#ifdef CHEBYSHEFF_X64
+    static InstructionSet const detected = detectInstructionSet();
+    return detected;
+#else
+    return InstructionSet::SCALAR;
+#endif
+}
+
+
+void ChebysheffBatch::evaluate(double const * coefficients, int const numCoefficient, int const dimension,
+                               double const * tc, size_t const count, double const vfac,
+                               double * const * position, double * const * velocity)
+{
+    if (dimension > Clenshaw::MAX_DIMENSION)
+    {
+        throw invalid_argument("ChebysheffBatch::evaluate: too many components");
+    }
+
+    size_t done = 0;
+#ifdef CHEBYSHEFF_X64
+    switch (instructionSet())
+    {
+    case InstructionSet::AVX512:
+        done = evaluateAvx512(coefficients, numCoefficient, dimension, tc, count, vfac, position, velocity);
+        break;
+    case InstructionSet::AVX2:
+        done = evaluateAvx2(coefficients, numCoefficient, dimension, tc, count, vfac, position, velocity);
+        break;
+    default:
+        break;
+    }
+#endif
+    // the remaining points that don't fill a complete register
+    evaluateScalar(coefficients, numCoefficient, dimension, tc, done, count, vfac, position, velocity);
+}
+
+
+void ChebysheffBatch::evaluate(float const * coefficients, int const numCoefficient, int const dimension,
+                               double const * tc, size_t const count, double const vfac,
+                               double * const * position, double * const * velocity)
+{
+    if (dimension > Clenshaw::MAX_DIMENSION)
+    {
+        throw invalid_argument("ChebysheffBatch::evaluate: too many components");
+    }
+
+    size_t done = 0;
+#ifdef CHEBYSHEFF_X64
+    switch (instructionSet())
+    {
+    case InstructionSet::AVX512:
+        done = evaluateAvx512(coefficients, numCoefficient, dimension, tc, count, vfac, position, velocity);
+        break;
+    case InstructionSet::AVX2:
+        done = evaluateAvx2(coefficients, numCoefficient, dimension, tc, count, vfac, position, velocity);
+        break;
+    default:
+        break;
+    }
+#endif
+    evaluateScalar(coefficients, numCoefficient, dimension, tc, done, count, vfac, position, velocity);
+}
@@ -0,0 +1,47 @@
+//
+// evaluation of a chebysheff series at many points at once
+// the points are distributed over the lanes of the SIMD registers (AVX-512: 8, AVX2: 4, scalar: 1)
+// the single precision version has twice the lanes (AVX-512: 16, AVX2: 8)
+// the instruction set is selected at runtime according to the capabilities of the processor
+//
+#ifndef CHEBYSHEFFBATCH_H
+#define CHEBYSHEFFBATCH_H
+
+#include <cstddef>
+
+
+namespace ChebysheffBatch
+{
+    enum class InstructionSet
+    {
+        SCALAR = 0,
+        AVX2   = 1,
+        AVX512 = 2,
+    };
+
+    // the instruction set used by evaluate(). Determined once from the processor capabilities
+    InstructionSet instructionSet();
+
+    // evaluate the chebysheff series of all components of one body at 'count' points
+    //
+    //   coefficients   the coefficients of the sub interval: 'dimension' blocks of 'numCoefficient' values
+    //   tc             the normalized times -1.0 <= tc <= 1.0 of the points
+    //   vfac           scale factor of the derivative (2 * nsub / secspan)
+    //   position[i]    output array for component i (count values)
+    //   velocity[i]    output array for the derivative of component i (count values). velocity may be nullptr
+    //
+    // the same Clenshaw recurrence as Clenshaw::evaluate (used by Chebysheff::operator()) i.e. identical results
+    void evaluate(double const * coefficients, int const numCoefficient, int const dimension,
+                  double const * tc, std::size_t const count, double const vfac,
+                  double * const * position, double * const * velocity);
+
+    // the same in single precision for screening (see Jpleph::dplephSingle): coefficients converted to float once per
+    // record (see EphemerisRecord::convertSingle), tc rounded to float and the recurrence in float. The results are
+    // widened to double, the derivative is scaled by vfac in double. Not identical to the double version: the error
+    // of a component is below numCoefficient^2 * 2^-24 * sum |coefficient| (worst case at tc = -1.0 and 1.0)
+    void evaluate(float const * coefficients, int const numCoefficient, int const dimension,
+                  double const * tc, std::size_t const count, double const vfac,
+                  double * const * position, double * const * velocity);
+}
+
+#endif
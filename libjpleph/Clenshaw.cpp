@@ -0,0 +1,183 @@
+//
+// Clenshaw recurrence for the chebysheff series f(t) = sum c[k] * T[k](t) and its 1st and 2nd derivative
+//
+//   b[k]   = c[k] + 2t * b[k+1] - b[k+2]
+//   b'[k]  = 2 * b[k+1] + 2t * b'[k+1] - b'[k+2]
+//   b''[k] = 4 * b'[k+1] + 2t * b''[k+1] - b''[k+2]
+//
+//   f = c[0] + t * b[1] - b[2],  f' = b[1] + t * b'[1] - b'[2],  f'' = 2 * b'[1] + t * b''[1] - b''[2]
+//
+#include "Clenshaw.h"
+
+// no fused multiply add: ChebysheffBatch does the same operations lane by lane and has to give identical results
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace
+{
+    // the coefficients of the components of a single entry: 'dimension' blocks of 'order' values
+    struct Blocks
+    {
+        double const * coefficients;
+        double const * operator()(int const component, int const order) const { return coefficients + component * order; }
+    };
+
+    // the coefficients of every component given separately (Clenshaw::evaluateRows)
+    struct Rows
+    {
+        double const * const * rows;
+        double const * operator()(int const component, int const) const { return rows[component]; }
+    };
+
+    // N > 0: number of coefficients known at compile time, N == 0: given by 'numCoefficient'
+    // D > 0: number of components known at compile time, D == 0: given by 'dimension'
+    // R: the derivatives computed (0: none, 1: the 1st, 2: both). Known at compile time the recurrences stay in registers
+    // The components are processed together i.e. the recurrences of the components are independent
+    // chains of operations that overlap in the pipeline
+    template<int N, int D, int R, typename Coefficients>
+    void recurrence(Coefficients const & coefficients, int const numCoefficient, int const dimension, double const tc,
+                    double * position, double * velocity, double * acceleration)
+    {
+        static int const SIZE = D > 0 ? D : Clenshaw::MAX_ROWS;
+        int const order      = N > 0 ? N : numCoefficient;
+        int const components = D > 0 ? D : dimension;
+        bool const derivative   = R >= 1;
+        bool const derivative2  = R >= 2;
+        double const twotc = tc + tc;
+
+        double const * c[SIZE];
+        double b1[SIZE] = {}; // b[k+1]
+        double b2[SIZE] = {}; // b[k+2]
+        double d1[SIZE] = {}; // b'[k+1]
+        double d2[SIZE] = {}; // b'[k+2]
+        double a1[SIZE] = {}; // b''[k+1]
+        double a2[SIZE] = {}; // b''[k+2]
+        for (int i = 0; i < components; ++i)
+        {
+            c[i] = coefficients(i, order);
+        }
+
+        for (int k = order - 1; k >= 1; --k)
+        {
+            for (int i = 0; i < components; ++i)
+            {
+                if (derivative2)
+                {
+                    double const a0 = 4.0 * d1[i] + twotc * a1[i] - a2[i];
+                    a2[i] = a1[i];
+                    a1[i] = a0;
+                }
+                if (derivative)
+                {
+                    double const d0 = (b1[i] + b1[i]) + twotc * d1[i] - d2[i];
+                    d2[i] = d1[i];
+                    d1[i] = d0;
+                }
+                double const b0 = c[i][k] + twotc * b1[i] - b2[i];
+                b2[i] = b1[i];
+                b1[i] = b0;
+            }
+        }
+
+        for (int i = 0; i < components; ++i)
+        {
+            position[i] = c[i][0] + tc * b1[i] - b2[i];
+            if (velocity != nullptr)
+            {
+                velocity[i] = b1[i] + tc * d1[i] - d2[i];
+            }
+            if (acceleration != nullptr)
+            {
+                acceleration[i] = (d1[i] + d1[i]) + tc * a1[i] - a2[i];
+            }
+        }
+    }
+
+    template<int N, int D, typename Coefficients>
+    void clenshaw(Coefficients const & coefficients, int const numCoefficient, int const dimension, double const tc,
+                  double * position, double * velocity, double * acceleration)
+    {
+        if (acceleration != nullptr)
+        {
+            recurrence<N, D, 2>(coefficients, numCoefficient, dimension, tc, position, velocity, acceleration);
+        }
+        else if (velocity != nullptr)
+        {
+            recurrence<N, D, 1>(coefficients, numCoefficient, dimension, tc, position, velocity, acceleration);
+        }
+        else
+        {
+            recurrence<N, D, 0>(coefficients, numCoefficient, dimension, tc, position, velocity, acceleration);
+        }
+    }
+
+    // the specialized versions for the coefficient counts of the DE files
+    template<int D, typename Coefficients>
+    void dispatch(Coefficients const & coefficients, int const numCoefficient, int const dimension, double const tc,
+                  double * position, double * velocity, double * acceleration)
+    {
+        switch (numCoefficient)
+        {
+        case 6:
+            clenshaw<6, D>(coefficients, numCoefficient, dimension, tc, position, velocity, acceleration);
+            break;
+        case 7:
+            clenshaw<7, D>(coefficients, numCoefficient, dimension, tc, position, velocity, acceleration);
+            break;
+        case 8:
+            clenshaw<8, D>(coefficients, numCoefficient, dimension, tc, position, velocity, acceleration);
+            break;
+        case 10:
+            clenshaw<10, D>(coefficients, numCoefficient, dimension, tc, position, velocity, acceleration);
+            break;
+        case 11:
+            clenshaw<11, D>(coefficients, numCoefficient, dimension, tc, position, velocity, acceleration);
+            break;
+        case 12:
+            clenshaw<12, D>(coefficients, numCoefficient, dimension, tc, position, velocity, acceleration);
+            break;
+        case 13:
+            clenshaw<13, D>(coefficients, numCoefficient, dimension, tc, position, velocity, acceleration);
+            break;
+        case 14:
+            clenshaw<14, D>(coefficients, numCoefficient, dimension, tc, position, velocity, acceleration);
+            break;
+        default:
+            clenshaw<0, D>(coefficients, numCoefficient, dimension, tc, position, velocity, acceleration);
+            break;
+        }
+    }
+}
+
+
+void Clenshaw::evaluate(double const * coefficients, int const numCoefficient, int const dimension, double const tc,
+                        double * position, double * velocity, double * acceleration)
+{
+    if (dimension != 3)
+    {
+        clenshaw<0, 0>(Blocks{ coefficients }, numCoefficient, dimension, tc, position, velocity, acceleration);
+        return;
+    }
+    dispatch<3>(Blocks{ coefficients }, numCoefficient, dimension, tc, position, velocity, acceleration);
+}
+
+
+void Clenshaw::evaluateRows(double const * const * rows, int const numRows, int const numCoefficient, double const tc,
+                            double * position, double * velocity, double * acceleration)
+{
+    switch (numRows)
+    {
+    case 3:
+        dispatch<3>(Rows{ rows }, numCoefficient, numRows, tc, position, velocity, acceleration);
+        break;
+    case 6:
+        dispatch<6>(Rows{ rows }, numCoefficient, numRows, tc, position, velocity, acceleration);
+        break;
+    default:
+        clenshaw<0, 0>(Rows{ rows }, numCoefficient, numRows, tc, position, velocity, acceleration);
+        break;
+    }
+}
@@ -0,0 +1,36 @@
+//
+// evaluation of chebysheff series with the Clenshaw recurrence
+// position, velocity and acceleration of all components of an entry are produced in a single pass over the coefficients
+//
+#ifndef CLENSHAW_H
+#define CLENSHAW_H
+
+
+namespace Clenshaw
+{
+    static int const MAX_DIMENSION = 3; // number of components of an entry
+    static int const MAX_ROWS      = 2 * MAX_DIMENSION; // number of components evaluated together by evaluateRows(). More do not fit the registers
+
+    // evaluate the chebysheff series of all components of one entry at the normalized time tc
+    //
+    //   coefficients   the coefficients of the sub interval: 'dimension' blocks of 'numCoefficient' values
+    //   tc             the normalized time -1.0 <= tc <= 1.0
+    //   position       'dimension' values of the series
+    //   velocity       'dimension' values of the 1st derivative with respect to tc. May be nullptr
+    //   acceleration   'dimension' values of the 2nd derivative with respect to tc. May be nullptr
+    //   dimension      at most MAX_DIMENSION
+    //
+    // The coefficient counts of the DE files (6 to 8, 10 to 14) with 3 components use code specialized at compile time,
+    // everything else a generic version with the same sequence of operations, i.e. the same results.
+    void evaluate(double const * coefficients, int const numCoefficient, int const dimension, double const tc,
+                  double * position, double * velocity, double * acceleration);
+
+    // the components of several entries with the same number of coefficients at the same normalized time in a
+    // single pass (see Jpleph::state). 'rows': the coefficients of every component, at most MAX_ROWS. One value
+    // per component as above, with the same operations, i.e. the same results as evaluate() entry by entry.
+    // Multiples of MAX_DIMENSION rows use specialized code
+    void evaluateRows(double const * const * rows, int const numRows, int const numCoefficient, double const tc,
+                      double * position, double * velocity, double * acceleration);
+}
+
+#endif
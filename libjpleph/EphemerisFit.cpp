@@ -0,0 +1,332 @@
+//
+// re-fitting of an ephemeris file (see EphemerisFit.h)
+//
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include "EphemerisFit.h"
+#include "EphemerisFormat.h"
+#include "FortranFormat.h"
+#include "Clenshaw.h"
+
+using namespace std;
+
+namespace
+{
+    double const PI = 3.14159265358979323846;
+
+    int const NUM_BODY_ENTRIES = int(EphemerisRecord::Entry::SUN) + 1; // the entries with positions in km
+    int const CHECK_FACTOR     = 3;  // check points per coefficient and sub interval
+    int const MIN_CHECKS       = 16; // minimum number of check points per sub interval
+
+    // the state given by an entry of the record
+    Jpleph::Pair const ENTRY_PAIR[NUM_BODY_ENTRIES] =
+    {
+        { Jpleph::Target::MERCURY,       Jpleph::Target::SS_BARYCENTER },
+        { Jpleph::Target::VENUS,         Jpleph::Target::SS_BARYCENTER },
+        { Jpleph::Target::EM_BARYCENTER, Jpleph::Target::SS_BARYCENTER },
+        { Jpleph::Target::MARS,          Jpleph::Target::SS_BARYCENTER },
+        { Jpleph::Target::JUPITER,       Jpleph::Target::SS_BARYCENTER },
+        { Jpleph::Target::SATURN,        Jpleph::Target::SS_BARYCENTER },
+        { Jpleph::Target::URANUS,        Jpleph::Target::SS_BARYCENTER },
+        { Jpleph::Target::NEPTUN,        Jpleph::Target::SS_BARYCENTER },
+        { Jpleph::Target::PLUTO,         Jpleph::Target::SS_BARYCENTER },
+        { Jpleph::Target::MOON,          Jpleph::Target::EARTH },
+        { Jpleph::Target::SUN,           Jpleph::Target::SS_BARYCENTER },
+    };
+}
+
+
+// the source file on the records of the window. Positions in km, velocities in km/day
+struct EphemerisFit::Source
+{
+    Jpleph const & jpleph;
+    double      dateStart;    // start of the first record of the window
+    double      dateInterval;
+    size_t      numRecords;
+
+    void state(int const entry, size_t const record, double const offset, Jpleph::Posvel & posvel) const
+    {
+        Jpleph::Time et;
+        et.t1 = dateStart + double(record) * dateInterval;
+        et.t2 = offset;
+        jpleph.dpleph(et, ENTRY_PAIR[entry].target, ENTRY_PAIR[entry].center, posvel);
+    }
+};
+
+
+EphemerisFit::Options::Options()
+    : dateStart(-numeric_limits<double>::max()), dateEnd(numeric_limits<double>::max()), tolerance(0.001), maxCoefficients(18), maxSubIntervals(32)
+{
+}
+
+
+EphemerisFit::Result EphemerisFit::refit(string const & sourceFileName, string const & fileName, Options const & options)
+{
+    if (options.bodies.empty() || !(options.tolerance > 0.0) || options.maxCoefficients < 2 || options.maxSubIntervals < 1)
+    {
+        throw invalid_argument("EphemerisFit: no bodies, tolerance or layout limits invalid");
+    }
+
+    // the entries needed for the bodies
+    bool needed[NUM_BODY_ENTRIES] = {};
+    for (Target const body : options.bodies)
+    {
+        switch (body)
+        {
+        case Target::EARTH:
+        case Target::MOON:
+            needed[int(EphemerisRecord::Entry::EMB)]  = true;
+            needed[int(EphemerisRecord::Entry::MOON)] = true;
+            break;
+        case Target::EM_BARYCENTER:
+            needed[int(EphemerisRecord::Entry::EMB)] = true;
+            break;
+        case Target::SUN:
+            needed[int(EphemerisRecord::Entry::SUN)] = true;
+            break;
+        case Target::SS_BARYCENTER:
+            break;
+        default:
+            if (body < Target::MERCURY || body > Target::PLUTO)
+            {
+                throw invalid_argument("EphemerisFit: only bodies and barycenters can be refitted");
+            }
+            needed[int(body) - 1] = true;
+        }
+    }
+
+    Jpleph const jpleph(sourceFileName, false, true, false, Jpleph::Access::MAPPED);
+    Jpleph::Constants constants;
+    double sourceStart;
+    double sourceEnd;
+    double dateInterval;
+    jpleph.constants(constants, sourceStart, sourceEnd, dateInterval);
+
+    // the window, extended to whole records of the source
+    double const windowStart = max(options.dateStart, sourceStart);
+    double const windowEnd   = min(options.dateEnd, sourceEnd);
+    if (!(windowStart < windowEnd))
+    {
+        throw invalid_argument("EphemerisFit: window not within the ephemeris");
+    }
+    long long const sourceRecords = llround((sourceEnd - sourceStart) / dateInterval);
+    long long const first         = max(0LL, (long long)(floor((windowStart - sourceStart) / dateInterval)));
+    long long const last          = min(sourceRecords, (long long)(ceil((windowEnd - sourceStart) / dateInterval)));
+    Source const source = { jpleph, sourceStart + double(first) * dateInterval, dateInterval, size_t(last - first) };
+
+    Result result;
+    result.dateStart     = source.dateStart;
+    result.dateEnd       = source.dateStart + double(source.numRecords) * dateInterval;
+    result.dateInterval  = dateInterval;
+    result.numRecords    = source.numRecords;
+    result.positionError = 0.0;
+    result.sourceValues  = 2;
+    for (int entry = 0; entry <= int(EphemerisRecord::Entry::TT_TDB); ++entry)
+    {
+        EphemerisRecord::RecordDescriptorEntry const descriptor = jpleph.record.getDescriptorEntry(entry);
+        result.sourceValues += size_t(descriptor.numEntries) * descriptor.numCoefficient * descriptor.dimension;
+    }
+
+    // the layouts to try: by coefficients per component and record, the longer sub intervals first
+    vector<pair<int, int>> layouts; // sub intervals, coefficients
+    for (int subIntervals = 1; subIntervals <= options.maxSubIntervals; subIntervals *= 2)
+    {
+        for (int coefficients = 2; coefficients <= options.maxCoefficients; ++coefficients)
+        {
+            layouts.push_back(make_pair(subIntervals, coefficients));
+        }
+    }
+    stable_sort(layouts.begin(), layouts.end(), [](pair<int, int> const & lhs, pair<int, int> const & rhs)
+    {
+        return lhs.first * lhs.second < rhs.first * rhs.second;
+    });
+
+    vector<vector<double>> series(NUM_BODY_ENTRIES);
+    for (int entry = 0; entry < NUM_BODY_ENTRIES; ++entry)
+    {
+        if (!needed[entry])
+        {
+            continue;
+        }
+        EphemerisRecord::RecordDescriptorEntry const descriptor = jpleph.record.getDescriptorEntry(entry);
+        EntryFit fit = { entry, 0, 0, descriptor.numCoefficient, descriptor.numEntries, 0.0, 0.0 };
+        for (pair<int, int> const & layout : layouts)
+        {
+            double velocityError;
+            double const positionError = fitEntry(source, entry, layout.second, layout.first, options.tolerance, series[entry], velocityError);
+            if (positionError <= options.tolerance)
+            {
+                fit.subIntervals  = layout.first;
+                fit.coefficients  = layout.second;
+                fit.positionError = positionError;
+                fit.velocityError = velocityError;
+                break;
+            }
+        }
+        if (fit.coefficients == 0)
+        {
+            ostringstream message;
+            message << "EphemerisFit: tolerance not reached for entry " << entry << " with " << options.maxCoefficients
+                    << " coefficients and " << options.maxSubIntervals << " sub intervals";
+            throw runtime_error(message.str());
+        }
+        result.entries.push_back(fit);
+        result.positionError = max(result.positionError, fit.positionError);
+    }
+
+    // the record layout: the fitted entries in the order of the source, the others are not present
+    vector<EphemerisFormat::Descriptor> descriptors;
+    int index = 3; // Fortran index of the first coefficient, after the dates
+    size_t fitted = 0;
+    for (int entry = 0; entry < FortranFormat::NUM_ENTRIES; ++entry)
+    {
+        if (entry < NUM_BODY_ENTRIES && needed[entry])
+        {
+            EntryFit const & fit = result.entries[fitted++];
+            descriptors.push_back({ index, fit.coefficients, fit.subIntervals, 3 });
+            index += fit.coefficients * fit.subIntervals * 3;
+        }
+        else
+        {
+            descriptors.push_back({ index, 0, 0, FortranFormat::DIMENSIONS[entry] });
+        }
+    }
+    result.numValues = size_t(index - 1);
+
+    vector<string> constantNames;
+    vector<double> constantValues;
+    for (Jpleph::Constant const & constant : constants)
+    {
+        constantNames.push_back(constant.name);
+        constantValues.push_back(constant.value);
+    }
+    ostringstream title;
+    title << "Refitted from " << sourceFileName;
+    ostringstream bodies;
+    bodies << "Entries";
+    for (EntryFit const & fit : result.entries)
+    {
+        bodies << " " << fit.entry;
+    }
+    bodies << ", tolerance " << options.tolerance << " km";
+    ostringstream window;
+    window << fixed << "Start Epoch: JED= " << result.dateStart << "  Final Epoch: JED= " << result.dateEnd;
+    vector<string> const ttl = { title.str().substr(0, FortranFormat::TTL_LENGTH), bodies.str().substr(0, FortranFormat::TTL_LENGTH),
+                                 window.str().substr(0, FortranFormat::TTL_LENGTH) };
+
+    EphemerisFormat::Header header;
+    vector<char> head = EphemerisFormat::head(ttl, constantNames, constantValues, descriptors, header);
+    header.au           = double(jpleph.au);
+    header.emrat        = double(jpleph.emrat);
+    header.denum        = int32_t(jpleph.denum);
+    header.dateStart    = result.dateStart;
+    header.dateEnd      = result.dateEnd;
+    header.dateInterval = dateInterval;
+
+    ofstream file(fileName, ofstream::binary);
+    file.write(head.data(), streamsize(head.size()));
+    vector<double> values(result.numValues);
+    vector<double> buffer;
+    for (size_t record = 0; record < source.numRecords; ++record)
+    {
+        values[0] = source.dateStart + double(record) * dateInterval;
+        values[1] = values[0] + dateInterval;
+        size_t position = 2;
+        for (EntryFit const & fit : result.entries)
+        {
+            size_t const size = size_t(fit.subIntervals) * fit.coefficients * 3;
+            copy(series[fit.entry].begin() + record * size, series[fit.entry].begin() + (record + 1) * size, values.begin() + position);
+            position += size;
+        }
+        EphemerisFormat::record(values.data(), values.size(), header, buffer);
+        file.write(reinterpret_cast<char const *>(buffer.data()), streamsize(buffer.size() * sizeof(double)));
+    }
+    memcpy(head.data(), &header, sizeof(header));
+    file.seekp(0);
+    file.write(head.data(), streamsize(sizeof(header)));
+    result.bytes = size_t(header.recordOffset + header.numRecords * header.recordStride);
+    if (!file.good())
+    {
+        throw runtime_error("EphemerisFit: could not write " + fileName);
+    }
+    return result;
+}
+
+
+// interpolate the positions of 'entry' at the chebysheff nodes of every sub interval and compare with the source
+// at the midpoints of equal parts of it, leaving out the ends (the source may switch to its next sub interval there).
+// The series of the records go to 'series' (sub intervals, components, coefficients). Returns the maximum position
+// error, stops at the first one above 'tolerance'
+double EphemerisFit::fitEntry(Source const & source, int const entry, int const coefficients, int const subIntervals,
+                              double const tolerance, vector<double> & series, double & velocityError)
+{
+    int const n      = coefficients;
+    int const checks = max(CHECK_FACTOR * n, MIN_CHECKS);
+    double const length = source.dateInterval / subIntervals; // days
+
+    series.assign(source.numRecords * subIntervals * 3 * n, 0.0);
+    vector<double> samples(size_t(3) * n);
+    Jpleph::Posvel posvel;
+    double positionError = 0.0;
+    velocityError = 0.0;
+    for (size_t record = 0; record < source.numRecords; ++record)
+    {
+        for (int sub = 0; sub < subIntervals; ++sub)
+        {
+            double const mid = (sub + 0.5) * length;
+            for (int k = 0; k < n; ++k)
+            {
+                source.state(entry, record, mid + 0.5 * length * cos(PI * (k + 0.5) / n), posvel);
+                for (int i = 0; i < 3; ++i)
+                {
+                    samples[i * n + k] = posvel.pos[i];
+                }
+            }
+
+            double * const c = &series[((record * subIntervals) + sub) * 3 * n];
+            for (int i = 0; i < 3; ++i)
+            {
+                for (int j = 0; j < n; ++j)
+                {
+                    double sum = 0.0;
+                    for (int k = 0; k < n; ++k)
+                    {
+                        sum += samples[i * n + k] * cos(PI * j * (k + 0.5) / n);
+                    }
+                    c[i * n + j] = (j == 0 ? 1.0 : 2.0) * sum / n;
+                }
+            }
+
+            for (int m = 0; m < checks; ++m)
+            {
+                double const tc = -1.0 + (2.0 * m + 1.0) / checks;
+                source.state(entry, record, mid + 0.5 * length * tc, posvel);
+                double position[3];
+                double velocity[3];
+                Clenshaw::evaluate(c, n, 3, tc, position, velocity, nullptr);
+                double dp = 0.0;
+                double dv = 0.0;
+                for (int i = 0; i < 3; ++i)
+                {
+                    dp += (position[i] - posvel.pos[i]) * (position[i] - posvel.pos[i]);
+                    double const v = velocity[i] * 2.0 / length - posvel.vel[i];
+                    dv += v * v;
+                }
+                positionError = max(positionError, sqrt(dp));
+                velocityError = max(velocityError, sqrt(dv));
+                if (positionError > tolerance)
+                {
+                    return positionError;
+                }
+            }
+        }
+    }
+    return positionError;
+}
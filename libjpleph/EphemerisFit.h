@@ -0,0 +1,75 @@
+//
+// re-fitting of an ephemeris file to a subset of the bodies, a time window and a precision (see refiteph)
+//
+// Every entry needed for the bodies (e.g. the Earth-Moon barycenter and the geocentric Moon for the Earth) is fitted
+// anew: its positions in the source file are interpolated at the chebysheff nodes of every sub interval and the
+// result is checked against the source at a denser grid. The layouts are tried by increasing number of coefficients
+// per record, for the same number the longer sub intervals first; the first one within the tolerance is taken.
+// The records keep the interval of the source file, the window is extended to whole records.
+// The result is written in the v2 format (see EphemerisFormat.h) with the constants of the source. Entries not needed
+// are not present in the file, dpleph throws invalid_argument for the bodies depending on them.
+//
+#pragma once
+#ifndef EPHEMERISFIT_H
+#define EPHEMERISFIT_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "jpleph.h"
+
+
+class EphemerisFit
+{
+public:
+    typedef Jpleph::Target Target;
+
+    struct Options
+    {
+        Options();
+        std::vector<Target> bodies; // Mercury ... Pluto, Moon, Sun, Earth, Earth-Moon barycenter
+        double dateStart;           // window in julian ephemeris days, default: the whole source file
+        double dateEnd;
+        double tolerance;           // maximum position error of every entry in km
+        int    maxCoefficients;     // per component and sub interval
+        int    maxSubIntervals;     // per record
+    };
+
+    // the layout chosen for an entry of the record (EphemerisRecord::Entry) and the errors reached with it
+    struct EntryFit
+    {
+        int    entry;
+        int    coefficients;
+        int    subIntervals;
+        int    sourceCoefficients;
+        int    sourceSubIntervals;
+        double positionError; // km
+        double velocityError; // km/day
+    };
+
+    struct Result
+    {
+        std::vector<EntryFit> entries;
+        double      dateStart;
+        double      dateEnd;
+        double      dateInterval;
+        std::size_t numRecords;
+        std::size_t numValues;       // doubles per record of the new file
+        std::size_t sourceValues;    // doubles per record of the source file
+        double      positionError;   // maximum of the entries, km
+        std::size_t bytes;           // size of the new file
+    };
+
+    // fit the entries for options.bodies and write the file 'fileName'. Throws invalid_argument for invalid
+    // options, runtime_error if an entry can't be fitted within the tolerance or the file can't be written
+    static Result refit(std::string const & sourceFileName, std::string const & fileName, Options const & options);
+
+private:
+    struct Source;
+
+    static double fitEntry(Source const & source, int const entry, int const coefficients, int const subIntervals,
+                           double const tolerance, std::vector<double> & series, double & velocityError);
+};
+
+#endif
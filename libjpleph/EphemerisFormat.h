@@ -0,0 +1,217 @@
+//
+// layout of the v2 binary ephemeris file (written by asc2eph -2 and refiteph, read by Jpleph)
+//
+//   offset 0                Header
+//   header.tocOffset        table of contents: header.numSections Section entries
+//   section.offset          the sections, 8 byte aligned:
+//                             TTL              the title lines, NUL terminated strings
+//                             CONSTANT_NAMES   NUL terminated strings
+//                             CONSTANT_VALUES  double
+//                             DESCRIPTOR       one Descriptor per entry of the record (GROUP 1050)
+//   header.recordOffset     the records, page aligned. Record k starts at recordOffset + k * recordStride (a multiple of
+//                           RECORD_ALIGNMENT) with header.numValues doubles (start date, end date, coefficients).
+//                           The last 8 bytes of the stride hold the checksum of the values, the bytes in between are 0.
+//
+// The compressed container (header.version VERSION_COMPRESSED) has the same header and sections. Every record is a
+// block compressed on its own (see RecordCodec.h), header.recordStride is 0. The RECORD_INDEX section is the last entry
+// of the table of contents and follows the records: the start of every block relative to header.recordOffset and
+// the end of the last block (header.numRecords + 1 values of uint64).
+//
+// All values are stored in the byte order of the writing machine, header.endianness tells which one.
+// The v1 format is a stream of size prefixed vectors and NUL terminated strings (see asc2eph writeHeader)
+//
+#pragma once
+#ifndef EPHEMERISFORMAT_H
+#define EPHEMERISFORMAT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+namespace EphemerisFormat
+{
+    static char const          MAGIC[8]         = { 'J', 'P', 'L', 'E', 'P', 'H', 'v', '2' };
+    static std::uint32_t const VERSION          = 2;
+    static std::uint32_t const VERSION_COMPRESSED = 3;        // records compressed block by block
+    static std::uint32_t const ENDIANNESS       = 0x01020304; // reads as 0x04030201 with the other byte order
+    static std::size_t const   RECORD_ALIGNMENT = 64;         // cache line
+    static std::size_t const   PAGE_SIZE        = 4096;       // alignment of the first record
+
+    enum class SectionType : std::uint32_t
+    {
+        TTL             = 1,
+        CONSTANT_NAMES  = 2,
+        CONSTANT_VALUES = 3,
+        DESCRIPTOR      = 4,
+        RECORD_INDEX    = 5, // compressed container only
+    };
+
+    struct Header
+    {
+        char          magic[8];
+        std::uint32_t version;
+        std::uint32_t endianness;
+        std::uint32_t headerSize;   // sizeof(Header)
+        std::uint32_t numSections;
+        std::uint64_t tocOffset;
+        double        dateStart;
+        double        dateEnd;
+        double        dateInterval;
+        double        au;
+        double        emrat;
+        std::int32_t  denum;
+        std::int32_t  numEntries;   // number of Descriptor entries
+        std::uint64_t numRecords;
+        std::uint64_t recordOffset;
+        std::uint64_t recordStride; // bytes from one record to the next
+        std::uint32_t numValues;    // doubles per record
+        std::uint32_t reserved;
+    };
+
+    struct Section
+    {
+        std::uint32_t type;         // SectionType
+        std::uint32_t reserved;
+        std::uint64_t offset;
+        std::uint64_t size;         // bytes
+    };
+
+    struct Descriptor
+    {
+        std::int32_t index;         // Fortran index of the first coefficient in the record
+        std::int32_t order;         // number of coefficients per component
+        std::int32_t entries;       // number of sub intervals
+        std::int32_t dimension;     // number of components
+    };
+
+    static_assert(sizeof(Header) == 112, "EphemerisFormat::Header must not contain padding");
+    static_assert(sizeof(Section) == 24, "EphemerisFormat::Section must not contain padding");
+    static_assert(sizeof(Descriptor) == 16, "EphemerisFormat::Descriptor must not contain padding");
+
+    inline std::size_t align(std::size_t const value, std::size_t const alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // bytes per record: the values and the checksum, rounded up to the record alignment
+    inline std::size_t recordStride(std::size_t const numValues)
+    {
+        return align((numValues + 1) * sizeof(double), RECORD_ALIGNMENT);
+    }
+
+    // FNV-1a over the 64 bit words of the values
+    inline std::uint64_t checksum(double const * values, std::size_t const numValues)
+    {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (std::size_t i = 0; i < numValues; ++i)
+        {
+            std::uint64_t word;
+            std::memcpy(&word, values + i, sizeof(word));
+            hash ^= word;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // the header, the table of contents and the sections up to the first record. 'header' is set up for them, the
+    // caller fills in au, emrat, denum and the dates and writes it to the start of the returned bytes.
+    // The record layout (numValues, recordStride, numRecords) follows with the records (see record()).
+    // 'compressed': the table of contents ends with an empty RECORD_INDEX section, see indexSection()
+    inline std::vector<char> head(std::vector<std::string> const & ttl, std::vector<std::string> const & constantNames,
+                                  std::vector<double> const & constantValues, std::vector<Descriptor> const & descriptors,
+                                  Header & header, bool const compressed = false)
+    {
+        std::vector<char> ttlSection;
+        for (std::string const & line : ttl)
+        {
+            ttlSection.insert(ttlSection.end(), line.c_str(), line.c_str() + line.size() + 1);
+        }
+        std::vector<char> namesSection;
+        for (std::string const & name : constantNames)
+        {
+            namesSection.insert(namesSection.end(), name.c_str(), name.c_str() + name.size() + 1);
+        }
+
+        struct Content
+        {
+            SectionType  type;
+            void const * data;
+            std::size_t  size;
+        };
+        Content const contents[] =
+        {
+            { SectionType::TTL,             ttlSection.data(),     ttlSection.size() },
+            { SectionType::CONSTANT_NAMES,  namesSection.data(),   namesSection.size() },
+            { SectionType::CONSTANT_VALUES, constantValues.data(), constantValues.size() * sizeof(double) },
+            { SectionType::DESCRIPTOR,      descriptors.data(),    descriptors.size() * sizeof(Descriptor) },
+            { SectionType::RECORD_INDEX,    nullptr,               0 },
+        };
+        std::size_t const numSections = sizeof(contents) / sizeof(contents[0]) - (compressed ? 0 : 1);
+
+        std::vector<char> bytes(sizeof(Header) + numSections * sizeof(Section));
+        for (std::size_t i = 0; i < numSections; ++i)
+        {
+            Section const section = { std::uint32_t(contents[i].type), 0, align(bytes.size(), sizeof(double)), contents[i].size };
+            std::memcpy(bytes.data() + sizeof(Header) + i * sizeof(section), &section, sizeof(section));
+            bytes.resize(std::size_t(section.offset + section.size));
+            if (section.size > 0)
+            {
+                std::memcpy(bytes.data() + section.offset, contents[i].data, contents[i].size);
+            }
+        }
+
+        header = Header();
+        std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version      = compressed ? VERSION_COMPRESSED : VERSION;
+        header.endianness   = ENDIANNESS;
+        header.headerSize   = sizeof(Header);
+        header.numSections  = std::uint32_t(numSections);
+        header.tocOffset    = sizeof(Header);
+        header.numEntries   = std::int32_t(descriptors.size());
+        header.recordOffset = align(bytes.size(), PAGE_SIZE);
+        bytes.resize(std::size_t(header.recordOffset));
+        return bytes;
+    }
+
+    // a record as written to the file: the values, zero padding and the checksum at the end of the stride.
+    // The first record fixes the record layout of 'header', false if the number of values differs from it
+    template<typename T>
+    bool record(T const * values, std::size_t const numValues, Header & header, std::vector<double> & buffer)
+    {
+        if (header.numRecords == 0)
+        {
+            header.numValues    = std::uint32_t(numValues);
+            header.recordStride = recordStride(numValues);
+        }
+        if (numValues != header.numValues)
+        {
+            return false;
+        }
+
+        buffer.assign(std::size_t(header.recordStride / sizeof(double)), 0.0);
+        std::copy(values, values + numValues, buffer.begin());
+        std::uint64_t const sum = checksum(buffer.data(), numValues);
+        std::memcpy(&buffer.back(), &sum, sizeof(sum));
+        ++header.numRecords;
+        return true;
+    }
+
+    // compressed container: the entry of the RECORD_INDEX section in the table of contents, written by head() as
+    // placeholder. 'offset': where the index is written behind the records. Returns the position of the entry
+    inline std::uint64_t indexSection(Header const & header, std::uint64_t const offset, Section & section)
+    {
+        section = Section{ std::uint32_t(SectionType::RECORD_INDEX), 0, offset, (header.numRecords + 1) * sizeof(std::uint64_t) };
+        return header.tocOffset + (header.numSections - 1) * sizeof(Section);
+    }
+
+    inline bool isV2(char const * start, std::size_t const size)
+    {
+        return size >= sizeof(MAGIC) && std::memcmp(start, MAGIC, sizeof(MAGIC)) == 0;
+    }
+}
+
+#endif
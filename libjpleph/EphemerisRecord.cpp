@@ -1,18 +1,87 @@
 
 #include <cassert>
+#include <algorithm>
+#include <iomanip>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <numeric>
+#include <bitset>
 //#include "Eigen"
 #include "jplephread.h"
 #include "EphemerisRecord.h"
+#include "EphemerisFormat.h"
+#include "RecordCodec.h"
+#include "Clenshaw.h"
 
 
 
 
 using namespace std;
 
-EphemerisRecord::EphemerisRecord(ifstream & jpleph, bool & good):good(good), jpleph(jpleph), recordLength(0), currentPosition(0), capacity(10), numElements(0) {} 
+namespace
+{
+    static int const SEQUENTIAL_RUN   = 2;  // number of consecutive steps in one direction that start the read ahead
+    static int const MAX_COEFFICIENTS = 64; // upper limit for the number of coefficients of a derived series
+    static size_t const MAX_TERMS     = 4;  // upper limit for the number of terms of a derivation (two per body)
+    static double const PI = 3.14159265358979323846;
+}
+
+// the cache holds the records read ahead in addition to the records in use
+EphemerisRecord::EphemerisRecord(ifstream & jpleph, bool & good, Access const access, Prefetch const & prefetch, size_t const capacity,
+                                 shared_ptr<CacheBudget> const & budget)
+    : good(good), numElements(0), jpleph(jpleph), recordLength(0), currentPosition(0), derivedSize(0), singlePrecision(false), access(access), numRecords(0), fixedValues(0), checksums(false),
+      capacity(capacity == UNBOUNDED_CAPACITY || budget != nullptr ? UNBOUNDED_CAPACITY : max(capacity, size_t(1)) + 2 * size_t(max(prefetch.depth, 0))),
+      allEntries(0), usedEntries(0), cacheBudget(budget), clockHand(0),
+      prefetch(prefetch), runLength(0), runDirection(0), pendingRecord(0), pendingDirection(0), stopPrefetch(false), budgetBytes(0),
+      lastRecord(-1), requests(0), misses(0), evictions(0), prefetched(0), bytesRead(0), ioNanoseconds(0), entryLoads(0), decoded(0), decodeNanoseconds(0)
+{
+    for (atomic<size_t> & distance : distances)
+    {
+        distance.store(0);
+    }
+}
+
+EphemerisRecord::Prefetch::Prefetch(int const depth, size_t const bytesPerSecond) : depth(depth), bytesPerSecond(bytesPerSecond) {}
+
+
+EphemerisRecord::CacheBudget::CacheBudget(size_t const records) : records(max(records, size_t(1))), inUse(0) {}
+
+size_t EphemerisRecord::CacheBudget::capacity() const
+{
+    return records;
+}
+
+size_t EphemerisRecord::CacheBudget::used() const
+{
+    return inUse.load(memory_order_relaxed);
+}
 
+bool EphemerisRecord::CacheBudget::acquire()
+{
+    size_t used = inUse.load();
+    while (used < records)
+    {
+        if (inUse.compare_exchange_weak(used, used + 1))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void EphemerisRecord::CacheBudget::force()
+{
+    inUse.fetch_add(1);
+}
+
+void EphemerisRecord::CacheBudget::release(size_t const count)
+{
+    inUse.fetch_sub(count);
+}
 
-void EphemerisRecord::operator()() // to be called when input stream is properly positioned
+
+void EphemerisRecord::operator()(string const & jplFileName) // to be called when input stream is properly positioned
 {
 
     //first read the record descriptor
@@ -22,13 +91,145 @@ void EphemerisRecord::operator()() // to be called when input stream is properly
         recordStart = jpleph.tellg();
     }
 
-   readRecord(0); // read record 0 to set up the data. Could that be avoided?
+   unique_ptr<RecordBuffer> first(readRecord(0)); // read record 0 to set up the data. Could that be avoided?
    if(good)
    {
       currentPosition = jpleph.tellg();
       recordLength    = currentPosition - recordStart;
    }
-    
+
+   setUp(jplFileName, *first);
+}
+
+
+void EphemerisRecord::operator()(string const & jplFileName, FixedLayout const & layout)
+{
+    recordDescriptor = layout.descriptor;
+    countElements();
+    bool const compressed = !layout.blocks.empty();
+    if (   layout.numValues < numElements || layout.numRecords <= 0
+        || (!compressed && layout.recordStride < streamoff((layout.numValues + (layout.checksums ? 1 : 0)) * sizeof(double)))
+        || (compressed && (   layout.blocks.size() != size_t(layout.numRecords) + 1 || layout.order.size() != size_t(layout.numValues)
+                           || !is_sorted(layout.blocks.begin(), layout.blocks.end()))))
+    {
+        good = false;
+        throw runtime_error("EphemerisRecord: inconsistent record layout");
+    }
+
+    fixedValues  = layout.numValues;
+    checksums    = layout.checksums;
+    recordStart  = layout.recordOffset;
+    recordLength = layout.recordStride;
+    numRecords   = layout.numRecords;
+
+    unique_ptr<RecordBuffer> first;
+    if (compressed)
+    {
+        blocks       = layout.blocks;
+        blockOrder   = layout.order;
+        recordLength = streamoff(blocks.back() / uint64_t(numRecords));
+        access       = Access::STREAM;
+
+        vector<unsigned char> block;
+        first = make_unique<RecordBuffer>();
+        if (!readBlock(0, block) || !decodeBlock(block, *first))
+        {
+            good = false;
+            throw runtime_error("EphemerisRecord: could not read record or checksum error");
+        }
+    }
+    else
+    {
+        first.reset(readRecord(0));
+    }
+    setUp(jplFileName, *first);
+}
+
+
+// v1 files: the number of records follows from the file size. v2 files give it in the header
+void EphemerisRecord::setUp(string const & jplFileName, RecordBuffer & first)
+{
+   if (access == Access::MAPPED)
+   {
+       // the records are served from the mapping. The stream is only used for the header
+       mapping = make_unique<MappedFile>(jplFileName);
+
+       // the values of a v1 record follow its size prefix, i.e. they are only aligned if the prefix happens to
+       // leave them so. Misaligned records cannot be used in place: fall back to Access::STREAM (see getAccess())
+       uintptr_t const firstValues = uintptr_t(mapping->data()) + uintptr_t(streamoff(recordStart))
+                                   + (fixedValues == 0 ? sizeof(vector<double>::size_type) : 0);
+       if (firstValues % alignof(double) != 0 || recordLength % streamoff(alignof(double)) != 0)
+       {
+           mapping.reset();
+           access = Access::STREAM;
+       }
+   }
+
+   if (access == Access::MAPPED)
+   {
+       if (fixedValues == 0)
+       {
+           numRecords = int((streamoff(mapping->size()) - streamoff(recordStart)) / recordLength);
+       }
+       else
+       {
+           if (streamoff(mapping->size()) < streamoff(recordStart) + numRecords * recordLength)
+           {
+               throw runtime_error("EphemerisRecord: file shorter than given in its header");
+           }
+           if (checksums)
+           {
+               verified = make_unique<atomic<bool>[]>(size_t(numRecords));
+           }
+       }
+   }
+   else
+   {
+       if (fixedValues == 0)
+       {
+           jpleph.seekg(0, ios::end);
+           numRecords = int((streamoff(jpleph.tellg()) - streamoff(recordStart)) / recordLength);
+           jpleph.seekg(currentPosition);
+       }
+       slots = vector<Slot>(numRecords);
+
+       // the entries of the file (Access::PARTIAL reads them one by one)
+       for (int e = 0; e < min(int(recordDescriptor.size()), int(NUM_ENTRIES)); ++e)
+       {
+           if (recordDescriptor[e].recordIndex >= 2 && recordDescriptor[e].numEntries > 0)
+           {
+               entryOrder.push_back(e);
+               allEntries |= uint32_t(1) << e;
+           }
+       }
+       sort(entryOrder.begin(), entryOrder.end(),
+            [this](int const lhs, int const rhs) { return recordDescriptor[lhs].recordIndex < recordDescriptor[rhs].recordIndex; });
+
+       // keep record 0 in the cache
+       if (cacheBudget != nullptr)
+       {
+           cacheBudget->force();
+       }
+       cache.push_back(make_unique<CachedRecord>());
+       cache.back()->values    = std::move(first);
+       cache.back()->numRecord = 0;
+       cache.back()->resident.store(allEntries);
+       slots[0].cached.store(cache.back().get());
+
+       // set up the complete pool now. Loading a record into an entry reuses its buffer, i.e. once constructed
+       // the cache does not allocate any memory as long as not all entries are pinned at the same time.
+       // An unbounded cache is filled on demand
+       while (capacity != UNBOUNDED_CAPACITY && cache.size() < min(capacity, size_t(numRecords)))
+       {
+           cache.push_back(make_unique<CachedRecord>());
+           cache.back()->values.reserve(cache.front()->values.size());
+       }
+   }
+
+   if (prefetch.depth > 0 && numRecords > 1)
+   {
+       prefetchThread = thread(&EphemerisRecord::prefetchLoop, this);
+   }
 }
 
 
@@ -67,6 +268,13 @@ void EphemerisRecord::getDescriptor()
         recordDescriptor.push_back(RecordDescriptorEntry(index[i] - 1, order[i], subRecords[i], dimensions[i]));  // change Fortran index into C++ index (base 1 -> base 0)
     }
 
+    countElements();
+}
+
+
+void EphemerisRecord::countElements()
+{
+    numElements = 0;
     for (size_t i = 0; i < recordDescriptor.size(); ++i)
     {
         numElements += recordDescriptor[i].numEntries * (recordDescriptor[i].numCoefficient)*(recordDescriptor[i].dimension); // total number of double coefficients  
@@ -75,13 +283,355 @@ void EphemerisRecord::getDescriptor()
 }
 
 
-EphemerisRecord::RecordType  & EphemerisRecord::operator[](int const numRecord)
+// the sub intervals of the series are the finest of the terms, the number of coefficients the largest
+EphemerisRecord::DerivedSeries EphemerisRecord::prepareSeries(Derivation const & derivation) const
+{
+    if (derivation.terms.size() > MAX_TERMS)
+    {
+        throw invalid_argument("EphemerisRecord::deriveSeries: too many terms");
+    }
+
+    int subIntervals = 1;
+    int coefficients = 1;
+    for (Derivation::Term const & term : derivation.terms)
+    {
+        if (term.entry < Entry::MERCURY || term.entry > Entry::SUN)
+        {
+            throw invalid_argument("EphemerisRecord::deriveSeries: only bodies can be combined");
+        }
+        RecordDescriptorEntry const & descriptor = recordDescriptor[int(term.entry)];
+        if (descriptor.recordIndex <= 0 || descriptor.numEntries <= 0 || descriptor.dimension != 3)
+        {
+            throw invalid_argument("EphemerisRecord::deriveSeries: body not in ephemeris file");
+        }
+        subIntervals = lcm(subIntervals, descriptor.numEntries);
+        coefficients = max(coefficients, descriptor.numCoefficient);
+    }
+    if (coefficients > MAX_COEFFICIENTS)
+    {
+        throw invalid_argument("EphemerisRecord::deriveSeries: too many coefficients");
+    }
+
+    DerivedSeries series;
+    series.derivation     = derivation;
+    series.descriptor     = -1;
+    series.numCoefficient = coefficients;
+    series.numEntries     = subIntervals;
+    series.nodes.resize(coefficients);
+    series.transform.resize(coefficients * coefficients);
+    for (int k = 0; k < coefficients; ++k)
+    {
+        series.nodes[k] = cos(PI * (k + 0.5) / coefficients);
+        for (int j = 0; j < coefficients; ++j)
+        {
+            series.transform[j * coefficients + k] = cos(PI * j * (k + 0.5) / coefficients) * (j == 0 ? 1.0 : 2.0) / coefficients;
+        }
+    }
+    return series;
+}
+
+
+// the derived series are appended to the descriptor of the file. They are computed for the records already loaded,
+// the other entries of the cache reserve the memory for them (Access::MAPPED: the cache is set up now)
+int EphemerisRecord::deriveSeries(vector<Derivation> const & derivations)
+{
+    if (!derivedSeries.empty())
+    {
+        throw invalid_argument("EphemerisRecord::deriveSeries: derived series already set up");
+    }
+
+    while (recordDescriptor.size() < size_t(NUM_ENTRIES))
+    {
+        recordDescriptor.push_back(RecordDescriptorEntry(-1, 0, 0, 0)); // not in the file
+    }
+    int const first = int(recordDescriptor.size());
+
+    for (Derivation const & derivation : derivations)
+    {
+        DerivedSeries series = prepareSeries(derivation);
+        series.descriptor = int(recordDescriptor.size());
+        derivedSeries.push_back(series);
+
+        recordDescriptor.push_back(RecordDescriptorEntry(numElements + int(derivedSize), series.numCoefficient, series.numEntries, 3));
+        derivedSize += size_t(series.numEntries) * series.numCoefficient * 3;
+    }
+
+    if (access == Access::MAPPED)
+    {
+        cacheMapped();
+    }
+    else
+    {
+        for (unique_ptr<CachedRecord> const & cached : cache)
+        {
+            if (cached->numRecord >= 0)
+            {
+                completeRecord(*cached);
+                computeDerived(cached->values.data(), cached->derived);
+                if (singlePrecision)
+                {
+                    computeSingle(cached->values.data(), *cached);
+                }
+            }
+            else
+            {
+                cached->derived.reserve(derivedSize);
+            }
+        }
+    }
+    return first;
+}
+
+
+// the records already loaded are converted now
+void EphemerisRecord::convertSingle()
+{
+    if (singlePrecision)
+    {
+        return;
+    }
+    singlePrecision = true;
+
+    if (access == Access::MAPPED)
+    {
+        cacheMapped();
+        return;
+    }
+    for (unique_ptr<CachedRecord> const & cached : cache)
+    {
+        if (cached->numRecord >= 0)
+        {
+            completeRecord(*cached);
+            computeSingle(cached->values.data(), *cached);
+        }
+        else
+        {
+            cached->single.reserve(size_t(numElements) + derivedSize);
+        }
+    }
+}
+
+
+// the records themselves are used in place, the cache holds what is computed from them. The pool is set up once
+void EphemerisRecord::cacheMapped()
+{
+    if (slots.empty())
+    {
+        slots = vector<Slot>(numRecords);
+    }
+    while (capacity != UNBOUNDED_CAPACITY && cache.size() < min(capacity, size_t(numRecords)))
+    {
+        cache.push_back(make_unique<CachedRecord>());
+    }
+    for (unique_ptr<CachedRecord> const & cached : cache)
+    {
+        cached->derived.reserve(derivedSize);
+        if (singlePrecision)
+        {
+            cached->single.reserve(size_t(numElements) + derivedSize);
+        }
+    }
+}
+
+
+// the values of the file up to the last coefficient followed by the derived series, i.e. indexed like the doubles
+void EphemerisRecord::computeSingle(double const * values, CachedRecord & cached) const
+{
+    cached.single.resize(size_t(numElements) + cached.derived.size());
+    float * out = cached.single.data();
+    for (int i = 0; i < numElements; ++i)
+    {
+        *out++ = float(values[i]);
+    }
+    for (double const value : cached.derived)
+    {
+        *out++ = float(value);
+    }
+}
+
+
+void EphemerisRecord::computeDerived(double const * values, RecordBuffer & derived) const
+{
+    derived.resize(derivedSize);
+
+    for (DerivedSeries const & series : derivedSeries)
+    {
+        double const * terms[MAX_TERMS];
+        for (size_t t = 0; t < series.derivation.terms.size(); ++t)
+        {
+            terms[t] = values + recordDescriptor[int(series.derivation.terms[t].entry)].recordIndex;
+        }
+        double * out = derived.data() + (recordDescriptor[series.descriptor].recordIndex - numElements);
+        for (int sub = 0; sub < series.numEntries; ++sub)
+        {
+            combineSeries(series, terms, sub, out + sub * series.numCoefficient * 3);
+        }
+    }
+}
+
+
+void EphemerisRecord::deriveCoefficients(DerivedSeries const & series, RecordType const & record, int const sub, double * coefficients) const
+{
+    if (sub < 0 || sub >= series.numEntries)
+    {
+        throw out_of_range("EphemerisRecord::deriveCoefficients: invalid sub intervall");
+    }
+    double const * terms[MAX_TERMS];
+    for (size_t t = 0; t < series.derivation.terms.size(); ++t)
+    {
+        RecordDescriptorEntry const & entry = recordDescriptor[int(series.derivation.terms[t].entry)];
+        terms[t] = record.coefficients(size_t(entry.recordIndex), size_t(entry.numEntries) * entry.numCoefficient * 3);
+    }
+    combineSeries(series, terms, sub, coefficients);
+}
+
+
+// the terms with the sub intervals of the derived series are added up coefficient by coefficient, the ones with longer
+// sub intervals are evaluated at the nodes of the derived series and transformed to coefficients.
+// 'terms': the coefficients of the entry of every term
+void EphemerisRecord::combineSeries(DerivedSeries const & series, double const * const * terms, int const sub, double * out) const
+{
+    int const nsub = series.numEntries;
+    int const n    = series.numCoefficient;
+
+    double coefficients[3][MAX_COEFFICIENTS] = {};
+    double samples[3][MAX_COEFFICIENTS]      = {};
+    bool sampled = false;
+
+    for (size_t t = 0; t < series.derivation.terms.size(); ++t)
+    {
+        Derivation::Term const & term = series.derivation.terms[t];
+        RecordDescriptorEntry const & entry = recordDescriptor[int(term.entry)];
+        int const ratio = nsub / entry.numEntries; // sub intervals of the derived series per sub intervall of the term
+        double const * c = terms[t] + (sub / ratio) * entry.numCoefficient * 3;
+        if (ratio == 1)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                for (int j = 0; j < entry.numCoefficient; ++j)
+                {
+                    coefficients[i][j] += term.factor * c[i * entry.numCoefficient + j];
+                }
+            }
+            continue;
+        }
+
+        // the nodes of the derived sub intervall in the normalized time of the term
+        int const part = sub % ratio;
+        for (int k = 0; k < n; ++k)
+        {
+            double p[3];
+            Clenshaw::evaluate(c, entry.numCoefficient, 3, -1.0 + (2.0 * part + 1.0 + series.nodes[k]) / ratio, p, nullptr, nullptr);
+            for (int i = 0; i < 3; ++i)
+            {
+                samples[i][k] += term.factor * p[i];
+            }
+        }
+        sampled = true;
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < n; ++j)
+        {
+            double value = coefficients[i][j];
+            if (sampled)
+            {
+                for (int k = 0; k < n; ++k)
+                {
+                    value += series.transform[j * n + k] * samples[i][k];
+                }
+            }
+            out[i * n + j] = value;
+        }
+    }
+}
+
+
+EphemerisRecord::RecordType EphemerisRecord::operator[](int const numRecord) const
+{
+    noteRequest(numRecord);
+
+    if (access == Access::MAPPED)
+    {
+        if (derivedSeries.empty() && !singlePrecision)
+        {
+            return mappedRecord(numRecord);
+        }
+        size_t numValues;
+        double const * values = mappedValues(numRecord, numValues);
+        return RecordType(values, numValues, getRecord(numRecord), recordDescriptor, numElements);
+    }
+
+    return RecordType(getRecord(numRecord), recordDescriptor, numElements, access == Access::PARTIAL ? this : nullptr);
+}
+
+
+EphemerisRecord::Access EphemerisRecord::getAccess() const
+{
+    return access;
+}
+
+
+EphemerisRecord::Statistics EphemerisRecord::statistics() const
+{
+    Statistics result;
+    result.requests   = requests.load(memory_order_relaxed);
+    result.misses     = misses.load(memory_order_relaxed);
+    result.hits       = access != Access::MAPPED && result.requests > result.misses ? result.requests - result.misses : 0;
+    result.evictions  = evictions.load(memory_order_relaxed);
+    result.prefetched = prefetched.load(memory_order_relaxed);
+    result.bytesRead  = bytesRead.load(memory_order_relaxed);
+    result.ioSeconds  = ioNanoseconds.load(memory_order_relaxed) * 1.0e-9;
+    result.entryLoads = entryLoads.load(memory_order_relaxed);
+    result.decoded       = decoded.load(memory_order_relaxed);
+    result.decodeSeconds = decodeNanoseconds.load(memory_order_relaxed) * 1.0e-9;
+    if (derivedSize != 0)
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        result.derivedBytes = cache.size() * derivedSize * sizeof(double);
+    }
+    if (singlePrecision)
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        result.singleBytes = cache.size() * (size_t(numElements) + derivedSize) * sizeof(float);
+    }
+    for (int i = 0; i < HISTOGRAM_SIZE; ++i)
+    {
+        result.distances[i] = distances[i].load(memory_order_relaxed);
+    }
+    return result;
+}
+
+
+// the histogram bucket of the distance between the current and the previous request
+void EphemerisRecord::noteRequest(int const numRecord) const
 {
-    return *getRecord(numRecord);
+    requests.fetch_add(1, memory_order_relaxed);
+
+    int const previous = lastRecord.exchange(numRecord, memory_order_relaxed);
+    if (previous < 0)
+    {
+        return; // first request
+    }
+
+    unsigned int distance = numRecord > previous ? unsigned(numRecord - previous) : unsigned(previous - numRecord);
+    int bucket = 0;
+    while (distance != 0 && bucket < HISTOGRAM_SIZE - 1)
+    {
+        distance >>= 1;
+        ++bucket;
+    }
+    distances[bucket].fetch_add(1, memory_order_relaxed);
+
+    if (prefetchThread.joinable() && previous != numRecord)
+    {
+        notePrefetch(numRecord, previous);
+    }
 }
 
 
-EphemerisRecord::RecordType * EphemerisRecord::readRecord(int const numRecord)
+EphemerisRecord::RecordBuffer * EphemerisRecord::readRecord(int const numRecord)
 {
     if (numRecord >= 0)
     {
@@ -91,7 +641,7 @@ EphemerisRecord::RecordType * EphemerisRecord::readRecord(int const numRecord)
         {
             jpleph.seekg(newPosition);
         }
-        RecordType * newRecord = new RecordType(recordDescriptor);
+        RecordBuffer * newRecord = new RecordBuffer();
         good = read(jpleph, *newRecord);
         if (good)
         {
@@ -99,125 +649,828 @@ EphemerisRecord::RecordType * EphemerisRecord::readRecord(int const numRecord)
 
             return newRecord; 
         }
+        delete newRecord;
+        throw runtime_error("EphemerisRecord::RecordType::readRecord: could not read record or checksum error");
     }
     good = false;
     throw invalid_argument("EphemerisRecord::RecordType::readRecord: invalid record number");
 }
 
 
-
-
-EphemerisRecord::RecordType::RecordType(std::vector<EphemerisRecord::RecordDescriptorEntry> const & descriptor): descriptor(descriptor)
+// v1: a record in the file is a size prefixed vector of doubles (see jplephread.h). The view points directly behind the size.
+// The records of this file format are not necessarily aligned to alignof(double), setUp() only maps aligned ones.
+// v2: the records are aligned to 64 bytes, the checksum is verified at the first use of a record
+// JPL Fortran: the records are aligned to 8 bytes
+EphemerisRecord::RecordType EphemerisRecord::mappedRecord(int const numRecord) const
 {
+    size_t numValues;
+    double const * values = mappedValues(numRecord, numValues);
+    return RecordType(values, numValues, recordDescriptor);
 }
 
 
-EphemerisRecord::RecordDescriptorEntry const & EphemerisRecord::RecordType::getDescriptor(int const body) const
+double const * EphemerisRecord::mappedValues(int const numRecord, size_t & numValues) const
 {
-    return descriptor.at(body);
+    if (numRecord < 0 || numRecord >= numRecords)
+    {
+        throw invalid_argument("EphemerisRecord::mappedRecord: invalid record number");
+    }
+
+    char const * start = mapping->data() + streamoff(recordStart) + numRecord * recordLength;
+
+    if (fixedValues != 0)
+    {
+        double const * values = reinterpret_cast<double const *>(start);
+        if (checksums && !verified[numRecord].load(memory_order_acquire))
+        {
+            uint64_t stored;
+            memcpy(&stored, start + recordLength - sizeof(stored), sizeof(stored));
+            if (stored != EphemerisFormat::checksum(values, size_t(fixedValues)))
+            {
+                throw runtime_error("EphemerisRecord::mappedRecord: checksum error in record " + to_string(numRecord));
+            }
+            verified[numRecord].store(true, memory_order_release);
+        }
+        numValues = size_t(fixedValues);
+        return values;
+    }
+
+    vector<double>::size_type size;
+    memcpy(&size, start, sizeof(size));
+    if (streamoff(sizeof(size) + size * sizeof(double)) != recordLength)
+    {
+        throw invalid_argument("EphemerisRecord::mappedRecord: corrupt record");
+    }
+
+    numValues = size;
+    return reinterpret_cast<double const *>(start + sizeof(size));
 }
 
 
 
 
-EphemerisRecord::RecordDescriptorEntry::RecordDescriptorEntry(int const index, int const order, int const entries, int const dim)
+EphemerisRecord::RecordType::RecordType(double const * values, size_t const numValues, std::vector<EphemerisRecord::RecordDescriptorEntry> const & descriptor)
+    : values(values), numValues(numValues), derived(nullptr), numDerived(0), derivedStart(numValues), single(nullptr), numSingle(0),
+      descriptor(&descriptor), cached(nullptr), partial(nullptr)
 {
-    recordIndex     = index;
-    numCoefficient  = order;
-    numEntries      = entries;
-    dimension       = dim;
 }
 
 
+EphemerisRecord::RecordType::RecordType(CachedRecord * cached, std::vector<EphemerisRecord::RecordDescriptorEntry> const & descriptor, int const derivedStart,
+                                        EphemerisRecord const * partial)
+    : values(cached->values.data()), numValues(cached->values.size()), derived(cached->derived.data()), numDerived(cached->derived.size()),
+      derivedStart(size_t(derivedStart)), single(cached->single.empty() ? nullptr : cached->single.data()), numSingle(cached->single.size()),
+      descriptor(&descriptor), cached(cached), partial(partial)
+{
+}
 
-    
 
-// cache functions  
-// Obtain value of the cached function for k 
-EphemerisRecord::RecordType  * EphemerisRecord::getRecord(const int k)
-{ 
-    // Attempt to find existing record 
-    const KeyToValueType::iterator it = keyToValue.find(k); 
- 
-    if (it == keyToValue.end())
-    { 
-        // We don't have it: 
-        // Evaluate function and create new record 
-        RecordType  * v = readRecord(k); 
-        insert(k, v); 
- 
-        // Return the freshly computed value 
-        return v; 
- 
-    } else
-    { 
-        // We do have it: 
-        // Update access record by moving 
-        // accessed key to back of list 
-        keyTracker.splice(keyTracker.end(), keyTracker, (*it).second.second); 
- 
-        // Return the retrieved value 
-        return (*it).second.first; 
-    } 
-  }
-
-    // Record a fresh key-value pair in the cache 
-void EphemerisRecord::insert(int const k, RecordType  *  v)
-{ 
-    // Method is only called on cache misses 
-    assert(keyToValue.find(k) == keyToValue.end()); 
- 
-    // Make space if necessary 
-    if (keyToValue.size() == capacity)
-    { 
-      evict(); 
-    }
- 
-    // Record k as most-recently-used key 
-    KeyTrackerType::iterator it = keyTracker.insert(keyTracker.end(), k); 
- 
-    // Create the key-value entry, 
-    // linked to the usage record. 
-    keyToValue.insert(std::make_pair(k, std::make_pair(v, it) )); 
-
-    // No need to check return, 
-    // given previous assert. 
-  } 
-
-    // Purge the least-recently-used element in the cache 
-  void EphemerisRecord::evict()
-  { 
-    // Assert method is never called when cache is empty 
-    assert(!keyTracker.empty()); 
- 
-    // Identify least recently used key 
-    const KeyToValueType::iterator it = keyToValue.find(keyTracker.front()); 
-
-    assert(it != keyToValue.end()); 
- 
-    // Erase both elements to completely purge record 
-    delete (*it).second.first;
-    keyToValue.erase(it); 
-    keyTracker.pop_front(); 
-} 
-
-
-EphemerisRecord::RecordDescriptorEntry EphemerisRecord::getDescriptorEntry(const int body)
+EphemerisRecord::RecordType::RecordType(double const * values, size_t const numValues, CachedRecord * cached,
+                                        std::vector<EphemerisRecord::RecordDescriptorEntry> const & descriptor, int const derivedStart)
+    : values(values), numValues(numValues), derived(cached->derived.data()), numDerived(cached->derived.size()),
+      derivedStart(size_t(derivedStart)), single(cached->single.empty() ? nullptr : cached->single.data()), numSingle(cached->single.size()),
+      descriptor(&descriptor), cached(cached), partial(nullptr)
 {
-    //todo : range checks
-    return recordDescriptor.at(body);
 }
 
-bool EphemerisRecord::read(std::ifstream & jpleph, EphemerisRecord::RecordType & values)
+
+EphemerisRecord::RecordType::RecordType(RecordType const & other)
+    : values(other.values), numValues(other.numValues), derived(other.derived), numDerived(other.numDerived), derivedStart(other.derivedStart),
+      single(other.single), numSingle(other.numSingle), descriptor(other.descriptor), cached(other.cached),
+      partial(other.partial)
 {
-    return ::read(jpleph, static_cast<std::vector<double> &>(values));
+    if (cached != nullptr)
+    {
+        cached->pins.fetch_add(1);
+    }
 }
 
-// cleanup chache and don't leak
-EphemerisRecord::~EphemerisRecord()
+
+EphemerisRecord::RecordType & EphemerisRecord::RecordType::operator=(RecordType const & rhs)
+{
+    if (rhs.cached != nullptr)
+    {
+        rhs.cached->pins.fetch_add(1);
+    }
+    if (cached != nullptr)
+    {
+        cached->pins.fetch_sub(1);
+    }
+
+    values       = rhs.values;
+    numValues    = rhs.numValues;
+    derived      = rhs.derived;
+    numDerived   = rhs.numDerived;
+    derivedStart = rhs.derivedStart;
+    single       = rhs.single;
+    numSingle    = rhs.numSingle;
+    descriptor   = rhs.descriptor;
+    cached       = rhs.cached;
+    partial      = rhs.partial;
+    return *this;
+}
+
+
+EphemerisRecord::RecordType::~RecordType()
 {
-    for (auto elem : keyToValue)
+    if (cached != nullptr)
     {
-        delete (elem.second.first);
+        cached->pins.fetch_sub(1);
     }
-}
\ No newline at end of file
+}
+
+
+EphemerisRecord::RecordDescriptorEntry const & EphemerisRecord::RecordType::getDescriptor(int const body) const
+{
+    return descriptor->at(body);
+}
+
+
+double const & EphemerisRecord::RecordType::at(size_t const index) const
+{
+    if (index >= numValues)
+    {
+        throw out_of_range("EphemerisRecord::RecordType::at: index out of range");
+    }
+    return values[index];
+}
+
+
+double const & EphemerisRecord::RecordType::operator[](size_t const index) const
+{
+    return values[index];
+}
+
+
+size_t EphemerisRecord::RecordType::size() const
+{
+    return numValues;
+}
+
+
+double const * EphemerisRecord::RecordType::data() const
+{
+    return values;
+}
+
+
+double const * EphemerisRecord::RecordType::coefficients(size_t const index, size_t const count) const
+{
+    if (index >= derivedStart && derived != nullptr)
+    {
+        if (index - derivedStart + count > numDerived)
+        {
+            throw out_of_range("EphemerisRecord::RecordType::coefficients: derived series outside of the record");
+        }
+        return derived + (index - derivedStart);
+    }
+    if (index + count > numValues)
+    {
+        throw out_of_range("EphemerisRecord::RecordType::coefficients: coefficients outside of the record");
+    }
+    if (partial != nullptr)
+    {
+        partial->makeResident(*cached, index, count);
+    }
+    return values + index;
+}
+
+
+float const * EphemerisRecord::RecordType::singleCoefficients(size_t const index, size_t const count) const
+{
+    if (single == nullptr)
+    {
+        throw out_of_range("EphemerisRecord::RecordType::singleCoefficients: no single precision copy of the record");
+    }
+    if (index + count > numSingle)
+    {
+        throw out_of_range("EphemerisRecord::RecordType::singleCoefficients: coefficients outside of the record");
+    }
+    return single + index;
+}
+
+
+
+
+EphemerisRecord::RecordDescriptorEntry::RecordDescriptorEntry(int const index, int const order, int const entries, int const dim)
+{
+    recordIndex     = index;
+    numCoefficient  = order;
+    numEntries      = entries;
+    dimension       = dim;
+}
+
+
+
+    
+
+EphemerisRecord::Statistics::Statistics() : requests(0), hits(0), misses(0), evictions(0), prefetched(0), bytesRead(0), derivedBytes(0), singleBytes(0), ioSeconds(0.0),
+                                             entryLoads(0), decoded(0), decodeSeconds(0.0)
+{
+    for (size_t & distance : distances)
+    {
+        distance = 0;
+    }
+}
+
+
+void EphemerisRecord::Statistics::print(ostream & out) const
+{
+    ios::fmtflags const flags = out.flags();
+    streamsize const precision = out.precision();
+
+    out << "Record requests : " << requests << endl;
+    out << "Cache hits      : " << hits << endl;
+    out << "Cache misses    : " << misses << endl;
+    out << "Evictions       : " << evictions << endl;
+    out << "Read ahead      : " << prefetched << endl;
+    out << "Bytes read      : " << bytesRead << endl;
+    out << "I/O time [s]    : " << fixed << setprecision(6) << ioSeconds << endl;
+    if (entryLoads != 0)
+    {
+        out << "Entries loaded  : " << entryLoads << endl;
+    }
+    if (decoded != 0)
+    {
+        out << "Decompressed    : " << decoded << " records, " << setprecision(2) << (decodeSeconds * 1.0e6 / double(decoded)) << " us per record" << endl;
+    }
+    if (derivedBytes != 0)
+    {
+        out << "Derived series  : " << derivedBytes << " bytes" << endl;
+    }
+    if (singleBytes != 0)
+    {
+        out << "Single precision: " << singleBytes << " bytes" << endl;
+    }
+    out << "Record distance : requests" << endl;
+    for (int i = 0; i < HISTOGRAM_SIZE; ++i)
+    {
+        if (distances[i] == 0)
+        {
+            continue;
+        }
+        if (i <= 1)
+        {
+            out << setw(16) << i << ": ";
+        }
+        else if (i == HISTOGRAM_SIZE - 1)
+        {
+            out << "    >= " << setw(9) << (1u << (i - 1)) << ": ";
+        }
+        else
+        {
+            out << setw(7) << (1u << (i - 1)) << " - " << setw(6) << ((1u << i) - 1) << ": ";
+        }
+        out << distances[i] << endl;
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+
+EphemerisRecord::CachedRecord::CachedRecord() : numRecord(-1), pins(0), referenced(false), resident(0) {}
+
+EphemerisRecord::Slot::Slot() : cached(nullptr), loading(false) {}
+
+
+// cache functions  
+// Obtain the pinned cached copy of a record. Lock free if the record is in the cache.
+// A reader pins the copy and then verifies that the slot still refers to it. A copy is only
+// reused by the evicting thread after it has been unlinked from its slot and found unpinned,
+// so a successful verification guarantees the copy stays valid until it is unpinned.
+EphemerisRecord::CachedRecord * EphemerisRecord::getRecord(int const numRecord) const
+{ 
+    if (numRecord < 0 || numRecord >= numRecords)
+    {
+        throw invalid_argument("EphemerisRecord::getRecord: invalid record number");
+    }
+
+    Slot & slot = slots[numRecord];
+    for (;;)
+    {
+        CachedRecord * cached = slot.cached.load();
+        if (cached != nullptr)
+        {
+            cached->pins.fetch_add(1);
+            if (slot.cached.load() == cached)
+            {
+                cached->referenced.store(true, memory_order_relaxed);
+                return cached;
+            }
+            cached->pins.fetch_sub(1); // evicted in between. Try again
+            continue;
+        }
+
+        // We don't have it: the first thread loads it, the others wait for this record only
+        bool expected = false;
+        if (slot.loading.compare_exchange_strong(expected, true))
+        {
+            if (slot.cached.load() != nullptr) // loaded by another thread in the meantime
+            {
+                slot.loading.store(false);
+                slot.loading.notify_all();
+                continue;
+            }
+
+            try
+            {
+                cached = loadRecord(numRecord);
+                misses.fetch_add(1, memory_order_relaxed);
+            }
+            catch (...)
+            {
+                slot.loading.store(false);
+                slot.loading.notify_all();
+                throw;
+            }
+
+            slot.cached.store(cached);
+            slot.loading.store(false);
+            slot.loading.notify_all();
+            return cached;
+        }
+
+        slot.loading.wait(true);
+    }
+}
+
+
+// read a record into a free cache entry. The entry is returned pinned 
+EphemerisRecord::CachedRecord * EphemerisRecord::loadRecord(int const numRecord) const
+{
+    CachedRecord * cached = acquireCacheSlot();
+
+    if (access == Access::MAPPED)
+    {
+        // only the derived series and the single precision copy are cached, the record itself is used in place
+        try
+        {
+            size_t numValues;
+            double const * values = mappedValues(numRecord, numValues);
+            computeDerived(values, cached->derived);
+            if (singlePrecision)
+            {
+                computeSingle(values, *cached);
+            }
+        }
+        catch (...)
+        {
+            cached->pins.fetch_sub(1); // back to the pool as unused entry
+            throw;
+        }
+    }
+    else if (access == Access::PARTIAL)
+    {
+        // the dates and the entries used so far. The derived series and the single precision copy need all entries
+        uint32_t const entries = !derivedSeries.empty() || singlePrecision ? allEntries : usedEntries.load(memory_order_relaxed);
+        try
+        {
+            cached->values.resize(fixedValues != 0 ? size_t(fixedValues)
+                                                   : size_t(recordLength - streamoff(sizeof(vector<double>::size_type))) / sizeof(double));
+            lock_guard<mutex> lock(ioMutex);
+            readEntries(numRecord, true, entries, cached->values);
+        }
+        catch (...)
+        {
+            cached->pins.fetch_sub(1); // back to the pool as unused entry
+            throw;
+        }
+        cached->resident.store(entries, memory_order_release);
+
+        if (!derivedSeries.empty())
+        {
+            computeDerived(cached->values.data(), cached->derived);
+        }
+        if (singlePrecision)
+        {
+            computeSingle(cached->values.data(), *cached);
+        }
+    }
+    else
+    {
+        bool ok;
+        static thread_local vector<unsigned char> block; // compressed container. Decompressed without holding the lock
+        {
+            lock_guard<mutex> lock(ioMutex);
+            auto const start = chrono::steady_clock::now();
+            jpleph.clear();
+            if (blocks.empty())
+            {
+                jpleph.seekg(recordStart + numRecord * recordLength);
+                ok = read(jpleph, cached->values) && int(cached->values.size()) >= numElements;
+                bytesRead.fetch_add(size_t(recordLength), memory_order_relaxed);
+            }
+            else
+            {
+                ok = readBlock(numRecord, block);
+            }
+            ioNanoseconds.fetch_add(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count(), memory_order_relaxed);
+        }
+        if (ok && !blocks.empty())
+        {
+            ok = decodeBlock(block, cached->values);
+        }
+
+        if (!ok)
+        {
+            cached->pins.fetch_sub(1); // back to the pool as unused entry
+            throw runtime_error("EphemerisRecord::loadRecord: could not read record or checksum error");
+        }
+
+        if (!derivedSeries.empty())
+        {
+            computeDerived(cached->values.data(), cached->derived);
+        }
+        if (singlePrecision)
+        {
+            computeSingle(cached->values.data(), *cached);
+        }
+    }
+
+    cached->numRecord = numRecord;
+    cached->referenced.store(true, memory_order_relaxed);
+    return cached;
+}
+
+
+// the dates and the coefficients of the entries. Entries next to each other in the record are read in one go.
+// The checksums of v2 records cover the whole record and are not verified
+void EphemerisRecord::readEntries(int const numRecord, bool const dates, uint32_t const entries, RecordBuffer & values) const
+{
+    streamoff const start = streamoff(recordStart) + numRecord * recordLength + (fixedValues == 0 ? streamoff(sizeof(vector<double>::size_type)) : 0);
+    auto const begin = chrono::steady_clock::now();
+
+    size_t bytes = 0;
+    auto readRange = [&](size_t const first, size_t const last)
+    {
+        jpleph.clear();
+        jpleph.seekg(start + streamoff(first * sizeof(double)));
+        jpleph.read(reinterpret_cast<char *>(values.data() + first), streamsize((last - first) * sizeof(double)));
+        if (!jpleph)
+        {
+            throw runtime_error("EphemerisRecord::readEntries: could not read record " + to_string(numRecord));
+        }
+        bytes += (last - first) * sizeof(double);
+    };
+
+    size_t first = 0;
+    size_t last  = dates ? 2 : 0; // nothing pending otherwise
+    for (int const e : entryOrder)
+    {
+        if ((entries & (uint32_t(1) << e)) == 0)
+        {
+            continue;
+        }
+        RecordDescriptorEntry const & entry = recordDescriptor[e];
+        size_t const index = size_t(entry.recordIndex);
+        size_t const end   = min(index + size_t(entry.numEntries) * entry.numCoefficient * entry.dimension, values.size());
+        if (last == 0)
+        {
+            first = index;
+        }
+        else if (index > last)
+        {
+            readRange(first, last);
+            first = index;
+        }
+        last = max(last, end);
+    }
+    if (last > first)
+    {
+        readRange(first, last);
+    }
+
+    ioNanoseconds.fetch_add(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - begin).count(), memory_order_relaxed);
+    bytesRead.fetch_add(bytes, memory_order_relaxed);
+}
+
+
+// the entries overlapping the coefficients [index, index + count). Entries once read stay until the record is evicted,
+// the caller holds a pin
+void EphemerisRecord::makeResident(CachedRecord & cached, size_t const index, size_t const count) const
+{
+    uint32_t const resident = cached.resident.load(memory_order_acquire);
+    if (resident == allEntries)
+    {
+        return;
+    }
+
+    uint32_t wanted = 0;
+    for (int const e : entryOrder)
+    {
+        RecordDescriptorEntry const & entry = recordDescriptor[e];
+        size_t const first = size_t(entry.recordIndex);
+        size_t const last  = first + size_t(entry.numEntries) * entry.numCoefficient * entry.dimension;
+        if (index < last && index + count > first)
+        {
+            wanted |= uint32_t(1) << e;
+        }
+    }
+    if ((resident & wanted) == wanted)
+    {
+        return;
+    }
+    usedEntries.fetch_or(wanted, memory_order_relaxed); // read with the next records loaded
+
+    lock_guard<mutex> lock(ioMutex);
+    uint32_t const missing = wanted & ~cached.resident.load(memory_order_acquire);
+    if (missing != 0)
+    {
+        readEntries(cached.numRecord, false, missing, cached.values);
+        cached.resident.fetch_or(missing, memory_order_release);
+        entryLoads.fetch_add(size_t(bitset<32>(missing).count()), memory_order_relaxed);
+    }
+}
+
+
+bool EphemerisRecord::readBlock(int const numRecord, vector<unsigned char> & block) const
+{
+    uint64_t const size = blocks[size_t(numRecord) + 1] - blocks[size_t(numRecord)];
+    block.resize(size_t(size));
+    jpleph.clear();
+    jpleph.seekg(streamoff(recordStart) + streamoff(blocks[size_t(numRecord)]));
+    jpleph.read(reinterpret_cast<char *>(block.data()), streamsize(size));
+    bytesRead.fetch_add(size_t(size), memory_order_relaxed);
+    return jpleph.good();
+}
+
+
+bool EphemerisRecord::decodeBlock(vector<unsigned char> const & block, RecordBuffer & values) const
+{
+    static thread_local vector<unsigned char> planes;
+    auto const start = chrono::steady_clock::now();
+    values.resize(size_t(fixedValues));
+    bool const ok = RecordCodec::decode(block.data(), block.size(), blockOrder, values.data(), planes);
+    decodeNanoseconds.fetch_add(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count(), memory_order_relaxed);
+    decoded.fetch_add(1, memory_order_relaxed);
+    return ok;
+}
+
+
+void EphemerisRecord::completeRecord(CachedRecord & cached) const
+{
+    if (access == Access::PARTIAL)
+    {
+        makeResident(cached, 0, cached.values.size());
+    }
+}
+
+
+// Find a cache entry for a new record. The pool of a bounded cache is allocated up front, an unbounded
+// cache gets a new entry for every record. The clock hand sweeps the entries: pinned entries are skipped, recently
+// referenced ones get a second chance. If all entries are pinned by other threads the cache grows beyond its capacity.
+EphemerisRecord::CachedRecord * EphemerisRecord::acquireCacheSlot() const
+{
+    lock_guard<mutex> lock(cacheMutex);
+
+    if (cache.size() < capacity && (cacheBudget == nullptr || cacheBudget->acquire()))
+    {
+        cache.push_back(make_unique<CachedRecord>());
+        cache.back()->pins.store(1);
+        return cache.back().get();
+    }
+
+    for (size_t sweep = 0; sweep < 2 * cache.size(); ++sweep)
+    {
+        CachedRecord * candidate = cache[clockHand].get();
+        clockHand = (clockHand + 1) % cache.size();
+
+        if (candidate->pins.load() != 0)
+        {
+            continue;
+        }
+        if (candidate->referenced.exchange(false, memory_order_relaxed))
+        {
+            continue; // second chance
+        }
+
+        // unlink from its slot. It might already be unlinked if it was replaced by a concurrent load
+        int const oldRecord = candidate->numRecord;
+        if (oldRecord >= 0)
+        {
+            CachedRecord * expected = candidate;
+            slots[oldRecord].cached.compare_exchange_strong(expected, nullptr);
+        }
+
+        // claim it. Fails if a reader pinned it before it was unlinked
+        int unpinned = 0;
+        if (candidate->pins.compare_exchange_strong(unpinned, 1))
+        {
+            if (oldRecord >= 0)
+            {
+                evictions.fetch_add(1, memory_order_relaxed);
+            }
+            candidate->numRecord = -1;
+            return candidate;
+        }
+
+        // still in use: link it again unless the record has been loaded again in the meantime
+        if (oldRecord >= 0)
+        {
+            CachedRecord * expected = nullptr;
+            slots[oldRecord].cached.compare_exchange_strong(expected, candidate);
+        }
+    }
+
+    // everything is in use
+    if (cacheBudget != nullptr)
+    {
+        cacheBudget->force();
+    }
+    cache.push_back(make_unique<CachedRecord>());
+    cache.back()->pins.store(1);
+    return cache.back().get();
+}
+
+
+EphemerisRecord::RecordDescriptorEntry EphemerisRecord::getDescriptorEntry(const int body) const
+{
+    //todo : range checks
+    return recordDescriptor.at(body);
+}
+
+// v1: a size prefixed vector. v2: a fixed number of values, padding and the checksum. JPL Fortran: a fixed number of values
+bool EphemerisRecord::read(std::ifstream & jpleph, EphemerisRecord::RecordBuffer & values) const
+{
+    if (fixedValues == 0)
+    {
+        return ::read(jpleph, values);
+    }
+
+    values.resize(size_t(fixedValues));
+    jpleph.read(reinterpret_cast<char *>(values.data()), fixedValues * sizeof(double));
+    if (!checksums)
+    {
+        jpleph.ignore(recordLength - streamoff(fixedValues * sizeof(double)));
+        return jpleph.good();
+    }
+    jpleph.ignore(recordLength - streamoff((fixedValues + 1) * sizeof(double)));
+    uint64_t stored = 0;
+    jpleph.read(reinterpret_cast<char *>(&stored), sizeof(stored));
+    return jpleph.good() && stored == EphemerisFormat::checksum(values.data(), size_t(fixedValues));
+}
+
+// the cached records are owned by the cache
+EphemerisRecord::~EphemerisRecord()
+{
+    if (prefetchThread.joinable())
+    {
+        {
+            lock_guard<mutex> lock(prefetchMutex);
+            stopPrefetch = true;
+        }
+        prefetchCondition.notify_one();
+        prefetchThread.join();
+    }
+    if (cacheBudget != nullptr)
+    {
+        cacheBudget->release(cache.size());
+    }
+}
+
+
+// read ahead functions
+
+// Called when the requested record changes. A step of +1 or -1 in the
+// same direction as before extends the run, anything else ends it. The tracking is a heuristic: concurrent
+// requests of several threads may interleave, the worst outcome is a useless or missing read ahead.
+void EphemerisRecord::notePrefetch(int const numRecord, int const previous) const
+{
+    int const step = numRecord - previous;
+    if (step != 1 && step != -1)
+    {
+        runLength.store(0, memory_order_relaxed);
+        return;
+    }
+
+    int run = 1;
+    if (runDirection.exchange(step, memory_order_relaxed) == step)
+    {
+        run = runLength.fetch_add(1, memory_order_relaxed) + 1;
+    }
+    else
+    {
+        runLength.store(1, memory_order_relaxed);
+    }
+
+    if (run >= SEQUENTIAL_RUN)
+    {
+        {
+            lock_guard<mutex> lock(prefetchMutex);
+            pendingRecord    = numRecord;
+            pendingDirection = step;
+        }
+        prefetchCondition.notify_one();
+    }
+}
+
+
+// the read ahead thread. Loads the 'depth' records following the pending record in the pending direction
+void EphemerisRecord::prefetchLoop()
+{
+    budgetStart = chrono::steady_clock::now();
+
+    unique_lock<mutex> lock(prefetchMutex);
+    for (;;)
+    {
+        prefetchCondition.wait(lock, [this] { return stopPrefetch || pendingDirection != 0; });
+        if (stopPrefetch)
+        {
+            return;
+        }
+
+        int const from      = pendingRecord;
+        int const direction = pendingDirection;
+        pendingDirection = 0;
+
+        for (int k = 1; k <= prefetch.depth && !stopPrefetch && pendingDirection == 0; ++k)
+        {
+            int const numRecord = from + direction * k;
+            if (numRecord < 0 || numRecord >= numRecords)
+            {
+                break;
+            }
+
+            waitForBudget(lock);
+            if (stopPrefetch)
+            {
+                return;
+            }
+
+            lock.unlock();
+            prefetchRecord(numRecord);
+            lock.lock();
+        }
+    }
+}
+
+
+// Access::STREAM: load the record into the cache with the same protocol as getRecord, but never wait for
+// a record loaded by another thread. Errors are ignored here, they are reported when the record is requested.
+// Access::MAPPED: ask the operating system to page in the record
+void EphemerisRecord::prefetchRecord(int const numRecord)
+{
+    if (access == Access::MAPPED)
+    {
+        mapping->prefetch(size_t(streamoff(recordStart) + numRecord * recordLength), size_t(recordLength));
+        budgetBytes += size_t(recordLength); // the budget applies to the paging too
+        prefetched.fetch_add(1);
+        return;
+    }
+
+    Slot & slot = slots[numRecord];
+    if (slot.cached.load() != nullptr)
+    {
+        return;
+    }
+
+    bool expected = false;
+    if (!slot.loading.compare_exchange_strong(expected, true))
+    {
+        return;
+    }
+
+    if (slot.cached.load() == nullptr)
+    {
+        try
+        {
+            CachedRecord * cached = loadRecord(numRecord);
+            slot.cached.store(cached);
+            cached->pins.fetch_sub(1); // nobody uses it yet
+            budgetBytes += size_t(recordLength);
+            prefetched.fetch_add(1);
+        }
+        catch (...)
+        {
+        }
+    }
+
+    slot.loading.store(false);
+    slot.loading.notify_all();
+}
+
+
+// the I/O budget is granted per second. Wait for the next period if it is used up
+void EphemerisRecord::waitForBudget(unique_lock<mutex> & lock)
+{
+    if (prefetch.bytesPerSecond == 0)
+    {
+        return;
+    }
+
+    auto now = chrono::steady_clock::now();
+    if (now - budgetStart >= chrono::seconds(1))
+    {
+        budgetStart = now;
+        budgetBytes = 0;
+    }
+
+    if (budgetBytes + size_t(recordLength) > prefetch.bytesPerSecond && budgetBytes > 0)
+    {
+        auto const nextPeriod = budgetStart + chrono::seconds(1);
+        prefetchCondition.wait_until(lock, nextPeriod, [this] { return stopPrefetch; });
+        budgetStart = max(nextPeriod, chrono::steady_clock::now());
+        budgetBytes = 0;
+    }
+}
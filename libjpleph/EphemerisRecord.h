@@ -5,9 +5,18 @@
 #ifndef EPHEMERISRECORD_H
 #define EPHEMERISRECORD_H
 #include <fstream>
+#include <ostream>
 #include <vector>
-#include <list>
-#include <unordered_map>
+#include <memory>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+#include "MappedFile.h"
 
 
 //  the actual data
@@ -102,13 +111,114 @@ public:
 		TT_TDB    = 14,
 	};
 
+	// how the records are accessed
+	enum class Access
+	{
+		STREAM = 0,   // records are read through the file stream into a cache of private copies
+		MAPPED = 1,   // the whole file is mapped read only and records are served as views into the mapping (zero copy, no cache)
+		PARTIAL = 2,  // as STREAM, but only the coefficients of the entries used are read (see RecordType::coefficients())
+	};
+
+	// background read ahead of records. When the requested records form a run of consecutive record numbers
+	// (increasing or decreasing) a background thread loads the next 'depth' records in this direction
+	// before they are requested. Access::STREAM loads them into the cache, Access::MAPPED asks the operating
+	// system to page them in.
+	struct Prefetch
+	{
+		Prefetch(int const depth = 0, std::size_t const bytesPerSecond = 0);
+		int         depth;          // number of records read ahead. 0 disables the read ahead
+		std::size_t bytesPerSecond; // I/O budget of the read ahead. 0 is unlimited
+	};
+
+	// a series derived from the series in the file when a record is loaded (see deriveSeries()): the linear combination
+	// factor[0] * entry[0] + factor[1] * entry[1] + ... of bodies (3 components) on the common sub intervals of the terms
+	struct Derivation
+	{
+		struct Term
+		{
+			Entry  entry;
+			double factor;
+		};
+		std::vector<Term> terms;
+	};
+
+	static int const         NUM_ENTRIES        = 15;                // number of entries of a file (Entry::TT_TDB + 1)
+	static constexpr std::size_t DEFAULT_CAPACITY   = 10;                // default number of records in the cache
+	static constexpr std::size_t UNBOUNDED_CAPACITY = std::size_t(-1);   // keep every record once read, never evict
+	static int const         HISTOGRAM_SIZE     = 16;                // number of buckets of the distance histogram
+
+	// usage of the record cache. The counters are maintained with relaxed atomics, a snapshot taken while other
+	// threads are evaluating is not necessarily consistent
+	struct Statistics
+	{
+		Statistics();
+		std::size_t requests;   // records requested
+		std::size_t hits;       // requests served from the cache (Access::STREAM, PARTIAL)
+		std::size_t misses;     // requests that had to load the record (Access::STREAM, PARTIAL)
+		std::size_t evictions;  // records dropped from the cache (Access::STREAM)
+		std::size_t prefetched; // records read ahead in the background
+		std::size_t bytesRead;  // bytes read from the file (Access::STREAM, PARTIAL)
+		std::size_t derivedBytes; // memory of the derived series of the records in the cache
+		std::size_t singleBytes;  // memory of the single precision copies of the records in the cache
+		double      ioSeconds;  // time spent reading records from the file (Access::STREAM)
+		std::size_t entryLoads; // entries read into records already in the cache (Access::PARTIAL)
+		std::size_t decoded;       // records decompressed (compressed container)
+		double      decodeSeconds; // time spent decompressing them
+
+		// distance between the record numbers of consecutive requests. Bucket 0: same record,
+		// bucket i: 2^(i-1) <= |distance| < 2^i, the last bucket collects all larger distances
+		std::size_t distances[HISTOGRAM_SIZE];
+
+		void print(std::ostream & out) const;
+	};
+
+	// a number of cache entries shared by the caches of several files (see EphemerisSet). A cache with a budget grows
+	// on demand as long as the budget has entries left, then it replaces its own entries. Thread safe
+	class CacheBudget
+	{
+	public:
+		explicit CacheBudget(std::size_t const records);
+		std::size_t capacity() const; // number of records
+		std::size_t used() const;     // entries held by the caches
+
+	private:
+		friend class EphemerisRecord;
+		bool acquire();               // take an entry if one is left
+		void force();                 // take an entry in any case (the first entry of a cache, all entries pinned)
+		void release(std::size_t const count);
+
+		std::size_t const        records;
+		std::atomic<std::size_t> inUse;
+	};
+
 public:
-    EphemerisRecord(std::ifstream & jpleph, bool & good);
+    // with a 'budget' the capacity is ignored: the cache takes its entries from the budget
+    EphemerisRecord(std::ifstream & jpleph, bool & good, Access const access = Access::STREAM, Prefetch const & prefetch = Prefetch(),
+                    std::size_t const capacity = DEFAULT_CAPACITY, std::shared_ptr<CacheBudget> const & budget = nullptr);
     ~EphemerisRecord();
 
 
-    // initialize i.e. read record 0
-    void operator()();
+    // initialize i.e. read record 0. For Access::MAPPED the file 'jplFileName' is mapped afterwards. v1 files whose
+    // values are not aligned to alignof(double) cannot be used in place and fall back to Access::STREAM (see getAccess())
+    void operator()(std::string const & jplFileName);
+
+    // the records of a v2 file (see EphemerisFormat.h): fixed stride, no size prefix, checksum behind the values
+    struct FixedLayout;
+
+    // initialize for a v2 file. The descriptor comes from the header, the stream is not used for it.
+    // The records of a compressed container are decompressed into the cache, i.e. Access::MAPPED and Access::PARTIAL
+    // fall back to Access::STREAM (see getAccess())
+    void operator()(std::string const & jplFileName, FixedLayout const & layout);
+
+    // compute the derived series for every record when it is loaded and keep them with the record in the cache
+    // (Access::MAPPED: the derived series only). They are described by the descriptor entries following the ones
+    // of the file, the index of the first one is returned. Not thread safe: call before the first record is requested
+    int deriveSeries(std::vector<Derivation> const & derivations);
+
+    // keep a single precision copy of the coefficients (including the derived series) with every record when it
+    // is loaded, for the screening evaluation (see Jpleph::dplephSingle). Access::MAPPED: the copies are cached.
+    // The memory is reported by the statistics. Not thread safe: call before the first record is requested
+    void convertSingle();
     
 
 	// descibes the format of the original raw record in the binary file. TODO: better optimized file format.
@@ -122,34 +232,156 @@ public:
         
    };
 
-   class RecordType : public std::vector<double>
+   struct FixedLayout
+   {
+       std::streamoff                     recordOffset; // position of record 0
+       std::streamoff                     recordStride; // bytes from one record to the next
+       int                                numValues;    // doubles per record
+       int                                numRecords;
+       bool                               checksums;    // v2: checksum in the last 8 bytes of the stride. JPL Fortran files: none
+       std::vector<RecordDescriptorEntry> descriptor;
+       std::vector<std::uint64_t>         blocks;       // compressed container: start of the block of every record relative to
+                                                        // recordOffset and the end of the last one. Empty: records as they are
+       std::vector<std::uint32_t>         order;        // compressed container: the order of the values in a block (see RecordCodec.h)
+   };
+
+private:
+    struct CachedRecord; // a cache slot holding a private copy of a record (Access::STREAM)
+
+public:
+   // non-owning view of the coefficients of a single record. Either points into a cached copy (Access::STREAM)
+   // or directly into the file mapping (Access::MAPPED). The view is cheap to copy.
+   // For Access::STREAM the view pins the cached record, i.e. it is not evicted as long as a view refers to it.
+   // A view is meant to be used by a single thread for the duration of an evaluation.
+   class RecordType
    {
    public:
-       explicit RecordType(std::vector<RecordDescriptorEntry> const & descriptor);
+       RecordType(double const * values, std::size_t const numValues, std::vector<RecordDescriptorEntry> const & descriptor);
+       RecordType(CachedRecord * cached, std::vector<RecordDescriptorEntry> const & descriptor, int const derivedStart, // takes over an existing pin
+                  EphemerisRecord const * partial = nullptr);
+       RecordType(double const * values, std::size_t const numValues, CachedRecord * cached, // mapped record with cached derived series
+                  std::vector<RecordDescriptorEntry> const & descriptor, int const derivedStart);
+       RecordType(RecordType const & other);
+       RecordType & operator=(RecordType const & rhs);
+       ~RecordType();
 
        RecordDescriptorEntry const & getDescriptor(int const body) const;
 
+       double const & at(std::size_t const index) const;         // range checked access
+       double const & operator[](std::size_t const index) const;
+       std::size_t size() const;
+       double const * data() const;
+
+       // the 'count' coefficients starting at 'index' (RecordDescriptorEntry::recordIndex). Derived series start
+       // behind the coefficients of the file. Throws out_of_range.
+       // Access::PARTIAL: entries not yet read are read now. at(), operator[] and data() give the start and end date
+       // and the entries read so far only
+       double const * coefficients(std::size_t const index, std::size_t const count) const;
+
+       // the same coefficients in single precision (see convertSingle()). Throws out_of_range, also if the
+       // record has no single precision copy
+       float const * singleCoefficients(std::size_t const index, std::size_t const count) const;
+
    private:
-       std::vector<RecordDescriptorEntry> const & descriptor;
+       double const * values;
+       std::size_t    numValues;
+       double const * derived;      // the derived series, nullptr if none
+       std::size_t    numDerived;
+       std::size_t    derivedStart; // index of the first derived coefficient
+       float const *  single;       // the single precision copy, nullptr if none
+       std::size_t    numSingle;
+       std::vector<RecordDescriptorEntry> const * descriptor;
+       CachedRecord * cached; // the pinned cache slot. nullptr for Access::MAPPED
+       EphemerisRecord const * partial; // reads missing entries (Access::PARTIAL), otherwise nullptr
    };
 
 
+    // a derived series. Its coefficients are evaluated at the chebysheff nodes of the sub intervals of the
+    // derived series, i.e. re-expanded on these sub intervals (exact, all terms have at most as many coefficients)
+    struct DerivedSeries
+    {
+        Derivation          derivation;
+        int                 descriptor;     // index of its descriptor entry, -1 if not kept with the records
+        int                 numCoefficient;
+        int                 numEntries;     // number of sub intervals
+        std::vector<double> nodes;          // chebysheff nodes of the derived series
+        std::vector<double> transform;      // values at the nodes -> coefficients (discrete cosine transform)
+    };
+
+    // a derived series not kept with the records, e.g. for the record a stream is in (see EphemerisStream).
+    // Throws as deriveSeries(). deriveCoefficients() computes the coefficients of sub intervall 'sub' of 'record' as
+    // deriveSeries() does: 3 * numCoefficient values
+    DerivedSeries prepareSeries(Derivation const & derivation) const;
+    void deriveCoefficients(DerivedSeries const & series, RecordType const & record, int const sub, double * coefficients) const;
+
+
+   // thread safe. Records already in the cache are retrieved without locking. A record not in the cache
+   // is loaded by the first thread asking for it. Other threads asking for the same record wait for this load only.
+   RecordType operator[](int const numRecord) const;
 
-   RecordType  & operator[](int const numRecord);
+   Access getAccess() const;
 
+   Statistics statistics() const;
 
-   RecordDescriptorEntry getDescriptorEntry(const int body);
+
+   RecordDescriptorEntry getDescriptorEntry(const int body) const;
 
 private: 
 
-    bool read(std::ifstream & jpleph, RecordType & values);
+    typedef std::vector<double> RecordBuffer; // a privately owned copy of a record
+
+    struct CachedRecord
+    {
+        CachedRecord();
+        RecordBuffer             values;     // the record of the file (Access::STREAM)
+        RecordBuffer             derived;    // the derived series
+        std::vector<float>       single;     // single precision copy of the values and the derived series (convertSingle())
+        int                      numRecord;  // the record held, -1 if unused
+        std::atomic<int>         pins;       // number of views referring to this record
+        std::atomic<bool>        referenced; // used since the last pass of the clock hand
+        std::atomic<std::uint32_t> resident; // Access::PARTIAL: bit e is set if the coefficients of entry e are read
+    };
+
+    // a record of the file. Points to the cached copy of the record if present
+    struct Slot
+    {
+        Slot();
+        std::atomic<CachedRecord *> cached;
+        std::atomic<bool>           loading; // a thread is loading this record
+    };
+
+    bool read(std::ifstream & jpleph, RecordBuffer & values) const; // read the record at the current position
     void getDescriptor(); // read the record structure descriptor. Note: This requires a proper positioning of the input stream!!
-    RecordType * readRecord(int const numRecord);
+    void countElements(); // number of doubles described by the descriptor
+    void setUp(std::string const & jplFileName, RecordBuffer & first); // mapping or cache, read ahead
+    RecordBuffer * readRecord(int const numRecord);
+    RecordType mappedRecord(int const numRecord) const;
+    double const * mappedValues(int const numRecord, std::size_t & numValues) const;
+    void computeDerived(double const * values, RecordBuffer & derived) const; // compute the derived series of a record
+    void combineSeries(DerivedSeries const & series, double const * const * terms, int const sub, double * out) const; // a sub intervall of a derived series
+    void computeSingle(double const * values, CachedRecord & cached) const;    // the single precision copy of a record
+    void cacheMapped(); // Access::MAPPED: set up the cache for the derived series and the single precision copies
+
+    // Access::PARTIAL
+    void readEntries(int const numRecord, bool const dates, std::uint32_t const entries, RecordBuffer & values) const; // the dates and the entries (bits). ioMutex held
+    void makeResident(CachedRecord & cached, std::size_t const index, std::size_t const count) const; // read the entries of the range if missing
+    void completeRecord(CachedRecord & cached) const; // read all entries not read yet
+
+    // compressed container: the block of a record (ioMutex held) and its values
+    bool readBlock(int const numRecord, std::vector<unsigned char> & block) const;
+    bool decodeBlock(std::vector<unsigned char> const & block, RecordBuffer & values) const;
 
     // caching functions
-    RecordType * getRecord(const int k);
-    void insert(int const k, RecordType  *  v);
-    void evict();
+    CachedRecord * getRecord(int const numRecord) const;   // returns the pinned cached record
+    CachedRecord * loadRecord(int const numRecord) const;  // load a record into a free cache slot. Returned pinned
+    CachedRecord * acquireCacheSlot() const;               // find an unused cache slot or evict one (clock algorithm)
+
+    // read ahead functions
+    void noteRequest(int const numRecord) const;          // statistics of the record numbers requested
+    void notePrefetch(int const numRecord, int const previous) const; // detect sequential access and hand it to the read ahead thread
+    void prefetchLoop();                                  // the read ahead thread
+    void prefetchRecord(int const numRecord);             // load a record not yet in the cache
+    void waitForBudget(std::unique_lock<std::mutex> & lock); // throttle to the I/O budget
 
     bool & good;
     std::vector<RecordDescriptorEntry> recordDescriptor;
@@ -161,20 +393,73 @@ private:
    std::streamoff recordLength;
    std::streampos currentPosition;
 
+   std::vector<DerivedSeries> derivedSeries;
+   std::size_t                derivedSize; // number of coefficients of all derived series of a record
+   bool                       singlePrecision; // keep single precision copies of the records (convertSingle())
+
+   Access access;                       // fixed once the file is set up
+   std::unique_ptr<MappedFile> mapping; // only for Access::MAPPED
+   int numRecords;                      // number of records in the file
+
+   // v2 and JPL Fortran files: records of 'fixedValues' doubles. 0 for v1 files.
+   // v2 files have a checksum at the end of the record stride. Mapped records are verified the first time they are used
+   int                                    fixedValues;
+   bool                                   checksums;
+   mutable std::unique_ptr<std::atomic<bool>[]> verified;
+
+   // compressed container (see RecordCodec.h): the blocks of the records, the order of the values in a block.
+   // recordLength is the mean length of a block then
+   std::vector<std::uint64_t> blocks;
+   std::vector<std::uint32_t> blockOrder;
+
+
+  // the cache for ephemeris records (Access::STREAM). Every record of the file has a slot pointing to its
+  // cached copy. The copies are kept in a pool of 'capacity' entries that are replaced by the clock
+  // (second chance) algorithm, an approximation of LRU that needs no bookkeeping on a cache hit.
+  // Only misses lock 'cacheMutex' to find a free entry and 'ioMutex' to read from the shared file stream.
+  // An unbounded cache grows up to the number of records in the file and never evicts.
+  // A cache with a budget is unbounded as far as the budget has entries left.
+  size_t const capacity; 
 
+  // Access::PARTIAL: the entries of the file in the order of their coefficients in the record, their bits, the entries
+  // requested so far (read together with the dates whenever a record is loaded)
+  std::vector<int>                   entryOrder;
+  std::uint32_t                      allEntries;
+  mutable std::atomic<std::uint32_t> usedEntries;
+  std::shared_ptr<CacheBudget> const cacheBudget; // shared with the caches of other files. nullptr: none
 
-  // the LRU cache for ephemeris records. The actual records are cached here and are retrieved as vectors
-  typedef std::list<int> KeyTrackerType; 
-  typedef std::unordered_map<int, std::pair< RecordType *, KeyTrackerType::iterator > > KeyToValueType;
+  mutable std::vector<Slot>                          slots;
+  mutable std::vector<std::unique_ptr<CachedRecord>> cache;
+  mutable size_t                                     clockHand;
+  mutable std::mutex                                 cacheMutex;
+  mutable std::mutex                                 ioMutex;
 
-  // Maximum number of key-value pairs to be retained 
-  const size_t capacity; 
+  // read ahead. The access pattern is tracked without locking, the thread is only woken up when a run of
+  // consecutive records continues to the next record
+  Prefetch const                  prefetch;
+  mutable std::atomic<int>        runLength;        // number of consecutive steps in the same direction
+  mutable std::atomic<int>        runDirection;     // +1 or -1
+  mutable std::mutex              prefetchMutex;
+  mutable std::condition_variable prefetchCondition;
+  mutable int                     pendingRecord;    // start of the pending read ahead
+  mutable int                     pendingDirection; // direction of the pending read ahead. 0 if nothing to do
+  bool                            stopPrefetch;
+  std::chrono::steady_clock::time_point budgetStart;  // start of the current I/O budget period
+  std::size_t                           budgetBytes;  // bytes read in the current period
+  std::thread                     prefetchThread;
 
-    // Key access history 
-  KeyTrackerType keyTracker; 
- 
-  // Key-to-value lookup 
-  KeyToValueType keyToValue;  // the actual cache
+  // statistics
+  mutable std::atomic<int>           lastRecord;      // the record requested last
+  mutable std::atomic<std::size_t>   requests;
+  mutable std::atomic<std::size_t>   misses;
+  mutable std::atomic<std::size_t>   evictions;
+  mutable std::atomic<std::size_t>   prefetched;
+  mutable std::atomic<std::size_t>   bytesRead;
+  mutable std::atomic<long long>     ioNanoseconds;
+  mutable std::atomic<std::size_t>   entryLoads;
+  mutable std::atomic<std::size_t>   decoded;
+  mutable std::atomic<long long>     decodeNanoseconds;
+  mutable std::atomic<std::size_t>   distances[HISTOGRAM_SIZE];
 };
 
 #endif
@@ -0,0 +1,213 @@
+//
+// several ephemeris files used as one ephemeris (see EphemerisSet.h)
+//
+#include <algorithm>
+#include <stdexcept>
+
+#include "EphemerisSet.h"
+
+using namespace std;
+
+
+// the files are read with a cache of a single record to get their time spans, then closed again
+EphemerisSet::EphemerisSet(vector<string> const & fileNames, bool const aukm, bool const daysecond, bool const iauau, Access const access,
+                           size_t const cacheBudget)
+    : aukm(aukm), daysecond(daysecond), iauau(iauau), access(access), shared(make_shared<Jpleph::CacheBudget>(cacheBudget))
+{
+    if (fileNames.empty())
+    {
+        throw invalid_argument("EphemerisSet: no ephemeris files");
+    }
+
+    for (string const & fileName : fileNames)
+    {
+        Jpleph const probe(fileName, aukm, daysecond, iauau, Access::STREAM, Jpleph::Prefetch(), 1);
+        Jpleph::Constants constants;
+        double dateInterval;
+        unique_ptr<Member> member = make_unique<Member>();
+        member->file.name   = fileName;
+        member->file.number = probe.number();
+        member->file.open   = false;
+        probe.constants(constants, member->file.dateStart, member->file.dateEnd, dateInterval);
+        member->opened.store(nullptr);
+        members.push_back(std::move(member));
+    }
+
+    indexes[0] = buildIndex(members, 0);
+    for (unique_ptr<Member> const & member : members)
+    {
+        if (indexes.count(member->file.number) == 0)
+        {
+            indexes[member->file.number] = buildIndex(members, member->file.number);
+        }
+    }
+}
+
+
+EphemerisSet::~EphemerisSet() {}
+
+
+// the boundaries of the files cut the time axis into pieces. Every piece goes to the first file covering it,
+// neighbouring pieces of the same file are joined. Pieces not covered by any file are gaps of the index
+vector<EphemerisSet::Interval> EphemerisSet::buildIndex(vector<unique_ptr<Member>> const & members, long const number)
+{
+    vector<double> boundaries;
+    for (unique_ptr<Member> const & member : members)
+    {
+        if (number == 0 || member->file.number == number)
+        {
+            boundaries.push_back(member->file.dateStart);
+            boundaries.push_back(member->file.dateEnd);
+        }
+    }
+    sort(boundaries.begin(), boundaries.end());
+    boundaries.erase(unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+    vector<Interval> index;
+    for (size_t k = 0; k + 1 < boundaries.size(); ++k)
+    {
+        for (size_t file = 0; file < members.size(); ++file)
+        {
+            File const & candidate = members[file]->file;
+            if (   (number == 0 || candidate.number == number)
+                && candidate.dateStart <= boundaries[k] && candidate.dateEnd >= boundaries[k + 1])
+            {
+                if (!index.empty() && index.back().file == int(file) && index.back().dateEnd == boundaries[k])
+                {
+                    index.back().dateEnd = boundaries[k + 1];
+                }
+                else
+                {
+                    index.push_back(Interval{ boundaries[k], boundaries[k + 1], int(file) });
+                }
+                break;
+            }
+        }
+    }
+    return index;
+}
+
+
+// the last interval starting at or before the epoch. An epoch on the boundary of two intervals goes to the later one
+int EphemerisSet::locate(Time const & et, long const number) const
+{
+    vector<Interval> const & index = intervals(number);
+    double const t = et.t1 + et.t2;
+    auto interval = upper_bound(index.begin(), index.end(), t, [](double const time, Interval const & rhs) { return time < rhs.dateStart; });
+    if (interval == index.begin() || t > (--interval)->dateEnd)
+    {
+        throw out_of_range("EphemerisSet: date not covered by the ephemeris files");
+    }
+    return interval->file;
+}
+
+
+// double checked: once opened a file is used without locking
+Jpleph const & EphemerisSet::open(int const file) const
+{
+    Member & member = *members[file];
+    Jpleph const * jpleph = member.opened.load(memory_order_acquire);
+    if (jpleph != nullptr)
+    {
+        return *jpleph;
+    }
+
+    lock_guard<mutex> lock(openMutex);
+    if (member.jpleph == nullptr)
+    {
+        member.jpleph = make_unique<Jpleph>(member.file.name, aukm, daysecond, iauau, access, Jpleph::Prefetch(), Jpleph::DEFAULT_CACHE, shared);
+        member.file.open = true;
+        member.opened.store(member.jpleph.get(), memory_order_release);
+    }
+    return *member.jpleph;
+}
+
+
+void EphemerisSet::dpleph(Time const & et, Target const target, Target const center, Posvel & posvel, bool const acceleration, long const number) const
+{
+    open(locate(et, number)).dpleph(et, target, center, posvel, acceleration);
+}
+
+
+Jpleph const & EphemerisSet::ephemeris(Time const & et, long const number) const
+{
+    return open(locate(et, number));
+}
+
+
+vector<EphemerisSet::Interval> const & EphemerisSet::intervals(long const number) const
+{
+    auto const index = indexes.find(number);
+    if (index == indexes.end())
+    {
+        throw invalid_argument("EphemerisSet: no ephemeris file of this DE number");
+    }
+    return index->second;
+}
+
+
+vector<EphemerisSet::File> EphemerisSet::files() const
+{
+    lock_guard<mutex> lock(openMutex);
+    vector<File> result;
+    for (unique_ptr<Member> const & member : members)
+    {
+        result.push_back(member->file);
+    }
+    return result;
+}
+
+
+vector<long> EphemerisSet::numbers() const
+{
+    vector<long> result;
+    for (auto const & index : indexes)
+    {
+        if (index.first != 0)
+        {
+            result.push_back(index.first);
+        }
+    }
+    return result;
+}
+
+
+size_t EphemerisSet::budget() const
+{
+    return shared->capacity();
+}
+
+
+size_t EphemerisSet::cachedRecords() const
+{
+    return shared->used();
+}
+
+
+Jpleph::Statistics EphemerisSet::statistics() const
+{
+    Jpleph::Statistics total;
+    for (unique_ptr<Member> const & member : members)
+    {
+        Jpleph const * jpleph = member->opened.load(memory_order_acquire);
+        if (jpleph == nullptr)
+        {
+            continue;
+        }
+        Jpleph::Statistics const statistics = jpleph->statistics();
+        total.requests     += statistics.requests;
+        total.hits         += statistics.hits;
+        total.misses       += statistics.misses;
+        total.evictions    += statistics.evictions;
+        total.prefetched   += statistics.prefetched;
+        total.bytesRead    += statistics.bytesRead;
+        total.derivedBytes += statistics.derivedBytes;
+        total.singleBytes  += statistics.singleBytes;
+        total.ioSeconds    += statistics.ioSeconds;
+        for (int i = 0; i < EphemerisRecord::HISTOGRAM_SIZE; ++i)
+        {
+            total.distances[i] += statistics.distances[i];
+        }
+    }
+    return total;
+}
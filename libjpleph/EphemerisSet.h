@@ -0,0 +1,111 @@
+//
+// several ephemeris files used as one ephemeris, e.g. DE441 in its two halves or different DE versions side by side
+//
+// The time spans of the files form an index of intervals, each served by a single file. Where files overlap the one
+// given first serves the overlap. A query is dispatched by a binary search over the starts of the intervals.
+// Every DE number has an index of its own, the index for number 0 takes all files.
+//
+// Opening the set reads the header and the first record of every file only. A file is opened for evaluation
+// (i.e. mapped for Access::MAPPED) when the first query needs it. All files share one budget of cached records
+// (see EphemerisRecord::CacheBudget): the cache of a file grows as long as the budget allows, then it replaces its
+// own records.
+//
+//   EphemerisSet const de441({ "de441_part-1.eph", "de441_part-2.eph" });
+//   de441.dpleph(et, Target::MARS, Target::EARTH, posvel);
+//
+// Thread safe as Jpleph: all const methods may be called concurrently.
+//
+#pragma once
+#ifndef EPHEMERISSET_H
+#define EPHEMERISSET_H
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "jpleph.h"
+
+
+class EphemerisSet
+{
+public:
+    typedef Jpleph::Target Target;
+    typedef Jpleph::Time   Time;
+    typedef Jpleph::Posvel Posvel;
+    typedef Jpleph::Access Access;
+
+    static std::size_t const DEFAULT_BUDGET = 64; // records cached for all files together
+
+    struct File
+    {
+        std::string name;
+        long        number;    // the DE number
+        double      dateStart; // julian ephemeris days
+        double      dateEnd;
+        bool        open;      // opened for evaluation
+    };
+
+    // an interval of the index served by the file 'file' (index into files())
+    struct Interval
+    {
+        double dateStart;
+        double dateEnd;
+        int    file;
+    };
+
+    // the units as for Jpleph. Throws as the constructor of Jpleph for a file that can't be read
+    explicit EphemerisSet(std::vector<std::string> const & fileNames, bool aukm = true, bool daysecond = true, bool iauau = false,
+                          Access const access = Access::MAPPED, std::size_t const cacheBudget = DEFAULT_BUDGET);
+    ~EphemerisSet();
+
+    // dpleph of the file serving 'et' in the index of the DE 'number' (0: all files). Throws out_of_range if no file
+    // covers the epoch, invalid_argument for a number without files
+    void dpleph(Time const & et, Target const target, Target const center, Posvel & posvel, bool const acceleration = false,
+                long const number = 0) const;
+
+    // the file serving 'et', opened if necessary. Throws as dpleph
+    Jpleph const & ephemeris(Time const & et, long const number = 0) const;
+
+    // the index of the DE 'number' (0: all files) in increasing order. Throws invalid_argument for a number without files
+    std::vector<Interval> const & intervals(long const number = 0) const;
+
+    std::vector<File> files() const;
+
+    // the DE numbers of the files in increasing order
+    std::vector<long> numbers() const;
+
+    // the cache budget shared by the files and the number of records cached
+    std::size_t budget() const;
+    std::size_t cachedRecords() const;
+
+    // the usage of the caches of the files opened so far, added up
+    Jpleph::Statistics statistics() const;
+
+private:
+    struct Member
+    {
+        File                        file;
+        std::unique_ptr<Jpleph>     jpleph;  // nullptr until the first query
+        std::atomic<Jpleph const *> opened;  // set once jpleph is complete
+    };
+
+    static std::vector<Interval> buildIndex(std::vector<std::unique_ptr<Member>> const & members, long const number);
+    int locate(Time const & et, long const number) const;
+    Jpleph const & open(int const file) const;
+
+    bool const   aukm;
+    bool const   daysecond;
+    bool const   iauau;
+    Access const access;
+
+    std::shared_ptr<Jpleph::CacheBudget> const shared; // the budget of all files
+    std::vector<std::unique_ptr<Member>>       members;
+    std::map<long, std::vector<Interval>>      indexes; // by DE number, 0: all files
+    mutable std::mutex                         openMutex;
+};
+
+#endif
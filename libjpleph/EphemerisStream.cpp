@@ -0,0 +1,224 @@
+//
+// states of a body pair on a regular time grid (see EphemerisStream.h)
+//
+#include <cmath>
+
+#include "EphemerisStream.h"
+
+using namespace std;
+
+namespace
+{
+    double const SECONDS_PER_DAY  = 86400.0;
+    double const MIN_SUB_STEPS    = 4.0;   // steps per sub intervall from which the combined series pays off
+}
+
+
+EphemerisStream::EphemerisStream(Jpleph const & jpleph, Target const target, Target const center, Time const & tStart, double const step,
+                                 bool const acceleration)
+    : jpleph(jpleph), target(target), center(center), start(tStart), step(step), acceleration(acceleration),
+      count(0), record(-1), baseIndex(0), baseTime(0.0), scaledStep(double(step / jpleph.dateInterval)),
+      combined(false), pairEntry(-1), numCoefficient(0), numEntries(0), scale{ 0.0, 0.0, 0.0 }, subCoefficients(nullptr), blockSub(-1),
+      ended(false)
+{
+    jpleph.checkTargetCenter(target, center);
+    prepareSeries();
+    evaluate();
+}
+
+
+EphemerisStream::Posvel const & EphemerisStream::operator*() const
+{
+    return current;
+}
+
+
+EphemerisStream & EphemerisStream::operator++()
+{
+    if (!ended)
+    {
+        ++count;
+        evaluate();
+    }
+    return *this;
+}
+
+
+bool EphemerisStream::atEnd() const
+{
+    return ended;
+}
+
+
+EphemerisStream::Time EphemerisStream::time() const
+{
+    Time et;
+    et.t1 = start.t1;
+    et.t2 = start.t2 + double(count) * step;
+    return et;
+}
+
+
+long long EphemerisStream::index() const
+{
+    return count;
+}
+
+
+// the pair of bodies as a single series: the derived series of jpleph, otherwise the linear combination of the
+// barycentric series of target and center (as Jpleph::deriveSeries). Only when a sub intervall takes several steps,
+// otherwise the combination costs more than it saves
+void EphemerisStream::prepareSeries()
+{
+    if (   target > Target::EM_BARYCENTER || center > Target::EM_BARYCENTER || target == center
+        || !jpleph.bodyPresent[int(target)] || !jpleph.bodyPresent[int(center)])
+    {
+        return;
+    }
+
+    double sign = 1.0;
+    Jpleph::Derived const & pair = jpleph.derived[int(target)][int(center)];
+    if (pair.entry >= 0)
+    {
+        EphemerisRecord::RecordDescriptorEntry const descriptor = jpleph.record.getDescriptorEntry(pair.entry);
+        pairEntry      = pair.entry;
+        sign           = pair.sign;
+        numCoefficient = descriptor.numCoefficient;
+        numEntries     = descriptor.numEntries;
+    }
+    else
+    {
+        EphemerisRecord::Derivation derivation;
+        jpleph.barycentricTerms(target, 1.0, derivation.terms);
+        jpleph.barycentricTerms(center, -1.0, derivation.terms);
+        series = jpleph.record.prepareSeries(derivation);
+        numCoefficient = series.numCoefficient;
+        numEntries     = series.numEntries;
+        block.resize(size_t(numCoefficient) * 3);
+    }
+    combined = fabs(scaledStep) * numEntries * MIN_SUB_STEPS <= 1.0;
+
+    // derivatives with respect to tc -> per second (as Chebysheff), then the units of dpleph
+    double const vfac = (2.0 * numEntries) / double(jpleph.dateInterval * SECONDS_PER_DAY);
+    scale[0] = sign * jpleph.xscale;
+    scale[1] = sign * vfac * jpleph.vscale;
+    scale[2] = sign * (vfac * vfac) * jpleph.ascale;
+}
+
+
+// within the current record the normalized time follows from the index. The epoch is located as by dpleph
+// for the first epoch and whenever the grid leaves the record
+void EphemerisStream::evaluate()
+{
+    double tScaled = baseTime + double(count - baseIndex) * scaledStep;
+    if (chebysheff == nullptr || tScaled < 0.0 || tScaled >= 1.0)
+    {
+        Time const et = time();
+        Time interpolationTime;
+        jpleph.determineTime(et, interpolationTime);
+        if (!jpleph.inDateRange(interpolationTime))
+        {
+            ended = true;
+            return;
+        }
+
+        long double located;
+        int const loadRecord = jpleph.locateRecord(interpolationTime, located);
+        if (loadRecord != record || chebysheff == nullptr)
+        {
+            chebysheff.reset(); // unpin the previous record first
+            view.reset();
+            view       = make_unique<EphemerisRecord::RecordType>(jpleph.record[loadRecord]);
+            chebysheff = make_unique<Chebysheff>(*view, double(jpleph.dateInterval * SECONDS_PER_DAY));
+            record     = loadRecord;
+            blockSub   = -1;
+        }
+        baseIndex = count;
+        baseTime  = double(located);
+        tScaled   = baseTime;
+    }
+
+    if (target <= Target::EM_BARYCENTER && target == center)
+    {
+        current = Posvel();
+        return;
+    }
+    if (!combined)
+    {
+        jpleph.evaluatePair(*chebysheff, tScaled, target, center, acceleration, current);
+        return;
+    }
+
+    // a single series: one evaluation per step
+    int sub = 0;
+    double const tc = Chebysheff::normalizedTime(tScaled, numEntries, sub);
+    if (sub != blockSub)
+    {
+        if (pairEntry >= 0)
+        {
+            int const size = numCoefficient * 3;
+            EphemerisRecord::RecordDescriptorEntry const & descriptor = view->getDescriptor(pairEntry);
+            subCoefficients = view->coefficients(size_t(descriptor.recordIndex + sub * size), size_t(size));
+        }
+        else
+        {
+            jpleph.record.deriveCoefficients(series, *view, sub, block.data());
+            subCoefficients = block.data();
+        }
+        blockSub = sub;
+    }
+    Clenshaw::evaluate(subCoefficients, numCoefficient, 3, tc, current.pos.data(), current.vel.data(), acceleration ? current.acc.data() : nullptr);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        current.pos[i] *= scale[0];
+        current.vel[i] *= scale[1];
+        current.acc[i]  = acceleration ? current.acc[i] * scale[2] : 0.0;
+    }
+}
+
+
+EphemerisStream::iterator EphemerisStream::begin()
+{
+    return iterator(this);
+}
+
+
+EphemerisStream::iterator EphemerisStream::end()
+{
+    return iterator(nullptr);
+}
+
+
+EphemerisStream::iterator::iterator(EphemerisStream * stream) : stream(stream) {}
+
+EphemerisStream::Posvel const & EphemerisStream::iterator::operator*() const
+{
+    return **stream;
+}
+
+EphemerisStream::Posvel const * EphemerisStream::iterator::operator->() const
+{
+    return &**stream;
+}
+
+EphemerisStream::iterator & EphemerisStream::iterator::operator++()
+{
+    ++*stream;
+    return *this;
+}
+
+bool EphemerisStream::iterator::operator==(iterator const & rhs) const
+{
+    return atEnd() == rhs.atEnd();
+}
+
+bool EphemerisStream::iterator::operator!=(iterator const & rhs) const
+{
+    return !(*this == rhs);
+}
+
+bool EphemerisStream::iterator::atEnd() const
+{
+    return stream == nullptr || stream->atEnd();
+}
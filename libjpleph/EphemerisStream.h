@@ -0,0 +1,103 @@
+//
+// states of a body pair on a regular time grid (see Jpleph::stream), e.g. for tables or for sampling an integrator
+//
+// The record of the current epoch stays pinned and its Chebysheff object is kept. From one epoch to the next only the
+// normalized time within the record is advanced; the epoch is converted, range checked and looked up again only
+// when the grid leaves the record. A pair of bodies is evaluated as a single series: the derived series of the pair
+// (see Jpleph::deriveSeries) or the combination of the series of target and center, built once per sub intervall
+// of the record when the grid takes several steps in it. The results agree with dpleph at the same epochs to the
+// rounding of that time and of the combination.
+//
+//   for (Jpleph::Posvel const & posvel : jpleph.stream(Target::MOON, Target::EARTH, start, 0.01)) { ... }
+//
+// The range ends with the first epoch outside of the ephemeris. A stream is used by a single thread
+//
+#pragma once
+#ifndef EPHEMERISSTREAM_H
+#define EPHEMERISSTREAM_H
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "jpleph.h"
+#include "Chebysheff.h"
+
+
+class EphemerisStream
+{
+public:
+    typedef Jpleph::Time   Time;
+    typedef Jpleph::Posvel Posvel;
+    typedef Jpleph::Target Target;
+
+    // the epochs tStart + k * step (days) for k = 0, 1, 2 ... Throws as dpleph for invalid targets and centers
+    EphemerisStream(Jpleph const & jpleph, Target const target, Target const center, Time const & tStart, double const step,
+                    bool const acceleration = false);
+
+    Posvel const & operator*() const;  // the state at the current epoch
+    EphemerisStream & operator++();    // advance to the next epoch
+    bool atEnd() const;                // the current epoch is outside of the ephemeris
+    Time time() const;                 // the current epoch
+    long long index() const;           // number of steps from tStart to the current epoch
+
+    class iterator
+    {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef Posvel                  value_type;
+        typedef std::ptrdiff_t          difference_type;
+        typedef Posvel const *          pointer;
+        typedef Posvel const &          reference;
+
+        explicit iterator(EphemerisStream * stream);
+        Posvel const & operator*() const;
+        Posvel const * operator->() const;
+        iterator & operator++();
+        bool operator==(iterator const & rhs) const; // iterators only compare by being at the end
+        bool operator!=(iterator const & rhs) const;
+
+    private:
+        bool atEnd() const;
+        EphemerisStream * stream; // nullptr: the end
+    };
+
+    iterator begin(); // the current epoch
+    iterator end();
+
+private:
+    void prepareSeries();
+    void evaluate();
+
+    Jpleph const & jpleph;
+    Target target;
+    Target center;
+    Time   start;
+    double step;
+    bool   acceleration;
+
+    long long count;       // index of the current epoch
+    int       record;      // the record of the chebysheff object
+    long long baseIndex;   // the epoch at which the record was located
+    double    baseTime;    // its normalized time within the record (0.0 ... 1.0)
+    double    scaledStep;  // step in normalized time of the record
+    std::unique_ptr<EphemerisRecord::RecordType> view; // pins the record
+    std::unique_ptr<Chebysheff> chebysheff; // on the pinned record, replaced when the grid leaves it
+
+    // the pair as a single series
+    bool   combined;       // evaluated as a single series, otherwise by Jpleph::evaluatePair
+    int    pairEntry;      // the derived series of jpleph, -1: the combination 'series'
+    int    numCoefficient;
+    int    numEntries;     // sub intervals of the series
+    double scale[3];       // of position, velocity and acceleration: units of dpleph, sign of a reversed pair
+    EphemerisRecord::DerivedSeries series;
+    std::vector<double> block;     // the combination for the current sub intervall
+    double const * subCoefficients; // the coefficients of sub intervall 'blockSub' of the record
+    int    blockSub;               // -1: none
+
+    Posvel current;
+    bool   ended;
+};
+
+#endif
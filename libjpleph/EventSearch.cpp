@@ -0,0 +1,464 @@
+//
+// search for events directly on chebysheff series (see EventSearch.h)
+//
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <stdexcept>
+
+#include "EventSearch.h"
+#include "Clenshaw.h"
+
+using namespace std;
+
+namespace
+{
+    double const PI = 3.14159265358979323846;
+
+    // obliquity of the ecliptic J2000 (IAU 2006: 84381.406 arcseconds)
+    double const OBLIQUITY     = 84381.406 / 3600.0 * PI / 180.0;
+    double const COS_OBLIQUITY = cos(OBLIQUITY);
+    double const SIN_OBLIQUITY = sin(OBLIQUITY);
+
+    int const    MAX_NODES        = 64;    // upper limit for the number of nodes i.e. the degree of the fitted series
+    int const    MAX_SPLITS       = 4;     // number of halvings of a sub interval if the fitted series doesn't converge
+    double const CONVERGENCE      = 1e-10; // relative size of the last coefficients of a converged series
+    int const    MAX_DEPTH        = 10;    // number of interval halvings when bracketing roots
+    int const    MAX_REFINEMENT   = 60;    // steps on the exact event function, usually a few Newton steps suffice
+    double const NEWTON_TOLERANCE = 1e-9;  // days, the Newton steps stop below this correction
+    double const SERIES_TOLERANCE = 1e-13; // normalized time, precision of the roots of the fitted series
+    double const INSIDE           = 1e-12; // normalized time, distance of the exact evaluations from the ends of a sub interval
+    double const DUPLICATE_EVENTS = 1e-7;  // days, events found in two neighboring sub intervals
+
+
+    // the series s(x) = c[0] + c[1] T1(x) + ... on the normalized interval -1 <= x <= 1
+    struct Series
+    {
+        double c[MAX_NODES];
+        int    n;
+    };
+
+    double value(Series const & series, double const x, double & derivative)
+    {
+        double p;
+        Clenshaw::evaluate(series.c, series.n, 1, x, &p, &derivative, nullptr);
+        return p;
+    }
+
+    double value(Series const & series, double const x)
+    {
+        double p;
+        Clenshaw::evaluate(series.c, series.n, 1, x, &p, nullptr, nullptr);
+        return p;
+    }
+
+    // x of the chebysheff node k of n i.e. the roots of Tn
+    double node(int const k, int const n)
+    {
+        return cos(PI * (k + 0.5) / n);
+    }
+
+    // the chebysheff series through the values f[k] at the n nodes (discrete cosine transform).
+    // Exact for polynomials of degree < n
+    void fit(double const * f, int const n, Series & series)
+    {
+        series.n = n;
+        for (int j = 0; j < n; ++j)
+        {
+            double sum = 0.0;
+            for (int k = 0; k < n; ++k)
+            {
+                sum += f[k] * cos(PI * j * (k + 0.5) / n);
+            }
+            series.c[j] = sum * (j == 0 ? 1.0 : 2.0) / n;
+        }
+    }
+
+    // the same polynomial as 'series' re-expanded on the part lo <= x <= hi
+    void restrict(Series const & series, double const lo, double const hi, Series & part)
+    {
+        double f[MAX_NODES];
+        double const mid  = 0.5 * (hi + lo);
+        double const half = 0.5 * (hi - lo);
+        for (int k = 0; k < series.n; ++k)
+        {
+            f[k] = value(series, mid + half * node(k, series.n));
+        }
+        fit(f, series.n, part);
+    }
+
+    // the series of the derivative ds/dx
+    void derivative(Series const & series, Series & result)
+    {
+        int const n = series.n;
+        result.n = max(n - 1, 1);
+        fill(result.c, result.c + MAX_NODES, 0.0);
+
+        // d[k-1] = d[k+1] + 2 k c[k] with the first coefficient halved
+        double next = 0.0;     // d[k+1]
+        double nextNext = 0.0; // d[k+2]
+        for (int k = n - 1; k >= 1; --k)
+        {
+            double const d = nextNext + 2.0 * k * series.c[k];
+            result.c[k - 1] = d;
+            nextNext = next;
+            next = d;
+        }
+        result.c[0] *= 0.5;
+    }
+
+    // |c0| > |c1| + ... + |cn|: the series has no root because |Tk(x)| <= 1
+    bool rootFree(Series const & series)
+    {
+        double bound = 0.0;
+        for (int k = 1; k < series.n; ++k)
+        {
+            bound += fabs(series.c[k]);
+        }
+        return fabs(series.c[0]) > bound;
+    }
+
+    // the intervals [lo, hi] of the normalized time with a sign change of 'series' and exactly one root.
+    // A series vanishing identically has no (isolated) roots
+    void bracket(Series const & series, double const lo, double const hi, int const depth, vector<pair<double, double>> & brackets)
+    {
+        Series part;
+        restrict(series, lo, hi, part);
+        if (rootFree(part) || all_of(part.c, part.c + part.n, [](double const c) { return c == 0.0; }))
+        {
+            return;
+        }
+
+        bool const signChange = (value(series, lo) < 0.0) != (value(series, hi) < 0.0);
+        Series slope;
+        derivative(part, slope);
+        if (rootFree(slope) || depth == 0) // monotone
+        {
+            if (signChange)
+            {
+                brackets.emplace_back(lo, hi);
+            }
+            return;
+        }
+
+        double const mid = 0.5 * (lo + hi);
+        bracket(series, lo, mid, depth - 1, brackets);
+        bracket(series, mid, hi, depth - 1, brackets);
+    }
+
+    // the root of 'series' in a bracket: Newton steps, bisection if they leave the bracket
+    double solve(Series const & series, double lo, double hi)
+    {
+        bool const rising = value(series, lo) < 0.0;
+        double x = 0.5 * (lo + hi);
+        for (int iteration = 0; iteration < 100 && hi - lo > SERIES_TOLERANCE; ++iteration)
+        {
+            double slope;
+            double const s = value(series, x, slope);
+            if ((s < 0.0) == rising)
+            {
+                lo = x;
+            }
+            else
+            {
+                hi = x;
+            }
+
+            double const step = slope != 0.0 ? s / slope : 0.0;
+            double const newton = x - step;
+            if (slope == 0.0 || newton <= lo || newton >= hi)
+            {
+                x = 0.5 * (lo + hi);
+            }
+            else
+            {
+                x = newton;
+                if (fabs(step) < SERIES_TOLERANCE)
+                {
+                    break;
+                }
+            }
+        }
+        return x;
+    }
+
+    // ecliptic coordinates x, y (mean ecliptic J2000) of an equatorial position
+    void ecliptic(Jpleph::Posvel const & posvel, double & x, double & y)
+    {
+        x = posvel.pos[0];
+        y = posvel.pos[1] * COS_OBLIQUITY + posvel.pos[2] * SIN_OBLIQUITY;
+    }
+}
+
+
+EventSearch::EventSearch(Jpleph const & jpleph, Target const target, Target const center, Target const reference, unsigned const numThreads)
+    : jpleph(jpleph), target(target), center(center), reference(reference), numThreads(numThreads), dateStart(0.0), dateEnd(0.0),
+      pieceLength(0.0), piecesPerRecord(1), numNodes(0)
+{
+    if (this->numThreads == 0)
+    {
+        this->numThreads = max(thread::hardware_concurrency(), 1u);
+    }
+
+    Jpleph::Constants constants;
+    double dateInterval;
+    jpleph.constants(constants, dateStart, dateEnd, dateInterval);
+
+    // the sub intervals common to all series involved, the fitted series has twice the degree of the finest one
+    int subIntervals = 1;
+    int coefficients = 1;
+    for (Target const body : { target, center, reference })
+    {
+        Jpleph::Layout const layout = jpleph.layout(body);
+        if (layout.subIntervals <= 0 || layout.coefficients <= 0)
+        {
+            throw invalid_argument("EventSearch: target not in ephemeris file");
+        }
+        subIntervals = lcm(subIntervals, layout.subIntervals);
+        coefficients = max(coefficients, layout.coefficients);
+    }
+    pieceLength = dateInterval / subIntervals;
+    piecesPerRecord = subIntervals;
+    numNodes = min(max(2 * coefficients, 8), MAX_NODES);
+}
+
+
+vector<EventSearch::Event> EventSearch::roots(Function const & function, double const tStart, double const tEnd) const
+{
+    return search(function, tStart, tEnd, false);
+}
+
+
+vector<EventSearch::Event> EventSearch::extrema(Function const & function, double const tStart, double const tEnd) const
+{
+    return search(function, tStart, tEnd, true);
+}
+
+
+// the sub intervals are processed in parallel, a thread takes all sub intervals of a record at once
+vector<EventSearch::Event> EventSearch::search(Function const & function, double const tStart, double const tEnd, bool const extrema) const
+{
+    double const start = max(tStart, dateStart);
+    double const end   = min(tEnd, dateEnd);
+    vector<Event> events;
+    if (start >= end)
+    {
+        return events;
+    }
+
+    long long const numPieces = llround((dateEnd - dateStart) / pieceLength);
+    long long const first     = min(max(0LL, (long long)(floor((start - dateStart) / pieceLength))), numPieces - 1);
+    long long const last      = min(max(first + 1, (long long)(ceil((end - dateStart) / pieceLength))), numPieces);
+
+    atomic<long long> nextRecord(first / piecesPerRecord);
+    vector<vector<Event>> found(numThreads);
+    vector<exception_ptr> errors(numThreads);
+    auto worker = [&](unsigned const index)
+    {
+        try
+        {
+            for (long long record = nextRecord++; record * piecesPerRecord < last; record = nextRecord++)
+            {
+                long long const begin = max(first, record * piecesPerRecord);
+                long long const stop  = min(last, (record + 1) * piecesPerRecord);
+                for (long long piece = begin; piece < stop; ++piece)
+                {
+                    double const mid = dateStart + (double(piece) + 0.5) * pieceLength;
+                    searchPiece(function, mid, 0.5 * pieceLength, MAX_SPLITS, start, end, extrema, found[index]);
+                }
+            }
+        }
+        catch (...)
+        {
+            errors[index] = current_exception();
+        }
+    };
+
+    vector<thread> threads;
+    for (unsigned index = 1; index < numThreads; ++index)
+    {
+        threads.emplace_back(worker, index);
+    }
+    worker(0);
+    for (thread & running : threads)
+    {
+        running.join();
+    }
+    for (exception_ptr const & error : errors)
+    {
+        if (error)
+        {
+            rethrow_exception(error);
+        }
+    }
+
+    for (vector<Event> const & part : found)
+    {
+        events.insert(events.end(), part.begin(), part.end());
+    }
+    sort(events.begin(), events.end(), [](Event const & lhs, Event const & rhs) { return lhs.time < rhs.time; });
+
+    // a root exactly on the border of two sub intervals is found in both
+    auto const duplicate = [](Event const & lhs, Event const & rhs)
+    {
+        return lhs.kind == rhs.kind && rhs.time - lhs.time < DUPLICATE_EVENTS;
+    };
+    events.erase(unique(events.begin(), events.end(), duplicate), events.end());
+    return events;
+}
+
+
+// fit the event function on the interval mid - half ... mid + half (a sub interval), bracket the roots of the series
+// (extrema: of its derivative) and refine them. If the series doesn't converge the interval is split in halves
+void EventSearch::searchPiece(Function const & function, double const mid, double const half, int const splits,
+                              double const tStart, double const tEnd, bool const extrema, vector<Event> & events) const
+{
+    double f[MAX_NODES];
+    for (int k = 0; k < numNodes; ++k)
+    {
+        f[k] = evaluate(function, mid, half * node(k, numNodes));
+    }
+    Series series;
+    fit(f, numNodes, series);
+
+    double const scale = fabs(*max_element(series.c, series.c + numNodes, [](double const a, double const b) { return fabs(a) < fabs(b); }));
+    double const tail  = fabs(series.c[numNodes - 1]) + fabs(series.c[numNodes - 2]);
+    if (tail > CONVERGENCE * scale && splits > 0)
+    {
+        searchPiece(function, mid - 0.5 * half, 0.5 * half, splits - 1, tStart, tEnd, extrema, events);
+        searchPiece(function, mid + 0.5 * half, 0.5 * half, splits - 1, tStart, tEnd, extrema, events);
+        return;
+    }
+
+    Series searched; // the series whose roots are searched
+    if (extrema)
+    {
+        derivative(series, searched);
+    }
+    else
+    {
+        searched = series;
+    }
+
+    vector<pair<double, double>> brackets;
+    bracket(searched, -1.0, 1.0, MAX_DEPTH, brackets);
+
+    for (pair<double, double> const & range : brackets)
+    {
+        double const x = solve(searched, range.first, range.second);
+        bool const rising = value(searched, range.first) < 0.0;
+
+        Event event;
+        event.kind = extrema ? (rising ? Kind::MINIMUM : Kind::MAXIMUM) : (rising ? Kind::RISING : Kind::FALLING);
+        double offset = half * x;
+        if (!extrema)
+        {
+            // Newton steps on the exact function with the slope of the series. The bracket is kept on the
+            // exact function, steps leaving it are replaced by bisection. The ends of the sub interval belong to the
+            // neighbors, the exact function is only evaluated inside
+            double lo = half * max(range.first, -1.0 + INSIDE);
+            double hi = half * min(range.second, 1.0 - INSIDE);
+            bool const negativeLo = evaluate(function, mid, lo) < 0.0;
+            if (negativeLo == (evaluate(function, mid, hi) < 0.0))
+            {
+                continue; // the series doesn't follow the function closely enough
+            }
+            for (int step = 0; step < MAX_REFINEMENT && hi - lo > NEWTON_TOLERANCE; ++step)
+            {
+                double const f = evaluate(function, mid, offset);
+                if (f == 0.0)
+                {
+                    break;
+                }
+                ((f < 0.0) == negativeLo ? lo : hi) = offset;
+
+                double slope;
+                value(series, offset / half, slope);
+                slope /= half;
+                double const newton = slope != 0.0 ? offset - f / slope : lo;
+                if (newton <= lo || newton >= hi)
+                {
+                    offset = 0.5 * (lo + hi);
+                }
+                else
+                {
+                    bool const converged = fabs(newton - offset) < NEWTON_TOLERANCE;
+                    offset = newton;
+                    if (converged)
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+        event.time  = mid + offset;
+        event.value = evaluate(function, mid, offset);
+        if (event.time >= tStart && event.time <= tEnd)
+        {
+            events.push_back(event);
+        }
+    }
+}
+
+
+double EventSearch::evaluate(Function const & function, double const t1, double const t2) const
+{
+    Jpleph::Time et;
+    et.t1 = t1;
+    et.t2 = t2;
+
+    Jpleph::Posvel body;
+    Jpleph::Posvel relative;
+    jpleph.dpleph(et, target, center, body);
+    if (reference != Target::NONE)
+    {
+        jpleph.dpleph(et, reference, center, relative);
+    }
+    return function(body, relative);
+}
+
+
+EventSearch::Function EventSearch::distance()
+{
+    return [](Jpleph::Posvel const & body, Jpleph::Posvel const &)
+    {
+        return sqrt(body.pos[0] * body.pos[0] + body.pos[1] * body.pos[1] + body.pos[2] * body.pos[2]);
+    };
+}
+
+
+EventSearch::Function EventSearch::longitude(double const angle)
+{
+    double const cosAngle = cos(angle);
+    double const sinAngle = sin(angle);
+    return [cosAngle, sinAngle](Jpleph::Posvel const & body, Jpleph::Posvel const &)
+    {
+        double x;
+        double y;
+        ecliptic(body, x, y);
+        return (y * cosAngle - x * sinAngle) / hypot(x, y);
+    };
+}
+
+
+EventSearch::Function EventSearch::longitudeDifference(double const angle)
+{
+    double const cosAngle = cos(angle);
+    double const sinAngle = sin(angle);
+    return [cosAngle, sinAngle](Jpleph::Posvel const & body, Jpleph::Posvel const & reference)
+    {
+        double xb;
+        double yb;
+        double xr;
+        double yr;
+        ecliptic(body, xb, yb);
+        ecliptic(reference, xr, yr);
+        double const norm       = hypot(xb, yb) * hypot(xr, yr);
+        double const sinLongitude = (yb * xr - xb * yr) / norm;
+        double const cosLongitude = (xb * xr + yb * yr) / norm;
+        return sinLongitude * cosAngle - cosLongitude * sinAngle;
+    };
+}
@@ -0,0 +1,80 @@
+//
+// search for events (conjunctions, oppositions, lunar phases, equinoxes, perihelion/aphelion ...) in an ephemeris
+//
+// The event function of a body pair is evaluated at the chebysheff nodes of every sub interval of the ephemeris
+// and turned into a chebysheff series on that sub interval. Roots are bracketed with the bound
+// |c0| > |c1| + ... + |cn| (no root) on recursively halved intervals, then refined with a few Newton steps on the
+// exact event function. Extrema are the roots of the derivative of the series.
+// The records are searched in parallel, i.e. multi century searches take seconds.
+//
+#pragma once
+#ifndef EVENTSEARCH_H
+#define EVENTSEARCH_H
+
+#include <functional>
+#include <vector>
+
+#include "jpleph.h"
+
+
+class EventSearch
+{
+public:
+    typedef Jpleph::Target Target;
+
+    // the event function: a smooth scalar function of the state of 'target' and of 'reference' relative to 'center'.
+    // 'reference' is all 0.0 if no reference body is searched. The function is called concurrently by several threads
+    typedef std::function<double(Jpleph::Posvel const & body, Jpleph::Posvel const & reference)> Function;
+
+    enum class Kind
+    {
+        RISING  = 0, // root, the function changes from negative to positive
+        FALLING = 1, // root, the function changes from positive to negative
+        MINIMUM = 2,
+        MAXIMUM = 3,
+    };
+
+    struct Event
+    {
+        double time;  // julian ephemeris date
+        Kind   kind;
+        double value; // value of the event function at 'time'
+    };
+
+    // events of 'target' relative to 'center' and optionally of a 2nd body 'reference' relative to 'center'
+    // e.g. Mars, Earth, Sun for oppositions of Mars. numThreads == 0: one thread per processor
+    EventSearch(Jpleph const & jpleph, Target const target, Target const center, Target const reference = Target::NONE,
+                unsigned const numThreads = 0);
+
+    // the roots of 'function' between tStart and tEnd, sorted by time. Precision better than 0.01 seconds
+    std::vector<Event> roots(Function const & function, double const tStart, double const tEnd) const;
+
+    // the local minima and maxima of 'function' between tStart and tEnd, sorted by time
+    std::vector<Event> extrema(Function const & function, double const tStart, double const tEnd) const;
+
+    // ready made event functions. Longitudes are ecliptic longitudes (mean ecliptic of J2000) seen from 'center'
+    static Function distance();                            // |target - center|, extrema: perihelion/aphelion, perigee/apogee
+    static Function longitude(double const angle);         // sin(lambda(target) - angle), roots: equinoxes (Sun, 0), solstices (Sun, pi/2)
+    static Function longitudeDifference(double const angle); // sin(lambda(target) - lambda(reference) - angle)
+                                                             // roots: conjunctions and oppositions (0), lunar phases (0, pi/2)
+
+private:
+    std::vector<Event> search(Function const & function, double const tStart, double const tEnd, bool const extrema) const;
+    void searchPiece(Function const & function, double const mid, double const half, int const splits,
+                     double const tStart, double const tEnd, bool const extrema, std::vector<Event> & events) const;
+    double evaluate(Function const & function, double const t1, double const t2) const;
+
+    Jpleph const & jpleph;
+    Target target;
+    Target center;
+    Target reference;
+    unsigned numThreads;
+
+    double dateStart;
+    double dateEnd;
+    double pieceLength; // length of the sub intervals common to all bodies in days
+    long long piecesPerRecord;
+    int    numNodes;    // number of chebysheff nodes per sub interval
+};
+
+#endif
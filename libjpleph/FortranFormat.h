@@ -0,0 +1,93 @@
+//
+// layout of the binary ephemeris files published by JPL (written by JPL's Fortran asc2eph.f, direct access, fixed record length)
+//
+//   record 1     TTL        3 * 84 characters
+//                CNAM       400 * 6 characters, the first OLDMAX constant names
+//                SS         3 double: start date, end date, record interval
+//                NCON       int32, number of constants
+//                AU, EMRAT  double
+//                IPT(3,12)  int32: index, coefficients, sub intervals of Mercury ... Nutation (GROUP 1050)
+//                NUMDE      int32
+//                IPT(3,13)  int32: librations
+//                CNAM       (NCON - 400) * 6 characters (DE430 and later, if there are more than 400 constants)
+//                IPT(3,14)  int32: lunar mantle angular velocity (DE430 and later)
+//                IPT(3,15)  int32: TT-TDB (DE430 and later)
+//   record 2     CVAL       NCON double
+//   record 3...  the data: NCOEFF double per record (start date, end date, coefficients)
+//
+// The record length is NCOEFF * 8 bytes (KSIZE = 2 * NCOEFF 4 byte words). It is not stored in the file, it follows
+// from IPT. There is no padding between the fields of record 1 i.e. its doubles are not aligned.
+// Long ephemerides are split into several files (DE441: two segments), every one is a complete ephemeris file.
+// The files have no byte order mark. A file of the other byte order is recognized by implausible NCON and NUMDE.
+//
+#pragma once
+#ifndef FORTRANFORMAT_H
+#define FORTRANFORMAT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+
+namespace FortranFormat
+{
+    static std::size_t const TTL_LENGTH  = 84;  // characters per title line
+    static std::size_t const NUM_TTL     = 3;
+    static std::size_t const NAME_LENGTH = 6;   // characters per constant name
+    static int const         OLDMAX      = 400; // number of constant names in the fixed part of record 1
+    static int const         NUM_ENTRIES = 15;  // entries of IPT
+
+    static std::size_t const NAMES_OFFSET     = NUM_TTL * TTL_LENGTH;
+    static std::size_t const SS_OFFSET        = NAMES_OFFSET + OLDMAX * NAME_LENGTH;
+    static std::size_t const NCON_OFFSET      = SS_OFFSET + 3 * sizeof(double);
+    static std::size_t const AU_OFFSET        = NCON_OFFSET + sizeof(std::int32_t);
+    static std::size_t const EMRAT_OFFSET     = AU_OFFSET + sizeof(double);
+    static std::size_t const IPT_OFFSET       = EMRAT_OFFSET + sizeof(double);
+    static std::size_t const NUMDE_OFFSET     = IPT_OFFSET + 12 * 3 * sizeof(std::int32_t);
+    static std::size_t const LIBRATION_OFFSET = NUMDE_OFFSET + sizeof(std::int32_t);
+    static std::size_t const FIXED_SIZE       = LIBRATION_OFFSET + 3 * sizeof(std::int32_t); // start of the DE430 extension
+
+    // number of components of the entries. Not in the file, fixed by the type of the entry
+    static int const DIMENSIONS[NUM_ENTRIES] = { 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 2, 3, 3, 1 };
+
+    // unaligned value of record 1
+    template<typename T>
+    T value(char const * record, std::size_t const offset)
+    {
+        T result;
+        std::memcpy(&result, record + offset, sizeof(result));
+        return result;
+    }
+
+    inline std::int32_t byteSwapped(std::int32_t const value)
+    {
+        std::uint32_t const v = std::uint32_t(value);
+        return std::int32_t((v >> 24) | ((v >> 8) & 0xff00u) | ((v << 8) & 0xff0000u) | (v << 24));
+    }
+
+    // NCON and NUMDE of real ephemerides are small positive numbers
+    inline bool isPlausible(std::int32_t const ncon, std::int32_t const numde)
+    {
+        return ncon > 0 && ncon < 100000 && numde > 0 && numde < 100000;
+    }
+
+    // the file starts with the title, i.e. printable characters. v1 files start with a binary vector size.
+    // Note: the magic of v2 files is printable as well, check for it first
+    inline bool isFortran(char const * start, std::size_t const size)
+    {
+        if (size < TTL_LENGTH)
+        {
+            return false;
+        }
+        for (std::size_t i = 0; i < TTL_LENGTH; ++i)
+        {
+            if (start[i] < ' ' || start[i] > '~')
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+#endif
@@ -0,0 +1,129 @@
+//
+// read only memory mapping of a complete file. Windows and POSIX implementation
+//
+#include <stdexcept>
+#include <algorithm>
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(string const & fileName) : base(nullptr), length(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr)
+{
+    fileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+    {
+        throw runtime_error("MappedFile: could not open " + fileName);
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(fileHandle);
+        throw runtime_error("MappedFile: could not determine size of " + fileName);
+    }
+    length = size_t(fileSize.QuadPart);
+
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle == nullptr)
+    {
+        CloseHandle(fileHandle);
+        throw runtime_error("MappedFile: could not create mapping for " + fileName);
+    }
+
+    base = static_cast<char const *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (base == nullptr)
+    {
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        throw runtime_error("MappedFile: could not map " + fileName);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    UnmapViewOfFile(base);
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+}
+
+#else
+
+MappedFile::MappedFile(string const & fileName) : base(nullptr), length(0), fileDescriptor(-1)
+{
+    fileDescriptor = open(fileName.c_str(), O_RDONLY);
+    if (fileDescriptor < 0)
+    {
+        throw runtime_error("MappedFile: could not open " + fileName);
+    }
+
+    struct stat status;
+    if (fstat(fileDescriptor, &status) != 0 || status.st_size == 0)
+    {
+        close(fileDescriptor);
+        throw runtime_error("MappedFile: could not determine size of " + fileName);
+    }
+    length = size_t(status.st_size);
+
+    void * mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+    if (mapping == MAP_FAILED)
+    {
+        close(fileDescriptor);
+        throw runtime_error("MappedFile: could not map " + fileName);
+    }
+    madvise(mapping, length, MADV_RANDOM); // records are accessed randomly. Don't waste page cache on read ahead
+    base = static_cast<char const *>(mapping);
+}
+
+MappedFile::~MappedFile()
+{
+    munmap(const_cast<char *>(base), length);
+    close(fileDescriptor);
+}
+
+#endif
+
+char const * MappedFile::data() const
+{
+    return base;
+}
+
+size_t MappedFile::size() const
+{
+    return length;
+}
+
+// asynchronous read ahead of a part of the file. Only a hint, errors are ignored
+void MappedFile::prefetch(size_t const offset, size_t const length) const
+{
+    if (offset >= this->length)
+    {
+        return;
+    }
+    size_t const end = min(offset + length, this->length);
+
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = const_cast<char *>(base + offset);
+    range.NumberOfBytes  = end - offset;
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    size_t const pageSize = size_t(sysconf(_SC_PAGESIZE));
+    size_t const start    = offset / pageSize * pageSize; // madvise wants page aligned addresses
+    madvise(const_cast<char *>(base + start), end - start, MADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,40 @@
+//
+// read only memory mapping of a complete file
+// the mapping is shared through the page cache of the operating system i.e.
+// all processes mapping the same ephemeris file use the same physical pages
+//
+#pragma once
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+
+class MappedFile
+{
+public:
+    explicit MappedFile(std::string const & fileName); // throws runtime_error if the file can't be mapped
+    ~MappedFile();
+
+    MappedFile(MappedFile const &) = delete;
+    MappedFile & operator=(MappedFile const &) = delete;
+
+    char const * data() const;  // start of the mapping
+    std::size_t size() const;   // size of the mapped file in bytes
+
+    void prefetch(std::size_t const offset, std::size_t const length) const; // hint: the range will be needed soon
+
+private:
+    char const * base;
+    std::size_t  length;
+
+#ifdef _WIN32
+    void * fileHandle;
+    void * mappingHandle;
+#else
+    int fileDescriptor;
+#endif
+};
+
+#endif
@@ -0,0 +1,276 @@
+//
+// compression of the records of the compressed v2 container (see EphemerisFormat.h, VERSION_COMPRESSED)
+//
+// Every record is compressed on its own, i.e. a record is decompressed without touching the others:
+//   order   the values are transposed by the order of the coefficients: the dates, coefficient 0 of every component
+//           of every sub interval of every entry, then coefficient 1, ... Coefficients of the same order have similar
+//           magnitudes, the high orders are tiny
+//   planes  the bytes of the transposed values are split into 8 byte planes, the most significant byte first. The
+//           sign and exponent bytes of neighbouring coefficients form runs of few distinct values
+//   LZ      the planes are compressed by a byte oriented LZ77 coder: sequences of literals and matches as in LZ4,
+//           without dictionary and without entropy coding
+// The checksum of the values (see EphemerisFormat::checksum) follows the compressed bytes. Decoding reverses the
+// steps and gives the values bit for bit, any corruption of a block is detected.
+//
+#pragma once
+#ifndef RECORDCODEC_H
+#define RECORDCODEC_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "EphemerisFormat.h"
+
+
+namespace RecordCodec
+{
+    static std::size_t const MIN_MATCH  = 4;       // shortest match coded
+    static std::size_t const MAX_OFFSET = 65535;   // window of the matches
+    static int const         HASH_BITS  = 14;      // size of the match finder table
+
+    // the position of every value of a record in the transposed order. The descriptors are those of the file
+    // (Fortran indexes), values not covered by an entry keep their order at the end
+    inline std::vector<std::uint32_t> order(std::vector<EphemerisFormat::Descriptor> const & descriptors, std::size_t const numValues)
+    {
+        std::vector<std::uint32_t> result;
+        std::vector<bool> taken(numValues, false);
+        auto take = [&](std::size_t const index)
+        {
+            if (index < numValues && !taken[index])
+            {
+                taken[index] = true;
+                result.push_back(std::uint32_t(index));
+            }
+        };
+
+        take(0); // the dates
+        take(1);
+        int maxOrder = 0;
+        for (EphemerisFormat::Descriptor const & descriptor : descriptors)
+        {
+            maxOrder = std::max(maxOrder, descriptor.index > 0 && descriptor.entries > 0 ? descriptor.order : 0);
+        }
+        for (int j = 0; j < maxOrder; ++j)
+        {
+            for (EphemerisFormat::Descriptor const & descriptor : descriptors)
+            {
+                if (descriptor.index <= 0 || descriptor.entries <= 0 || j >= descriptor.order)
+                {
+                    continue;
+                }
+                for (int series = 0; series < descriptor.entries * descriptor.dimension; ++series)
+                {
+                    take(std::size_t(descriptor.index - 1) + std::size_t(series) * std::size_t(descriptor.order) + std::size_t(j));
+                }
+            }
+        }
+        for (std::size_t i = 0; i < numValues; ++i)
+        {
+            take(i);
+        }
+        return result;
+    }
+
+
+    namespace detail
+    {
+        inline std::uint32_t hash(unsigned char const * bytes)
+        {
+            std::uint32_t word;
+            std::memcpy(&word, bytes, sizeof(word));
+            return (word * 2654435761u) >> (32 - HASH_BITS);
+        }
+
+        inline void putLength(std::vector<unsigned char> & out, std::size_t length)
+        {
+            while (length >= 255)
+            {
+                out.push_back(255);
+                length -= 255;
+            }
+            out.push_back((unsigned char)(length));
+        }
+
+        // false if the length runs past the end of the input
+        inline bool getLength(unsigned char const * & in, unsigned char const * const end, std::size_t & length)
+        {
+            unsigned char byte;
+            do
+            {
+                if (in == end)
+                {
+                    return false;
+                }
+                byte = *in++;
+                length += byte;
+            } while (byte == 255);
+            return true;
+        }
+
+        inline void putSequence(std::vector<unsigned char> & out, unsigned char const * literals, std::size_t const numLiterals,
+                                std::size_t const offset, std::size_t const matchLength)
+        {
+            std::size_t const match = matchLength >= MIN_MATCH ? matchLength - MIN_MATCH : 0;
+            out.push_back((unsigned char)((std::min<std::size_t>(numLiterals, 15) << 4) | std::min<std::size_t>(match, 15)));
+            if (numLiterals >= 15)
+            {
+                putLength(out, numLiterals - 15);
+            }
+            out.insert(out.end(), literals, literals + numLiterals);
+            if (matchLength == 0)
+            {
+                return; // the last sequence
+            }
+            out.push_back((unsigned char)(offset & 0xff));
+            out.push_back((unsigned char)(offset >> 8));
+            if (match >= 15)
+            {
+                putLength(out, match - 15);
+            }
+        }
+    }
+
+    // LZ77 with a single entry hash table (greedy parsing). Appends to 'out'
+    inline void compress(unsigned char const * in, std::size_t const size, std::vector<unsigned char> & out)
+    {
+        std::vector<std::int64_t> table(std::size_t(1) << HASH_BITS, -1);
+        std::size_t anchor = 0; // start of the pending literals
+        std::size_t pos    = 0;
+        while (pos + MIN_MATCH <= size)
+        {
+            std::uint32_t const h = detail::hash(in + pos);
+            std::int64_t const candidate = table[h];
+            table[h] = std::int64_t(pos);
+            if (candidate < 0 || pos - std::size_t(candidate) > MAX_OFFSET || std::memcmp(in + candidate, in + pos, MIN_MATCH) != 0)
+            {
+                ++pos;
+                continue;
+            }
+
+            std::size_t length = MIN_MATCH;
+            while (pos + length < size && in[std::size_t(candidate) + length] == in[pos + length])
+            {
+                ++length;
+            }
+            detail::putSequence(out, in + anchor, pos - anchor, pos - std::size_t(candidate), length);
+            for (std::size_t k = pos + 1; k < pos + length && k + MIN_MATCH <= size; ++k)
+            {
+                table[detail::hash(in + k)] = std::int64_t(k);
+            }
+            pos   += length;
+            anchor = pos;
+        }
+        detail::putSequence(out, in + anchor, size - anchor, 0, 0);
+    }
+
+    // exactly 'size' bytes are expected. False for corrupt input
+    inline bool decompress(unsigned char const * in, std::size_t const inSize, unsigned char * out, std::size_t const size)
+    {
+        unsigned char const * const inEnd = in + inSize;
+        std::size_t pos = 0;
+        while (in < inEnd)
+        {
+            unsigned char const token = *in++;
+            std::size_t numLiterals = token >> 4;
+            if (numLiterals == 15 && !detail::getLength(in, inEnd, numLiterals))
+            {
+                return false;
+            }
+            if (numLiterals > std::size_t(inEnd - in) || numLiterals > size - pos)
+            {
+                return false;
+            }
+            std::memcpy(out + pos, in, numLiterals);
+            in  += numLiterals;
+            pos += numLiterals;
+            if (in == inEnd)
+            {
+                break; // the last sequence
+            }
+
+            if (inEnd - in < 2)
+            {
+                return false;
+            }
+            std::size_t const offset = std::size_t(in[0]) | (std::size_t(in[1]) << 8);
+            in += 2;
+            std::size_t length = token & 0x0f;
+            if (length == 15 && !detail::getLength(in, inEnd, length))
+            {
+                return false;
+            }
+            length += MIN_MATCH;
+            if (offset == 0 || offset > pos || length > size - pos)
+            {
+                return false;
+            }
+            for (std::size_t k = 0; k < length; ++k) // the match may overlap its copy
+            {
+                out[pos + k] = out[pos - offset + k];
+            }
+            pos += length;
+        }
+        return pos == size;
+    }
+
+
+    // a record as block: the compressed planes of the transposed values and the checksum of the values.
+    // 'planes' is a buffer reused from record to record
+    template<typename T>
+    void encode(T const * values, std::vector<std::uint32_t> const & order, std::vector<unsigned char> & planes, std::vector<unsigned char> & block)
+    {
+        std::size_t const numValues = order.size();
+        planes.resize(numValues * sizeof(double));
+        for (std::size_t i = 0; i < numValues; ++i)
+        {
+            double const value = double(values[order[i]]);
+            std::uint64_t word;
+            std::memcpy(&word, &value, sizeof(word));
+            for (std::size_t b = 0; b < sizeof(word); ++b)
+            {
+                planes[b * numValues + i] = (unsigned char)(word >> (8 * (sizeof(word) - 1 - b)));
+            }
+        }
+
+        std::vector<double> converted(values, values + numValues);
+        std::uint64_t const sum = EphemerisFormat::checksum(converted.data(), numValues);
+        block.clear();
+        compress(planes.data(), planes.size(), block);
+        unsigned char bytes[sizeof(sum)];
+        std::memcpy(bytes, &sum, sizeof(sum));
+        block.insert(block.end(), bytes, bytes + sizeof(sum));
+    }
+
+    // the 'order.size()' values of a block. False for a corrupt block
+    inline bool decode(unsigned char const * block, std::size_t const size, std::vector<std::uint32_t> const & order, double * values,
+                       std::vector<unsigned char> & planes)
+    {
+        std::size_t const numValues = order.size();
+        std::uint64_t sum;
+        if (size < sizeof(sum))
+        {
+            return false;
+        }
+        planes.resize(numValues * sizeof(double));
+        if (!decompress(block, size - sizeof(sum), planes.data(), planes.size()))
+        {
+            return false;
+        }
+        for (std::size_t i = 0; i < numValues; ++i)
+        {
+            std::uint64_t word = 0;
+            for (std::size_t b = 0; b < sizeof(word); ++b)
+            {
+                word = (word << 8) | planes[b * numValues + i];
+            }
+            std::memcpy(values + order[i], &word, sizeof(word));
+        }
+        std::memcpy(&sum, block + size - sizeof(sum), sizeof(sum));
+        return sum == EphemerisFormat::checksum(values, numValues);
+    }
+}
+
+#endif
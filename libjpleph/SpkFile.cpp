@@ -0,0 +1,404 @@
+//
+// NAIF SPK kernels, segment types 2 and 3 (see SpkFile.h)
+//
+// DAF layout:
+//   record 1       file record: "DAF/SPK ", ND, NI, internal name, FWARD, BWARD, FREE, "LTL-IEEE" ...
+//   record FWARD   summary record: NEXT, PREV, NSUM (as double), NSUM summaries of ND doubles and NI int32
+//                  SPK: ND = 2 (start, end), NI = 6 (target, center, frame, type, begin address, end address)
+//   record NEXT    the next summary record, every summary record is followed by its name record
+// Records are 1024 bytes, addresses count doubles from 1.
+// Segment types 2 and 3: the records (mid time, radius, coefficients of x, y, z [, vx, vy, vz]) followed by the
+// directory INIT, INTLEN, RSIZE, N
+//
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+
+#include "SpkFile.h"
+#include "Clenshaw.h"
+
+using namespace std;
+
+namespace
+{
+    size_t const RECORD_LENGTH    = 1024;     // bytes per DAF record
+    int const    SUMMARY_DOUBLES  = 2;        // ND of SPK files
+    int const    SUMMARY_INTEGERS = 6;        // NI of SPK files
+    int const    SUMMARY_SIZE     = SUMMARY_DOUBLES + (SUMMARY_INTEGERS + 1) / 2; // doubles per summary
+    int const    DIRECTORY_SIZE   = 4;        // INIT, INTLEN, RSIZE, N at the end of type 2 and 3 segments
+    double const J2000_JED        = 2451545.0;
+    double const SECONDS_PER_DAY  = 86400.0;
+
+    template<typename T>
+    T value(char const * start, size_t const offset)
+    {
+        T result;
+        memcpy(&result, start + offset, sizeof(result));
+        return result;
+    }
+
+    bool littleEndian()
+    {
+        uint32_t const probe = 1;
+        unsigned char first;
+        memcpy(&first, &probe, 1);
+        return first == 1;
+    }
+}
+
+
+SpkFile::SpkFile(string const & spkFileName, bool const aukm, bool const daysecond, double const au)
+    : mapping(make_unique<MappedFile>(spkFileName)), xscale(1.0), vscale(1.0), ascale(1.0)
+{
+    if (aukm)
+    {
+        xscale = 1.0 / au;
+    }
+    if (daysecond)
+    {
+        vscale = xscale * SECONDS_PER_DAY;
+        ascale = vscale * SECONDS_PER_DAY;
+    }
+    else
+    {
+        vscale = xscale;
+        ascale = xscale;
+    }
+
+    readSummaries();
+    indexSegments();
+}
+
+
+void SpkFile::readSummaries()
+{
+    char const * const start = mapping->data();
+    size_t const size        = mapping->size();
+    if (size < RECORD_LENGTH || memcmp(start, "DAF/SPK ", 8) != 0)
+    {
+        throw runtime_error("SpkFile: not an SPK file");
+    }
+
+    string const format(start + 88, 8);
+    if ((format == "BIG-IEEE" && littleEndian()) || (format == "LTL-IEEE" && !littleEndian()))
+    {
+        throw runtime_error("SpkFile: SPK file written with a different byte order");
+    }
+    if (value<int32_t>(start, 8) != SUMMARY_DOUBLES || value<int32_t>(start, 12) != SUMMARY_INTEGERS)
+    {
+        throw runtime_error("SpkFile: unexpected summary format");
+    }
+
+    // the linked list of summary records. The number of records limits the length of the list (no cycles)
+    int32_t next = value<int32_t>(start, 76);
+    for (size_t records = 0; next != 0 && records < size / RECORD_LENGTH; ++records)
+    {
+        size_t const offset = size_t(next - 1) * RECORD_LENGTH;
+        if (next < 0 || offset + RECORD_LENGTH > size)
+        {
+            throw runtime_error("SpkFile: invalid summary record");
+        }
+        double const * const summaryRecord = reinterpret_cast<double const *>(start + offset);
+        next = int32_t(summaryRecord[0]);
+        int const numSummaries = int(summaryRecord[2]);
+        if (numSummaries < 0 || 3 + numSummaries * SUMMARY_SIZE > int(RECORD_LENGTH / sizeof(double)))
+        {
+            throw runtime_error("SpkFile: invalid summary record");
+        }
+
+        for (int i = 0; i < numSummaries; ++i)
+        {
+            double const * const summary = summaryRecord + 3 + i * SUMMARY_SIZE;
+            int32_t integers[SUMMARY_INTEGERS];
+            memcpy(integers, summary + SUMMARY_DOUBLES, sizeof(integers));
+
+            Segment segment = {};
+            segment.target = integers[0];
+            segment.center = integers[1];
+            segment.frame  = integers[2];
+            segment.type   = integers[3];
+            segment.start  = summary[0];
+            segment.end    = summary[1];
+            int32_t const begin = integers[4];
+            int32_t const end   = integers[5];
+            if (begin < 1 || end < begin || size_t(end) * sizeof(double) > size)
+            {
+                throw runtime_error("SpkFile: segment outside of the file");
+            }
+
+            if ((segment.type == 2 || segment.type == 3) && segment.frame == J2000 && end - begin + 1 >= DIRECTORY_SIZE)
+            {
+                double const * const data = reinterpret_cast<double const *>(start) + (begin - 1);
+                double const * const directory = reinterpret_cast<double const *>(start) + (end - DIRECTORY_SIZE);
+                segment.init           = directory[0];
+                segment.intervalLength = directory[1];
+                segment.recordSize     = int(directory[2]);
+                segment.numRecords     = int(directory[3]);
+                int const components   = segment.type == 2 ? 3 : 6;
+                segment.numCoefficient = (segment.recordSize - 2) / components;
+                if (   segment.numCoefficient < 1 || segment.recordSize != 2 + components * segment.numCoefficient
+                    || segment.numRecords < 1 || !(segment.intervalLength > 0.0)
+                    || int64_t(segment.numRecords) * segment.recordSize + DIRECTORY_SIZE != int64_t(end - begin + 1))
+                {
+                    throw runtime_error("SpkFile: inconsistent directory of a type 2/3 segment");
+                }
+                segment.records = data;
+            }
+            segmentList.push_back(segment);
+        }
+    }
+}
+
+
+// the time line of every body: elementary intervals between the ends of its segments, each one served by the
+// last segment of the file covering it. Adjacent intervals of the same segment are merged
+void SpkFile::indexSegments()
+{
+    map<int, vector<int>> bodies;
+    for (size_t i = 0; i < segmentList.size(); ++i)
+    {
+        if (segmentList[i].records != nullptr)
+        {
+            bodies[segmentList[i].target].push_back(int(i));
+        }
+    }
+
+    for (auto const & body : bodies)
+    {
+        struct Boundary
+        {
+            double time;
+            bool   starts;
+            int    segment;
+        };
+        vector<Boundary> boundaries;
+        for (int segment : body.second)
+        {
+            boundaries.push_back({ segmentList[segment].start, true, segment });
+            boundaries.push_back({ segmentList[segment].end, false, segment });
+        }
+        sort(boundaries.begin(), boundaries.end(), [](Boundary const & a, Boundary const & b) { return a.time < b.time; });
+
+        vector<Coverage> & timeLine = coverage[body.first];
+        set<int> active; // the segments covering the current interval. The last one of the file wins
+        for (size_t i = 0; i < boundaries.size();)
+        {
+            double const time = boundaries[i].time;
+            for (; i < boundaries.size() && boundaries[i].time == time; ++i)
+            {
+                if (boundaries[i].starts)
+                {
+                    active.insert(boundaries[i].segment);
+                }
+                else
+                {
+                    active.erase(boundaries[i].segment);
+                }
+            }
+            if (i == boundaries.size())
+            {
+                break;
+            }
+            if (!active.empty())
+            {
+                int const segment = *active.rbegin();
+                if (!timeLine.empty() && timeLine.back().segment == segment && timeLine.back().end == time)
+                {
+                    timeLine.back().end = boundaries[i].time;
+                }
+                else
+                {
+                    timeLine.push_back({ time, boundaries[i].time, segment });
+                }
+            }
+        }
+    }
+}
+
+
+vector<SpkFile::Segment> const & SpkFile::segments() const
+{
+    return segmentList;
+}
+
+
+// the segment serving 'body' at 'et' or -1
+int SpkFile::lookup(int const body, double const et) const
+{
+    auto const found = coverage.find(body);
+    if (found == coverage.end())
+    {
+        return -1;
+    }
+    vector<Coverage> const & timeLine = found->second;
+    auto const after = upper_bound(timeLine.begin(), timeLine.end(), et, [](double const t, Coverage const & c) { return t < c.start; });
+    if (after == timeLine.begin())
+    {
+        return -1;
+    }
+    Coverage const & interval = *(after - 1);
+    return et <= interval.end ? interval.segment : -1;
+}
+
+
+// the bodies from 'body' to the root of its chain at 'et' and the segments between them. Returns the number of segments
+int SpkFile::chain(int const body, double const et, int * bodies, int * chainSegments) const
+{
+    bodies[0] = body;
+    int length = 0;
+    while (length < MAX_CHAIN)
+    {
+        int const segment = lookup(bodies[length], et);
+        if (segment < 0)
+        {
+            break;
+        }
+        chainSegments[length] = segment;
+        bodies[length + 1]    = segmentList[segment].center;
+        ++length;
+    }
+    return length;
+}
+
+
+// the time is given as sum seconds1 + seconds2 (seconds past J2000) to keep the precision of the normalized time
+void SpkFile::evaluate(Segment const & segment, double const seconds1, double const seconds2, bool const acceleration,
+                       double * position, double * velocity, double * accelerationOut) const
+{
+    double const et = seconds1 + seconds2;
+    int record = int(floor((et - segment.init) / segment.intervalLength));
+    record = max(0, min(record, segment.numRecords - 1));
+
+    double const * const values = segment.records + size_t(record) * size_t(segment.recordSize);
+    double const mid    = values[0];
+    double const radius = values[1];
+    double const tc     = ((seconds1 - mid) + seconds2) / radius;
+    int const n         = segment.numCoefficient;
+
+    if (segment.type == 2)
+    {
+        Clenshaw::evaluate(values + 2, n, 3, tc, position, velocity, acceleration ? accelerationOut : nullptr);
+        for (int i = 0; i < 3; ++i)
+        {
+            velocity[i] /= radius;
+            if (acceleration)
+            {
+                accelerationOut[i] /= radius * radius;
+            }
+        }
+    }
+    else
+    {
+        Clenshaw::evaluate(values + 2, n, 3, tc, position, nullptr, nullptr);
+        Clenshaw::evaluate(values + 2 + 3 * n, n, 3, tc, velocity, acceleration ? accelerationOut : nullptr, nullptr);
+        if (acceleration)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                accelerationOut[i] /= radius;
+            }
+        }
+    }
+}
+
+
+void SpkFile::state(Time const & et, int const target, int const center, Posvel & posvel, bool const acceleration) const
+{
+    double const seconds1 = (et.t1 - J2000_JED) * SECONDS_PER_DAY;
+    double const seconds2 = et.t2 * SECONDS_PER_DAY;
+    double const seconds  = seconds1 + seconds2;
+
+    int targetBodies[MAX_CHAIN + 1];
+    int targetSegments[MAX_CHAIN];
+    int centerBodies[MAX_CHAIN + 1];
+    int centerSegments[MAX_CHAIN];
+    int const targetLength = chain(target, seconds, targetBodies, targetSegments);
+    int const centerLength = chain(center, seconds, centerBodies, centerSegments);
+
+    // the first common body of both chains
+    int targetCommon = -1;
+    int centerCommon = -1;
+    for (int i = 0; i <= targetLength && targetCommon < 0; ++i)
+    {
+        for (int j = 0; j <= centerLength; ++j)
+        {
+            if (targetBodies[i] == centerBodies[j])
+            {
+                targetCommon = i;
+                centerCommon = j;
+                break;
+            }
+        }
+    }
+    if (targetCommon < 0)
+    {
+        throw invalid_argument("SpkFile::state: no segments connect target and center at the requested time");
+    }
+
+    double position[3]      = { 0.0, 0.0, 0.0 };
+    double velocity[3]      = { 0.0, 0.0, 0.0 };
+    double accelerations[3] = { 0.0, 0.0, 0.0 };
+    for (int side = 0; side < 2; ++side)
+    {
+        int const * const chainSegments = side == 0 ? targetSegments : centerSegments;
+        int const length                = side == 0 ? targetCommon : centerCommon;
+        double const sign               = side == 0 ? 1.0 : -1.0;
+        for (int k = 0; k < length; ++k)
+        {
+            double p[3];
+            double v[3];
+            double a[3];
+            evaluate(segmentList[chainSegments[k]], seconds1, seconds2, acceleration, p, v, a);
+            for (int i = 0; i < 3; ++i)
+            {
+                position[i] += sign * p[i];
+                velocity[i] += sign * v[i];
+                if (acceleration)
+                {
+                    accelerations[i] += sign * a[i];
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        posvel.pos[i] = position[i] * xscale;
+        posvel.vel[i] = velocity[i] * vscale;
+        posvel.acc[i] = accelerations[i] * ascale;
+    }
+}
+
+
+void SpkFile::dpleph(Time const & et, Target const target, Target const center, Posvel & posvel, bool const acceleration) const
+{
+    state(et, naifId(target), naifId(center), posvel, acceleration);
+}
+
+
+// the bodies of the JPL ephemerides as in the SPK files derived from them (de4xx.bsp). Mercury and Venus
+// are given by their barycenters (identical to the bodies), the other planets are system barycenters
+int SpkFile::naifId(Target const target)
+{
+    switch (target)
+    {
+    case Target::MERCURY:       return 1;
+    case Target::VENUS:         return 2;
+    case Target::EARTH:         return 399;
+    case Target::MARS:          return 4;
+    case Target::JUPITER:       return 5;
+    case Target::SATURN:        return 6;
+    case Target::URANUS:        return 7;
+    case Target::NEPTUN:        return 8;
+    case Target::PLUTO:         return 9;
+    case Target::MOON:          return 301;
+    case Target::SUN:           return 10;
+    case Target::SS_BARYCENTER: return 0;
+    case Target::EM_BARYCENTER: return 3;
+    default:
+        throw invalid_argument("SpkFile::naifId: not a body or barycenter");
+    }
+}
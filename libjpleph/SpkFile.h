@@ -0,0 +1,93 @@
+//
+// access to NAIF SPK kernels (.bsp) with segments of type 2 (chebysheff series of the position) and
+// type 3 (chebysheff series of position and velocity)
+//
+// The file is mapped read only. The segments are indexed by body at construction: for every body the time line of
+// the segments covering it, the segment added last to the file taking precedence (as by the SPICE toolkit).
+// A state of a target relative to a center follows the chains of segments of both (e.g. Moon -> Earth-Moon barycenter
+// -> solar system barycenter) up to the first common body. The series are evaluated in place with the same Clenshaw
+// kernel as the JPL ephemerides (see Clenshaw.h).
+// Only segments in the J2000 frame are used. Segments of other types or frames are listed but not indexed.
+//
+// Thread safety: all const methods may be called concurrently
+//
+#pragma once
+#ifndef SPKFILE_H
+#define SPKFILE_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "jpleph.h"
+#include "MappedFile.h"
+
+
+class SpkFile
+{
+public:
+    typedef Jpleph::Time   Time;
+    typedef Jpleph::Posvel Posvel;
+    typedef Jpleph::Target Target;
+
+    static int const J2000 = 1; // NAIF id of the reference frame
+
+    struct Segment
+    {
+        int    target;          // NAIF ids, e.g. 399 Earth, 301 Moon, 3 Earth-Moon barycenter, 0 solar system barycenter
+        int    center;
+        int    frame;
+        int    type;
+        double start;           // covered time span in seconds past J2000 (TDB)
+        double end;
+        double init;            // start of the first record in seconds past J2000
+        double intervalLength;  // time span of a record in seconds
+        int    recordSize;      // doubles per record: mid time, radius, the coefficients
+        int    numRecords;
+        int    numCoefficient;  // per component
+        double const * records; // into the mapping, 0 for segments that are not indexed
+    };
+
+    // positions in au (aukm) or km, velocities per day (daysecond) or per second. 'au' in km, SPK files don't contain it
+    explicit SpkFile(std::string const & spkFileName, bool const aukm = true, bool const daysecond = true, double const au = 149597870.700);
+
+    // as Jpleph::dpleph for the bodies and barycenters (Target::MERCURY ... Target::EM_BARYCENTER)
+    void dpleph(Time const & et, Target const target, Target const center, Posvel & posvel, bool const acceleration = false) const;
+
+    // the state of 'target' relative to 'center' given by their NAIF ids
+    void state(Time const & et, int const target, int const center, Posvel & posvel, bool const acceleration = false) const;
+
+    // all segments of the file in the order of the file
+    std::vector<Segment> const & segments() const;
+
+    // NAIF id of a body or barycenter of the JPL ephemerides
+    static int naifId(Target const target);
+
+private:
+    static int const MAX_CHAIN = 16; // segments between a body and the root of its chain
+
+    struct Coverage
+    {
+        double start; // seconds past J2000
+        double end;
+        int    segment;
+    };
+
+    void readSummaries();
+    void indexSegments();
+    int lookup(int const body, double const et) const;
+    int chain(int const body, double const et, int * bodies, int * chainSegments) const;
+    void evaluate(Segment const & segment, double const seconds1, double const seconds2, bool const acceleration,
+                  double * position, double * velocity, double * accelerationOut) const;
+
+    std::unique_ptr<MappedFile> mapping;
+    std::vector<Segment> segmentList;
+    std::map<int, std::vector<Coverage>> coverage; // time line of the segments of every body
+
+    double xscale; // scale factor for position
+    double vscale; // scale factor for velocity
+    double ascale; // scale factor for acceleration
+};
+
+#endif
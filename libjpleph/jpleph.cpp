@@ -1,19 +1,28 @@
 //
 // class to provide access to a binary jpl ephemeris file
-// the ephmeris file had to be written with the corresponding asc2eph file
-// it is not compatible with the original JPL Fortran format!
+// the ephmeris file is either written with the corresponding asc2eph file (v1 or v2, see EphemerisFormat.h)
+// or one of the binary files published by JPL (see FortranFormat.h)
 
 #include <fstream>
 #include <cmath>
 #include <exception>
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
 
 #include "jpleph.h"
 #include "jplephread.h"
 #include "EphemerisRecord.h"
+#include "EphemerisFormat.h"
+#include "RecordCodec.h"
+#include "FortranFormat.h"
 
 #include "Chebysheff.h"
+#include "ChebysheffBatch.h"
+#include "Clenshaw.h"
+#include "EphemerisStream.h"
 
 using namespace std;
 
@@ -22,10 +31,90 @@ namespace {
     static const double SECONDS_PER_DAY = 86400.0; // the number of seconds in a day 
 }
 
-Jpleph::Jpleph(string const &  jplFileName, bool aukm, bool daysecond, bool iauau):good(false), record(jpleph, good)
+Jpleph::Jpleph(string const &  jplFileName, bool aukm, bool daysecond, bool iauau, Access const access, Prefetch const & prefetch, size_t const cacheCapacity,
+               shared_ptr<CacheBudget> const & cacheBudget)
+    :good(false), statisticsOut(nullptr), record(jpleph, good, access, prefetch, cacheCapacity, cacheBudget), singlePrecision(false)
 {
     jpleph.open(jplFileName, ifstream::binary);
     good = jpleph.good();
+
+    char start[FortranFormat::TTL_LENGTH] = {};
+    jpleph.read(start, sizeof(start));
+    size_t const size = size_t(jpleph.gcount());
+    jpleph.clear();
+    jpleph.seekg(0);
+    if (EphemerisFormat::isV2(start, size))
+    {
+        readHeaderV2(jplFileName);
+    }
+    else if (FortranFormat::isFortran(start, size))
+    {
+        readHeaderFortran(jplFileName);
+    }
+    else
+    {
+        readHeaderV1(jplFileName);
+    }
+
+     //has to be after reading the data 
+     calculateFactors(aukm, daysecond, iauau);
+
+     // the evaluation works on fixed size buffers (no heap allocations per call). Make sure the file fits into them
+     for (int entry = 0; entry <= int(EphemerisRecord::Entry::TT_TDB); ++entry)
+     {
+         if (record.getDescriptorEntry(entry).dimension > Chebysheff::MAX_DIMENSION)
+         {
+             throw invalid_argument("Jpleph: too many components in ephemeris file");
+         }
+     }
+
+     // the entries evaluated by state(), grouped by the number of coefficients and sub intervalls. The components
+     // of a group are evaluated in a single pass
+     for (int entry = 0; entry <= int(EphemerisRecord::Entry::TT_TDB); ++entry)
+     {
+         if (!isPresent(EphemerisRecord::Entry(entry)))
+         {
+             continue;
+         }
+         EphemerisRecord::RecordDescriptorEntry const descriptor = record.getDescriptorEntry(entry);
+         auto group = find_if(stateGroups.begin(), stateGroups.end(), [this, &descriptor](vector<int> const & candidate)
+         {
+             EphemerisRecord::RecordDescriptorEntry const first = record.getDescriptorEntry(candidate.front());
+             return first.numCoefficient == descriptor.numCoefficient && first.numEntries == descriptor.numEntries
+                 && int(candidate.size()) < Clenshaw::MAX_ROWS / Clenshaw::MAX_DIMENSION;
+         });
+         if (group == stateGroups.end())
+         {
+             group = stateGroups.insert(stateGroups.end(), vector<int>());
+         }
+         group->push_back(entry);
+     }
+
+     // the bodies and barycenters given by the entries in the file
+     bodyPresent[int(Target::NONE)]          = false;
+     bodyPresent[int(Target::SS_BARYCENTER)] = true;
+     for (int body = int(Target::MERCURY); body <= int(Target::PLUTO); ++body)
+     {
+         bodyPresent[body] = isPresent(EphemerisRecord::Entry(body - 1));
+     }
+     bodyPresent[int(Target::EM_BARYCENTER)] = isPresent(EphemerisRecord::Entry::EMB);
+     bodyPresent[int(Target::EARTH)]         = bodyPresent[int(Target::EM_BARYCENTER)] && isPresent(EphemerisRecord::Entry::MOON);
+     bodyPresent[int(Target::MOON)]          = bodyPresent[int(Target::EARTH)];
+     bodyPresent[int(Target::SUN)]           = isPresent(EphemerisRecord::Entry::SUN);
+
+     for (Derived (& row)[NUM_BODIES] : derived)
+     {
+         for (Derived & pair : row)
+         {
+             pair.entry = -1;
+             pair.sign  = 1.0;
+         }
+     }
+}
+
+// the stream of size prefixed vectors written by asc2eph (v1)
+void Jpleph::readHeaderV1(string const & jplFileName)
+{
     // read the header
     vector<string> ttl;
     if(good)
@@ -90,77 +179,372 @@ Jpleph::Jpleph(string const &  jplFileName, bool aukm, bool daysecond, bool iaua
 
 
     // read the first record to set up the size and the ramdom access
-     record(); // initialize the record keeper. this reads record 0 (Fortran 1) of actual ephemeries data
+    record(jplFileName); // initialize the record keeper. this reads record 0 (Fortran 1) of actual ephemeries data
+}
 
-     //has to be after reading the data 
-     calculateFactors(aukm, daysecond, iauau);
+
+// the header, the table of contents and the sections of a v2 file (see EphemerisFormat.h) are read at once.
+// The index of the blocks of a compressed container follows the records, it is read on its own
+void Jpleph::readHeaderV2(string const & jplFileName)
+{
+    EphemerisFormat::Header header;
+    jpleph.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!jpleph.good())
+    {
+        good = false;
+        throw runtime_error("Jpleph: could not read the header of the ephemeris file");
+    }
+    if (header.endianness != EphemerisFormat::ENDIANNESS)
+    {
+        throw runtime_error("Jpleph: ephemeris file written with a different byte order");
+    }
+    bool const compressed = header.version == EphemerisFormat::VERSION_COMPRESSED;
+    if ((header.version != EphemerisFormat::VERSION && !compressed) || header.headerSize != sizeof(header))
+    {
+        throw runtime_error("Jpleph: unsupported version of the ephemeris file");
+    }
+    if (   header.tocOffset + header.numSections * sizeof(EphemerisFormat::Section) > header.recordOffset
+        || header.recordOffset > (uint64_t(1) << 32))
+    {
+        throw runtime_error("Jpleph: corrupt table of contents in ephemeris file");
+    }
+
+    vector<char> head(size_t(header.recordOffset));
+    jpleph.seekg(0);
+    jpleph.read(head.data(), streamsize(head.size()));
+    if (!jpleph.good())
+    {
+        good = false;
+        throw runtime_error("Jpleph: could not read the header of the ephemeris file");
+    }
+
+    dateStart    = header.dateStart;
+    dateEnd      = header.dateEnd;
+    dateInterval = header.dateInterval;
+    au           = header.au;
+    emrat        = header.emrat;
+    denum        = header.denum;
+
+    vector<string> constantNames;
+    vector<double> constantValues;
+    vector<EphemerisFormat::Descriptor> descriptors;
+    EphemerisRecord::FixedLayout layout;
+    for (uint32_t i = 0; i < header.numSections; ++i)
+    {
+        EphemerisFormat::Section section;
+        memcpy(&section, head.data() + header.tocOffset + i * sizeof(section), sizeof(section));
+        if (compressed && EphemerisFormat::SectionType(section.type) == EphemerisFormat::SectionType::RECORD_INDEX)
+        {
+            if (section.size != (header.numRecords + 1) * sizeof(uint64_t))
+            {
+                throw runtime_error("Jpleph: corrupt record index in ephemeris file");
+            }
+            layout.blocks.resize(size_t(header.numRecords + 1));
+            jpleph.seekg(streamoff(section.offset));
+            jpleph.read(reinterpret_cast<char *>(layout.blocks.data()), streamsize(section.size));
+            if (!jpleph.good())
+            {
+                good = false;
+                throw runtime_error("Jpleph: could not read the record index of the ephemeris file");
+            }
+            continue;
+        }
+        if (section.offset + section.size > head.size())
+        {
+            throw runtime_error("Jpleph: corrupt section in ephemeris file");
+        }
+        char const * data = head.data() + section.offset;
+
+        switch (EphemerisFormat::SectionType(section.type))
+        {
+        case EphemerisFormat::SectionType::CONSTANT_NAMES:
+            for (char const * name = data; name < data + section.size; name += strnlen(name, size_t(data + section.size - name)) + 1)
+            {
+                constantNames.push_back(string(name, strnlen(name, size_t(data + section.size - name))));
+            }
+            break;
+        case EphemerisFormat::SectionType::CONSTANT_VALUES:
+            constantValues.resize(size_t(section.size / sizeof(double)));
+            memcpy(constantValues.data(), data, constantValues.size() * sizeof(double));
+            break;
+        case EphemerisFormat::SectionType::DESCRIPTOR:
+            for (uint64_t offset = 0; offset + sizeof(EphemerisFormat::Descriptor) <= section.size; offset += sizeof(EphemerisFormat::Descriptor))
+            {
+                EphemerisFormat::Descriptor descriptor;
+                memcpy(&descriptor, data + offset, sizeof(descriptor));
+                descriptors.push_back(descriptor);
+                // change Fortran index into C++ index (base 1 -> base 0)
+                layout.descriptor.push_back(EphemerisRecord::RecordDescriptorEntry(descriptor.index - 1, descriptor.order, descriptor.entries, descriptor.dimension));
+            }
+            break;
+        default: // TTL and unknown sections are not needed
+            break;
+        }
+    }
+
+    if (constantNames.size() != constantValues.size() || int(layout.descriptor.size()) != header.numEntries)
+    {
+        throw runtime_error("Jpleph: inconsistent header in ephemeris file");
+    }
+    jplConstants.reserve(constantValues.size());
+    for (size_t i = 0; i < constantNames.size(); ++i)
+    {
+        jplConstants.push_back(Constant(constantNames.at(i), constantValues.at(i)));
+    }
+
+    layout.recordOffset = streamoff(header.recordOffset);
+    layout.recordStride = streamoff(header.recordStride);
+    layout.numValues    = int(header.numValues);
+    layout.numRecords   = int(header.numRecords);
+    layout.checksums    = true;
+    if (compressed)
+    {
+        if (layout.blocks.empty())
+        {
+            throw runtime_error("Jpleph: compressed ephemeris file without record index");
+        }
+        layout.order = RecordCodec::order(descriptors, size_t(header.numValues));
+    }
+    good = true;
+    record(jplFileName, layout); // checks the layout and reads record 0
 }
 
 
-// the actual retrieval method.
-// At time t get the position (and) velocity of target with respect to center
-void Jpleph::dpleph(Time const & etd, Target const target, Target const center, Posvel & posvel)
+
+// the binary files of JPL. The records are read in place like the ones of v2 files, there is no conversion
+void Jpleph::readHeaderFortran(string const & jplFileName)
 {
-    //sanity check for proper combination of target and center
-    if (target < Target::MERCURY || target > Target::TT_TTB)
+    using namespace FortranFormat;
+
+    jpleph.seekg(0, ios::end);
+    streamoff const fileSize = jpleph.tellg();
+    jpleph.seekg(0);
+    vector<char> head(FIXED_SIZE);
+    jpleph.read(head.data(), streamsize(head.size()));
+    if (!jpleph.good())
     {
-        cerr << "Jpleph::dpleph: Invalid target " << int(target) << endl;
-        throw out_of_range("Invalid target");
+        good = false;
+        throw runtime_error("Jpleph: could not read the header of the ephemeris file");
     }
 
-    // no center for non body values
-    if (   (center <= Target::NONE && target < Target::NUTATIONS)
-        || (center > Target::EM_BARYCENTER && target < Target::NUTATIONS)
-        || (target <= Target::EM_BARYCENTER && center >= Target::NUTATIONS) )
+    int32_t const ncon  = value<int32_t>(head.data(), NCON_OFFSET);
+    int32_t const numde = value<int32_t>(head.data(), NUMDE_OFFSET);
+    if (!isPlausible(ncon, numde))
     {
-        cerr << "Jpleph::dpleph: Invalid center " << int(center) << " for target " << int(target) << endl;
-        throw out_of_range("Invalid center");
+        if (isPlausible(byteSwapped(ncon), byteSwapped(numde)))
+        {
+            throw runtime_error("Jpleph: ephemeris file written with a different byte order");
+        }
+        throw runtime_error("Jpleph: unknown format of the ephemeris file");
     }
 
+    // the rest of record 1: the constant names beyond OLDMAX and the entries of DE430 and later
+    size_t const extraNames = ncon > OLDMAX ? size_t(ncon - OLDMAX) : 0;
+    size_t const extension  = FIXED_SIZE + extraNames * NAME_LENGTH;
+    head.resize(extension + 2 * 3 * sizeof(int32_t));
+    jpleph.read(head.data() + FIXED_SIZE, streamsize(head.size() - FIXED_SIZE));
+    if (!jpleph.good())
+    {
+        good = false;
+        throw runtime_error("Jpleph: could not read the header of the ephemeris file");
+    }
 
-    // target anc center are the same. Location vector and relative speeds are both 0.0 
-    if (target <= Target::EM_BARYCENTER && target == center)
-    {   // target and center are equal
-        posvel.pos = std::vector<double>({ 0.0, 0.0, 0.0 });
-        posvel.vel = std::vector<double>({ 0.0, 0.0, 0.0 });
-        return;
+    vector<string> constantNames;
+    for (int i = 0; i < ncon; ++i)
+    {
+        size_t const offset = i < OLDMAX ? NAMES_OFFSET + i * NAME_LENGTH : FIXED_SIZE + (i - OLDMAX) * NAME_LENGTH;
+        string name(head.data() + offset, NAME_LENGTH);
+        name.erase(name.find_last_not_of(' ') + 1);
+        constantNames.push_back(name);
     }
 
-    Time interpolationTime = determineTime(etd, interpolationTime); // Really needed? 
+    // GROUP 1050. The entries follow each other in the record. Older files don't have the last two entries,
+    // the bytes after the librations are padding then. Such entries don't continue the record and are ignored
+    size_t const iptOffsets[NUM_ENTRIES] =
+    {
+        IPT_OFFSET,      IPT_OFFSET + 12,  IPT_OFFSET + 24,  IPT_OFFSET + 36,  IPT_OFFSET + 48,  IPT_OFFSET + 60,
+        IPT_OFFSET + 72, IPT_OFFSET + 84,  IPT_OFFSET + 96,  IPT_OFFSET + 108, IPT_OFFSET + 120, IPT_OFFSET + 132,
+        LIBRATION_OFFSET, extension, extension + 12
+    };
+    EphemerisRecord::FixedLayout layout;
+    int32_t end = 3; // Fortran index behind the last coefficient. 1 and 2 are the dates of the record
+    for (int entry = 0; entry < NUM_ENTRIES; ++entry)
+    {
+        int32_t const index     = value<int32_t>(head.data(), iptOffsets[entry]);
+        int32_t const order     = value<int32_t>(head.data(), iptOffsets[entry] + 4);
+        int32_t const intervals = value<int32_t>(head.data(), iptOffsets[entry] + 8);
+        bool const present = order > 0 && intervals > 0 && (entry < 13 ? index >= 3 : index == end);
+        if (present)
+        {
+            // change Fortran index into C++ index (base 1 -> base 0)
+            layout.descriptor.push_back(EphemerisRecord::RecordDescriptorEntry(index - 1, order, intervals, DIMENSIONS[entry]));
+            end = max(end, index + order * intervals * DIMENSIONS[entry]);
+        }
+        else
+        {
+            layout.descriptor.push_back(EphemerisRecord::RecordDescriptorEntry(-1, 0, 0, DIMENSIONS[entry])); // not in the file
+        }
+    }
 
-    if (!inDateRange(interpolationTime))
+    int const ncoeff = end - 1;
+    streamoff const recordLength = streamoff(ncoeff) * streamoff(sizeof(double));
+    dateStart    = value<double>(head.data(), SS_OFFSET);
+    dateEnd      = value<double>(head.data(), SS_OFFSET + sizeof(double));
+    dateInterval = value<double>(head.data(), SS_OFFSET + 2 * sizeof(double));
+    au           = value<double>(head.data(), AU_OFFSET);
+    emrat        = value<double>(head.data(), EMRAT_OFFSET);
+    denum        = numde;
+    long long const numRecords = dateInterval > 0.0 ? llround((dateEnd - dateStart) / dateInterval) : 0;
+    if (numRecords <= 0 || fileSize < (2 + numRecords) * recordLength || streamoff(ncon * sizeof(double)) > recordLength)
     {
-        cerr << "Jpleph::dpleph: Requested date " 
-             << fixed << showpoint << setw(14) << setprecision(5) << (etd.t1 + etd.t2)
-             << " not in ephmeries range "
-             << fixed << showpoint << setw(10) << setprecision(1) << dateStart 
-             << " < t < " 
-             << fixed << showpoint << setw(10) << setprecision(1) << dateEnd
-             << endl;
+        throw runtime_error("Jpleph: inconsistent header in ephemeris file");
+    }
 
-        throw out_of_range("Date outside of ephemeries range");
+    // record 2: the constant values
+    vector<double> constantValues(static_cast<size_t>(ncon));
+    jpleph.seekg(recordLength);
+    jpleph.read(reinterpret_cast<char *>(constantValues.data()), streamsize(constantValues.size() * sizeof(double)));
+
+    // a wrong record length shows up in the dates of the first data record
+    double dates[2] = {};
+    jpleph.seekg(2 * recordLength);
+    jpleph.read(reinterpret_cast<char *>(dates), sizeof(dates));
+    if (!jpleph.good() || dates[0] != dateStart || dates[1] - dates[0] != dateInterval)
+    {
+        good = false;
+        throw runtime_error("Jpleph: inconsistent record length in ephemeris file");
     }
 
-    // calculate ephemris record to load
-    int loadRecord = int(floor((interpolationTime.t1 - dateStart) / dateInterval));
-    if (interpolationTime.t1 == dateEnd)
+    jplConstants.reserve(constantValues.size());
+    for (size_t i = 0; i < constantNames.size(); ++i)
     {
-        loadRecord--;
+        jplConstants.push_back(Constant(constantNames.at(i), constantValues.at(i)));
     }
 
-    // scale time relative into the record (0<= tScaled <= 1.0). This is the range for time t the chebysheff interpolation routine expects.
-    long double tScaled = (interpolationTime.t1 - ((dateInterval * loadRecord) + dateStart) + interpolationTime.t2) / dateInterval;
+    layout.recordOffset = 2 * recordLength;
+    layout.recordStride = recordLength;
+    layout.numValues    = ncoeff;
+    layout.numRecords   = int(numRecords);
+    layout.checksums    = false;
+    good = true;
+    record(jplFileName, layout); // reads record 0
+}
+
 
-    Chebysheff chebysheff(record[loadRecord], dateInterval * SECONDS_PER_DAY); // set up interpolation
+// the series of every pair is the linear combination of the barycentric series of target and center
+void Jpleph::deriveSeries(vector<Pair> const & pairs)
+{
+    vector<EphemerisRecord::Derivation> derivations;
+    vector<Pair> derivedPairs;
+    for (Pair const & pair : pairs)
+    {
+        if (   pair.target < Target::MERCURY || pair.target > Target::EM_BARYCENTER
+            || pair.center < Target::MERCURY || pair.center > Target::EM_BARYCENTER || pair.target == pair.center)
+        {
+            throw invalid_argument("Jpleph::deriveSeries: invalid pair");
+        }
+        if (!bodyPresent[int(pair.target)] || !bodyPresent[int(pair.center)])
+        {
+            continue;
+        }
+
+        EphemerisRecord::Derivation derivation;
+        barycentricTerms(pair.target, 1.0, derivation.terms);
+        barycentricTerms(pair.center, -1.0, derivation.terms);
+        Derived & known    = derived[int(pair.target)][int(pair.center)];
+        Derived & reversed = derived[int(pair.center)][int(pair.target)];
+        if (derivation.terms.size() > 1 && known.entry < 0 && reversed.entry < 0)
+        {
+            derivations.push_back(derivation);
+            derivedPairs.push_back(pair);
+            known.entry    = 0; // marks duplicates, set below
+            reversed.entry = 0;
+        }
+    }
+
+    int const first = record.deriveSeries(derivations);
+    for (size_t k = 0; k < derivedPairs.size(); ++k)
+    {
+        int const target = int(derivedPairs[k].target);
+        int const center = int(derivedPairs[k].center);
+        derived[target][center] = Derived{ first + int(k), 1.0 };
+        derived[center][target] = Derived{ first + int(k), -1.0 };
+    }
+}
+
+
+vector<Jpleph::Pair> Jpleph::geocentricSeries()
+{
+    vector<Pair> pairs;
+    for (Target const body : { Target::SUN, Target::MERCURY, Target::VENUS, Target::MARS, Target::JUPITER, Target::SATURN,
+                               Target::URANUS, Target::NEPTUN, Target::PLUTO })
+    {
+        pairs.push_back(Pair{ body, Target::EARTH });
+    }
+    pairs.push_back(Pair{ Target::EARTH, Target::SS_BARYCENTER });
+    pairs.push_back(Pair{ Target::MOON, Target::SS_BARYCENTER });
+    return pairs;
+}
+
+
+// the series of the file making up the barycentric state of 'body', multiplied by 'sign' and added to 'terms'
+void Jpleph::barycentricTerms(Target const body, double const sign, vector<EphemerisRecord::Derivation::Term> & terms) const
+{
+    auto add = [&terms](EphemerisRecord::Entry const entry, double const factor)
+    {
+        for (auto term = terms.begin(); term != terms.end(); ++term)
+        {
+            if (term->entry == entry)
+            {
+                term->factor += factor;
+                if (term->factor == 0.0)
+                {
+                    terms.erase(term);
+                }
+                return;
+            }
+        }
+        terms.push_back(EphemerisRecord::Derivation::Term{ entry, factor });
+    };
+
+    switch (body)
+    {
+    case Target::SS_BARYCENTER:
+        break;
+    case Target::EM_BARYCENTER:
+        add(EphemerisRecord::Entry::EMB, sign);
+        break;
+    case Target::EARTH:
+        add(EphemerisRecord::Entry::EMB, sign);
+        add(EphemerisRecord::Entry::MOON, -sign * factorEarth);
+        break;
+    case Target::MOON:
+        add(EphemerisRecord::Entry::EMB, sign);
+        add(EphemerisRecord::Entry::MOON, -sign * factorMoon);
+        break;
+    default:
+        add(EphemerisRecord::Entry(int(body) - 1), sign);
+        break;
+    }
+}
+
+
+// Combine the entries of the ephemeris file to the state of 'target' with respect to 'center'.
+// 'interpolate(entry, posvel)' provides the values of an entry at the requested epoch
+template<typename Interpolate>
+void Jpleph::combine(Target const target, Target const center, Interpolate & interpolate, Posvel & posvel) const
+{
     //do auxiliary cases first
     //Nutation
     if (Target::NUTATIONS == target)
     {
         if (isPresent(EphemerisRecord::Entry::NUTATION))
         {
-            chebysheff(tScaled, int(EphemerisRecord::Entry::NUTATION), true, posvel.pos, posvel.vel); // dimension =2
+            interpolate(int(EphemerisRecord::Entry::NUTATION), posvel); // dimension =2
             posvel.vel[0] = SECONDS_PER_DAY * posvel.vel[0];  // always convert to radians/day
+            posvel.acc[0] = SECONDS_PER_DAY * SECONDS_PER_DAY * posvel.acc[0];
             posvel.vel[1] = SECONDS_PER_DAY * posvel.vel[1];
+            posvel.acc[1] = SECONDS_PER_DAY * SECONDS_PER_DAY * posvel.acc[1];
             return;
         }
         else
@@ -175,10 +559,13 @@ void Jpleph::dpleph(Time const & etd, Target const target, Target const center,
     {
         if (isPresent(EphemerisRecord::Entry::LIBRATION))
         {
-            chebysheff(tScaled, int(EphemerisRecord::Entry::LIBRATION), true, posvel.pos, posvel.vel); // dimension = 3
+            interpolate(int(EphemerisRecord::Entry::LIBRATION), posvel); // dimension = 3
             posvel.vel[0] = SECONDS_PER_DAY * posvel.vel[0];  // always convert to radians/day
+            posvel.acc[0] = SECONDS_PER_DAY * SECONDS_PER_DAY * posvel.acc[0];
             posvel.vel[1] = SECONDS_PER_DAY * posvel.vel[1];
+            posvel.acc[1] = SECONDS_PER_DAY * SECONDS_PER_DAY * posvel.acc[1];
             posvel.vel[2] = SECONDS_PER_DAY * posvel.vel[2];
+            posvel.acc[2] = SECONDS_PER_DAY * SECONDS_PER_DAY * posvel.acc[2];
             return;
         }
         else
@@ -194,10 +581,13 @@ void Jpleph::dpleph(Time const & etd, Target const target, Target const center,
     {
         if (isPresent(EphemerisRecord::Entry::VELOCITY))
         {
-            chebysheff(tScaled, int(EphemerisRecord::Entry::VELOCITY), true, posvel.pos, posvel.vel); // dimension = 3
+            interpolate(int(EphemerisRecord::Entry::VELOCITY), posvel); // dimension = 3
             posvel.vel[0] = SECONDS_PER_DAY * posvel.vel[0];  // always convert to radians/day**2
+            posvel.acc[0] = SECONDS_PER_DAY * SECONDS_PER_DAY * posvel.acc[0];
             posvel.vel[1] = SECONDS_PER_DAY * posvel.vel[1];
+            posvel.acc[1] = SECONDS_PER_DAY * SECONDS_PER_DAY * posvel.acc[1];
             posvel.vel[2] = SECONDS_PER_DAY * posvel.vel[2];
+            posvel.acc[2] = SECONDS_PER_DAY * SECONDS_PER_DAY * posvel.acc[2];
             return;
         }
         else
@@ -213,8 +603,9 @@ void Jpleph::dpleph(Time const & etd, Target const target, Target const center,
     {
         if (isPresent(EphemerisRecord::Entry::TT_TDB))
         {
-            chebysheff(tScaled, int(EphemerisRecord::Entry::TT_TDB), true, posvel.pos, posvel.vel); // dimension = 1
+            interpolate(int(EphemerisRecord::Entry::TT_TDB), posvel); // dimension = 1
             posvel.vel[0] = SECONDS_PER_DAY * posvel.vel[0];  // always convert to seconds/second to second/day
+            posvel.acc[0] = SECONDS_PER_DAY * SECONDS_PER_DAY * posvel.acc[0];
             return;
         }
         else
@@ -228,22 +619,24 @@ void Jpleph::dpleph(Time const & etd, Target const target, Target const center,
     // lookup for bodies
     if (target == Target::MOON && center == Target::EARTH)
     {
-        chebysheff(tScaled, int(EphemerisRecord::Entry::MOON), true, posvel.pos, posvel.vel); // dimension = 3
+        interpolate(int(EphemerisRecord::Entry::MOON), posvel); // dimension = 3
         for (int i = 0; i < 3; ++i)
         {
             posvel.pos[i] *= xscale;
             posvel.vel[i] *= vscale;
+            posvel.acc[i] *= ascale;
         }
         return;
     }
 
     if (target == Target::EARTH && center == Target::MOON)
     {
-        chebysheff(tScaled, int(EphemerisRecord::Entry::MOON), true, posvel.pos, posvel.vel); // dimension = 3
+        interpolate(int(EphemerisRecord::Entry::MOON), posvel); // dimension = 3
         for (int i = 0; i < 3; ++i)
         {
             posvel.pos[i] *= -xscale;
             posvel.vel[i] *= -vscale;
+            posvel.acc[i] *= -ascale;
         }
         return;
     }
@@ -256,18 +649,18 @@ void Jpleph::dpleph(Time const & etd, Target const target, Target const center,
     // cases involving moon xor earth
     if (target == Target::EARTH || target == Target::MOON || center == Target::EARTH || center == Target::MOON)
     {
-        chebysheff(tScaled, int(EphemerisRecord::Entry::MOON), true, posvelMoon.pos, posvelMoon.vel); // dimension = 3
-        chebysheff(tScaled, int(EphemerisRecord::Entry::EMB),  true, posvelEMB.pos,  posvelEMB.vel);   // dimension = 3
+        interpolate(int(EphemerisRecord::Entry::MOON), posvelMoon); // dimension = 3
+        interpolate(int(EphemerisRecord::Entry::EMB), posvelEMB);  // dimension = 3
 
         if (target == Target::EARTH || target == Target::MOON)
         {
             if (center < Target::SS_BARYCENTER)
             {
-                chebysheff(tScaled, int(center) - 1, true, posvel2.pos, posvel2.vel); // target as integer are the same in the given range as for Entry!!
+                interpolate(int(center) - 1, posvel2); // target as integer are the same in the given range as for Entry!!
             }
             else if (center == Target::EM_BARYCENTER)
             {
-                chebysheff(tScaled, int(EphemerisRecord::Entry::EMB), true, posvel2.pos, posvel2.vel);
+                interpolate(int(EphemerisRecord::Entry::EMB), posvel2);
             }
 
             if (target == Target::EARTH)
@@ -276,6 +669,7 @@ void Jpleph::dpleph(Time const & etd, Target const target, Target const center,
                 {
                     posvel.pos[i] = posvelEMB.pos[i] - factorEarth * posvelMoon.pos[i] - posvel2.pos[i];
                     posvel.vel[i] = posvelEMB.vel[i] - factorEarth * posvelMoon.vel[i] - posvel2.vel[i];
+                    posvel.acc[i] = posvelEMB.acc[i] - factorEarth * posvelMoon.acc[i] - posvel2.acc[i];
                 }
             }
             else
@@ -284,6 +678,7 @@ void Jpleph::dpleph(Time const & etd, Target const target, Target const center,
                 {
                     posvel.pos[i] = posvelEMB.pos[i] - factorMoon * posvelMoon.pos[i] - posvel2.pos[i];
                     posvel.vel[i] = posvelEMB.vel[i] - factorMoon * posvelMoon.vel[i] - posvel2.vel[i];
+                    posvel.acc[i] = posvelEMB.acc[i] - factorMoon * posvelMoon.acc[i] - posvel2.acc[i];
                 }
 
             }
@@ -292,11 +687,11 @@ void Jpleph::dpleph(Time const & etd, Target const target, Target const center,
         {
             if (target < Target::SS_BARYCENTER)
             {
-                chebysheff(tScaled, int(target) - 1, true, posvel1.pos, posvel1.vel); // target as integer are the same in the given range as for Entry!!
+                interpolate(int(target) - 1, posvel1); // target as integer are the same in the given range as for Entry!!
             }
             else if (target == Target::EM_BARYCENTER)
             {
-                chebysheff(tScaled, int(EphemerisRecord::Entry::EMB), true, posvel1.pos, posvel1.vel);
+                interpolate(int(EphemerisRecord::Entry::EMB), posvel1);
             }
 
             if (center == Target::EARTH)
@@ -305,6 +700,7 @@ void Jpleph::dpleph(Time const & etd, Target const target, Target const center,
                 {
                     posvel.pos[i] = posvel1.pos[i] - (posvelEMB.pos[i] - factorEarth * posvelMoon.pos[i]);
                     posvel.vel[i] = posvel1.vel[i] - (posvelEMB.vel[i] - factorEarth * posvelMoon.vel[i]);
+                    posvel.acc[i] = posvel1.acc[i] - (posvelEMB.acc[i] - factorEarth * posvelMoon.acc[i]);
                 }
             }
             else
@@ -313,6 +709,7 @@ void Jpleph::dpleph(Time const & etd, Target const target, Target const center,
                 {
                     posvel.pos[i] = posvel1.pos[i] - (posvelEMB.pos[i] - factorMoon * posvelMoon.pos[i]);
                     posvel.vel[i] = posvel1.vel[i] - (posvelEMB.vel[i] - factorMoon * posvelMoon.vel[i]);
+                    posvel.acc[i] = posvel1.acc[i] - (posvelEMB.acc[i] - factorMoon * posvelMoon.acc[i]);
                 }
             }
         }
@@ -321,6 +718,7 @@ void Jpleph::dpleph(Time const & etd, Target const target, Target const center,
         {
             posvel.pos[i] *= xscale;
             posvel.vel[i] *= vscale;
+            posvel.acc[i] *= ascale;
         }
 
         return;
@@ -330,125 +728,882 @@ void Jpleph::dpleph(Time const & etd, Target const target, Target const center,
     // cases not envolving moon or earth
     if (target < Target::SS_BARYCENTER)
     {
-        chebysheff(tScaled, int(target) - 1, true, posvel1.pos, posvel1.vel); // target as integer are the same in the given range as for Entry!!
+        interpolate(int(target) - 1, posvel1); // target as integer are the same in the given range as for Entry!!
     }
     else if (target == Target::EM_BARYCENTER)
     {
-        chebysheff(tScaled, int(EphemerisRecord::Entry::EMB), true, posvel1.pos, posvel1.vel);
+        interpolate(int(EphemerisRecord::Entry::EMB), posvel1);
     }
 
     if (center < Target::SS_BARYCENTER)
     {
-        chebysheff(tScaled, int(center) - 1, true, posvel2.pos, posvel2.vel); // target as integer are the same in the given range as for Entry!!
+        interpolate(int(center) - 1, posvel2); // target as integer are the same in the given range as for Entry!!
     }
     else if (center == Target::EM_BARYCENTER)
     {
-        chebysheff(tScaled, int(EphemerisRecord::Entry::EMB), true, posvel2.pos, posvel2.vel);
+        interpolate(int(EphemerisRecord::Entry::EMB), posvel2);
     }
 
     for (int i = 0; i < 3; ++i)
     {
         posvel.pos[i] = (posvel1.pos[i] - posvel2.pos[i]) * xscale;
         posvel.vel[i] = (posvel1.vel[i] - posvel2.vel[i]) * vscale;
+        posvel.acc[i] = (posvel1.acc[i] - posvel2.acc[i]) * ascale;
     }
  }
 
 
- Jpleph::Time & Jpleph::determineTime(Time const & inTime, Time & interpolationTime)
- {
-    double s = inTime.t1 - 0.5; // reduce from noon
-    Time part1;
-    split(s, part1);       // split integer and decimal part
-    
-    Time part2;
-    split(inTime.t2, part2); // split integer and decimal part
+// the actual retrieval method.
+// At time t get the position (and) velocity of target with respect to center
+void Jpleph::dpleph(Time const & etd, Target const target, Target const center, Posvel & posvel, bool const acceleration) const
+{
+    //sanity check for proper combination of target and center
+    checkTargetCenter(target, center);
 
-    interpolationTime.t1 = part1.t1 + part2.t1 + 0.5;
-    interpolationTime.t2 = part1.t2 + part2.t2; // this may result in a new integer component
-    split(interpolationTime.t2, part2);   // split integer and decimal part 
-    interpolationTime.t1 += part2.t1;
-    interpolationTime.t2  = part2.t2;
 
-    return interpolationTime;
- }
+    // target anc center are the same. Location vector and relative speeds are both 0.0 
+    if (target <= Target::EM_BARYCENTER && target == center)
+    {   // target and center are equal
+        posvel.pos.fill(0.0);
+        posvel.vel.fill(0.0);
+        posvel.acc.fill(0.0);
+        return;
+    }
 
+    Time interpolationTime = determineTime(etd, interpolationTime); // Really needed? 
 
-// split a given time into components in order to improve ephemeries precission
-void Jpleph::split(double const time, Time & preciseTime)
+    checkDateRange(etd, interpolationTime);
+
+    // calculate ephemris record to load
+    long double tScaled;
+    int const loadRecord = locateRecord(interpolationTime, tScaled);
+
+    Chebysheff chebysheff(record[loadRecord], dateInterval * SECONDS_PER_DAY); // set up interpolation
+    evaluatePair(chebysheff, double(tScaled), target, center, acceleration, posvel);
+}
+
+
+// 'target' relative to 'center' at the time 'tScaled' of the record of 'chebysheff'. Shared by dpleph and EphemerisStream
+void Jpleph::evaluatePair(Chebysheff & chebysheff, double const tScaled, Target const target, Target const center, bool const acceleration, Posvel & posvel) const
 {
-    preciseTime.t2 = modf(time, &preciseTime.t1);  
-    if(time >= 0 || preciseTime.t2 == 0.0)
+    // a single derived series
+    if (target <= Target::EM_BARYCENTER && center <= Target::EM_BARYCENTER && derived[int(target)][int(center)].entry >= 0)
     {
+        Derived const & pair = derived[int(target)][int(center)];
+        evaluate(chebysheff, tScaled, pair.entry, acceleration, posvel);
+        for (int i = 0; i < 3; ++i)
+        {
+            posvel.pos[i] *= pair.sign * xscale;
+            posvel.vel[i] *= pair.sign * vscale;
+            posvel.acc[i] *= pair.sign * ascale;
+        }
         return;
     }
 
-    // correct for negative values
-    preciseTime.t1 = preciseTime.t1 - 1.0; 
-    preciseTime.t2 = preciseTime.t2 + 1.0; 
+    auto interpolate = [&chebysheff, tScaled, acceleration](int const entry, Posvel & result)
+    {
+        evaluate(chebysheff, tScaled, entry, acceleration, result);
+    };
+    combine(target, center, interpolate, posvel);
 }
 
-void Jpleph::calculateFactors(bool aukm, bool daysecond, bool iauau)
+
+EphemerisStream Jpleph::stream(Target const target, Target const center, Time const & tStart, double const step, bool const acceleration) const
 {
-    factorEarth = 1.0 / (1.0 + emrat);
-    factorMoon  = factorEarth - 1.0;
+    return EphemerisStream(*this, target, center, tStart, step, acceleration);
+}
 
-    if (factorEarth == 0.0)
-    {
-        throw invalid_argument("Mass factor for Earth could not be determined");
-    }
 
-    if (aukm) // use au instead of km
+// the query planner: locate all queries, sort them by record and time within the record and evaluate
+// the entries needed at an epoch only once
+void Jpleph::dpleph(Query const * queries, size_t const n, Posvel * posvel, bool const acceleration) const
+{
+    struct Planned
     {
-        if (iauau) // use the IAU 2000 defined au value
+        int    record;
+        double tScaled;
+        Target target;
+        Target center;
+        size_t index;  // in the caller's order
+    };
+
+    vector<Planned> plan;
+    plan.reserve(n);
+    for (size_t k = 0; k < n; ++k)
+    {
+        Query const & query = queries[k];
+        checkTargetCenter(query.target, query.center);
+        if (query.target >= Target::NUTATIONS)
         {
-            xscale = 1.0 / IAU;
+            auxiliaryEntry(query.target); // throws if not in the file
         }
-        else
+
+        if (query.target <= Target::EM_BARYCENTER && query.target == query.center)
         {
-            xscale = 1.0 / au;
+            posvel[k].pos.fill(0.0);
+            posvel[k].vel.fill(0.0);
+            posvel[k].acc.fill(0.0);
+            continue;
         }
+
+        Time interpolationTime = determineTime(query.et, interpolationTime);
+        checkDateRange(query.et, interpolationTime);
+
+        long double tScaled;
+        int const loadRecord = locateRecord(interpolationTime, tScaled);
+        plan.push_back({ loadRecord, double(tScaled), query.target, query.center, k });
     }
 
-    if (daysecond) // in seconds or days
+    // order by record and by time within the record. Only the records of the queries are visited
+    sort(plan.begin(), plan.end(), [](Planned const & a, Planned const & b)
     {
-        vscale = xscale * SECONDS_PER_DAY; // per day
-    } else
-    { 
-        vscale = xscale;           // per second
-    }
+        return a.record < b.record || (a.record == b.record && a.tScaled < b.tScaled);
+    });
 
-    if (denum == 0)
+    static int const NUM_ENTRIES = int(EphemerisRecord::Entry::TT_TDB) + 1;
+
+    Posvel entries[NUM_ENTRIES]; // the entries at the current epoch, evaluated on first use
+    bool   evaluated[NUM_ENTRIES];
+
+    size_t k = 0;
+    while (k < plan.size())
     {
-        throw invalid_argument("No DENUM found");
+        int const loadRecord = plan[k].record;
+        Chebysheff chebysheff(record[loadRecord], dateInterval * SECONDS_PER_DAY);
+
+        while (k < plan.size() && plan[k].record == loadRecord)
+        {
+            double const tScaled = plan[k].tScaled;
+            fill(evaluated, evaluated + NUM_ENTRIES, false);
+            auto interpolate = [&](int const entry, Posvel & result)
+            {
+                if (!evaluated[entry])
+                {
+                    evaluate(chebysheff, tScaled, entry, acceleration, entries[entry]);
+                    evaluated[entry] = true;
+                }
+                result = entries[entry];
+            };
+
+            for (; k < plan.size() && plan[k].record == loadRecord && plan[k].tScaled == tScaled; ++k)
+            {
+                Target const target = plan[k].target;
+                Target const center = plan[k].center;
+                if (target <= Target::EM_BARYCENTER && center <= Target::EM_BARYCENTER && derived[int(target)][int(center)].entry >= 0)
+                {
+                    evaluatePair(chebysheff, tScaled, target, center, acceleration, posvel[plan[k].index]); // the derived series as dpleph
+                    continue;
+                }
+                combine(target, center, interpolate, posvel[plan[k].index]);
+            }
+        }
     }
 }
 
-// test if given time is within the date range of ephemeries file
-bool Jpleph::inDateRange(Time const & interpolationTime)
+
+// position, velocity and, if requested, acceleration of an entry. Without acceleration it is set to 0.0
+void Jpleph::evaluate(Chebysheff & chebysheff, double const tScaled, int const entry, bool const acceleration, Posvel & posvel)
 {
-    return (interpolationTime.t1 + interpolationTime.t2 >= dateStart && interpolationTime.t1 + interpolationTime.t2 <= dateEnd);
+    if (acceleration)
+    {
+        chebysheff(tScaled, entry, posvel.pos, posvel.vel, posvel.acc);
+    }
+    else
+    {
+        chebysheff(tScaled, entry, true, posvel.pos, posvel.vel);
+        posvel.acc.fill(0.0);
+    }
 }
 
-// test if data for 'body' is present the ephemeries file
-bool Jpleph::isPresent(EphemerisRecord::Entry const body)
+
+// all quantities of the ephemeris file at a single epoch
+void Jpleph::state(Time const & etd, SolarSystemState & state, bool const acceleration) const
 {
-    EphemerisRecord::RecordDescriptorEntry const & descriptor = record.getDescriptorEntry(int(body));
+    Time interpolationTime = determineTime(etd, interpolationTime);
+    checkDateRange(etd, interpolationTime);
 
-    return (descriptor.recordIndex > 0 && (descriptor.numEntries) * (descriptor.numCoefficient) != 0);
-}
+    long double tScaled;
+    int const loadRecord = locateRecord(interpolationTime, tScaled);
 
+    // a single record lookup for all entries
+    EphemerisRecord::RecordType const view = record[loadRecord];
+    double const secspan = double(dateInterval * SECONDS_PER_DAY);
 
-void Jpleph::constants(Constants & cons, double & dateStart, double & dateEnd, double & dateInterval) const
-{
-    cons         = jplConstants;
-    dateStart    = this->dateStart;
+    // the entries of the ephemeris file in the order of Target
+    static Target const ENTRY_TARGET[] =
+    {
+        Target::MERCURY, Target::VENUS, Target::EM_BARYCENTER, Target::MARS, Target::JUPITER, Target::SATURN, Target::URANUS,
+        Target::NEPTUN, Target::PLUTO, Target::MOON, Target::SUN, Target::NUTATIONS, Target::LIBRATIONS, Target::LIBRATIONVELO, Target::TT_TTB
+    };
+
+    // the entries of a group share the sub intervall and are evaluated in a single pass, every entry in MAX_DIMENSION rows
+    // (missing components repeat the last one). A group of one entry as by Chebysheff. The same operations in any case
+    fill(state.present, state.present + SolarSystemState::SIZE, false);
+    for (vector<int> const & group : stateGroups)
+    {
+        EphemerisRecord::RecordDescriptorEntry const & first = view.getDescriptor(group.front());
+        int const n = first.numCoefficient;
+        int sub = 0;
+        double const tc = Chebysheff::normalizedTime(double(tScaled), first.numEntries, sub);
+
+        double const * rows[Clenshaw::MAX_ROWS];
+        int numRows = 0;
+        for (int const entry : group)
+        {
+            EphemerisRecord::RecordDescriptorEntry const & descriptor = view.getDescriptor(entry);
+            double const * coefficients = view.coefficients(size_t(descriptor.recordIndex + sub * n * descriptor.dimension), size_t(n * descriptor.dimension));
+            for (int i = 0; i < Clenshaw::MAX_DIMENSION; ++i)
+            {
+                rows[numRows++] = coefficients + min(i, descriptor.dimension - 1) * n;
+            }
+        }
+
+        double position[Clenshaw::MAX_ROWS];
+        double velocity[Clenshaw::MAX_ROWS];
+        double accel[Clenshaw::MAX_ROWS];
+        if (group.size() == 1)
+        {
+            Clenshaw::evaluate(rows[0], n, first.dimension, tc, position, velocity, acceleration ? accel : nullptr);
+        }
+        else
+        {
+            Clenshaw::evaluateRows(rows, numRows, n, tc, position, velocity, acceleration ? accel : nullptr);
+        }
+
+        // derivatives with respect to tc -> per second
+        double const vfac = (2.0 * first.numEntries) / secspan;
+        for (size_t k = 0; k < group.size(); ++k)
+        {
+            Posvel & posvel = state.posvel[int(ENTRY_TARGET[group[k]])];
+            if (!acceleration)
+            {
+                posvel.acc.fill(0.0);
+            }
+            int const row       = int(k) * Clenshaw::MAX_DIMENSION;
+            int const dimension = view.getDescriptor(group[k]).dimension;
+            for (int i = 0; i < dimension; ++i)
+            {
+                posvel.pos[i] = position[row + i];
+                posvel.vel[i] = velocity[row + i] * vfac;
+                if (acceleration)
+                {
+                    posvel.acc[i] = accel[row + i] * (vfac * vfac);
+                }
+            }
+            state.present[int(ENTRY_TARGET[group[k]])] = true;
+        }
+    }
+
+    // the solar system barycenter is always there
+    Posvel & barycenter = state.posvel[int(Target::SS_BARYCENTER)];
+    for (int i = 0; i < 3; ++i)
+    {
+        barycenter.pos[i] = 0.0;
+        barycenter.vel[i] = 0.0;
+        barycenter.acc[i] = 0.0;
+    }
+    state.present[int(Target::SS_BARYCENTER)] = true;
+
+    // Earth and Moon from the Earth-Moon barycenter and the geocentric Moon
+    if (state.present[int(Target::EM_BARYCENTER)] && state.present[int(Target::MOON)])
+    {
+        Posvel const & emb = state.posvel[int(Target::EM_BARYCENTER)];
+        Posvel & earth = state.posvel[int(Target::EARTH)];
+        Posvel & moon  = state.posvel[int(Target::MOON)];
+        for (int i = 0; i < 3; ++i)
+        {
+            earth.pos[i] = emb.pos[i] - factorEarth * moon.pos[i];
+            earth.vel[i] = emb.vel[i] - factorEarth * moon.vel[i];
+            earth.acc[i] = emb.acc[i] - factorEarth * moon.acc[i];
+            moon.pos[i]  = emb.pos[i] - factorMoon * moon.pos[i];
+            moon.vel[i]  = emb.vel[i] - factorMoon * moon.vel[i];
+            moon.acc[i]  = emb.acc[i] - factorMoon * moon.acc[i];
+        }
+        state.present[int(Target::EARTH)] = true;
+    }
+    else
+    {
+        state.present[int(Target::MOON)] = false; // only geocentric
+    }
+
+    for (int body = int(Target::MERCURY); body <= int(Target::EM_BARYCENTER); ++body)
+    {
+        if (state.present[body] && body != int(Target::SS_BARYCENTER))
+        {
+            Posvel & posvel = state.posvel[body];
+            for (int i = 0; i < 3; ++i)
+            {
+                posvel.pos[i] *= xscale;
+                posvel.vel[i] *= vscale;
+                posvel.acc[i] *= ascale;
+            }
+        }
+    }
+
+    for (int auxiliary = int(Target::NUTATIONS); auxiliary <= int(Target::TT_TTB); ++auxiliary)
+    {
+        if (state.present[auxiliary])
+        {
+            Posvel & posvel = state.posvel[auxiliary];
+            for (int i = 0; i < 3; ++i)
+            {
+                posvel.vel[i] *= SECONDS_PER_DAY;  // always convert to .../day
+                posvel.acc[i] *= SECONDS_PER_DAY * SECONDS_PER_DAY;
+            }
+        }
+    }
+}
+
+
+void Jpleph::dpleph(Time const * et, size_t const n, Target const target, Target const center, PosvelArrays const & posvel) const
+{
+    dplephBatches(et, n, target, center, posvel, false);
+}
+
+
+void Jpleph::dplephSingle(Time const * et, size_t const n, Target const target, Target const center, PosvelArrays const & posvel) const
+{
+    if (!singlePrecision)
+    {
+        throw runtime_error("Jpleph::dplephSingle: no single precision coefficients, call convertSingle() first");
+    }
+    dplephBatches(et, n, target, center, posvel, true);
+}
+
+
+void Jpleph::convertSingle()
+{
+    record.convertSingle();
+    singlePrecision = true;
+}
+
+
+// the batch versions of dpleph. Processed in portions of BATCH_SIZE epochs
+void Jpleph::dplephBatches(Time const * et, size_t const n, Target const target, Target const center, PosvelArrays const & posvel, bool const single) const
+{
+    checkTargetCenter(target, center);
+
+    double * const components[6] = { posvel.x, posvel.y, posvel.z, posvel.vx, posvel.vy, posvel.vz };
+
+    // target anc center are the same. Location vector and relative speeds are both 0.0 
+    if (target <= Target::EM_BARYCENTER && target == center)
+    {
+        for (double * component : components)
+        {
+            fill(component, component + n, 0.0);
+        }
+        return;
+    }
+
+    for (size_t begin = 0; begin < n; begin += BATCH_SIZE)
+    {
+        double * const portion[6] = { posvel.x + begin, posvel.y + begin, posvel.z + begin, posvel.vx + begin, posvel.vy + begin, posvel.vz + begin };
+        dplephBatch(et + begin, min(BATCH_SIZE, n - begin), target, center, portion, single);
+    }
+}
+
+
+// up to BATCH_SIZE epochs. The epochs are sorted by time, so that epochs in the same record and sub intervall
+// are next to each other and can be evaluated together. The results are written back in the original order.
+// Epochs already in order (a sweep) are neither sorted nor reordered.
+void Jpleph::dplephBatch(Time const * et, size_t const count, Target const target, Target const center, double * const * posvel, bool const single) const
+{
+    int    records[BATCH_SIZE];
+    double times[BATCH_SIZE];
+    size_t order[BATCH_SIZE];
+
+    // the record only depends on the integer part of the interpolation time: it is located once for a run of
+    // epochs of the same day. tScaled as computed by locateRecord
+    bool        ordered    = true;
+    double      day        = 0.0;
+    int         dayRecord  = -1;
+    long double recordBase = 0.0;
+    for (size_t k = 0; k < count; ++k)
+    {
+        Time interpolationTime = determineTime(et[k], interpolationTime);
+        checkDateRange(et[k], interpolationTime);
+
+        if (dayRecord < 0 || interpolationTime.t1 != day)
+        {
+            long double tScaled;
+            dayRecord  = locateRecord(interpolationTime, tScaled);
+            day        = interpolationTime.t1;
+            recordBase = (dateInterval * dayRecord) + dateStart;
+        }
+        records[k] = dayRecord;
+        times[k]   = double((interpolationTime.t1 - recordBase + interpolationTime.t2) / dateInterval);
+        ordered    = ordered && (k == 0 || records[k - 1] < records[k] || (records[k - 1] == records[k] && times[k - 1] <= times[k]));
+    }
+
+    int    sortedStorage[BATCH_SIZE];
+    double sortedTimeStorage[BATCH_SIZE];
+    int const *    sortedRecords = records;
+    double const * sortedTimes   = times;
+    if (!ordered)
+    {
+        for (size_t k = 0; k < count; ++k)
+        {
+            order[k] = k;
+        }
+        sort(order, order + count, [&](size_t const a, size_t const b) { return records[a] < records[b] || (records[a] == records[b] && times[a] < times[b]); });
+        for (size_t k = 0; k < count; ++k)
+        {
+            sortedStorage[k]     = records[order[k]];
+            sortedTimeStorage[k] = times[order[k]];
+        }
+        sortedRecords = sortedStorage;
+        sortedTimes   = sortedTimeStorage;
+    }
+
+    double state[6][BATCH_SIZE]; // the results in sorted order
+    int dimension = 3;
+
+    if (target >= Target::NUTATIONS)
+    {
+        EphemerisRecord::Entry const entry = auxiliaryEntry(target);
+        evaluateBatch(entry, sortedRecords, sortedTimes, count, state, single);
+        dimension = record.getDescriptorEntry(int(entry)).dimension;
+        for (int i = 0; i < dimension; ++i)
+        {
+            for (size_t k = 0; k < count; ++k)
+            {
+                state[3 + i][k] *= SECONDS_PER_DAY; // always convert to .../day
+            }
+        }
+    }
+    else if ((target == Target::MOON && center == Target::EARTH) || (target == Target::EARTH && center == Target::MOON))
+    {
+        evaluateBatch(EphemerisRecord::Entry::MOON, sortedRecords, sortedTimes, count, state, single);
+        double const sign = (target == Target::MOON) ? 1.0 : -1.0;
+        for (int i = 0; i < 3; ++i)
+        {
+            for (size_t k = 0; k < count; ++k)
+            {
+                state[i][k]     *= sign * xscale;
+                state[3 + i][k] *= sign * vscale;
+            }
+        }
+    }
+    else if (target <= Target::EM_BARYCENTER && center <= Target::EM_BARYCENTER && derived[int(target)][int(center)].entry >= 0)
+    {
+        // the derived series as dpleph. Single precision: it keeps the error relative to the distance of the pair
+        Derived const & pair = derived[int(target)][int(center)];
+        evaluateBatch(EphemerisRecord::Entry(pair.entry), sortedRecords, sortedTimes, count, state, single);
+        for (int i = 0; i < 3; ++i)
+        {
+            for (size_t k = 0; k < count; ++k)
+            {
+                state[i][k]     *= pair.sign * xscale;
+                state[3 + i][k] *= pair.sign * vscale;
+            }
+        }
+    }
+    else
+    {
+        double centerState[6][BATCH_SIZE];
+        barycentricBatch(target, sortedRecords, sortedTimes, count, state, single);
+        barycentricBatch(center, sortedRecords, sortedTimes, count, centerState, single);
+        for (int i = 0; i < 3; ++i)
+        {
+            for (size_t k = 0; k < count; ++k)
+            {
+                state[i][k]     = (state[i][k] - centerState[i][k]) * xscale;
+                state[3 + i][k] = (state[3 + i][k] - centerState[3 + i][k]) * vscale;
+            }
+        }
+    }
+
+    for (int i = 0; i < dimension; ++i)
+    {
+        if (ordered)
+        {
+            copy(state[i], state[i] + count, posvel[i]);
+            copy(state[3 + i], state[3 + i] + count, posvel[3 + i]);
+            continue;
+        }
+        for (size_t k = 0; k < count; ++k)
+        {
+            posvel[i][order[k]]     = state[i][k];
+            posvel[3 + i][order[k]] = state[3 + i][k];
+        }
+    }
+}
+
+
+// the solar system barycentric state of a body (in km and km/s) for the sorted epochs
+void Jpleph::barycentricBatch(Target const body, int const * records, double const * times, size_t const count, double (* state)[BATCH_SIZE],
+                              bool const single) const
+{
+    if (body == Target::SS_BARYCENTER)
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            fill(state[i], state[i] + count, 0.0);
+        }
+    }
+    else if (body == Target::EARTH || body == Target::MOON)
+    {
+        double moonState[6][BATCH_SIZE];
+        evaluateBatch(EphemerisRecord::Entry::EMB, records, times, count, state, single);
+        evaluateBatch(EphemerisRecord::Entry::MOON, records, times, count, moonState, single);
+        double const factor = (body == Target::EARTH) ? factorEarth : factorMoon;
+        for (int i = 0; i < 6; ++i)
+        {
+            for (size_t k = 0; k < count; ++k)
+            {
+                state[i][k] = state[i][k] - factor * moonState[i][k];
+            }
+        }
+    }
+    else if (body == Target::EM_BARYCENTER)
+    {
+        evaluateBatch(EphemerisRecord::Entry::EMB, records, times, count, state, single);
+    }
+    else
+    {
+        evaluateBatch(EphemerisRecord::Entry(int(body) - 1), records, times, count, state, single); // target as integer are the same in the given range as for Entry!!
+    }
+}
+
+
+// evaluate the chebysheff series of an entry for the sorted epochs. Consecutive epochs in the same record
+// and sub intervall share the coefficients and are evaluated together. 'single': with the single precision coefficients
+void Jpleph::evaluateBatch(EphemerisRecord::Entry const entry, int const * records, double const * times, size_t const count, double (* state)[BATCH_SIZE],
+                           bool const single) const
+{
+    EphemerisRecord::RecordDescriptorEntry const descriptor = record.getDescriptorEntry(int(entry));
+    int const nsub = descriptor.numEntries;
+    size_t const subSize = size_t(descriptor.numCoefficient) * descriptor.dimension;
+
+    double const secspan = dateInterval * SECONDS_PER_DAY;
+    double const vfac = (2.0 * nsub) / secspan;
+
+    int    subs[BATCH_SIZE];
+    double tc[BATCH_SIZE];
+    for (size_t k = 0; k < count; ++k)
+    {
+        tc[k] = Chebysheff::normalizedTime(times[k], nsub, subs[k]);
+    }
+
+    double * position[3];
+    double * velocity[3];
+    size_t begin = 0;
+    while (begin < count)
+    {
+        EphemerisRecord::RecordType const data = record[records[begin]]; // coefficients() checks the range, also of the derived series
+
+        // all epochs in this record
+        size_t recordEnd = begin;
+        while (recordEnd < count && records[recordEnd] == records[begin])
+        {
+            recordEnd++;
+        }
+
+        while (begin < recordEnd)
+        {
+            size_t end = begin;
+            while (end < recordEnd && subs[end] == subs[begin])
+            {
+                end++;
+            }
+
+            for (int i = 0; i < descriptor.dimension; ++i)
+            {
+                position[i] = state[i] + begin;
+                velocity[i] = state[3 + i] + begin;
+            }
+            if (single)
+            {
+                ChebysheffBatch::evaluate(data.singleCoefficients(descriptor.recordIndex + subs[begin] * subSize, subSize), descriptor.numCoefficient,
+                                          descriptor.dimension, tc + begin, end - begin, vfac, position, velocity);
+            }
+            else
+            {
+                ChebysheffBatch::evaluate(data.coefficients(descriptor.recordIndex + subs[begin] * subSize, subSize), descriptor.numCoefficient, descriptor.dimension,
+                                          tc + begin, end - begin, vfac, position, velocity);
+            }
+            begin = end;
+        }
+    }
+}
+
+
+ Jpleph::Time & Jpleph::determineTime(Time const & inTime, Time & interpolationTime) const
+ {
+    double s = inTime.t1 - 0.5; // reduce from noon
+    Time part1;
+    split(s, part1);       // split integer and decimal part
+    
+    Time part2;
+    split(inTime.t2, part2); // split integer and decimal part
+
+    interpolationTime.t1 = part1.t1 + part2.t1 + 0.5;
+    interpolationTime.t2 = part1.t2 + part2.t2; // this may result in a new integer component
+    split(interpolationTime.t2, part2);   // split integer and decimal part 
+    interpolationTime.t1 += part2.t1;
+    interpolationTime.t2  = part2.t2;
+
+    return interpolationTime;
+ }
+
+
+// split a given time into components in order to improve ephemeries precission
+void Jpleph::split(double const time, Time & preciseTime) const
+{
+    preciseTime.t1 = trunc(time);        // as modf: the fractional part is exact, trunc is cheaper
+    preciseTime.t2 = time - preciseTime.t1;
+    if(time >= 0 || preciseTime.t2 == 0.0)
+    {
+        return;
+    }
+
+    // correct for negative values
+    preciseTime.t1 = preciseTime.t1 - 1.0; 
+    preciseTime.t2 = preciseTime.t2 + 1.0; 
+}
+
+void Jpleph::calculateFactors(bool aukm, bool daysecond, bool iauau)
+{
+    factorEarth = 1.0 / (1.0 + emrat);
+    factorMoon  = factorEarth - 1.0;
+
+    if (factorEarth == 0.0)
+    {
+        throw invalid_argument("Mass factor for Earth could not be determined");
+    }
+
+    if (aukm) // use au instead of km
+    {
+        if (iauau) // use the IAU 2000 defined au value
+        {
+            xscale = 1.0 / IAU;
+        }
+        else
+        {
+            xscale = 1.0 / au;
+        }
+    }
+    else // km as in the file
+    {
+        xscale = 1.0;
+    }
+
+    if (daysecond) // in seconds or days
+    {
+        vscale = xscale * SECONDS_PER_DAY; // per day
+        ascale = vscale * SECONDS_PER_DAY; // per day**2
+    } else
+    { 
+        vscale = xscale;           // per second
+        ascale = xscale;           // per second**2
+    }
+
+    if (denum == 0)
+    {
+        throw invalid_argument("No DENUM found");
+    }
+}
+
+// the record containing 'interpolationTime' and the time scaled into the record (0<= tScaled <= 1.0).
+// This is the range for time t the chebysheff interpolation routine expects.
+int Jpleph::locateRecord(Time const & interpolationTime, long double & tScaled) const
+{
+    int loadRecord = int(floor((interpolationTime.t1 - dateStart) / dateInterval));
+    if (interpolationTime.t1 == dateEnd)
+    {
+        loadRecord--;
+    }
+
+    tScaled = (interpolationTime.t1 - ((dateInterval * loadRecord) + dateStart) + interpolationTime.t2) / dateInterval;
+    return loadRecord;
+}
+
+
+// sanity check for proper combination of target and center
+void Jpleph::checkTargetCenter(Target const target, Target const center) const
+{
+    if (target < Target::MERCURY || target > Target::TT_TTB)
+    {
+        cerr << "Jpleph::dpleph: Invalid target " << int(target) << endl;
+        throw out_of_range("Invalid target");
+    }
+
+    // no center for non body values
+    if (   (center <= Target::NONE && target < Target::NUTATIONS)
+        || (center > Target::EM_BARYCENTER && target < Target::NUTATIONS)
+        || (target <= Target::EM_BARYCENTER && center >= Target::NUTATIONS) )
+    {
+        cerr << "Jpleph::dpleph: Invalid center " << int(center) << " for target " << int(target) << endl;
+        throw out_of_range("Invalid center");
+    }
+
+    // files refitted for a subset of the bodies
+    if (target <= Target::EM_BARYCENTER && (!bodyPresent[int(target)] || !bodyPresent[int(center)]))
+    {
+        cerr << "Jpleph::dpleph: Requested body " << int(bodyPresent[int(target)] ? center : target) << " but not in ephemeries file" << endl;
+        throw invalid_argument("Body not in ephemeries file");
+    }
+}
+
+
+void Jpleph::checkDateRange(Time const & etd, Time const & interpolationTime) const
+{
+    if (!inDateRange(interpolationTime))
+    {
+        cerr << "Jpleph::dpleph: Requested date " 
+             << fixed << showpoint << setw(14) << setprecision(5) << (etd.t1 + etd.t2)
+             << " not in ephmeries range "
+             << fixed << showpoint << setw(10) << setprecision(1) << dateStart 
+             << " < t < " 
+             << fixed << showpoint << setw(10) << setprecision(1) << dateEnd
+             << endl;
+
+        throw out_of_range("Date outside of ephemeries range");
+    }
+}
+
+
+// the entry for nutations, librations and TT-TDB. Throws if it is not in the ephemeris file
+EphemerisRecord::Entry Jpleph::auxiliaryEntry(Target const target) const
+{
+    struct Auxiliary
+    {
+        Target                 target;
+        EphemerisRecord::Entry entry;
+        char const *           name;
+    };
+    static Auxiliary const auxiliaries[] =
+    {
+        { Target::NUTATIONS,     EphemerisRecord::Entry::NUTATION,  "Nutation" },
+        { Target::LIBRATIONS,    EphemerisRecord::Entry::LIBRATION, "Libration" },
+        { Target::LIBRATIONVELO, EphemerisRecord::Entry::VELOCITY,  "Libration rates" },
+        { Target::TT_TTB,        EphemerisRecord::Entry::TT_TDB,    "TT-TDB" },
+    };
+
+    for (Auxiliary const & auxiliary : auxiliaries)
+    {
+        if (auxiliary.target == target)
+        {
+            if (!isPresent(auxiliary.entry))
+            {
+                cerr << "Jpleph::dpleph: Requested \"" << auxiliary.name << "\" but not in ephemeries file";
+                throw invalid_argument(string(auxiliary.name) + " not in ephemeries file");
+            }
+            return auxiliary.entry;
+        }
+    }
+
+    throw invalid_argument("Not an auxiliary target");
+}
+
+
+// test if given time is within the date range of ephemeries file
+bool Jpleph::inDateRange(Time const & interpolationTime) const
+{
+    return (interpolationTime.t1 + interpolationTime.t2 >= dateStart && interpolationTime.t1 + interpolationTime.t2 <= dateEnd);
+}
+
+// test if data for 'body' is present the ephemeries file
+bool Jpleph::isPresent(EphemerisRecord::Entry const body) const
+{
+    EphemerisRecord::RecordDescriptorEntry const descriptor = record.getDescriptorEntry(int(body));
+
+    return (descriptor.recordIndex > 0 && (descriptor.numEntries) * (descriptor.numCoefficient) != 0);
+}
+
+
+void Jpleph::constants(Constants & cons, double & dateStart, double & dateEnd, double & dateInterval) const
+{
+    cons         = jplConstants;
+    dateStart    = this->dateStart;
     dateEnd      = this->dateEnd;
     dateInterval = this->dateInterval;
 }
 
+Jpleph::~Jpleph()
+{
+    if (statisticsOut != nullptr)
+    {
+        record.statistics().print(*statisticsOut);
+    }
+}
+
+
+Jpleph::Layout Jpleph::layout(Target const target) const
+{
+    if (target < Target::NONE || target > Target::TT_TTB)
+    {
+        throw out_of_range("Invalid target");
+    }
+
+    auto entryLayout = [this](EphemerisRecord::Entry const entry)
+    {
+        EphemerisRecord::RecordDescriptorEntry const descriptor = record.getDescriptorEntry(int(entry));
+        return Layout{ descriptor.numEntries, descriptor.numCoefficient };
+    };
+
+    switch (target)
+    {
+    case Target::NONE:
+    case Target::SS_BARYCENTER:
+        return Layout{ 1, 1 };
+    case Target::EM_BARYCENTER:
+        return entryLayout(EphemerisRecord::Entry::EMB);
+    case Target::EARTH:
+    case Target::MOON:
+    {
+        Layout const emb  = entryLayout(EphemerisRecord::Entry::EMB);
+        Layout const moon = entryLayout(EphemerisRecord::Entry::MOON);
+        return Layout{ lcm(emb.subIntervals, moon.subIntervals), max(emb.coefficients, moon.coefficients) };
+    }
+    case Target::NUTATIONS:
+    case Target::LIBRATIONS:
+    case Target::LIBRATIONVELO:
+    case Target::TT_TTB:
+        return entryLayout(auxiliaryEntry(target));
+    default:
+        return entryLayout(EphemerisRecord::Entry(int(target) - 1));
+    }
+}
+
+
+long Jpleph::number() const
+{
+    return denum;
+}
+
+
+Jpleph::Access Jpleph::access() const
+{
+    return record.getAccess();
+}
+
+
+Jpleph::Statistics Jpleph::statistics() const
+{
+    return record.statistics();
+}
+
+
+void Jpleph::dumpStatistics(ostream * out)
+{
+    statisticsOut = out;
+}
+
+
+Jpleph::Posvel const & Jpleph::SolarSystemState::operator[](Target const target) const
+{
+    return posvel[int(target)];
+}
+
+bool Jpleph::SolarSystemState::isPresent(Target const target) const
+{
+    return present[int(target)];
+}
+
 Jpleph::Time::Time() : t1(0.0), t2(0.0) {}
 
-Jpleph::Posvel::Posvel() : pos({ 0.0, 0.0, 0.0 }), vel({ 0.0, 0.0, 0.0 }) {}
+Jpleph::Posvel::Posvel() : pos({ 0.0, 0.0, 0.0 }), vel({ 0.0, 0.0, 0.0 }), acc({ 0.0, 0.0, 0.0 }) {}
 
 Jpleph::Constant::Constant(string const name, double const value) : name(name), value(value) {}
 Jpleph::Constant::Constant(Constant const & other) : name(other.name), value(other.value) {}
@@ -1,16 +1,53 @@
 #pragma once
 
+#include <array>
 #include <string>
 #include <fstream>
 #include <vector>
+#include <memory>
 
 #include "EphemerisRecord.h"
 
+class Chebysheff;
+class EphemerisStream;
+
+// Thread safety:
+//   A Jpleph object can be shared between threads. All const methods, in particular dpleph(), may be called
+//   concurrently. Records in the cache are used without locking, a record not yet in the cache only blocks
+//   the threads asking for that record while it is loaded.
+//   Time and Posvel are plain values owned by the caller. Chebysheff and EphemerisRecord::RecordType are helper
+//   objects local to a single evaluation and must not be shared between threads.
 class Jpleph 
 {
 
 public:
-    explicit Jpleph(std::string const & jplFileName, bool aukm = true, bool daysecond = true, bool iauau = false);
+    // how the ephemeris records are accessed
+    //   Access::STREAM  records are read on demand through a file stream and kept in a small LRU cache
+    //   Access::MAPPED  the whole file is mapped read only, records are used in place without copying
+    //                   (v1 files with misaligned records and compressed files fall back to Access::STREAM)
+    //   Access::PARTIAL as STREAM, but of every record only the dates and the coefficients of the bodies evaluated
+    //                   are read. Cuts the bytes read when a few bodies of a large record are needed
+    typedef EphemerisRecord::Access Access;
+
+    // optional background read ahead for sequential sweeps through the ephemeris (see EphemerisRecord::Prefetch)
+    //   Prefetch(depth, bytesPerSecond)  read ahead 'depth' records with at most 'bytesPerSecond' (0: unlimited)
+    typedef EphemerisRecord::Prefetch Prefetch;
+
+    // usage of the record cache (see EphemerisRecord::Statistics)
+    typedef EphemerisRecord::Statistics Statistics;
+
+    // number of records kept in the cache for Access::STREAM. UNBOUNDED_CACHE keeps every record once read
+    static constexpr std::size_t DEFAULT_CACHE   = EphemerisRecord::DEFAULT_CAPACITY;
+    static constexpr std::size_t UNBOUNDED_CACHE = EphemerisRecord::UNBOUNDED_CAPACITY;
+
+    // a number of cached records shared by several Jpleph objects (see EphemerisRecord::CacheBudget, EphemerisSet)
+    typedef EphemerisRecord::CacheBudget CacheBudget;
+
+    // with a 'cacheBudget' the cache capacity is ignored: the records are cached as far as the budget allows
+    explicit Jpleph(std::string const & jplFileName, bool aukm = true, bool daysecond = true, bool iauau = false, Access const access = Access::STREAM,
+                    Prefetch const & prefetch = Prefetch(), std::size_t const cacheCapacity = DEFAULT_CACHE,
+                    std::shared_ptr<CacheBudget> const & cacheBudget = nullptr);
+    ~Jpleph();
 
     struct Time
     {
@@ -22,8 +59,9 @@ public:
     struct Posvel
     {
         Posvel();
-        std::vector<double> pos; // position vector
-        std::vector<double> vel; // velocity vector
+        std::array<double, 3> pos; // position vector
+        std::array<double, 3> vel; // velocity vector
+        std::array<double, 3> acc; // acceleration vector (only if requested)
     };
 
     enum class Target
@@ -115,7 +153,125 @@ public:
 //            for this, set km=.true. in the stcomx common block.        
 //                                                                       
 
-    void dpleph(Time const & et, Target const target, Target const center , Posvel & posvel);  
+//      acceleration  also compute posvel.acc (au/day**2 resp. km/s**2, radians/day**2 ...) from the 2nd derivative of the
+//                    chebysheff series. Otherwise posvel.acc is set to 0.0
+//
+
+    void dpleph(Time const & et, Target const target, Target const center , Posvel & posvel, bool const acceleration = false) const;  
+
+
+    // caller provided output of the batch version of dpleph (structure of arrays).
+    // Each pointer refers to an array with one value per requested epoch.
+    struct PosvelArrays
+    {
+        double * x;
+        double * y;
+        double * z;
+        double * vx;
+        double * vy;
+        double * vz;
+    };
+
+    // batch version of dpleph: position and velocity of 'target' with respect to 'center' at the 'n' epochs et[0] ... et[n-1].
+    // The results are the same as for n calls of dpleph, also for pairs with a derived series (see deriveSeries()).
+    // Components not defined for 'target' (e.g. z for nutations) are not written.
+    // The epochs don't have to be sorted. They are grouped by record and sub intervall internally and the chebysheff series
+    // are evaluated for several epochs at once (SIMD, see ChebysheffBatch). Epochs given in order are not sorted again.
+    void dpleph(Time const * et, std::size_t const n, Target const target, Target const center, PosvelArrays const & posvel) const;
+
+    // single precision version of the batch dpleph for screening (close approaches, sky plots ...) where a relative
+    // precision of 1e-6 is enough. Opt-in: convertSingle() has to be called before, otherwise runtime_error is thrown.
+    // dpleph itself always evaluates in double. The coefficients of every record are converted to float once when it
+    // is loaded, the series are evaluated in float with twice the SIMD lanes (see ChebysheffBatch). The epochs are
+    // located, the results combined and scaled in double. Pairs with a derived series (see deriveSeries()) are
+    // evaluated from it, otherwise target and center are combined from their barycentric states.
+    //
+    // Error bounds relative to dpleph. The worst case of a series with n coefficients c per component is
+    // n^2 * 2^-24 * sum |c| (see ChebysheffBatch), the errors reached are much smaller because the rounding errors
+    // of the recurrence don't add up in the same direction. Checked by testeph -f for every body:
+    //   Mercury ... Pluto, Sun, Earth-Moon barycenter, Earth, Moon
+    //              relative to the solar system barycentric position resp. velocity
+    //   Moon relative to Earth (and vice versa)
+    //              relative to the geocentric position resp. velocity of the Moon
+    //   position   SINGLE_POSITION_ERROR
+    //   velocity   SINGLE_VELOCITY_ERROR (the derivative of the series amplifies the rounding errors)
+    // The error of a pair is at most the sum of the errors of both bodies. Relative to the distance of the pair it is
+    // larger if the bodies are closer to each other than to the barycenter (e.g. Venus seen from the Earth at inferior
+    // conjunction: about 3 times). Pairs with a derived series have the bounds relative to their own distance.
+    // Nutations and librations: SINGLE_POSITION_ERROR of the largest angle in the record, TT-TDB: below 1e-9 s.
+    // Speed: only the evaluation of the series is done in float. Locating the epochs and combining the results cost
+    // as much as the series of few coefficients, i.e. on dense sorted epochs dplephSingle is only 1.0 to 1.2 times as
+    // fast as the batch dpleph (testeph -f, AVX-512), below 1.0 for some bodies in noisy runs.
+    void dplephSingle(Time const * et, std::size_t const n, Target const target, Target const center, PosvelArrays const & posvel) const;
+
+    // the documented bounds of dplephSingle (see there)
+    static constexpr double SINGLE_POSITION_ERROR = 1.0e-6;
+    static constexpr double SINGLE_VELOCITY_ERROR = 1.0e-5;
+
+    // keep a single precision copy of the coefficients with every record for dplephSingle. The memory is reported by
+    // the statistics. Not thread safe: call before the first evaluation
+    void convertSingle();
+
+    // a single request of a batch of mixed requests
+    struct Query
+    {
+        Time   et;
+        Target target;
+        Target center;
+    };
+
+    // planned version of dpleph for a batch of unrelated requests (e.g. from observation reduction). The queries are
+    // reordered by record and epoch: every record is looked up once and every entry is evaluated once per distinct epoch.
+    // These values are shared by all queries at this epoch. posvel[k] is the result for queries[k], identical to the
+    // result of the corresponding dpleph call. All queries are checked before the first one is evaluated.
+    void dpleph(Query const * queries, std::size_t const n, Posvel * posvel, bool const acceleration = false) const;
+
+    // the states of 'target' relative to 'center' at the epochs tStart, tStart + step, tStart + 2 * step ... in this order
+    // (see EphemerisStream.h, which has to be included to use it). The record of the current epoch stays pinned and
+    // the time is advanced within it without a new lookup. 'step' in days, may be negative
+    EphemerisStream stream(Target const target, Target const center, Time const & tStart, double const step, bool const acceleration = false) const;
+
+    // the states of everything in the ephemeris file at one epoch (see state())
+    // indexed by Target. The bodies are given relative to the solar system barycenter in the same units as by dpleph.
+    // Nutations, librations and TT-TDB are given as by dpleph. Entries not in the ephemeris file are marked as not present.
+    struct SolarSystemState
+    {
+        static int const SIZE = 18; // Target::TT_TTB + 1
+
+        Posvel const & operator[](Target const target) const;
+        bool isPresent(Target const target) const;
+
+        Posvel posvel[SIZE];
+        bool   present[SIZE];
+    };
+
+    // the barycentric states of all bodies in the file and nutations, librations and TT-TDB if present at the epoch 'et'.
+    // Much cheaper than the corresponding dpleph calls: the record is looked up once, every entry is evaluated once
+    // (entries with the same number of coefficients and sub intervalls in a single pass, see Clenshaw::evaluateRows)
+    // and Earth and Moon are derived from a single evaluation of the Earth-Moon barycenter and the geocentric Moon.
+    // The accelerations are computed as for dpleph if 'acceleration' is set.
+    void state(Time const & et, SolarSystemState & state, bool const acceleration = false) const;
+
+
+    // the state of 'target' relative to 'center', both bodies or barycenters
+    struct Pair
+    {
+        Target target;
+        Target center;
+    };
+
+    // derive the chebysheff series of these pairs from the series in the file whenever a record is loaded, e.g. the
+    // geocentric Sun from the Sun, the Earth-Moon barycenter and the Moon. dpleph evaluates a single series for
+    // them (and for the reversed pairs) instead of up to three. The results agree with the combination of the series
+    // in the file to rounding. The memory is reported by the statistics. Pairs given by a single series of the file
+    // (e.g. the Moon relative to the Earth) and pairs with bodies not in the file are not derived.
+    // Not thread safe: call before the first evaluation
+    void deriveSeries(std::vector<Pair> const & pairs);
+
+    // the pairs for geocentric work: the Sun and the planets relative to the Earth, Earth and Moon relative to the
+    // solar system barycenter
+    static std::vector<Pair> geocentricSeries();
+
 
     // read the names and values of the ephemeries constants
     struct Constant
@@ -131,17 +287,65 @@ public:
 
     void constants(Constants & constants, double & dateStart, double & dateEnd, double & dateInterval) const;
 
+    // how the chebysheff series of a target are laid out in every record. For Earth and Moon the combination of
+    // the Earth-Moon barycenter and the Moon (the finer sub intervals, the higher number of coefficients).
+    // The solar system barycenter has one constant series.
+    struct Layout
+    {
+        int subIntervals; // number of sub intervals per record
+        int coefficients; // number of chebysheff coefficients per component and sub interval
+    };
+
+    Layout layout(Target const target) const;
+
+    // the number of the development ephemeris (e.g. 440 for DE440)
+    long number() const;
+
+    // the access actually used: Access::MAPPED falls back to Access::STREAM for v1 files with misaligned records
+    // and for compressed files
+    Access access() const;
+
+    // usage of the record cache so far
+    Statistics statistics() const;
+
+    // print the statistics to 'out' when the object is destroyed. nullptr switches it off
+    void dumpStatistics(std::ostream * out);
+
 private:
 
-    void split(double const time, Time & preciseTime);
-    Time & determineTime(Time const & inTime, Time & interpolationTime);
+    static constexpr std::size_t BATCH_SIZE = 128; // number of epochs processed together by the batch version of dpleph
+
+    friend class EphemerisStream;
+    friend class EphemerisFit;
+
+    static void evaluate(Chebysheff & chebysheff, double const tScaled, int const entry, bool const acceleration, Posvel & posvel);
+    void evaluatePair(Chebysheff & chebysheff, double const tScaled, Target const target, Target const center, bool const acceleration, Posvel & posvel) const;
+    template<typename Interpolate>
+    void combine(Target const target, Target const center, Interpolate & interpolate, Posvel & posvel) const;
+    int locateRecord(Time const & interpolationTime, long double & tScaled) const;
+    void checkTargetCenter(Target const target, Target const center) const;
+    void checkDateRange(Time const & et, Time const & interpolationTime) const;
+    EphemerisRecord::Entry auxiliaryEntry(Target const target) const;
+    void dplephBatches(Time const * et, std::size_t const n, Target const target, Target const center, PosvelArrays const & posvel, bool const single) const;
+    void dplephBatch(Time const * et, std::size_t const count, Target const target, Target const center, double * const * posvel, bool const single) const;
+    void barycentricBatch(Target const body, int const * records, double const * times, std::size_t const count, double (* state)[BATCH_SIZE],
+                          bool const single) const;
+    void evaluateBatch(EphemerisRecord::Entry const entry, int const * records, double const * times, std::size_t const count, double (* state)[BATCH_SIZE],
+                       bool const single) const;
+    void split(double const time, Time & preciseTime) const;
+    Time & determineTime(Time const & inTime, Time & interpolationTime) const;
+    void readHeaderV1(std::string const & jplFileName);
+    void readHeaderV2(std::string const & jplFileName);
+    void readHeaderFortran(std::string const & jplFileName);
     void calculateFactors(bool aukm, bool daysecond, bool iauau);
-    bool inDateRange(Time const & interpolationTime);
-    bool isPresent(EphemerisRecord::Entry const body);
+    bool inDateRange(Time const & interpolationTime) const;
+    bool isPresent(EphemerisRecord::Entry const body) const;
+    void barycentricTerms(Target const body, double const sign, std::vector<EphemerisRecord::Derivation::Term> & terms) const;
 
     
    std::ifstream jpleph;
    bool good; 
+   std::ostream * statisticsOut; // where to dump the statistics at destruction
    std::streampos recordStart;
    std::streamoff recordLength;
    std::streampos currentPositon;
@@ -166,4 +370,23 @@ private:
     double factorMoon;  // mass factor for moon
     double xscale;      // scale factor for position
     double vscale;      // scale factor for velocity
+    double ascale;      // scale factor for acceleration
+
+    // the entries in the ephemeris file i.e. evaluated by state(), grouped by the number of coefficients and
+    // sub intervalls. At most Clenshaw::MAX_ROWS / Clenshaw::MAX_DIMENSION entries per group
+    std::vector<std::vector<int>> stateGroups;
+
+    // the derived series of the pairs (target, center) of bodies, indexed by the targets. entry < 0: not derived.
+    // A reversed pair uses the same series with sign -1.0
+    static int const NUM_BODIES = int(Target::EM_BARYCENTER) + 1;
+    struct Derived
+    {
+        int    entry;
+        double sign;
+    };
+    Derived derived[NUM_BODIES][NUM_BODIES];
+
+    bool singlePrecision; // single precision copies of the records for dplephSingle (convertSingle())
+
+    bool bodyPresent[NUM_BODIES]; // the entries of the body are in the file (refitted files may hold a subset, see EphemerisFit)
 };
\ No newline at end of file
@@ -33,7 +33,7 @@ inline bool read(std::ifstream & jpleph, std::string & value)
         return false;
     }
     
-    value = std::string(buffer, (unsigned int)jpleph.gcount());
+    value = std::string(buffer); // gcount() includes the extracted '\0'
     return true;
 }
 
@@ -42,30 +42,20 @@ template<typename T>
 bool read(std::ifstream & jpleph, std::vector<T> & values)
 {
     // first we read the size
-    std::vector<T>::size_type size;
+    typename std::vector<T>::size_type size;
     if(!read(jpleph, size))
     {
         return false;
     }
 
-    // just in case clear out the vector
-    values.clear();
-    // reserve the size and avoid realocations
-    values.reserve(size);
-    // now read the values
-    for(std::vector<T>::size_type i = 0; i < size; ++i)
+    // size the vector and read all values with a single read
+    values.resize(size);
+    if(size > 0)
     {
-        T value;
-        jpleph.read((char*) & value, sizeof(T));
-        if(!jpleph.good())
-        {
-            return false;
-        }
-        values.push_back(value);
+        jpleph.read((char*) values.data(), size * sizeof(T));
     }
 
-
-    return true;
+    return jpleph.good();
 }
 
 // specialized template for reading a vector<std::string>
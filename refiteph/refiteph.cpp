@@ -0,0 +1,272 @@
+//
+// refiteph: compact ephemeris files for a few bodies, a time window and a given precision (see EphemerisFit.h)
+//
+// The entries needed for the bodies are refitted with the fewest coefficients within the tolerance and written
+// in the v2 format. The new file is read back and compared with the source at random epochs of the window.
+//
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "jpleph.h"
+#include "EphemerisFit.h"
+
+#include "../jpleph/optionparser.h"
+
+
+
+namespace {
+
+struct Arg: public option::Arg
+{
+
+    static void printError(std::string const & msg, option::Option const & option, std::string const & msg2)
+    {
+        std::cerr << msg << std::string(option.name) << msg2 << std::flush;
+    }
+
+
+    static option::ArgStatus Unknown(option::Option const & option, bool const msg)
+    {
+        if(msg)
+        {
+            printError("Unknown option '", option, "'\n");
+        }
+        return option::ARG_ILLEGAL;
+    }
+
+
+    static option::ArgStatus Required(option::Option const & option, bool const msg)
+    {
+        if(option.arg != 0)
+        {
+            return option::ARG_OK;
+        } else
+        {
+            if(msg)
+            {
+                printError("Option '", option, "' requires an argument\n");
+            }
+            return option::ARG_ILLEGAL;
+        }
+    }
+};
+
+
+    enum OptionIndex { UNKNOWN, EPHEMERIS, OUTPUT, BODIES, START, FINAL, PRECISION, COEFFICIENTS, INTERVALS };
+    const option::Descriptor usage[] =
+    {
+        {UNKNOWN, 0, "", "" , Arg::None, "USAGE: refiteph -e ephemeris -o output -b bodies [-s start] [-f final] [-p km] [-k coefficients] [-i intervals]\n\n"},
+        {EPHEMERIS,  0, "e", "ephemeris", Arg::Required, "-e, --ephemeris   \t binary ephemeris file to be refitted"},
+        {OUTPUT,  0, "o", "output", Arg::Required, "-o, --output   \t refitted ephemeris file (v2 format)"},
+        {BODIES,  0, "b", "bodies", Arg::Required, "-b, --bodies   \t comma separated bodies: mercury, venus, earth, mars, jupiter, saturn, uranus, neptune, pluto, moon, sun, emb"},
+        {START,  0, "s", "start", Arg::Required, "-s, --start   \t start of the window (julian ephemeris date), default: start of the ephemeris"},
+        {FINAL,  0, "f", "final", Arg::Required, "-f, --final   \t end of the window (julian ephemeris date), default: end of the ephemeris"},
+        {PRECISION,  0, "p", "precision", Arg::Required, "-p, --precision   \t maximum position error of the fitted series in km, default 0.001"},
+        {COEFFICIENTS,  0, "k", "coefficients", Arg::Required, "-k, --coefficients   \t maximum number of coefficients per component and sub interval, default 18"},
+        {INTERVALS,  0, "i", "intervals", Arg::Required, "-i, --intervals   \t maximum number of sub intervals per record, default 32"},
+        {UNKNOWN, 0, "", "", Arg::None, "\nExamples:\n"
+                                        "refiteph -e jpleph.440 -o earthmoon.eph -b earth,moon,sun -s 2451544.5 -f 2469807.5\n"
+                                        "refiteph -e jpleph.440 -o mars.eph -b mars,earth -p 0.01\n"},
+        {0,0,0,0,0,0}
+    };
+
+    static size_t const VERIFY_EPOCHS = 200000; // random epochs for the comparison of the refitted file with the source
+
+    struct Body
+    {
+        char const *   name;
+        Jpleph::Target target;
+    };
+
+    static Body const BODY_NAMES[] =
+    {
+        { "mercury", Jpleph::Target::MERCURY }, { "venus", Jpleph::Target::VENUS },     { "earth", Jpleph::Target::EARTH },
+        { "mars", Jpleph::Target::MARS },       { "jupiter", Jpleph::Target::JUPITER }, { "saturn", Jpleph::Target::SATURN },
+        { "uranus", Jpleph::Target::URANUS },   { "neptune", Jpleph::Target::NEPTUN },  { "pluto", Jpleph::Target::PLUTO },
+        { "moon", Jpleph::Target::MOON },       { "sun", Jpleph::Target::SUN },         { "emb", Jpleph::Target::EM_BARYCENTER },
+    };
+
+    static char const * const ENTRY_NAMES[] =
+    {
+        "Mercury", "Venus", "Earth-Moon barycenter", "Mars", "Jupiter", "Saturn", "Uranus", "Neptune", "Pluto", "Moon (geocentric)", "Sun"
+    };
+}
+
+
+using namespace std;
+
+vector<Jpleph::Target> parseBodies(string const & list);
+bool verify(string const & sourceFileName, string const & fileName, vector<Jpleph::Target> const & bodies,
+            EphemerisFit::Result const & result, double const tolerance);
+
+int main(int argc, char * argv[])
+{
+    cout << endl << "Refitting of JPL DE ephemeries." << endl << endl;
+    // skip program name if present
+    if(argc > 0)
+    {
+        argc--;
+        argv++;
+    }
+
+    option::Stats stats(usage, argc, argv);
+    vector<option::Option> options(stats.options_max);
+    vector<option::Option> buffer(stats.buffer_max);
+    option::Parser parse(usage, argc, argv, &options[0], &buffer[0]);
+
+    if(parse.error())
+    {
+        return 1;
+    }
+
+    if(argc == 0 || options[EPHEMERIS].count() == 0 || options[OUTPUT].count() == 0 || options[BODIES].count() == 0)
+    {
+        option::printUsage(cout, usage);
+        return 0;
+    }
+
+    string const sourceFileName = options[EPHEMERIS].arg;
+    string const fileName       = options[OUTPUT].arg;
+
+    try
+    {
+        EphemerisFit::Options fitOptions;
+        fitOptions.bodies = parseBodies(options[BODIES].arg);
+        if (options[START].count() > 0)
+        {
+            fitOptions.dateStart = stod(options[START].arg);
+        }
+        if (options[FINAL].count() > 0)
+        {
+            fitOptions.dateEnd = stod(options[FINAL].arg);
+        }
+        if (options[PRECISION].count() > 0)
+        {
+            fitOptions.tolerance = stod(options[PRECISION].arg);
+        }
+        if (options[COEFFICIENTS].count() > 0)
+        {
+            fitOptions.maxCoefficients = stoi(options[COEFFICIENTS].arg);
+        }
+        if (options[INTERVALS].count() > 0)
+        {
+            fitOptions.maxSubIntervals = stoi(options[INTERVALS].arg);
+        }
+
+        cout << "Ephemeris file : " << sourceFileName << endl
+             << "Output file    : " << fileName << endl
+             << "Precision      : " << fitOptions.tolerance << " km" << endl;
+
+        auto const start = chrono::steady_clock::now();
+        EphemerisFit::Result const result = EphemerisFit::refit(sourceFileName, fileName, fitOptions);
+        double const seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << fixed << setprecision(1) << "Window         : " << result.dateStart << " to " << result.dateEnd << ", "
+             << result.numRecords << " records of " << result.dateInterval << " days" << endl << endl
+             << "   entry                   coefficients  sub intervals   (source)   max error km   velocity km/day" << endl;
+        for (EphemerisFit::EntryFit const & fit : result.entries)
+        {
+            cout << "   " << left << setw(24) << ENTRY_NAMES[fit.entry] << right << setw(8) << fit.coefficients << setw(13) << fit.subIntervals
+                 << "   " << setw(6) << fit.sourceCoefficients << " x" << setw(3) << fit.sourceSubIntervals
+                 << scientific << setprecision(3) << setw(15) << fit.positionError << setw(18) << fit.velocityError << fixed << endl;
+        }
+        cout << endl << setprecision(2)
+             << "   values per record: " << result.numValues << " (source " << result.sourceValues << ", "
+             << (100.0 * double(result.numValues) / double(result.sourceValues)) << " %)" << endl
+             << "   file size        : " << result.bytes << " bytes" << endl
+             << "   max error        : " << scientific << setprecision(3) << result.positionError << " km" << fixed << endl
+             << "   fitted in " << setprecision(2) << seconds << " s" << endl;
+
+        if (!verify(sourceFileName, fileName, fitOptions.bodies, result, fitOptions.tolerance))
+        {
+            return 1;
+        }
+    }
+    catch (exception const & e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+vector<Jpleph::Target> parseBodies(string const & list)
+{
+    vector<Jpleph::Target> bodies;
+    istringstream names(list);
+    string name;
+    while (getline(names, name, ','))
+    {
+        transform(name.begin(), name.end(), name.begin(), [](char const c) { return char(tolower(c)); });
+        auto const body = find_if(begin(BODY_NAMES), end(BODY_NAMES), [&name](Body const & body) { return name == body.name; });
+        if (body == end(BODY_NAMES))
+        {
+            throw invalid_argument("unknown body " + name);
+        }
+        bodies.push_back(body->target);
+    }
+    return bodies;
+}
+
+
+// the bodies from the refitted file against the source at random epochs of the window. The errors of the barycentric
+// positions are those of the entries, Earth and Moon combine two of them. Measures the throughput of both files
+bool verify(string const & sourceFileName, string const & fileName, vector<Jpleph::Target> const & bodies,
+            EphemerisFit::Result const & result, double const tolerance)
+{
+    Jpleph const source(sourceFileName, false, true, false, Jpleph::Access::MAPPED);
+    Jpleph const fitted(fileName, false, true, false, Jpleph::Access::MAPPED);
+
+    mt19937 random(4711);
+    uniform_real_distribution<double> epoch(result.dateStart, result.dateEnd);
+    uniform_int_distribution<size_t> pick(0, bodies.size() - 1);
+    vector<Jpleph::Query> queries(VERIFY_EPOCHS);
+    for (Jpleph::Query & query : queries)
+    {
+        query.et.t1  = epoch(random);
+        query.target = bodies[pick(random)];
+        query.center = Jpleph::Target::SS_BARYCENTER;
+    }
+
+    double maxError = 0.0;
+    for (Jpleph::Query const & query : queries)
+    {
+        Jpleph::Posvel one;
+        Jpleph::Posvel other;
+        source.dpleph(query.et, query.target, query.center, one);
+        fitted.dpleph(query.et, query.target, query.center, other);
+        maxError = max(maxError, sqrt(  (one.pos[0] - other.pos[0]) * (one.pos[0] - other.pos[0])
+                                      + (one.pos[1] - other.pos[1]) * (one.pos[1] - other.pos[1])
+                                      + (one.pos[2] - other.pos[2]) * (one.pos[2] - other.pos[2])));
+    }
+
+    auto measure = [&queries](Jpleph const & jpleph)
+    {
+        Jpleph::Posvel posvel;
+        auto const start = chrono::steady_clock::now();
+        for (Jpleph::Query const & query : queries)
+        {
+            jpleph.dpleph(query.et, query.target, query.center, posvel);
+        }
+        return double(queries.size()) / chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    };
+    double const sourceRate = measure(source);
+    double const fittedRate = measure(fitted);
+
+    // Earth and Moon: the error of the barycenter plus the share of the geocentric Moon
+    bool const ok = maxError <= 2.0 * tolerance;
+    cout << endl << "Refitted file against the source at " << queries.size() << " random epochs" << endl
+         << "   max error: " << scientific << setprecision(3) << maxError << " km" << (ok ? "" : "  *****  WARNING  *****") << endl
+         << fixed << setprecision(0)
+         << "   source   : " << setw(10) << sourceRate << " evaluations/s" << endl
+         << "   refitted : " << setw(10) << fittedRate << " evaluations/s" << endl;
+    return ok;
+}
@@ -0,0 +1,85 @@
+//
+// counting replacements of the global allocation functions (see AllocationCounter.h)
+//
+#include <cstdlib>
+#include <new>
+
+#include "AllocationCounter.h"
+
+std::atomic<std::size_t> allocationCount(0);
+std::atomic<bool>        countAllocations(false);
+
+
+namespace {
+
+void * countedAllocation(std::size_t const size) noexcept
+{
+    if (countAllocations.load(std::memory_order_relaxed))
+    {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+}
+
+
+void * operator new(std::size_t size)
+{
+    void * memory = countedAllocation(size);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void * operator new[](std::size_t size)
+{
+    void * memory = countedAllocation(size);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void * operator new(std::size_t size, std::nothrow_t const &) noexcept
+{
+    return countedAllocation(size);
+}
+
+void * operator new[](std::size_t size, std::nothrow_t const &) noexcept
+{
+    return countedAllocation(size);
+}
+
+void operator delete(void * memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void * memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void * memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void * memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void * memory, std::nothrow_t const &) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void * memory, std::nothrow_t const &) noexcept
+{
+    std::free(memory);
+}
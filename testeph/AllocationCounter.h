@@ -0,0 +1,19 @@
+//
+// counting of the heap allocations of testeph (see checkAllocations in testeph.cpp)
+//
+// AllocationCounter.cpp replaces all forms of the global operator new and delete by versions based on std::malloc
+// and std::free. While 'countAllocations' is set they count the allocations in 'allocationCount'.
+// The replacements live in a translation unit of their own: inlined into the callers, std::free on a pointer
+// returned by operator new looks like a mismatched deallocation to the compiler.
+//
+#pragma once
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <atomic>
+#include <cstddef>
+
+extern std::atomic<std::size_t> allocationCount;  // number of heap allocations while 'countAllocations' is set
+extern std::atomic<bool>        countAllocations;
+
+#endif
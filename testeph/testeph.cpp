@@ -6,7 +6,26 @@
 #include <iomanip>
 #include <vector>
 #include <limits>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+#include <sstream>
+#include <cstdio>
+#include <exception>
+#include <mutex>
+#include <numeric>
 #include "jpleph.h"
+#include "ChebysheffBatch.h"
+#include "EventSearch.h"
+#include "SpkFile.h"
+#include "EphemerisStream.h"
+#include "EphemerisSet.h"
+#include "AllocationCounter.h"
 
 #include "optionparser.h"
 
@@ -50,17 +69,92 @@ struct Arg: public option::Arg
 };
 
 
-    enum OptionIndex { UNKNOWN, EPHEMERIS, TESTFILE };
+    enum OptionIndex { UNKNOWN, EPHEMERIS, TESTFILE, MAPPED, COMPARE, THREADS, BATCH, STATE, ALLOCATIONS, PREFETCH, CACHE, REPORT, ACCELERATION, QUERIES, EVENTS, DERIVED, SPK, STREAM, SINGLE, SET, PARTIAL, COMPRESSED, FAILURES };
     const option::Descriptor usage[] =
     {
-        {UNKNOWN, 0, "", "" , Arg::None, "USAGE: testeph -e ephemeries -t testfile\n\n"},
+        {UNKNOWN, 0, "", "" , Arg::None, "USAGE: testeph -e ephemeries -t testfile [-m] [-c] [-j threads] [-b] [-s] [-a] [-p depth[,bytes/s]] [-k records] [-r] [-g] [-q] [-v] [-d] [-n spkfile] [-x] [-f] [-u files] [-l] [-z file] [-w]\n\n"},
         {EPHEMERIS,  0, "e", "ephemries", Arg::Required, "-e, --ephemeries   \t input binary ephemeris file to be tested"},
         {TESTFILE,  0, "t", "testfile", Arg::Required, "-t, --testfile   \t test control file (ASCII)"},
+        {MAPPED,  0, "m", "mapped", Arg::None, "-m, --mapped   \t use the memory mapped (zero copy) access to the ephemeris file"},
+        {COMPARE,  0, "c", "compare", Arg::None, "-c, --compare   \t compare stream and memory mapped access for identical results and throughput"},
+        {THREADS,  0, "j", "threads", Arg::Required, "-j, --threads   \t number of threads evaluating the test control file (default: one per hardware thread). "
+                                                                 "Also evaluates the test cases repeatedly on a shared ephemeris with that many threads"},
+        {FAILURES,  0, "w", "warnings", Arg::None, "-w, --warnings   \t print only the test lines with differences >= 1.D-13 and the summary"},
+        {BATCH,  0, "b", "batch", Arg::None, "-b, --batch   \t benchmark the batch version of dpleph against a loop of single calls"},
+        {STATE,  0, "s", "state", Arg::None, "-s, --state   \t benchmark the full solar system state against the equivalent single dpleph calls"},
+        {ALLOCATIONS,  0, "a", "allocations", Arg::None, "-a, --allocations   \t check that evaluating the ephemeris does no heap allocations"},
+        {PREFETCH,  0, "p", "prefetch", Arg::Required, "-p, --prefetch   \t sweep forward and backward through the ephemeris with background read ahead of the given depth (and I/O budget)"},
+        {CACHE,  0, "k", "cache", Arg::Required, "-k, --cache   \t number of records in the cache (stream access) or 'unbounded'"},
+        {REPORT,  0, "r", "report", Arg::None, "-r, --report   \t print the cache statistics at the end"},
+        {ACCELERATION,  0, "g", "acceleration", Arg::None, "-g, --acceleration   \t check the accelerations against differentiated velocities and measure their cost"},
+        {QUERIES,  0, "q", "queries", Arg::None, "-q, --queries   \t evaluate a batch of random mixed queries with the query planner and compare with single calls"},
+        {DERIVED,  0, "d", "derived", Arg::None, "-d, --derived   \t compare and benchmark the derived geocentric series against the combination of the series in the file"},
+        {EVENTS,  0, "v", "events", Arg::None, "-v, --events   \t search events (oppositions, lunar phases, equinoxes, perihelia) and compare with a scan of dpleph values"},
+        {SPK,  0, "n", "spk", Arg::Required, "-n, --spk   \t write the ephemeris as SPK file (type 2 and 3 segments), compare and benchmark it against the ephemeris"},
+        {STREAM,  0, "x", "stream", Arg::None, "-x, --stream   \t compare and benchmark dense sweeps with a streaming cursor against a loop of dpleph calls"},
+        {SET,  0, "u", "union", Arg::Required, "-u, --union   \t check a set of ephemeris files (comma separated) used as one: dispatch, lazy opening, shared cache budget"},
+        {PARTIAL,  0, "l", "partial", Arg::None, "-l, --partial   \t compare the partial reading of records for a few bodies with stream access: identical results, bytes read"},
+        {COMPRESSED,  0, "z", "compressed", Arg::Required, "-z, --compressed   \t compare the given compressed container (asc2eph -z) with the ephemeris file: identical results, ratio, decompression cost"},
+        {SINGLE,  0, "f", "float", Arg::None, "-f, --float   \t check the single precision screening evaluation against the error bounds and benchmark it against the batch dpleph"},
         {UNKNOWN, 0, "", "", Arg::None, "\nExamples:\n"
-                                        "testeph -e jpleph -t test432\n"},
+                                        "testeph -e jpleph -t test432\n"
+                                        "testeph -e jpleph -t test432 -m -c\n"
+                                        "testeph -e jpleph -t test432 -j 8\n"
+                                        "testeph -e jpleph -t test432 -w -r\n"
+                                        "testeph -e jpleph -t test432 -b\n"
+                                        "testeph -e jpleph -t test432 -p 4,1000000\n"
+                                        "testeph -e jpleph -t test432 -k unbounded -r\n"
+                                        "testeph -e jpleph -t test432 -v\n"
+                                        "testeph -e jpleph -t test432 -m -d\n"
+                                        "testeph -e jpleph -t test432 -m -n de432.bsp\n"
+                                        "testeph -e jpleph -t test432 -x\n"
+                                        "testeph -e jpleph -t test432 -m -f\n"
+                                        "testeph -e jpleph -t test432 -l -k 4\n"
+                                        "testeph -e jpleph -t test432 -z jpleph.z\n"
+                                        "testeph -e jpleph -t test432 -m -u de441_part-1.eph,de441_part-2.eph,de440.eph\n"},
         {0,0,0,0,0,0}
     };  
 
+    // a single evaluation request from the test control file
+    struct TestCase
+    {
+        double tdb;
+        int    target;
+        int    center;
+    };
+
+    // a line of the test control file and its result
+    struct TestLine
+    {
+        double tdb;
+        int    target;
+        int    center;
+        int    component; // translated to the components of Posvel
+        double value;     // JPL value
+        double calcValue; // user value
+        double del;       // difference
+    };
+
+    static size_t const TEST_CHUNK                = 1024;    // test lines of neighbouring dates evaluated by a thread at once
+    static double const TEST_TOLERANCE            = 1.0e-13; // difference of a test line to be reported
+    static size_t const MIN_BENCHMARK_EVALUATIONS = 1000000; // minimum number of dpleph calls for a throughput measurement
+    static size_t const BATCH_EPOCHS              = 50000;   // number of epochs of a batch request
+    static size_t const ALLOCATION_CHECK_CALLS    = 5000000; // minimum number of evaluations checked for heap allocations
+    static size_t const PLANNED_QUERIES           = 200000;  // number of random queries for the query planner
+    static size_t const QUERIES_PER_EPOCH         = 8;       // average number of queries at the same epoch
+    // relative difference of derived and combined series. The rounding errors of the re-expanded coefficients are amplified by the derivatives
+    static double const DERIVED_TOLERANCE[3]      = { 1e-13, 1e-9, 1e-7 };  // position, velocity, acceleration
+    static double const EVENT_SCAN_STEP           = 0.01;    // days, step of the scan for sign changes the event search is compared with
+    static double const EVENT_PRECISION           = 1e-5;    // days, maximum difference between searched and scanned events (0.86 s)
+    // relative difference of the SPK file and the ephemeris. The series are refitted at the chebysheff nodes
+    static double const SPK_TOLERANCE[3]          = { 1e-13, 1e-10, 1e-8 };  // position, velocity, acceleration
+    static double const STREAM_STEP               = 0.01;    // days, step of the dense sweeps
+    static double const STREAM_SPAN               = 2000.0;  // days, length of a sweep
+    static double const STREAM_OFFSET             = 0.005;   // days, keeps the epochs off the sub interval boundaries (see checkStream)
+    // relative difference of streamed states and dpleph. The normalized time within a record is accumulated instead of computed
+    // from the epoch, its rounding (1e-16 of a record) is amplified by the rate of change
+    static double const STREAM_TOLERANCE[2]       = { 1e-12, 1e-10 }; // position, velocity
+
 
     static double const JDEPOC_DEFAULT     = 2440400.5;
     static std::string const JDEPOC_NAME   = "JDEPOC";
@@ -71,6 +165,25 @@ struct Arg: public option::Arg
 using namespace std;
 
 bool skipToData(ifstream & contolFile);
+void evaluateTestLines(Jpleph const & jpleph, vector<TestLine> & lines, double const jdepoc, unsigned const numThreads);
+void printTestLines(vector<TestLine> const & lines, bool const failuresOnly, unsigned const numThreads);
+void compareAccess(string const & jplephFileName, vector<TestCase> const & testCases);
+void checkConcurrency(Jpleph const & jpleph, vector<TestCase> const & testCases, int const numThreads);
+void benchmarkBatch(Jpleph const & jpleph, double const dateStart, double const dateEnd);
+void benchmarkState(Jpleph const & jpleph, double const dateStart, double const dateEnd);
+bool checkAllocations(Jpleph const & jpleph, vector<TestCase> const & testCases, double const dateStart, double const dateEnd);
+bool sweepPrefetch(string const & jplephFileName, Jpleph::Access const access, string const & prefetchArg);
+bool checkAcceleration(Jpleph const & jpleph, double const dateStart, double const dateEnd);
+bool checkQueryPlanner(Jpleph const & jpleph, double const dateStart, double const dateEnd);
+bool checkEvents(Jpleph const & jpleph, double const dateStart, double const dateEnd);
+bool checkDerivedSeries(string const & jplephFileName, Jpleph::Access const access, size_t const cacheCapacity, double const dateStart, double const dateEnd);
+bool checkSpk(Jpleph const & jpleph, string const & spkFileName, vector<TestCase> const & testCases, double const au,
+              double const dateStart, double const dateEnd, double const dateInterval);
+bool checkStream(Jpleph const & jpleph, double const dateStart, double const dateEnd);
+bool checkSingle(string const & jplephFileName, Jpleph::Access const access, size_t const cacheCapacity, double const dateStart, double const dateEnd);
+bool checkSet(string const & fileList, Jpleph::Access const access);
+bool checkPartial(string const & jplephFileName, size_t const cacheCapacity, double const dateStart, double const dateEnd);
+bool checkCompressed(string const & jplephFileName, string const & compressedFileName, size_t const cacheCapacity, double const dateStart, double const dateEnd);
 
 int main(int argc, char * argv[])
 {
@@ -128,8 +241,28 @@ int main(int argc, char * argv[])
     }
 
 
+    bool const mapped = options[MAPPED].count() > 0;
+
+    size_t cacheCapacity = Jpleph::DEFAULT_CACHE;
+    if (options[CACHE].count() > 0)
+    {
+        string const capacity = options[CACHE].arg;
+        cacheCapacity = capacity == "unbounded" ? Jpleph::UNBOUNDED_CACHE : size_t(stoul(capacity));
+        cout << "Cache          : " << capacity << endl;
+    }
+
     // initialise ephemeries
-    Jpleph jpleph(jplephFileName); 
+    Jpleph jpleph(jplephFileName, true, true, false, mapped ? Jpleph::Access::MAPPED : Jpleph::Access::STREAM, Jpleph::Prefetch(), cacheCapacity); 
+    cout << "Access         : " << (mapped ? "memory mapped" : "stream");
+    if (mapped && jpleph.access() != Jpleph::Access::MAPPED)
+    {
+        cout << " not possible for this file (misaligned v1 records or compressed), falls back to stream";
+    }
+    cout << endl;
+    if (options[REPORT].count() > 0)
+    {
+        jpleph.dumpStatistics(&cout);
+    }
 
     // read constants and display them
     Jpleph::Constants constants;
@@ -175,7 +308,15 @@ int main(int argc, char * argv[])
     cout << "line -- jed --    t#   c#   x#    --- jpl value ---     --- user value --  -- difference --" << endl;
 
 
-    // read a test case
+    // the targets in the ephemeris file. Files converted or refitted for a subset of the bodies (asc2eph -b, refiteph)
+    // lack some of them
+    Jpleph::SolarSystemState inFile;
+    Jpleph::Time middle;
+    middle.t1 = 0.5 * (dateStart + dateEnd);
+    jpleph.state(middle, inFile);
+
+    // read the test cases. Lines outside the time span of the ephemeris file and lines of targets not in it are skipped
+    int absent = 0;
     string de;
     string date;
     double tdb; 
@@ -183,11 +324,8 @@ int main(int argc, char * argv[])
     int center;
     int component;
     double value;
-    int line = 0;
-    bool ok = true;
-    double tdbmin =  DBL_MAX;
-    double tdbmax = -DBL_MAX;
-    int warnings = 0;
+    vector<TestLine> lines;
+    vector<TestCase> testCases;
 
     while (!testInput.eof())
     {
@@ -200,13 +338,13 @@ int main(int argc, char * argv[])
         {
             continue;
         }
-        Jpleph::Time time;
-        time.t1 = tdb;
-        Jpleph::Posvel posvel;
-        jpleph.dpleph(time, Jpleph::Target(target), Jpleph::Target(center), posvel);
+        if (   target <= 0 || target >= Jpleph::SolarSystemState::SIZE || center < 0 || center >= Jpleph::SolarSystemState::SIZE
+            || !inFile.isPresent(Jpleph::Target(target)) || (center != 0 && !inFile.isPresent(Jpleph::Target(center))))
+        {
+            ++absent;
+            continue;
+        }
 
-        // the comparison with expected result
-        double del;
         // testeph and jpl uses a somewhat shifted and inhomogeneous component numbering
         // translate it to match our posvel structure
         if (target == 14) // nutation
@@ -225,78 +363,1830 @@ int main(int argc, char * argv[])
             }
         }
 
-        double calcValue = (component < 4) ? posvel.pos.at(component - 1) : posvel.vel.at(component - 4);
-        del = fabs(calcValue - value);
+        lines.push_back({ tdb, target, center, component, value, 0.0, 0.0 });
+        testCases.push_back({ tdb, target, center });
+    }
+
+    // evaluate them on several threads, in chunks of neighbouring dates
+    unsigned const numThreads = options[THREADS].count() > 0 ? unsigned(max(stoi(options[THREADS].arg), 1)) : max(thread::hardware_concurrency(), 1u);
+    Jpleph::Statistics const before = jpleph.statistics();
+    auto const start = chrono::steady_clock::now();
+    evaluateTestLines(jpleph, lines, jdepoc, numThreads);
+    double const seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    Jpleph::Statistics const after = jpleph.statistics();
+
+    // the output in the order of the control file
+    printTestLines(lines, options[FAILURES].count() > 0, numThreads);
+
+    int const line = int(lines.size());
+    int warnings = 0;
+    double tdbmin =  DBL_MAX;
+    double tdbmax = -DBL_MAX;
+    for (TestLine const & testLine : lines)
+    {
+        warnings += testLine.del >= TEST_TOLERANCE ? 1 : 0;
+        tdbmin = min(tdbmin, testLine.tdb);
+        tdbmax = max(tdbmax, testLine.tdb);
+    }
+    bool const ok = warnings == 0;
+
+    if (ok)
+    {
+        cout << endl;
+        cout << "testeph checked successfully against ephemeris file " << endl;
+        cout << "over Julian date range " << fixed << showpoint << setw(10) << setprecision(1)<< tdbmin 
+             << " to " << setw(10) << setprecision(1) << tdbmax << endl;
+    }
+    else
+    {
+        cout << endl << "testeph found problems with ephemeris file" << endl;
+        cout << warnings << " warnings in " << line << " lines. " << endl;
+        cout << "Failurerate: " << fixed << setw(6) << setprecision(1) << (100.0*(float(warnings) / float(line))) << "%" << endl;
+
+    }
+
+    size_t const requests = after.requests - before.requests;
+    size_t const hits     = after.hits - before.hits;
+    size_t const misses   = after.misses - before.misses;
+    cout << line << " test lines evaluated with " << numThreads << " threads in " << fixed << setprecision(3) << seconds << " s, "
+         << noshowpoint << setprecision(0) << (line / max(seconds, 1e-9)) << " evaluations/s" << endl;
+    if (absent > 0)
+    {
+        cout << absent << " test lines skipped, target or center not in the ephemeris file" << endl;
+    }
+    cout << "Record requests: " << requests;
+    if (hits + misses > 0)
+    {
+        cout << ", cache hit rate " << setprecision(1) << (100.0 * double(hits) / double(hits + misses)) << "%";
+    }
+    cout << endl;
+
+    if (options[COMPARE].count() > 0)
+    {
+        compareAccess(jplephFileName, testCases);
+    }
+
+    if (options[THREADS].count() > 0)
+    {
+        checkConcurrency(jpleph, testCases, stoi(options[THREADS].arg));
+    }
+
+    if (options[BATCH].count() > 0)
+    {
+        benchmarkBatch(jpleph, dateStart, dateEnd);
+
+        // once more with the derived geocentric series, which are only evaluated when derived before the first record
+        Jpleph derived(jplephFileName, true, true, false, mapped ? Jpleph::Access::MAPPED : Jpleph::Access::STREAM, Jpleph::Prefetch(), cacheCapacity);
+        derived.deriveSeries(Jpleph::geocentricSeries());
+        cout << endl << "With the derived geocentric series:";
+        benchmarkBatch(derived, dateStart, dateEnd);
+    }
+
+    if (options[STATE].count() > 0)
+    {
+        benchmarkState(jpleph, dateStart, dateEnd);
+    }
+
+    if (options[PREFETCH].count() > 0 && !sweepPrefetch(jplephFileName, mapped ? Jpleph::Access::MAPPED : Jpleph::Access::STREAM, options[PREFETCH].arg))
+    {
+        return 1;
+    }
+
+    if (options[ACCELERATION].count() > 0 && !checkAcceleration(jpleph, dateStart, dateEnd))
+    {
+        return 1;
+    }
+
+    if (options[QUERIES].count() > 0)
+    {
+        if (!checkQueryPlanner(jpleph, dateStart, dateEnd))
+        {
+            return 1;
+        }
 
-        if (Jpleph::Target::LIBRATIONS == Jpleph::Target(target) && component == 3)
+        Jpleph derived(jplephFileName, true, true, false, mapped ? Jpleph::Access::MAPPED : Jpleph::Access::STREAM, Jpleph::Prefetch(), cacheCapacity);
+        derived.deriveSeries(Jpleph::geocentricSeries());
+        cout << endl << "With the derived geocentric series:";
+        if (!checkQueryPlanner(derived, dateStart, dateEnd))
         {
-            del = del / (1.0 + 100.0*fabs(tdb - jdepoc) / 365.25);
+            return 1;
         }
+    }
 
-        line++;
+    if (options[DERIVED].count() > 0
+        && !checkDerivedSeries(jplephFileName, mapped ? Jpleph::Access::MAPPED : Jpleph::Access::STREAM, cacheCapacity, dateStart, dateEnd))
+    {
+        return 1;
+    }
+
+    if (options[EVENTS].count() > 0 && !checkEvents(jpleph, dateStart, dateEnd))
+    {
+        return 1;
+    }
 
-        if (tdb < tdbmin)
+    if (options[SPK].count() > 0)
+    {
+        double au = 0.0;
+        for (Jpleph::Constant const & constant : constants)
         {
-            tdbmin = tdb;
+            if (constant.name == "AU")
+            {
+                au = constant.value;
+            }
         }
-        if (tdb > tdbmax)
+        if (!checkSpk(jpleph, options[SPK].arg, testCases, au, dateStart, dateEnd, dateInterval))
         {
-            tdbmax = tdb;
+            return 1;
         }
+    }
+
+    if (options[STREAM].count() > 0 && !checkStream(jpleph, dateStart, dateEnd))
+    {
+        return 1;
+    }
+
+    if (options[SINGLE].count() > 0
+        && !checkSingle(jplephFileName, mapped ? Jpleph::Access::MAPPED : Jpleph::Access::STREAM, cacheCapacity, dateStart, dateEnd))
+    {
+        return 1;
+    }
+
+    if (options[SET].count() > 0 && !checkSet(options[SET].arg, mapped ? Jpleph::Access::MAPPED : Jpleph::Access::STREAM))
+    {
+        return 1;
+    }
+
+    if (options[PARTIAL].count() > 0 && !checkPartial(jplephFileName, cacheCapacity, dateStart, dateEnd))
+    {
+        return 1;
+    }
+
+    if (options[COMPRESSED].count() > 0 && !checkCompressed(jplephFileName, options[COMPRESSED].arg, cacheCapacity, dateStart, dateEnd))
+    {
+        return 1;
+    }
+
+    if (options[ALLOCATIONS].count() > 0 && !checkAllocations(jpleph, testCases, dateStart, dateEnd))
+    {
+        return 1;
+    }
+}
+
+
+// evaluate all test cases with stream and mapped access. The results have to be bitwise identical.
+// Then measure the throughput of both access methods on the same sequence of requests
+void compareAccess(string const & jplephFileName, vector<TestCase> const & testCases)
+{
+    cout << endl << "Comparing stream and memory mapped access" << endl;
+    if (testCases.empty())
+    {
+        cout << "No test cases available" << endl;
+        return;
+    }
 
-        cout << setw(5) << line
-            << fixed << showpoint
-            << setw(10) << setprecision(1) << tdb
-            << setw(5) << target
-            << setw(5) << center
-            << setw(5) << component
-            << showpoint
-            << setw(21) << setprecision(13)
-            << value
-            << setw(22) << setprecision(13)
-            << calcValue
-            << scientific << setw(13) << setprecision(5)
-            << del;
+    Jpleph streamed(jplephFileName, true, true, false, Jpleph::Access::STREAM);
+    Jpleph mapped(jplephFileName, true, true, false, Jpleph::Access::MAPPED);
+    if (mapped.access() != Jpleph::Access::MAPPED)
+    {
+        cout << "Memory mapped access not possible for this file (misaligned v1 records or compressed), skipped" << endl;
+        return;
+    }
 
-        if (del >= 1.0e-13)
+    int differences = 0;
+    for (TestCase const & testCase : testCases)
+    {
+        Jpleph::Time time;
+        time.t1 = testCase.tdb;
+        Jpleph::Posvel posvelStream;
+        Jpleph::Posvel posvelMapped;
+        streamed.dpleph(time, Jpleph::Target(testCase.target), Jpleph::Target(testCase.center), posvelStream);
+        mapped.dpleph(time, Jpleph::Target(testCase.target), Jpleph::Target(testCase.center), posvelMapped);
+        if (posvelStream.pos != posvelMapped.pos || posvelStream.vel != posvelMapped.vel)
         {
-            ok = false;
-            cout << "  *****  WARNING : difference >= 1.D-13  *****'" << endl;
-            warnings++;
+            differences++;
         }
-        else
+    }
+
+    if (differences == 0)
+    {
+        cout << "Results are identical for " << testCases.size() << " test cases" << endl;
+    }
+    else
+    {
+        cout << "  *****  WARNING : " << differences << " of " << testCases.size() << " test cases differ  *****" << endl;
+    }
+
+    size_t const repetitions = (MIN_BENCHMARK_EVALUATIONS + testCases.size() - 1) / testCases.size();
+    size_t const evaluations = repetitions * testCases.size();
+
+    for (Jpleph * jpleph : { &streamed, &mapped })
+    {
+        Jpleph::Posvel posvel;
+        auto const start = chrono::steady_clock::now();
+        for (size_t i = 0; i < repetitions; ++i)
         {
-            cout << endl;
+            for (TestCase const & testCase : testCases)
+            {
+                Jpleph::Time time;
+                time.t1 = testCase.tdb;
+                jpleph->dpleph(time, Jpleph::Target(testCase.target), Jpleph::Target(testCase.center), posvel);
+            }
         }
+        double const seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << setw(14) << (jpleph == &streamed ? "stream" : "memory mapped") << ": "
+             << fixed << setw(10) << setprecision(3) << seconds << " s for " << evaluations << " evaluations, "
+             << noshowpoint << setw(12) << setprecision(0) << (evaluations / seconds) << " evaluations/s" << endl;
     }
+}
 
-    if (ok)
+
+
+// evaluate the test cases with several threads on the shared ephemeris. Every thread starts at a different
+// test case so that the threads compete for different records. All results have to be identical to the serial ones.
+void checkConcurrency(Jpleph const & jpleph, vector<TestCase> const & testCases, int const numThreads)
+{
+    cout << endl << "Concurrent evaluation with " << numThreads << " threads" << endl;
+    if (testCases.empty() || numThreads < 1)
     {
-        cout << endl;
-        cout << "testeph checked successfully against ephemeris file " << endl;
-        cout << "over Julian date range " << fixed << showpoint << setw(10) << setprecision(1)<< tdbmin 
-             << " to " << setw(10) << setprecision(1) << tdbmax << endl;
+        cout << "Nothing to do" << endl;
+        return;
+    }
+
+    vector<Jpleph::Posvel> expected(testCases.size());
+    for (size_t i = 0; i < testCases.size(); ++i)
+    {
+        Jpleph::Time time;
+        time.t1 = testCases[i].tdb;
+        jpleph.dpleph(time, Jpleph::Target(testCases[i].target), Jpleph::Target(testCases[i].center), expected[i]);
+    }
+
+    size_t const repetitions = (MIN_BENCHMARK_EVALUATIONS + testCases.size() * numThreads - 1) / (testCases.size() * numThreads);
+    atomic<int> differences(0);
+
+    auto const start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        threads.emplace_back([&, t]()
+        {
+            size_t const offset = (t * testCases.size()) / numThreads;
+            for (size_t r = 0; r < repetitions; ++r)
+            {
+                for (size_t j = 0; j < testCases.size(); ++j)
+                {
+                    size_t const i = (j + offset) % testCases.size();
+                    Jpleph::Posvel posvel; // fresh as for the serial results. Nutations and TT-TDB don't set all components
+                    Jpleph::Time time;
+                    time.t1 = testCases[i].tdb;
+                    jpleph.dpleph(time, Jpleph::Target(testCases[i].target), Jpleph::Target(testCases[i].center), posvel);
+                    if (posvel.pos != expected[i].pos || posvel.vel != expected[i].vel)
+                    {
+                        differences++;
+                    }
+                }
+            }
+        });
+    }
+    for (thread & worker : threads)
+    {
+        worker.join();
+    }
+    double const seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    size_t const evaluations = repetitions * testCases.size() * numThreads;
+
+    if (differences == 0)
+    {
+        cout << "Results are identical to the serial evaluation" << endl;
     }
     else
     {
-        cout << endl << "testeph found problems with ephemeris file" << endl;
-        cout << warnings << " warnings in " << line << " lines. " << endl;
-        cout << "Failurerate: " << fixed << setw(6) << setprecision(1) << (100.0*(float(warnings) / float(line))) << "%" << endl;
+        cout << "  *****  WARNING : " << differences << " concurrent evaluations differ  *****" << endl;
+    }
+    cout << fixed << setw(10) << setprecision(3) << seconds << " s for " << evaluations << " evaluations, "
+         << noshowpoint << setw(12) << setprecision(0) << (evaluations / seconds) << " evaluations/s" << endl;
+}
+
+
+// a dense sweep over the whole ephemeris for some target/center pairs. Evaluated by a loop of single dpleph calls
+// and by a single call of the batch version. Reports the throughput of both and the largest difference
+void benchmarkBatch(Jpleph const & jpleph, double const dateStart, double const dateEnd)
+{
+    char const * const instructionSets[] = { "scalar", "AVX2", "AVX-512" };
+    cout << endl << "Batch evaluation of " << BATCH_EPOCHS << " epochs ("
+         << instructionSets[int(ChebysheffBatch::instructionSet())] << ")" << endl;
+
+    vector<Jpleph::Time> epochs(BATCH_EPOCHS);
+    for (size_t k = 0; k < BATCH_EPOCHS; ++k)
+    {
+        epochs[k].t1 = dateStart + (dateEnd - dateStart) * (k + 0.5) / BATCH_EPOCHS;
+    }
+
+    vector<vector<double>> loopResult(6, vector<double>(BATCH_EPOCHS));
+    vector<vector<double>> batchResult(6, vector<double>(BATCH_EPOCHS));
+    Jpleph::PosvelArrays const batchArrays = { batchResult[0].data(), batchResult[1].data(), batchResult[2].data(), batchResult[3].data(), batchResult[4].data(), batchResult[5].data() };
+
+    struct Pair
+    {
+        Jpleph::Target target;
+        Jpleph::Target center;
+        char const *   name;
+    };
+    Pair const pairs[] =
+    {
+        { Jpleph::Target::MARS,    Jpleph::Target::EARTH,         "Mars - Earth" },
+        { Jpleph::Target::MOON,    Jpleph::Target::EARTH,         "Moon - Earth" },
+        { Jpleph::Target::JUPITER, Jpleph::Target::SUN,           "Jupiter - Sun" },
+        { Jpleph::Target::SUN,     Jpleph::Target::SS_BARYCENTER, "Sun - SSB" },
+    };
+
+    size_t const repetitions = (MIN_BENCHMARK_EVALUATIONS + BATCH_EPOCHS - 1) / BATCH_EPOCHS;
+    for (Pair const & pair : pairs)
+    {
+        auto const loopStart = chrono::steady_clock::now();
+        for (size_t r = 0; r < repetitions; ++r)
+        {
+            Jpleph::Posvel posvel;
+            for (size_t k = 0; k < BATCH_EPOCHS; ++k)
+            {
+                jpleph.dpleph(epochs[k], pair.target, pair.center, posvel);
+                for (int i = 0; i < 3; ++i)
+                {
+                    loopResult[i][k]     = posvel.pos[i];
+                    loopResult[3 + i][k] = posvel.vel[i];
+                }
+            }
+        }
+        double const loopSeconds = chrono::duration<double>(chrono::steady_clock::now() - loopStart).count();
+
+        auto const batchStart = chrono::steady_clock::now();
+        for (size_t r = 0; r < repetitions; ++r)
+        {
+            jpleph.dpleph(epochs.data(), epochs.size(), pair.target, pair.center, batchArrays);
+        }
+        double const batchSeconds = chrono::duration<double>(chrono::steady_clock::now() - batchStart).count();
+
+        double maxDifference = 0.0;
+        for (int i = 0; i < 6; ++i)
+        {
+            for (size_t k = 0; k < BATCH_EPOCHS; ++k)
+            {
+                maxDifference = max(maxDifference, fabs(loopResult[i][k] - batchResult[i][k]));
+            }
+        }
 
+        double const evaluations = double(repetitions * BATCH_EPOCHS);
+        cout << setw(14) << pair.name << ":"
+             << noshowpoint << fixed << setprecision(0)
+             << " loop " << setw(10) << (evaluations / loopSeconds) << " epochs/s,"
+             << " batch " << setw(10) << (evaluations / batchSeconds) << " epochs/s,"
+             << showpoint << setprecision(2) << " speedup " << setw(6) << (loopSeconds / batchSeconds)
+             << scientific << setprecision(3) << "  max difference " << maxDifference << endl;
     }
 }
 
+// the state of the complete solar system in one call compared to a dpleph call for every target
+void benchmarkState(Jpleph const & jpleph, double const dateStart, double const dateEnd)
+{
+    cout << endl << "Solar system state at " << BATCH_EPOCHS << " epochs" << endl;
 
-bool skipToData(ifstream & controlFile)
+    vector<Jpleph::Time> epochs(BATCH_EPOCHS);
+    for (size_t k = 0; k < BATCH_EPOCHS; ++k)
+    {
+        epochs[k].t1 = dateStart + (dateEnd - dateStart) * (k + 0.5) / BATCH_EPOCHS;
+    }
+
+    // the targets available in the file. Bodies relative to the barycenter, the others without center
+    Jpleph::SolarSystemState state;
+    jpleph.state(epochs[0], state);
+    vector<Jpleph::Target> targets;
+    for (int target = int(Jpleph::Target::MERCURY); target <= int(Jpleph::Target::TT_TTB); ++target)
+    {
+        if (target != int(Jpleph::Target::SS_BARYCENTER) && state.isPresent(Jpleph::Target(target)))
+        {
+            targets.push_back(Jpleph::Target(target));
+        }
+    }
+
+    auto centerOf = [](Jpleph::Target const target)
+    {
+        return target < Jpleph::Target::NUTATIONS ? Jpleph::Target::SS_BARYCENTER : Jpleph::Target::NONE;
+    };
+
+    size_t const repetitions = (MIN_BENCHMARK_EVALUATIONS + BATCH_EPOCHS - 1) / BATCH_EPOCHS;
+
+    auto const loopStart = chrono::steady_clock::now();
+    double loopChecksum = 0.0;
+    for (size_t r = 0; r < repetitions; ++r)
+    {
+        for (size_t k = 0; k < BATCH_EPOCHS; ++k)
+        {
+            for (Jpleph::Target const target : targets)
+            {
+                Jpleph::Posvel posvel;
+                jpleph.dpleph(epochs[k], target, centerOf(target), posvel);
+                loopChecksum += posvel.pos[0];
+            }
+        }
+    }
+    double const loopSeconds = chrono::duration<double>(chrono::steady_clock::now() - loopStart).count();
+
+    auto const stateStart = chrono::steady_clock::now();
+    double stateChecksum = 0.0;
+    for (size_t r = 0; r < repetitions; ++r)
+    {
+        for (size_t k = 0; k < BATCH_EPOCHS; ++k)
+        {
+            jpleph.state(epochs[k], state);
+            for (Jpleph::Target const target : targets)
+            {
+                stateChecksum += state[target].pos[0];
+            }
+        }
+    }
+    double const stateSeconds = chrono::duration<double>(chrono::steady_clock::now() - stateStart).count();
+
+    // the results have to be identical to the ones of dpleph
+    size_t mismatches = 0;
+    for (size_t k = 0; k < BATCH_EPOCHS; ++k)
+    {
+        jpleph.state(epochs[k], state);
+        for (Jpleph::Target const target : targets)
+        {
+            Jpleph::Posvel posvel;
+            jpleph.dpleph(epochs[k], target, centerOf(target), posvel);
+            for (int i = 0; i < 3; ++i)
+            {
+                if (posvel.pos[i] != state[target].pos[i] || posvel.vel[i] != state[target].vel[i])
+                {
+                    ++mismatches;
+                    break;
+                }
+            }
+        }
+    }
+
+    double const evaluations = double(repetitions * BATCH_EPOCHS);
+    cout << setw(14) << targets.size() << " targets:"
+         << noshowpoint << fixed << setprecision(0)
+         << " dpleph " << setw(10) << (evaluations / loopSeconds) << " epochs/s,"
+         << " state " << setw(10) << (evaluations / stateSeconds) << " epochs/s,"
+         << showpoint << setprecision(2) << " speedup " << setw(6) << (loopSeconds / stateSeconds)
+         << "  mismatches " << mismatches << (loopChecksum == stateChecksum ? "" : " (checksum differs)") << endl;
+}
+
+// after construction (and warming up the record cache) the evaluation must not touch the heap
+bool checkAllocations(Jpleph const & jpleph, vector<TestCase> const & testCases, double const dateStart, double const dateEnd)
 {
-    string line = "";
-    while(getline(controlFile, line))
+    if (testCases.empty())
     {
-        if (line.size() >= 3 && line.substr(0, 3) == HEADER_MARKER)
+        cout << endl << "No test cases for the allocation check" << endl;
+        return true;
+    }
+
+    vector<vector<double>> batchResult(6, vector<double>(BATCH_EPOCHS));
+    Jpleph::PosvelArrays const arrays = { batchResult[0].data(), batchResult[1].data(), batchResult[2].data(), batchResult[3].data(), batchResult[4].data(), batchResult[5].data() };
+    vector<Jpleph::Time> epochs(BATCH_EPOCHS);
+    for (size_t k = 0; k < BATCH_EPOCHS; ++k)
+    {
+        epochs[k].t1 = dateStart + (dateEnd - dateStart) * (k + 0.5) / BATCH_EPOCHS;
+    }
+    Jpleph::SolarSystemState state;
+
+    size_t const repetitions = (ALLOCATION_CHECK_CALLS + testCases.size() - 1) / testCases.size();
+    size_t evaluations = 0;
+    size_t allocations = 0;
+    countAllocations.store(true);
+    for (int pass = 0; pass < 2; ++pass) // the first pass only warms up
+    {
+        size_t const before = allocationCount.load();
+        for (size_t r = 0; r < (pass == 0 ? 1 : repetitions); ++r)
         {
-            return true;
+            for (TestCase const & testCase : testCases)
+            {
+                Jpleph::Time time;
+                time.t1 = testCase.tdb;
+                Jpleph::Posvel posvel;
+                jpleph.dpleph(time, Jpleph::Target(testCase.target), Jpleph::Target(testCase.center), posvel);
+                jpleph.state(time, state);
+            }
         }
+        jpleph.dpleph(epochs.data(), epochs.size(), Jpleph::Target::MARS, Jpleph::Target::EARTH, arrays);
+
+        evaluations = repetitions * testCases.size();
+        allocations = allocationCount.load() - before;
     }
+    countAllocations.store(false);
 
-    return false;
-}
\ No newline at end of file
+    cout << endl << "Heap allocations during " << evaluations << " dpleph and state calls: " << allocations << endl;
+    return allocations == 0;
+}
+
+// Sweep through the whole ephemeris forward and backward without and with read ahead. The results have to be identical.
+// 'prefetchArg' is the depth optionally followed by the I/O budget in bytes per second: depth[,bytes/s]
+bool sweepPrefetch(string const & jplephFileName, Jpleph::Access const access, string const & prefetchArg)
+{
+    size_t const separator = prefetchArg.find(',');
+    Jpleph::Prefetch const prefetch(stoi(prefetchArg.substr(0, separator)),
+                                    separator == string::npos ? 0 : size_t(stoull(prefetchArg.substr(separator + 1))));
+
+    cout << endl << "Sweep with read ahead of " << prefetch.depth << " records";
+    if (prefetch.bytesPerSecond > 0)
+    {
+        cout << " at most " << prefetch.bytesPerSecond << " bytes/s";
+    }
+    cout << endl;
+
+    Jpleph plain(jplephFileName, true, true, false, access);
+    Jpleph ahead(jplephFileName, true, true, false, access, prefetch);
+
+    Jpleph::Constants constants;
+    double dateStart;
+    double dateEnd;
+    double dateInterval;
+    plain.constants(constants, dateStart, dateEnd, dateInterval);
+
+    // four epochs per record, the way a propagation walks through the file
+    size_t const numEpochs = size_t((dateEnd - dateStart) / dateInterval) * 4;
+    auto epochAt = [&](size_t const k, bool const forward)
+    {
+        Jpleph::Time time;
+        time.t1 = dateStart + (dateEnd - dateStart) * ((forward ? k : numEpochs - 1 - k) + 0.5) / numEpochs;
+        return time;
+    };
+
+    size_t mismatches = 0;
+    for (bool const forward : { true, false })
+    {
+        double seconds[2] = { 0.0, 0.0 };
+        vector<Jpleph::Posvel> results(numEpochs);
+        for (int withPrefetch = 0; withPrefetch < 2; ++withPrefetch)
+        {
+            Jpleph const & jpleph = withPrefetch ? ahead : plain;
+            auto const start = chrono::steady_clock::now();
+            for (size_t k = 0; k < numEpochs; ++k)
+            {
+                Jpleph::Posvel posvel;
+                jpleph.dpleph(epochAt(k, forward), Jpleph::Target::MARS, Jpleph::Target::EARTH, posvel);
+                if (!withPrefetch)
+                {
+                    results[k] = posvel;
+                }
+                else if (posvel.pos != results[k].pos || posvel.vel != results[k].vel)
+                {
+                    ++mismatches;
+                }
+            }
+            seconds[withPrefetch] = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+
+        cout << setw(9) << (forward ? "forward" : "backward") << ": " << numEpochs << " epochs,"
+             << noshowpoint << fixed << setprecision(3)
+             << " without read ahead " << seconds[0] << " s,"
+             << " with read ahead " << seconds[1] << " s" << endl;
+    }
+
+    cout << "Records read ahead: " << ahead.statistics().prefetched << ", mismatches: " << mismatches << endl;
+    return mismatches == 0;
+}
+
+// The accelerations have to agree with the central difference quotient of the velocities.
+// The error is taken relative to the size of the acceleration. Difference quotients across the boundary of
+// two sub intervalls suffer from the (small) discontinuities of the fit, therefore a few outliers are accepted.
+bool checkAcceleration(Jpleph const & jpleph, double const dateStart, double const dateEnd)
+{
+    static double const STEP      = 1.0e-4;  // days
+    static double const TOLERANCE = 1.0e-5;  // relative, dominated by the truncation error of the difference quotient
+    static double const OUTLIERS  = 0.01;    // accepted fraction of epochs not within the tolerance
+
+    cout << endl << "Accelerations at " << BATCH_EPOCHS << " epochs" << endl;
+
+    struct Pair
+    {
+        Jpleph::Target target;
+        Jpleph::Target center;
+        char const *   name;
+    };
+    Pair const pairs[] =
+    {
+        { Jpleph::Target::MARS,    Jpleph::Target::EARTH,         "Mars - Earth" },
+        { Jpleph::Target::MOON,    Jpleph::Target::EARTH,         "Moon - Earth" },
+        { Jpleph::Target::MERCURY, Jpleph::Target::SUN,           "Mercury - Sun" },
+        { Jpleph::Target::EARTH,   Jpleph::Target::SS_BARYCENTER, "Earth - SSB" },
+    };
+
+    bool ok = true;
+    size_t const repetitions = (MIN_BENCHMARK_EVALUATIONS + BATCH_EPOCHS - 1) / BATCH_EPOCHS;
+    for (Pair const & pair : pairs)
+    {
+        size_t outliers = 0;
+        for (size_t k = 0; k < BATCH_EPOCHS; ++k)
+        {
+            Jpleph::Time time;
+            time.t1 = dateStart + STEP + (dateEnd - dateStart - 2.0 * STEP) * (k + 0.5) / BATCH_EPOCHS;
+            Jpleph::Time before = time;
+            before.t2 = -STEP;
+            Jpleph::Time after = time;
+            after.t2 = STEP;
+
+            Jpleph::Posvel posvel;
+            Jpleph::Posvel posvelBefore;
+            Jpleph::Posvel posvelAfter;
+            jpleph.dpleph(time, pair.target, pair.center, posvel, true);
+            jpleph.dpleph(before, pair.target, pair.center, posvelBefore);
+            jpleph.dpleph(after, pair.target, pair.center, posvelAfter);
+
+            double size  = 0.0;
+            double error = 0.0;
+            for (int i = 0; i < 3; ++i)
+            {
+                double const difference = (posvelAfter.vel[i] - posvelBefore.vel[i]) / (2.0 * STEP);
+                size  = max(size, fabs(posvel.acc[i]));
+                error = max(error, fabs(posvel.acc[i] - difference));
+            }
+            if (error > TOLERANCE * size)
+            {
+                ++outliers;
+            }
+        }
+        ok = ok && outliers <= OUTLIERS * BATCH_EPOCHS;
+
+        // cost of the acceleration
+        double seconds[2] = { 0.0, 0.0 };
+        for (int withAcceleration = 0; withAcceleration < 2; ++withAcceleration)
+        {
+            auto const start = chrono::steady_clock::now();
+            for (size_t r = 0; r < repetitions; ++r)
+            {
+                for (size_t k = 0; k < BATCH_EPOCHS; ++k)
+                {
+                    Jpleph::Time time;
+                    time.t1 = dateStart + (dateEnd - dateStart) * (k + 0.5) / BATCH_EPOCHS;
+                    Jpleph::Posvel posvel;
+                    jpleph.dpleph(time, pair.target, pair.center, posvel, withAcceleration != 0);
+                }
+            }
+            seconds[withAcceleration] = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+
+        double const evaluations = double(repetitions * BATCH_EPOCHS);
+        cout << setw(14) << pair.name << ":"
+             << noshowpoint << fixed << setprecision(0)
+             << " position/velocity " << setw(10) << (evaluations / seconds[0]) << " epochs/s,"
+             << " with acceleration " << setw(10) << (evaluations / seconds[1]) << " epochs/s,"
+             << "  not within " << scientific << setprecision(1) << TOLERANCE << ": " << outliers << endl;
+    }
+
+    return ok;
+}
+
+// random (epoch, target, center) queries as they come from observation reduction. The planned evaluation
+// has to give the same results as single dpleph calls in arrival order
+bool checkQueryPlanner(Jpleph const & jpleph, double const dateStart, double const dateEnd)
+{
+    cout << endl << "Query planner with " << PLANNED_QUERIES << " random queries" << endl;
+
+    // the targets in the file
+    Jpleph::SolarSystemState state;
+    Jpleph::Time start;
+    start.t1 = dateStart;
+    jpleph.state(start, state);
+    vector<Jpleph::Target> targets;
+    for (int target = int(Jpleph::Target::MERCURY); target <= int(Jpleph::Target::TT_TTB); ++target)
+    {
+        if (state.isPresent(Jpleph::Target(target)))
+        {
+            targets.push_back(Jpleph::Target(target));
+        }
+    }
+
+    // several bodies are observed at the same epoch, the queries arrive in random order
+    mt19937 random(4711);
+    uniform_real_distribution<double> epoch(dateStart, dateEnd);
+    vector<double> epochs(PLANNED_QUERIES / QUERIES_PER_EPOCH);
+    for (double & observation : epochs)
+    {
+        observation = epoch(random);
+    }
+    uniform_int_distribution<size_t> pickEpoch(0, epochs.size() - 1);
+    uniform_int_distribution<size_t> pick(0, targets.size() - 1);
+    vector<Jpleph::Query> queries(PLANNED_QUERIES);
+    for (Jpleph::Query & query : queries)
+    {
+        query.et.t1  = epochs[pickEpoch(random)];
+        query.target = targets[pick(random)];
+        query.center = query.target >= Jpleph::Target::NUTATIONS ? Jpleph::Target::NONE : targets[pick(random)];
+        while (query.center >= Jpleph::Target::NUTATIONS)
+        {
+            query.center = targets[pick(random)];
+        }
+    }
+
+    vector<Jpleph::Posvel> single(queries.size());
+    size_t misses = jpleph.statistics().misses;
+    auto const singleStart = chrono::steady_clock::now();
+    for (size_t k = 0; k < queries.size(); ++k)
+    {
+        jpleph.dpleph(queries[k].et, queries[k].target, queries[k].center, single[k]);
+    }
+    double const singleSeconds = chrono::duration<double>(chrono::steady_clock::now() - singleStart).count();
+    size_t const singleMisses = jpleph.statistics().misses - misses;
+
+    vector<Jpleph::Posvel> planned(queries.size());
+    misses = jpleph.statistics().misses;
+    auto const plannedStart = chrono::steady_clock::now();
+    jpleph.dpleph(queries.data(), queries.size(), planned.data());
+    double const plannedSeconds = chrono::duration<double>(chrono::steady_clock::now() - plannedStart).count();
+    size_t const plannedMisses = jpleph.statistics().misses - misses;
+
+    size_t mismatches = 0;
+    for (size_t k = 0; k < queries.size(); ++k)
+    {
+        if (single[k].pos != planned[k].pos || single[k].vel != planned[k].vel)
+        {
+            ++mismatches;
+        }
+    }
+
+    double const evaluations = double(queries.size());
+    cout << noshowpoint << fixed << setprecision(0)
+         << "   single calls: " << setw(10) << (evaluations / singleSeconds) << " queries/s, " << singleMisses << " cache misses" << endl
+         << "        planned: " << setw(10) << (evaluations / plannedSeconds) << " queries/s, " << plannedMisses << " cache misses" << endl
+         << "     mismatches: " << mismatches << endl;
+    return mismatches == 0;
+}
+
+// the geocentric pairs (and the reversed ones) from derived series against the combination of the series in the file.
+// Both have to agree to rounding, the derived ones need a single evaluation
+bool checkDerivedSeries(string const & jplephFileName, Jpleph::Access const access, size_t const cacheCapacity, double const dateStart, double const dateEnd)
+{
+    cout << endl << "Derived geocentric series at " << BATCH_EPOCHS << " epochs" << endl;
+
+    Jpleph combined(jplephFileName, true, true, false, access, Jpleph::Prefetch(), cacheCapacity);
+    Jpleph derived(jplephFileName, true, true, false, access, Jpleph::Prefetch(), cacheCapacity);
+    vector<Jpleph::Pair> const pairs = Jpleph::geocentricSeries();
+    derived.deriveSeries(pairs);
+
+    vector<Jpleph::Pair> requests;
+    for (Jpleph::Pair const & pair : pairs)
+    {
+        requests.push_back(pair);
+        requests.push_back(Jpleph::Pair{ pair.center, pair.target });
+    }
+
+    mt19937 random(4711);
+    uniform_real_distribution<double> epoch(dateStart, dateEnd);
+    vector<Jpleph::Time> epochs(BATCH_EPOCHS);
+    for (Jpleph::Time & et : epochs)
+    {
+        et.t1 = epoch(random);
+    }
+    sort(epochs.begin(), epochs.end(), [](Jpleph::Time const & lhs, Jpleph::Time const & rhs) { return lhs.t1 < rhs.t1; });
+
+    // relative difference of two vectors
+    auto difference = [](array<double, 3> const & lhs, array<double, 3> const & rhs)
+    {
+        double diff = 0.0;
+        double norm = 0.0;
+        for (int i = 0; i < 3; ++i)
+        {
+            diff = max(diff, fabs(lhs[i] - rhs[i]));
+            norm = max(norm, fabs(rhs[i]));
+        }
+        return norm > 0.0 ? diff / norm : diff;
+    };
+
+    double maxDifference[3] = { 0.0, 0.0, 0.0 };
+    Jpleph::Posvel one;
+    Jpleph::Posvel other;
+    for (Jpleph::Time const & et : epochs)
+    {
+        for (Jpleph::Pair const & pair : requests)
+        {
+            combined.dpleph(et, pair.target, pair.center, one, true);
+            derived.dpleph(et, pair.target, pair.center, other, true);
+            maxDifference[0] = max(maxDifference[0], difference(other.pos, one.pos));
+            maxDifference[1] = max(maxDifference[1], difference(other.vel, one.vel));
+            maxDifference[2] = max(maxDifference[2], difference(other.acc, one.acc));
+        }
+    }
+
+    auto measure = [&](Jpleph const & jpleph)
+    {
+        auto const start = chrono::steady_clock::now();
+        for (Jpleph::Time const & et : epochs)
+        {
+            for (Jpleph::Pair const & pair : requests)
+            {
+                jpleph.dpleph(et, pair.target, pair.center, one);
+            }
+        }
+        return double(epochs.size() * requests.size()) / chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    };
+    double const combinedRate = measure(combined);
+    double const derivedRate  = measure(derived);
+
+    cout << noshowpoint << fixed << setprecision(0)
+         << "   combined: " << setw(10) << combinedRate << " evaluations/s" << endl
+         << "    derived: " << setw(10) << derivedRate << " evaluations/s, " << derived.statistics().derivedBytes
+         << " bytes of derived series in the cache" << endl
+         << "   max relative difference: " << scientific << setprecision(3) << "position " << maxDifference[0]
+         << ", velocity " << maxDifference[1] << ", acceleration " << maxDifference[2] << endl;
+    return maxDifference[0] <= DERIVED_TOLERANCE[0] && maxDifference[1] <= DERIVED_TOLERANCE[1] && maxDifference[2] <= DERIVED_TOLERANCE[2];
+}
+
+// the event search against a scan of the event function in small steps with bisection of every sign change.
+// Sign changes with a jump of the function (the series of two sub intervals don't fit exactly) are no events.
+// Every root of the scan has to be found by the search, the search may find more (close pairs of roots between two steps)
+bool checkEvents(Jpleph const & jpleph, double const dateStart, double const dateEnd)
+{
+    cout << endl << "Event search" << endl;
+
+    typedef Jpleph::Target Target;
+    struct Search
+    {
+        char const * name;
+        Target       target;
+        Target       center;
+        Target       reference;
+        EventSearch::Function function;
+    };
+    Search const searches[] =
+    {
+        { "Mars conjunctions/oppositions", Target::MARS, Target::EARTH, Target::SUN,  EventSearch::longitudeDifference(0.0) },
+        { "lunar phases (new/full moon)",  Target::MOON, Target::EARTH, Target::SUN,  EventSearch::longitudeDifference(0.0) },
+        { "lunar phases (quarters)",       Target::MOON, Target::EARTH, Target::SUN,  EventSearch::longitudeDifference(acos(0.0)) },
+        { "equinoxes",                     Target::SUN,  Target::EARTH, Target::NONE, EventSearch::longitude(0.0) },
+    };
+
+    bool ok = true;
+    for (Search const & search : searches)
+    {
+        EventSearch const events(jpleph, search.target, search.center, search.reference);
+        auto const searchStart = chrono::steady_clock::now();
+        vector<EventSearch::Event> const found = events.roots(search.function, dateStart, dateEnd);
+        double const searchSeconds = chrono::duration<double>(chrono::steady_clock::now() - searchStart).count();
+
+        auto f = [&](double const t)
+        {
+            Jpleph::Time et;
+            et.t1 = t;
+            Jpleph::Posvel body;
+            Jpleph::Posvel reference;
+            jpleph.dpleph(et, search.target, search.center, body);
+            if (search.reference != Target::NONE)
+            {
+                jpleph.dpleph(et, search.reference, search.center, reference);
+            }
+            return search.function(body, reference);
+        };
+
+        auto const scanStart = chrono::steady_clock::now();
+        vector<double> scanned;
+        double previous = f(dateStart);
+        for (double t = dateStart + EVENT_SCAN_STEP; t < dateEnd; t += EVENT_SCAN_STEP)
+        {
+            double const current = f(t);
+            if ((previous < 0.0) != (current < 0.0))
+            {
+                double lo = t - EVENT_SCAN_STEP;
+                double hi = t;
+                while (hi - lo > 1e-9)
+                {
+                    double const mid = 0.5 * (lo + hi);
+                    ((f(mid) < 0.0) == (previous < 0.0) ? lo : hi) = mid;
+                }
+                if (fabs(f(lo) - f(hi)) < 1e-6)
+                {
+                    scanned.push_back(0.5 * (lo + hi));
+                }
+            }
+            previous = current;
+        }
+        double const scanSeconds = chrono::duration<double>(chrono::steady_clock::now() - scanStart).count();
+
+        size_t missed = 0;
+        double maxDifference = 0.0;
+        for (double const root : scanned)
+        {
+            auto const after = lower_bound(found.begin(), found.end(), root,
+                                           [](EventSearch::Event const & event, double const time) { return event.time < time; });
+            double difference = numeric_limits<double>::max();
+            if (after != found.end())
+            {
+                difference = after->time - root;
+            }
+            if (after != found.begin())
+            {
+                difference = min(difference, root - prev(after)->time);
+            }
+            if (difference > EVENT_PRECISION)
+            {
+                ++missed;
+            }
+            else
+            {
+                maxDifference = max(maxDifference, difference);
+            }
+        }
+
+        cout << "   " << left << setw(32) << search.name << right << noshowpoint << fixed << setprecision(0)
+             << setw(6) << found.size() << " events in " << setprecision(3) << setw(7) << searchSeconds << " s, scan: "
+             << setw(6) << scanned.size() << " in " << setw(7) << scanSeconds << " s, missed: " << missed
+             << ", max difference: " << setprecision(4) << (maxDifference * 86400.0) << " s" << endl;
+        ok = ok && missed == 0;
+    }
+
+    EventSearch const perihelia(jpleph, Target::EARTH, Target::SUN);
+    auto const searchStart = chrono::steady_clock::now();
+    vector<EventSearch::Event> const extrema = perihelia.extrema(EventSearch::distance(), dateStart, dateEnd);
+    double const searchSeconds = chrono::duration<double>(chrono::steady_clock::now() - searchStart).count();
+    size_t minima = 0;
+    for (EventSearch::Event const & event : extrema)
+    {
+        minima += event.kind == EventSearch::Kind::MINIMUM ? 1 : 0;
+    }
+    cout << "   " << left << setw(32) << "perihelia/aphelia of the Earth" << right << setw(6) << extrema.size() << " events in "
+         << setprecision(3) << setw(7) << searchSeconds << " s, " << minima << " minima" << endl;
+
+    return ok;
+}
+
+// the test lines in chunks of neighbouring dates: the lines sorted by date touch each record of the ephemeris once,
+// the threads take the chunks in date order. The results are kept with the lines
+void evaluateTestLines(Jpleph const & jpleph, vector<TestLine> & lines, double const jdepoc, unsigned const numThreads)
+{
+    vector<size_t> order(lines.size());
+    iota(order.begin(), order.end(), size_t(0));
+    stable_sort(order.begin(), order.end(), [&lines](size_t const lhs, size_t const rhs) { return lines[lhs].tdb < lines[rhs].tdb; });
+
+    atomic<size_t> nextChunk(0);
+    exception_ptr failure;
+    mutex failureMutex;
+    vector<thread> threads;
+    for (unsigned t = 0; t < numThreads; ++t)
+    {
+        threads.emplace_back([&]()
+        {
+            try
+            {
+                for (size_t first = nextChunk++ * TEST_CHUNK; first < order.size(); first = nextChunk++ * TEST_CHUNK)
+                {
+                    for (size_t k = first; k < min(first + TEST_CHUNK, order.size()); ++k)
+                    {
+                        TestLine & line = lines[order[k]];
+                        Jpleph::Time time;
+                        time.t1 = line.tdb;
+                        Jpleph::Posvel posvel;
+                        jpleph.dpleph(time, Jpleph::Target(line.target), Jpleph::Target(line.center), posvel);
+
+                        line.calcValue = (line.component < 4) ? posvel.pos.at(line.component - 1) : posvel.vel.at(line.component - 4);
+                        line.del = fabs(line.calcValue - line.value);
+                        if (Jpleph::Target::LIBRATIONS == Jpleph::Target(line.target) && line.component == 3)
+                        {
+                            line.del = line.del / (1.0 + 100.0*fabs(line.tdb - jdepoc) / 365.25);
+                        }
+                    }
+                }
+            }
+            catch (...)
+            {
+                lock_guard<mutex> lock(failureMutex);
+                failure = failure != nullptr ? failure : current_exception();
+                nextChunk = order.size(); // the other threads stop after their chunk
+            }
+        });
+    }
+    for (thread & worker : threads)
+    {
+        worker.join();
+    }
+    if (failure != nullptr)
+    {
+        rethrow_exception(failure);
+    }
+}
+
+
+// the output lines, numbered in the order of the control file. The lines are formatted by the threads in contiguous
+// ranges and printed in order
+void printTestLines(vector<TestLine> const & lines, bool const failuresOnly, unsigned const numThreads)
+{
+    vector<string> texts(numThreads);
+    vector<thread> threads;
+    for (unsigned t = 0; t < numThreads; ++t)
+    {
+        threads.emplace_back([&, t]()
+        {
+            char buffer[256];
+            for (size_t i = t * lines.size() / numThreads; i < (t + 1) * lines.size() / numThreads; ++i)
+            {
+                TestLine const & line = lines[i];
+                bool const warning = line.del >= TEST_TOLERANCE;
+                if (failuresOnly && !warning)
+                {
+                    continue;
+                }
+                snprintf(buffer, sizeof(buffer), "%5d%10.1f%5d%5d%5d%21.13f%22.13f%13.5e%s\n", int(i + 1), line.tdb, line.target, line.center,
+                         line.component, line.value, line.calcValue, line.del, warning ? "  *****  WARNING : difference >= 1.D-13  *****'" : "");
+                texts[t] += buffer;
+            }
+        });
+    }
+    for (thread & worker : threads)
+    {
+        worker.join();
+    }
+    for (string const & text : texts)
+    {
+        cout << text;
+    }
+    cout << flush;
+}
+
+
+bool skipToData(ifstream & controlFile)
+{
+    string line = "";
+    while(getline(controlFile, line))
+    {
+        if (line.size() >= 3 && line.substr(0, 3) == HEADER_MARKER)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// the bodies of the ephemeris as SPK segments, as in the SPK files JPL derives from its ephemerides:
+// type 2 segments for the barycenters and the Sun, type 3 segments for Earth and Moon.
+// The series are refitted at the chebysheff nodes of every sub interval, i.e. reproduce the ephemeris to rounding.
+// Positions in km, velocities in km/s, times in seconds past J2000
+bool writeSpk(Jpleph const & jpleph, string const & spkFileName, double const au, double const dateStart, double const dateEnd, double const dateInterval)
+{
+    typedef Jpleph::Target Target;
+    struct Body
+    {
+        int    target;
+        int    center;
+        Target jplTarget;
+        Target jplCenter;
+        int    type;
+    };
+    Body const bodies[] =
+    {
+        { 1, 0, Target::MERCURY, Target::SS_BARYCENTER, 2 },       { 2, 0, Target::VENUS, Target::SS_BARYCENTER, 2 },
+        { 3, 0, Target::EM_BARYCENTER, Target::SS_BARYCENTER, 2 }, { 4, 0, Target::MARS, Target::SS_BARYCENTER, 2 },
+        { 5, 0, Target::JUPITER, Target::SS_BARYCENTER, 2 },       { 6, 0, Target::SATURN, Target::SS_BARYCENTER, 2 },
+        { 7, 0, Target::URANUS, Target::SS_BARYCENTER, 2 },        { 8, 0, Target::NEPTUN, Target::SS_BARYCENTER, 2 },
+        { 9, 0, Target::PLUTO, Target::SS_BARYCENTER, 2 },         { 10, 0, Target::SUN, Target::SS_BARYCENTER, 2 },
+        { 301, 3, Target::MOON, Target::EM_BARYCENTER, 3 },        { 399, 3, Target::EARTH, Target::EM_BARYCENTER, 3 },
+    };
+    int const numBodies     = int(sizeof(bodies) / sizeof(bodies[0]));
+    size_t const RECORD     = 128;   // doubles per DAF record
+    double const PI         = 3.14159265358979323846;
+    double const J2000      = 2451545.0;
+    double const DAY        = 86400.0;
+    long long const records = llround((dateEnd - dateStart) / dateInterval);
+
+    // records 1 to 3: file record, summary record, name record. The segments follow
+    vector<double> file(3 * RECORD, 0.0);
+    vector<double> summaries;
+    for (Body const & body : bodies)
+    {
+        Jpleph::Layout const layout = jpleph.layout(body.jplTarget);
+        int const n              = layout.coefficients;
+        int const components     = body.type == 2 ? 3 : 6;
+        int const recordSize     = 2 + components * n;
+        double const length      = dateInterval / layout.subIntervals; // days
+        size_t const begin       = file.size() + 1;
+
+        vector<double> samples(size_t(components) * n);
+        for (long long record = 0; record < records; ++record)
+        {
+            for (int sub = 0; sub < layout.subIntervals; ++sub)
+            {
+                double const offset = (sub + 0.5) * length; // mid of the sub interval relative to the record
+                for (int k = 0; k < n; ++k)
+                {
+                    Jpleph::Time et;
+                    et.t1 = dateStart + record * dateInterval;
+                    et.t2 = offset + 0.5 * length * cos(PI * (k + 0.5) / n);
+                    Jpleph::Posvel posvel;
+                    jpleph.dpleph(et, body.jplTarget, body.jplCenter, posvel);
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        samples[i * n + k] = posvel.pos[i] * au;
+                        if (components == 6)
+                        {
+                            samples[(3 + i) * n + k] = posvel.vel[i] * au / DAY;
+                        }
+                    }
+                }
+
+                file.push_back(((dateStart + record * dateInterval - J2000) + offset) * DAY);
+                file.push_back(0.5 * length * DAY);
+                for (int i = 0; i < components; ++i)
+                {
+                    for (int j = 0; j < n; ++j)
+                    {
+                        double c = 0.0;
+                        for (int k = 0; k < n; ++k)
+                        {
+                            c += samples[i * n + k] * cos(PI * j * (k + 0.5) / n);
+                        }
+                        file.push_back((j == 0 ? 1.0 : 2.0) * c / n);
+                    }
+                }
+            }
+        }
+        file.push_back((dateStart - J2000) * DAY);
+        file.push_back(length * DAY);
+        file.push_back(recordSize);
+        file.push_back(double(records * layout.subIntervals));
+
+        summaries.push_back((dateStart - J2000) * DAY);
+        summaries.push_back((dateEnd - J2000) * DAY);
+        int32_t const integers[6] = { body.target, body.center, SpkFile::J2000, body.type, int32_t(begin), int32_t(file.size()) };
+        double packed[3];
+        memcpy(packed, integers, sizeof(integers));
+        summaries.insert(summaries.end(), packed, packed + 3);
+    }
+
+    char * const header = reinterpret_cast<char *>(file.data());
+    int32_t const fileRecord[5] = { 2, 6, 0, 0, 0 };
+    memcpy(header, "DAF/SPK ", 8);
+    memcpy(header + 8, fileRecord, 2 * sizeof(int32_t));
+    string const internalName = string("testeph ").append(52, ' ');
+    memcpy(header + 16, internalName.data(), 60);
+    int32_t const pointers[3] = { 2, 2, int32_t(file.size() + 1) }; // FWARD, BWARD, FREE
+    memcpy(header + 76, pointers, sizeof(pointers));
+    memcpy(header + 88, "LTL-IEEE", 8);
+    char const ftp[] = "FTPSTR:\r:\n:\r\n:\r\x00:\x81:\x10\xce:ENDFTP";
+    memcpy(header + 699, ftp, sizeof(ftp) - 1);
+
+    file[RECORD + 2] = numBodies; // NEXT = PREV = 0
+    copy(summaries.begin(), summaries.end(), file.begin() + RECORD + 3);
+    char * const names = reinterpret_cast<char *>(file.data() + 2 * RECORD);
+    memset(names, ' ', RECORD * sizeof(double));
+
+    ofstream spk(spkFileName, ofstream::binary);
+    spk.write(reinterpret_cast<char const *>(file.data()), streamsize(file.size() * sizeof(double)));
+    return spk.good();
+}
+
+
+// write the SPK file, compare its states with the ephemeris at the test cases and random epochs and
+// measure the throughput of both for the same requests
+bool checkSpk(Jpleph const & jpleph, string const & spkFileName, vector<TestCase> const & testCases, double const au,
+              double const dateStart, double const dateEnd, double const dateInterval)
+{
+    cout << endl << "SPK file " << spkFileName << endl;
+    auto const writeStart = chrono::steady_clock::now();
+    if (!writeSpk(jpleph, spkFileName, au, dateStart, dateEnd, dateInterval))
+    {
+        cout << "  *****  WARNING : could not write " << spkFileName << "  *****" << endl;
+        return false;
+    }
+    double const writeSeconds = chrono::duration<double>(chrono::steady_clock::now() - writeStart).count();
+
+    SpkFile const spk(spkFileName, true, true, au);
+    cout << fixed << setprecision(3) << "   " << spk.segments().size() << " segments written in " << writeSeconds << " s" << endl;
+
+    vector<TestCase> requests;
+    for (TestCase const & testCase : testCases)
+    {
+        if (   testCase.target >= int(Jpleph::Target::MERCURY) && testCase.target <= int(Jpleph::Target::EM_BARYCENTER)
+            && testCase.center >= int(Jpleph::Target::MERCURY) && testCase.center <= int(Jpleph::Target::EM_BARYCENTER))
+        {
+            requests.push_back(testCase);
+        }
+    }
+    mt19937 random(4711);
+    uniform_real_distribution<double> epoch(dateStart, dateEnd);
+    uniform_int_distribution<int> body(int(Jpleph::Target::MERCURY), int(Jpleph::Target::EM_BARYCENTER));
+    while (requests.size() < BATCH_EPOCHS)
+    {
+        TestCase const request = { epoch(random), body(random), body(random) };
+        if (request.target != request.center)
+        {
+            requests.push_back(request);
+        }
+    }
+
+    // difference relative to the barycentric states of target and center. Close pairs (e.g. Earth and Earth-Moon
+    // barycenter) are the small difference of large vectors in the ephemeris, a single series in the SPK file
+    auto difference = [](array<double, 3> const & lhs, array<double, 3> const & rhs, array<double, 3> const & target, array<double, 3> const & center)
+    {
+        double diff = 0.0;
+        double norm = 0.0;
+        for (int i = 0; i < 3; ++i)
+        {
+            diff = max(diff, fabs(lhs[i] - rhs[i]));
+            norm = max({ norm, fabs(rhs[i]), fabs(target[i]), fabs(center[i]) });
+        }
+        return norm > 0.0 ? diff / norm : diff;
+    };
+
+    double maxDifference[3] = { 0.0, 0.0, 0.0 };
+    Jpleph::Posvel one;
+    Jpleph::Posvel other;
+    Jpleph::Posvel target;
+    Jpleph::Posvel center;
+    for (TestCase const & request : requests)
+    {
+        Jpleph::Time time;
+        time.t1 = request.tdb;
+        jpleph.dpleph(time, Jpleph::Target(request.target), Jpleph::Target(request.center), one, true);
+        spk.dpleph(time, Jpleph::Target(request.target), Jpleph::Target(request.center), other, true);
+        jpleph.dpleph(time, Jpleph::Target(request.target), Jpleph::Target::SS_BARYCENTER, target, true);
+        jpleph.dpleph(time, Jpleph::Target(request.center), Jpleph::Target::SS_BARYCENTER, center, true);
+        maxDifference[0] = max(maxDifference[0], difference(other.pos, one.pos, target.pos, center.pos));
+        maxDifference[1] = max(maxDifference[1], difference(other.vel, one.vel, target.vel, center.vel));
+        maxDifference[2] = max(maxDifference[2], difference(other.acc, one.acc, target.acc, center.acc));
+    }
+
+    auto measure = [&](auto const & ephemeris)
+    {
+        auto const start = chrono::steady_clock::now();
+        for (TestCase const & request : requests)
+        {
+            Jpleph::Time time;
+            time.t1 = request.tdb;
+            ephemeris.dpleph(time, Jpleph::Target(request.target), Jpleph::Target(request.center), one);
+        }
+        return double(requests.size()) / chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    };
+    double const jplRate = measure(jpleph);
+    double const spkRate = measure(spk);
+
+    cout << noshowpoint << fixed << setprecision(0)
+         << "   ephemeris: " << setw(10) << jplRate << " evaluations/s" << endl
+         << "         SPK: " << setw(10) << spkRate << " evaluations/s" << endl
+         << "   max relative difference: " << scientific << setprecision(3) << "position " << maxDifference[0]
+         << ", velocity " << maxDifference[1] << ", acceleration " << maxDifference[2] << endl;
+    return maxDifference[0] <= SPK_TOLERANCE[0] && maxDifference[1] <= SPK_TOLERANCE[1] && maxDifference[2] <= SPK_TOLERANCE[2];
+}
+
+
+// dense sweeps of body pairs forward to the end and backward to the start of the ephemeris with a streaming cursor
+// against dpleph at the same epochs: the same number of epochs, the states agree to the rounding of the normalized time.
+// The grid is shifted off the sub interval boundaries, at a boundary the rounding may select the other series
+bool checkStream(Jpleph const & jpleph, double const dateStart, double const dateEnd)
+{
+    cout << endl << defaultfloat << "Streaming cursor, step " << STREAM_STEP << " days" << endl;
+
+    struct Sweep
+    {
+        Jpleph::Target target;
+        Jpleph::Target center;
+        double         start;
+        double         step;
+    };
+    double const span = min(STREAM_SPAN, dateEnd - dateStart) - STREAM_OFFSET;
+    Sweep const sweeps[] =
+    {
+        { Jpleph::Target::MOON,    Jpleph::Target::EARTH,         dateEnd - span,   STREAM_STEP },
+        { Jpleph::Target::MARS,    Jpleph::Target::SUN,           dateEnd - span,   STREAM_STEP },
+        { Jpleph::Target::JUPITER, Jpleph::Target::EARTH,         dateStart + span, -STREAM_STEP },
+        { Jpleph::Target::EARTH,   Jpleph::Target::SS_BARYCENTER, dateStart + span, -STREAM_STEP },
+    };
+
+    auto difference = [](array<double, 3> const & lhs, array<double, 3> const & rhs)
+    {
+        double diff = 0.0;
+        double norm = 0.0;
+        for (int i = 0; i < 3; ++i)
+        {
+            diff = max(diff, fabs(lhs[i] - rhs[i]));
+            norm = max(norm, fabs(rhs[i]));
+        }
+        return norm > 0.0 ? diff / norm : diff;
+    };
+
+    bool ok = true;
+    double loopSeconds = 0.0;
+    double streamSeconds = 0.0;
+    size_t evaluations = 0;
+    for (Sweep const & sweep : sweeps)
+    {
+        Jpleph::Time start;
+        start.t1 = sweep.start;
+
+        vector<Jpleph::Posvel> single;
+        auto const loopStart = chrono::steady_clock::now();
+        for (Jpleph::Time time = start; time.t1 + time.t2 >= dateStart && time.t1 + time.t2 <= dateEnd; time.t2 = double(single.size()) * sweep.step)
+        {
+            single.emplace_back();
+            jpleph.dpleph(time, sweep.target, sweep.center, single.back());
+        }
+        loopSeconds += chrono::duration<double>(chrono::steady_clock::now() - loopStart).count();
+
+        vector<Jpleph::Posvel> streamed;
+        streamed.reserve(single.size());
+        auto const streamStart = chrono::steady_clock::now();
+        for (Jpleph::Posvel const & posvel : jpleph.stream(sweep.target, sweep.center, start, sweep.step))
+        {
+            streamed.push_back(posvel);
+        }
+        streamSeconds += chrono::duration<double>(chrono::steady_clock::now() - streamStart).count();
+        evaluations += single.size();
+
+        double maxDifference[2] = { 0.0, 0.0 };
+        for (size_t k = 0; k < min(single.size(), streamed.size()); ++k)
+        {
+            maxDifference[0] = max(maxDifference[0], difference(streamed[k].pos, single[k].pos));
+            maxDifference[1] = max(maxDifference[1], difference(streamed[k].vel, single[k].vel));
+        }
+        bool const agree = streamed.size() == single.size() && maxDifference[0] <= STREAM_TOLERANCE[0] && maxDifference[1] <= STREAM_TOLERANCE[1];
+        cout << "   " << setw(2) << int(sweep.target) << " -> " << setw(2) << int(sweep.center) << ": " << setw(7) << streamed.size()
+             << " of " << setw(7) << single.size() << " epochs, max relative difference " << scientific << setprecision(3)
+             << "position " << maxDifference[0] << ", velocity " << maxDifference[1] << (agree ? "" : "  *****  WARNING  *****")
+             << defaultfloat << endl;
+        ok = ok && agree;
+    }
+
+    cout << noshowpoint << fixed << setprecision(0)
+         << "   dpleph loop: " << setw(10) << (double(evaluations) / loopSeconds) << " evaluations/s" << endl
+         << "        stream: " << setw(10) << (double(evaluations) / streamSeconds) << " evaluations/s" << endl
+         << "      speed-up: " << setprecision(2) << (loopSeconds / streamSeconds) << defaultfloat << endl;
+    return ok;
+}
+
+
+// the single precision screening evaluation against the batch dpleph for every body at random epochs: barycentric
+// bodies relative to the solar system barycenter, the Moon relative to the Earth (see Jpleph::dplephSingle for the
+// bounds). The double precision results of the same object must stay untouched by the single precision copies
+bool checkSingle(string const & jplephFileName, Jpleph::Access const access, size_t const cacheCapacity, double const dateStart, double const dateEnd)
+{
+    char const * const instructionSets[] = { "scalar", "AVX2", "AVX-512" };
+    cout << endl << "Single precision screening at " << BATCH_EPOCHS << " epochs ("
+         << instructionSets[int(ChebysheffBatch::instructionSet())] << ")" << endl;
+
+    Jpleph reference(jplephFileName, true, true, false, access, Jpleph::Prefetch(), cacheCapacity);
+    Jpleph jpleph(jplephFileName, true, true, false, access, Jpleph::Prefetch(), cacheCapacity);
+
+    mt19937 random(4711);
+    uniform_real_distribution<double> epoch(dateStart, dateEnd);
+    vector<Jpleph::Time> epochs(BATCH_EPOCHS);
+    for (Jpleph::Time & et : epochs)
+    {
+        et.t1 = epoch(random);
+    }
+    sort(epochs.begin(), epochs.end(), [](Jpleph::Time const & lhs, Jpleph::Time const & rhs) { return lhs.t1 < rhs.t1; }); // dense as for a scan
+
+    vector<vector<double>> doubleResult(6, vector<double>(BATCH_EPOCHS));
+    vector<vector<double>> singleResult(6, vector<double>(BATCH_EPOCHS));
+    vector<vector<double>> referenceResult(6, vector<double>(BATCH_EPOCHS));
+    auto arrays = [](vector<vector<double>> & result)
+    {
+        return Jpleph::PosvelArrays{ result[0].data(), result[1].data(), result[2].data(), result[3].data(), result[4].data(), result[5].data() };
+    };
+
+    bool ok = true;
+    try
+    {
+        jpleph.dplephSingle(epochs.data(), epochs.size(), Jpleph::Target::MARS, Jpleph::Target::SUN, arrays(singleResult));
+        cout << "   no error without convertSingle()  *****  WARNING  *****" << endl;
+        ok = false;
+    }
+    catch (runtime_error const &)
+    {
+    }
+    jpleph.convertSingle();
+
+    struct Body
+    {
+        Jpleph::Target target;
+        Jpleph::Target center;
+        char const *   name;
+    };
+    Body const bodies[] =
+    {
+        { Jpleph::Target::MERCURY,       Jpleph::Target::SS_BARYCENTER, "Mercury" },
+        { Jpleph::Target::VENUS,         Jpleph::Target::SS_BARYCENTER, "Venus" },
+        { Jpleph::Target::EARTH,         Jpleph::Target::SS_BARYCENTER, "Earth" },
+        { Jpleph::Target::MARS,          Jpleph::Target::SS_BARYCENTER, "Mars" },
+        { Jpleph::Target::JUPITER,       Jpleph::Target::SS_BARYCENTER, "Jupiter" },
+        { Jpleph::Target::SATURN,        Jpleph::Target::SS_BARYCENTER, "Saturn" },
+        { Jpleph::Target::URANUS,        Jpleph::Target::SS_BARYCENTER, "Uranus" },
+        { Jpleph::Target::NEPTUN,        Jpleph::Target::SS_BARYCENTER, "Neptune" },
+        { Jpleph::Target::PLUTO,         Jpleph::Target::SS_BARYCENTER, "Pluto" },
+        { Jpleph::Target::MOON,          Jpleph::Target::SS_BARYCENTER, "Moon" },
+        { Jpleph::Target::SUN,           Jpleph::Target::SS_BARYCENTER, "Sun" },
+        { Jpleph::Target::EM_BARYCENTER, Jpleph::Target::SS_BARYCENTER, "EMB" },
+        { Jpleph::Target::MOON,          Jpleph::Target::EARTH,         "Moon - Earth" },
+    };
+
+    // largest error of a vector relative to its length
+    auto relative = [](vector<vector<double>> const & result, vector<vector<double>> const & exact, int const first, size_t const k)
+    {
+        double diff = 0.0;
+        double norm = 0.0;
+        for (int i = first; i < first + 3; ++i)
+        {
+            diff += (result[i][k] - exact[i][k]) * (result[i][k] - exact[i][k]);
+            norm += exact[i][k] * exact[i][k];
+        }
+        return norm > 0.0 ? sqrt(diff / norm) : sqrt(diff);
+    };
+
+    size_t const repetitions = (MIN_BENCHMARK_EVALUATIONS + BATCH_EPOCHS - 1) / BATCH_EPOCHS;
+    double const positionBound = Jpleph::SINGLE_POSITION_ERROR;
+    double const velocityBound = Jpleph::SINGLE_VELOCITY_ERROR;
+    cout << "             body   position error   velocity error     double epochs/s     single epochs/s   speedup" << endl;
+    for (Body const & body : bodies)
+    {
+        reference.dpleph(epochs.data(), epochs.size(), body.target, body.center, arrays(referenceResult));
+
+        auto const doubleStart = chrono::steady_clock::now();
+        for (size_t r = 0; r < repetitions; ++r)
+        {
+            jpleph.dpleph(epochs.data(), epochs.size(), body.target, body.center, arrays(doubleResult));
+        }
+        double const doubleSeconds = chrono::duration<double>(chrono::steady_clock::now() - doubleStart).count();
+
+        auto const singleStart = chrono::steady_clock::now();
+        for (size_t r = 0; r < repetitions; ++r)
+        {
+            jpleph.dplephSingle(epochs.data(), epochs.size(), body.target, body.center, arrays(singleResult));
+        }
+        double const singleSeconds = chrono::duration<double>(chrono::steady_clock::now() - singleStart).count();
+
+        bool identical = true;
+        double maxError[2] = { 0.0, 0.0 };
+        for (size_t k = 0; k < BATCH_EPOCHS; ++k)
+        {
+            for (int i = 0; i < 6; ++i)
+            {
+                identical = identical && doubleResult[i][k] == referenceResult[i][k];
+            }
+            maxError[0] = max(maxError[0], relative(singleResult, referenceResult, 0, k));
+            maxError[1] = max(maxError[1], relative(singleResult, referenceResult, 3, k));
+        }
+        bool const within = maxError[0] <= positionBound && maxError[1] <= velocityBound;
+
+        double const evaluations = double(repetitions * BATCH_EPOCHS);
+        cout << setw(17) << body.name << scientific << setprecision(3) << setw(17) << maxError[0] << setw(17) << maxError[1]
+             << noshowpoint << fixed << setprecision(0) << setw(20) << (evaluations / doubleSeconds) << setw(20) << (evaluations / singleSeconds)
+             << showpoint << setprecision(2) << setw(10) << (doubleSeconds / singleSeconds)
+             << (identical ? "" : "  *****  WARNING: double results changed  *****")
+             << (within ? "" : "  *****  WARNING: above the bound  *****") << endl;
+        ok = ok && identical && within;
+    }
+
+    cout << "   bounds: position " << scientific << setprecision(1) << positionBound << ", velocity " << velocityBound
+         << fixed << ", " << jpleph.statistics().singleBytes << " bytes of single precision coefficients in the cache" << endl;
+    return ok;
+}
+
+
+// a set of files against the files themselves: at random epochs over all files (gaps included) the set has to give
+// the result of the first file in the list covering the epoch, bit for bit, for every DE number and for all files.
+// No file may be opened before it is needed. Then the overhead of the dispatch is measured
+bool checkSet(string const & fileList, Jpleph::Access const access)
+{
+    vector<string> fileNames;
+    istringstream names(fileList);
+    string name;
+    while (getline(names, name, ','))
+    {
+        fileNames.push_back(name);
+    }
+
+    EphemerisSet const set(fileNames, true, true, false, access);
+    vector<EphemerisSet::File> const files = set.files();
+    bool ok = true;
+
+    cout << endl << "Set of " << files.size() << " ephemeris files, cache budget " << set.budget() << " records" << endl;
+    for (EphemerisSet::File const & file : files)
+    {
+        cout << "   DE" << file.number << fixed << setprecision(1) << setw(12) << file.dateStart << " to " << setw(10) << file.dateEnd
+             << "  " << file.name << (file.open ? "  *****  WARNING: opened  *****" : "") << endl;
+        ok = ok && !file.open;
+    }
+    vector<long> numbers = set.numbers();
+    numbers.insert(numbers.begin(), 0);
+    for (long const number : numbers)
+    {
+        cout << "   index " << (number == 0 ? string("all") : "DE" + to_string(number)) << ":";
+        for (EphemerisSet::Interval const & interval : set.intervals(number))
+        {
+            cout << " [" << interval.dateStart << ", " << interval.dateEnd << "] " << interval.file;
+        }
+        cout << endl;
+    }
+
+    vector<unique_ptr<Jpleph>> references;
+    for (string const & fileName : fileNames)
+    {
+        references.push_back(make_unique<Jpleph>(fileName, true, true, false, access));
+    }
+
+    double first = files.front().dateStart;
+    double last  = files.front().dateEnd;
+    for (EphemerisSet::File const & file : files)
+    {
+        first = min(first, file.dateStart);
+        last  = max(last, file.dateEnd);
+    }
+
+    Jpleph::Target const targets[] = { Jpleph::Target::MERCURY, Jpleph::Target::VENUS, Jpleph::Target::EARTH, Jpleph::Target::MARS,
+                                       Jpleph::Target::JUPITER, Jpleph::Target::SATURN, Jpleph::Target::MOON, Jpleph::Target::SUN };
+    mt19937 random(4711);
+    uniform_real_distribution<double> epoch(first - 0.05 * (last - first), last + 0.05 * (last - first));
+    uniform_int_distribution<size_t> pick(0, sizeof(targets) / sizeof(targets[0]) - 1);
+
+    struct Query
+    {
+        Jpleph::Time   et;
+        Jpleph::Target target;
+        Jpleph::Target center;
+    };
+    vector<Query> queries(PLANNED_QUERIES);
+    for (Query & query : queries)
+    {
+        query.et.t1  = epoch(random);
+        query.target = targets[pick(random)];
+        query.center = targets[pick(random)];
+    }
+
+    size_t mismatches = 0;
+    size_t uncovered  = 0;
+    for (long const number : numbers)
+    {
+        for (Query const & query : queries)
+        {
+            int expected = -1;
+            for (size_t file = 0; file < files.size() && expected < 0; ++file)
+            {
+                if (   (number == 0 || files[file].number == number)
+                    && files[file].dateStart <= query.et.t1 && query.et.t1 <= files[file].dateEnd)
+                {
+                    expected = int(file);
+                }
+            }
+
+            Jpleph::Posvel one;
+            try
+            {
+                set.dpleph(query.et, query.target, query.center, one, false, number);
+            }
+            catch (out_of_range const &)
+            {
+                uncovered++;
+                mismatches += expected < 0 ? 0 : 1;
+                continue;
+            }
+            if (expected < 0)
+            {
+                mismatches++;
+                continue;
+            }
+
+            Jpleph::Posvel other;
+            references[expected]->dpleph(query.et, query.target, query.center, other);
+            mismatches += one.pos == other.pos && one.vel == other.vel ? 0 : 1;
+        }
+    }
+
+    // the queries in the range of the set only
+    vector<Query> covered;
+    for (Query const & query : queries)
+    {
+        if (query.et.t1 >= first && query.et.t1 <= last)
+        {
+            try
+            {
+                set.ephemeris(query.et);
+                covered.push_back(query);
+            }
+            catch (out_of_range const &)
+            {
+            }
+        }
+    }
+    Jpleph const single(fileNames.front(), true, true, false, access, Jpleph::Prefetch(), set.budget()); // the cache of the set for itself
+    vector<Query> inFirst;
+    for (Query const & query : covered)
+    {
+        if (query.et.t1 >= files.front().dateStart && query.et.t1 <= files.front().dateEnd)
+        {
+            inFirst.push_back(query);
+        }
+    }
+
+    auto measure = [](vector<Query> const & queries, auto const & evaluate)
+    {
+        Jpleph::Posvel posvel;
+        size_t const repetitions = max(size_t(1), MIN_BENCHMARK_EVALUATIONS / max(queries.size(), size_t(1)));
+        auto const start = chrono::steady_clock::now();
+        for (size_t r = 0; r < repetitions; ++r)
+        {
+            for (Query const & query : queries)
+            {
+                evaluate(query, posvel);
+            }
+        }
+        return double(repetitions * queries.size()) / chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    };
+    double const setRate    = measure(inFirst, [&set](Query const & query, Jpleph::Posvel & posvel) { set.dpleph(query.et, query.target, query.center, posvel); });
+    double const singleRate = measure(inFirst, [&single](Query const & query, Jpleph::Posvel & posvel) { single.dpleph(query.et, query.target, query.center, posvel); });
+
+    Jpleph::Statistics const statistics = set.statistics();
+    size_t opened = 0;
+    for (EphemerisSet::File const & file : set.files())
+    {
+        opened += file.open ? 1 : 0;
+    }
+
+    cout << "   " << queries.size() * numbers.size() << " queries, " << uncovered << " not covered, " << mismatches << " different from the file"
+         << (mismatches == 0 ? "" : "  *****  WARNING  *****") << endl
+         << "   files opened: " << opened << " of " << files.size() << ", records cached: " << set.cachedRecords() << " (budget " << set.budget() << ")"
+         << ", cache hits " << statistics.hits << " of " << statistics.requests << endl
+         << noshowpoint << fixed << setprecision(0)
+         << "   set   : " << setw(10) << setRate << " evaluations/s" << endl
+         << "   single: " << setw(10) << singleRate << " evaluations/s (the first file alone)" << endl;
+    return ok && mismatches == 0;
+}
+
+
+// partial against full reading of the records for narrow and wide workloads: random epochs with single dpleph calls,
+// then the same epochs as batch. The results have to be bitwise identical, the partial reading should read a fraction
+// of the bytes. Finally the single precision copies, which need complete records, are set up on a partially read cache
+bool checkPartial(string const & jplephFileName, size_t const cacheCapacity, double const dateStart, double const dateEnd)
+{
+    cout << endl << "Partial reading of records at " << BATCH_EPOCHS << " random epochs" << endl;
+
+    mt19937 random(4711);
+    uniform_real_distribution<double> epoch(dateStart, dateEnd);
+    vector<Jpleph::Time> epochs(BATCH_EPOCHS);
+    for (Jpleph::Time & et : epochs)
+    {
+        et.t1 = epoch(random);
+    }
+
+    struct Workload
+    {
+        char const *                                 name;
+        vector<pair<Jpleph::Target, Jpleph::Target>> pairs;
+    };
+    Workload const workloads[] =
+    {
+        { "Moon - Earth", { { Jpleph::Target::MOON, Jpleph::Target::EARTH } } },
+        { "Mars - Sun",   { { Jpleph::Target::MARS, Jpleph::Target::SUN } } },
+        { "Earth, Moon, Sun", { { Jpleph::Target::EARTH, Jpleph::Target::SS_BARYCENTER }, { Jpleph::Target::MOON, Jpleph::Target::SS_BARYCENTER },
+                                { Jpleph::Target::SUN, Jpleph::Target::SS_BARYCENTER } } },
+        { "all planets",  { { Jpleph::Target::MERCURY, Jpleph::Target::SUN }, { Jpleph::Target::VENUS, Jpleph::Target::SUN },
+                            { Jpleph::Target::EARTH, Jpleph::Target::SUN }, { Jpleph::Target::MARS, Jpleph::Target::SUN },
+                            { Jpleph::Target::JUPITER, Jpleph::Target::SUN }, { Jpleph::Target::SATURN, Jpleph::Target::SUN },
+                            { Jpleph::Target::URANUS, Jpleph::Target::SUN }, { Jpleph::Target::NEPTUN, Jpleph::Target::SUN },
+                            { Jpleph::Target::PLUTO, Jpleph::Target::SUN } } },
+    };
+
+    vector<vector<double>> fullResult(6, vector<double>(BATCH_EPOCHS));
+    vector<vector<double>> partialResult(6, vector<double>(BATCH_EPOCHS));
+    auto arrays = [](vector<vector<double>> & result)
+    {
+        return Jpleph::PosvelArrays{ result[0].data(), result[1].data(), result[2].data(), result[3].data(), result[4].data(), result[5].data() };
+    };
+
+    // single calls, the pairs of the workload in turn
+    auto run = [&epochs](Jpleph const & jpleph, Workload const & workload, vector<Jpleph::Posvel> & result)
+    {
+        auto const start = chrono::steady_clock::now();
+        for (size_t k = 0; k < epochs.size(); ++k)
+        {
+            auto const & pair = workload.pairs[k % workload.pairs.size()];
+            jpleph.dpleph(epochs[k], pair.first, pair.second, result[k]);
+        }
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    };
+
+    bool ok = true;
+    cout << "                 workload   full bytes read   partial bytes read   ratio   entries loaded   full s   partial s   mismatches" << endl;
+    for (Workload const & workload : workloads)
+    {
+        Jpleph const full(jplephFileName, true, true, false, Jpleph::Access::STREAM, Jpleph::Prefetch(), cacheCapacity);
+        Jpleph const partial(jplephFileName, true, true, false, Jpleph::Access::PARTIAL, Jpleph::Prefetch(), cacheCapacity);
+
+        vector<Jpleph::Posvel> fullSingle(BATCH_EPOCHS);
+        vector<Jpleph::Posvel> partialSingle(BATCH_EPOCHS);
+        double const fullSeconds    = run(full, workload, fullSingle);
+        double const partialSeconds = run(partial, workload, partialSingle);
+        size_t mismatches = 0;
+        for (size_t k = 0; k < BATCH_EPOCHS; ++k)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                mismatches += fullSingle[k].pos[i] != partialSingle[k].pos[i] || fullSingle[k].vel[i] != partialSingle[k].vel[i] ? 1 : 0;
+            }
+        }
+        for (auto const & pair : workload.pairs)
+        {
+            full.dpleph(epochs.data(), epochs.size(), pair.first, pair.second, arrays(fullResult));
+            partial.dpleph(epochs.data(), epochs.size(), pair.first, pair.second, arrays(partialResult));
+            for (int i = 0; i < 6; ++i)
+            {
+                mismatches += memcmp(fullResult[i].data(), partialResult[i].data(), BATCH_EPOCHS * sizeof(double)) != 0 ? 1 : 0;
+            }
+        }
+
+        size_t const fullBytes = full.statistics().bytesRead;
+        Jpleph::Statistics const statistics = partial.statistics();
+        cout << setw(25) << workload.name << setw(18) << fullBytes << setw(21) << statistics.bytesRead
+             << fixed << setprecision(2) << setw(8) << (double(fullBytes) / double(max(statistics.bytesRead, size_t(1))))
+             << setw(17) << statistics.entryLoads << setprecision(3) << setw(9) << fullSeconds << setw(12) << partialSeconds
+             << setw(13) << mismatches << (mismatches == 0 ? "" : "  *****  WARNING  *****") << defaultfloat << endl;
+        ok = ok && mismatches == 0;
+    }
+
+    // the single precision copies complete the records read so far
+    Jpleph full(jplephFileName, true, true, false, Jpleph::Access::STREAM, Jpleph::Prefetch(), cacheCapacity);
+    Jpleph partial(jplephFileName, true, true, false, Jpleph::Access::PARTIAL, Jpleph::Prefetch(), cacheCapacity);
+    partial.dpleph(epochs.data(), epochs.size(), Jpleph::Target::MOON, Jpleph::Target::EARTH, arrays(partialResult));
+    full.convertSingle();
+    partial.convertSingle();
+    size_t mismatches = 0;
+    for (Jpleph::Target const target : { Jpleph::Target::MARS, Jpleph::Target::MOON })
+    {
+        full.dplephSingle(epochs.data(), epochs.size(), target, Jpleph::Target::SUN, arrays(fullResult));
+        partial.dplephSingle(epochs.data(), epochs.size(), target, Jpleph::Target::SUN, arrays(partialResult));
+        for (int i = 0; i < 6; ++i)
+        {
+            mismatches += memcmp(fullResult[i].data(), partialResult[i].data(), BATCH_EPOCHS * sizeof(double)) != 0 ? 1 : 0;
+        }
+    }
+    cout << "   single precision copies of partially read records: " << (mismatches == 0 ? "identical" : "differ  *****  WARNING  *****") << endl;
+    return ok && mismatches == 0;
+}
+
+
+// a compressed container against the ephemeris file it was written from: all bodies at random epochs have to be bitwise
+// identical. Reports the compression ratio, the cost of decompressing a record and the throughput of both files
+bool checkCompressed(string const & jplephFileName, string const & compressedFileName, size_t const cacheCapacity, double const dateStart, double const dateEnd)
+{
+    cout << endl << "Compressed container " << compressedFileName << " at " << BATCH_EPOCHS << " random epochs" << endl;
+
+    auto fileSize = [](string const & fileName)
+    {
+        ifstream file(fileName, ifstream::binary | ifstream::ate);
+        return double(file.tellg());
+    };
+    double const plainBytes      = fileSize(jplephFileName);
+    double const compressedBytes = fileSize(compressedFileName);
+
+    Jpleph const plain(jplephFileName, true, true, false, Jpleph::Access::STREAM, Jpleph::Prefetch(), cacheCapacity);
+    Jpleph const compressed(compressedFileName, true, true, false, Jpleph::Access::STREAM, Jpleph::Prefetch(), cacheCapacity);
+
+    Jpleph::Target const targets[] =
+    {
+        Jpleph::Target::MERCURY, Jpleph::Target::VENUS, Jpleph::Target::EARTH, Jpleph::Target::MARS, Jpleph::Target::JUPITER,
+        Jpleph::Target::SATURN, Jpleph::Target::URANUS, Jpleph::Target::NEPTUN, Jpleph::Target::PLUTO, Jpleph::Target::MOON,
+        Jpleph::Target::SUN, Jpleph::Target::EM_BARYCENTER
+    };
+    mt19937 random(4711);
+    uniform_real_distribution<double> epoch(dateStart, dateEnd);
+    vector<Jpleph::Query> queries(BATCH_EPOCHS);
+    for (size_t k = 0; k < queries.size(); ++k)
+    {
+        queries[k].et.t1  = epoch(random);
+        queries[k].target = targets[k % (sizeof(targets) / sizeof(targets[0]))];
+        queries[k].center = Jpleph::Target::SS_BARYCENTER;
+    }
+
+    auto run = [&queries](Jpleph const & jpleph, vector<Jpleph::Posvel> & result)
+    {
+        auto const start = chrono::steady_clock::now();
+        for (size_t k = 0; k < queries.size(); ++k)
+        {
+            jpleph.dpleph(queries[k].et, queries[k].target, queries[k].center, result[k]);
+        }
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    };
+    vector<Jpleph::Posvel> plainResult(queries.size());
+    vector<Jpleph::Posvel> compressedResult(queries.size());
+    double const plainSeconds      = run(plain, plainResult);
+    double const compressedSeconds = run(compressed, compressedResult);
+
+    size_t mismatches = 0;
+    for (size_t k = 0; k < queries.size(); ++k)
+    {
+        mismatches += plainResult[k].pos != compressedResult[k].pos || plainResult[k].vel != compressedResult[k].vel ? 1 : 0;
+    }
+
+    Jpleph::Statistics const statistics = compressed.statistics();
+    double const perRecord = statistics.decoded > 0 ? statistics.decodeSeconds / double(statistics.decoded) : 0.0;
+    cout << noshowpoint << fixed << setprecision(2)
+         << "   file size      : " << setw(12) << setprecision(0) << plainBytes << " bytes, compressed " << compressedBytes << " bytes, ratio "
+         << setprecision(2) << (plainBytes / compressedBytes) << endl
+         << "   bytes read     : " << setw(12) << setprecision(0) << double(plain.statistics().bytesRead) << " bytes, compressed "
+         << double(statistics.bytesRead) << " bytes" << endl
+         << "   decompression  : " << setw(12) << statistics.decoded << " records, " << setprecision(1) << (perRecord * 1.0e6) << " us per record" << endl
+         << "   throughput     : " << setw(12) << setprecision(0) << (double(queries.size()) / plainSeconds) << " evaluations/s, compressed "
+         << (double(queries.size()) / compressedSeconds) << " evaluations/s" << endl
+         << "   mismatches     : " << setw(12) << mismatches << (mismatches == 0 ? "" : "  *****  WARNING  *****") << defaultfloat << endl;
+    return mismatches == 0;
+}